@@ -0,0 +1,187 @@
+#include "AssetLoader.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "Trace.h"
+
+// fill data with a unit box, one quad per side so every face has its own normal
+static void make_box_mesh(MeshData& data)
+{
+	const float normals[6][3] = {
+		{ 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f },
+		{ 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+		{ 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }
+	};
+
+	data = MeshData();
+	data.vertexStorage.resize(24 * sizeof(VertexNormal));
+	data.indexStorage.resize(36 * sizeof(GLuint));
+	VertexNormal* vertices = reinterpret_cast<VertexNormal*>(data.vertexStorage.data());
+	GLuint* indices = reinterpret_cast<GLuint*>(data.indexStorage.data());
+
+	for (int side = 0; side < 6; side++)
+	{
+		// the axis of the normal and the two axes across the face
+		int axis = side / 2;
+		int u = (axis + 1) % 3;
+		int v = (axis + 2) % 3;
+		float sign = normals[side][axis];
+
+		for (int corner = 0; corner < 4; corner++)
+		{
+			VertexNormal& vertex = vertices[side * 4 + corner];
+
+			vertex.position[axis] = 0.5f * sign;
+			vertex.position[u] = (corner == 1 || corner == 2) ? 0.5f : -0.5f;
+			vertex.position[v] = (corner >= 2) ? 0.5f : -0.5f;
+
+			vertex.normal[0] = normals[side][0];
+			vertex.normal[1] = normals[side][1];
+			vertex.normal[2] = normals[side][2];
+		}
+
+		// counter clockwise seen from outside, the corner order flips with the side
+		const GLuint base = side * 4;
+		const GLuint front[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+		const GLuint back[6] = { base, base + 2, base + 1, base, base + 3, base + 2 };
+		const GLuint* corners = sign > 0.0f ? front : back;
+		std::copy(corners, corners + 6, indices + side * 6);
+	}
+
+	data.vertexCount = 24;
+	data.indexCount = 36;
+	data.vertices = data.vertexStorage.data();
+	data.indices = data.indexStorage.data();
+	compute_mesh_bounds(data);
+}
+
+AssetLoader::AssetLoader(JobSystem& jobs) : mJobs(jobs)
+{}
+
+AssetLoader::~AssetLoader()
+{
+	mJobs.wait(mCounter);
+}
+
+void AssetLoader::loadModel(SimpleModel& model, const char* filename, bool texture, bool packed)
+{
+	std::unique_ptr<Request> request(new Request());
+	request->model = &model;
+	request->filename = filename;
+	request->format = get_vertex_format(texture, packed);
+	request->requestTime = Clock::now();
+
+	if (mRequests.size() == static_cast<std::size_t>(mCompletedCount))
+		mFirstRequestTime = request->requestTime;
+
+	Request* job = request.get();
+	mRequests.push_back(std::move(request));
+
+	// imports run on the workers only, a thread waiting on a parallelFor would otherwise pick up a whole load
+	mJobs.runInBackground([this, job]() { read(*job); }, &mCounter);
+}
+
+void AssetLoader::update(std::size_t byteBudget)
+{
+	TRACE_SCOPE("upload models");
+
+	// without workers the loads only run when someone waits for them
+	if (mJobs.getThreadCount() == 1)
+		mJobs.wait(mCounter);
+
+	while (byteBudget > 0)
+	{
+		if (mUploading == nullptr)
+		{
+			std::lock_guard<std::mutex> lock(mReadMutex);
+			if (mRead.empty())
+				return;
+
+			mUploading = mRead.front();
+			mRead.pop_front();
+		}
+
+		Request& request = *mUploading;
+
+		// same message and exit as a failed load before the first frame
+		if (request.failed)
+		{
+			std::cerr << "Failed to open: " << request.filename << std::endl;
+			exit(EXIT_FAILURE);
+		}
+
+		request.uploadFrames++;
+		if (!request.model->uploadMesh(request.data, byteBudget))
+			return;
+
+		mUploading = nullptr;
+		complete(request);
+	}
+}
+
+SimpleModel& AssetLoader::getPlaceholder()
+{
+	if (!mPlaceholder.isLoaded())
+	{
+		MeshData data;
+		make_box_mesh(data);
+
+		std::size_t byteBudget = std::numeric_limits<std::size_t>::max();
+		mPlaceholder.uploadMesh(data, byteBudget);
+	}
+
+	return mPlaceholder;
+}
+
+int AssetLoader::getRequestedCount() const
+{
+	return static_cast<int>(mRequests.size());
+}
+
+int AssetLoader::getCompletedCount() const
+{
+	return mCompletedCount;
+}
+
+bool AssetLoader::isDone() const
+{
+	return getCompletedCount() == getRequestedCount();
+}
+
+double AssetLoader::getLoadTime() const
+{
+	if (mRequests.empty())
+		return 0.0;
+
+	Clock::time_point end = isDone() ? mLastCompletedTime : Clock::now();
+	return std::chrono::duration<double, std::milli>(end - mFirstRequestTime).count();
+}
+
+// job: read the mesh from its cache or import it and queue it for upload
+void AssetLoader::read(Request& request)
+{
+	TRACE_SCOPE("read model");
+	Clock::time_point start = Clock::now();
+
+	request.failed = !load_mesh_data(request.filename.c_str(), request.format, request.data);
+	request.readTime = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	std::lock_guard<std::mutex> lock(mReadMutex);
+	mRead.push_back(&request);
+}
+
+// report a finished model and free its CPU copy
+void AssetLoader::complete(Request& request)
+{
+	mCompletedCount++;
+	mLastCompletedTime = Clock::now();
+
+	double totalTime = std::chrono::duration<double, std::milli>(mLastCompletedTime - request.requestTime).count();
+
+	std::cout << "Loaded " << request.filename << (request.data.fromCache ? " from mesh cache" : " through Assimp")
+		<< " in " << request.readTime << " ms, uploaded over " << request.uploadFrames << " frames, ready after "
+		<< totalTime << " ms" << std::endl;
+
+	request.data = MeshData();
+}
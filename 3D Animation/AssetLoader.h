@@ -0,0 +1,83 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "JobSystem.h"
+#include "MeshCache.h"
+#include "SimpleModel.h"
+
+/*****************************************************************
+ * loads models in the background
+ * file reads and Assimp imports run as jobs on the job system, the
+ * GL thread only copies finished meshes to the GPU, a few bytes
+ * per frame so loading never stalls a frame for long
+ * until a model is complete it can be drawn as the placeholder
+ *****************************************************************/
+class AssetLoader
+{
+public:
+	explicit AssetLoader(JobSystem& jobs);
+	// waits for loads still running on the job system
+	~AssetLoader();
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	// start loading a model file into model, which must stay at the same address until it is loaded
+	// packed stores the vertices in the packed formats of VertexPacking.h
+	void loadModel(SimpleModel& model, const char* filename, bool texture = false, bool packed = false);
+
+	// GL thread: copy finished meshes to the GPU, at most byteBudget bytes per call
+	// a mesh larger than the budget is spread over several calls
+	void update(std::size_t byteBudget);
+
+	// GL thread: stand-in for models that are not loaded yet, created on first use
+	SimpleModel& getPlaceholder();
+
+	int getRequestedCount() const;
+	int getCompletedCount() const;
+	bool isDone() const;
+	// milliseconds from the first request until the last model was ready, or until now while loading
+	double getLoadTime() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Request
+	{
+		SimpleModel* model;
+		std::string filename;
+		VertexFormat format;
+		MeshData data;
+		bool failed = false;
+		Clock::time_point requestTime;
+		double readTime = 0.0;		// milliseconds spent on the worker
+		int uploadFrames = 0;		// calls to update the upload was spread over
+	};
+
+	JobSystem& mJobs;
+	JobCounter mCounter;				// loads running on the job system
+
+	std::vector<std::unique_ptr<Request>> mRequests;
+	std::mutex mReadMutex;				// guards mRead
+	std::deque<Request*> mRead;			// requests whose mesh is in memory, in the order they finished
+	Request* mUploading = nullptr;		// request partway through its upload
+
+	int mCompletedCount = 0;
+	Clock::time_point mFirstRequestTime;
+	Clock::time_point mLastCompletedTime;
+
+	SimpleModel mPlaceholder;
+
+	void read(Request& request);
+	void complete(Request& request);
+};
+
+#endif
@@ -0,0 +1,825 @@
+#include "Benchmarks.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "utilities.h"
+#include "ResourceRegistry.h"
+#include "OrbitSystem.h"
+#include "SceneGraph.h"
+#include "JobSystem.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "VertexPacking.h"
+#include "Culling.h"
+#include "RenderQueue.h"
+#include "KernelChecks.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+// keeps the optimiser from removing benchmark results
+static volatile float gBenchmarkSink = 0.0f;
+
+// time a function and return the average microseconds per frame
+template <typename Function>
+static double time_per_frame(int frames, Function function)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < frames; i++)
+		function(i);
+
+	auto end = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double, std::micro>(end - start).count() / frames;
+}
+
+// compare per-frame resource lookups through string-keyed maps against registry handles
+void benchmark_resource_lookups(int frames)
+{
+	const char* materialNames[] = { "Pearl", "Jade", "Brass" };
+	const char* modelNames[] = { "Sphere", "Cube", "Suzanne", "Torus" };
+
+	// map based storage as used by the original render loop
+	std::map<std::string, Material> materialMap;
+	std::map<std::string, int> modelMap;
+	std::map<std::string, int> selectedMaterialMap;
+	std::map<std::string, int> selectedModelMap;
+
+	// registry based storage with handles resolved up front
+	ResourceRegistry<Material> materialRegistry;
+	ResourceRegistry<int> modelRegistry;
+	ResourceRegistry<Material>::Handle materialHandles[3];
+	ResourceRegistry<int>::Handle modelHandles[4];
+	int selectedMaterials[2] = { 1, 0 };
+	int selectedModels[2] = { 2, 1 };
+
+	for (int i = 0; i < 3; i++)
+	{
+		materialMap[materialNames[i]].shininess = static_cast<float>(i);
+		materialHandles[i] = materialRegistry.add(materialNames[i]);
+		materialRegistry.get(materialHandles[i]).shininess = static_cast<float>(i);
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		modelMap[modelNames[i]] = i;
+		modelHandles[i] = modelRegistry.add(modelNames[i]);
+		modelRegistry.get(modelHandles[i]) = i;
+	}
+
+	selectedMaterialMap["Obj1"] = selectedMaterials[0];
+	selectedMaterialMap["Obj2"] = selectedMaterials[1];
+	selectedModelMap["Obj1"] = selectedModels[0];
+	selectedModelMap["Obj2"] = selectedModels[1];
+
+	// one frame of the original lookups: select names through if/else chains then look up by name
+	double mapTime = time_per_frame(frames, [&](int frame) {
+		const char* objects[] = { "Obj1", "Obj2" };
+		float sum = modelMap["Sphere"] + materialMap["Brass"].shininess;
+
+		for (int i = 0; i < 2; i++)
+		{
+			std::string selectedMaterial;
+			std::string selectedModel;
+
+			int material = selectedMaterialMap[objects[i]];
+			if (material == 0) selectedMaterial = "Pearl";
+			else if (material == 1) selectedMaterial = "Jade";
+			else if (material == 2) selectedMaterial = "Brass";
+
+			int model = selectedModelMap[objects[i]];
+			if (model == 0) selectedModel = "Sphere";
+			else if (model == 1) selectedModel = "Cube";
+			else if (model == 2) selectedModel = "Suzanne";
+			else if (model == 3) selectedModel = "Torus";
+
+			// Ka, Kd, Ks and shininess were each looked up separately
+			sum += materialMap[selectedMaterial].Ka.x + materialMap[selectedMaterial].Kd.x
+				+ materialMap[selectedMaterial].Ks.x + materialMap[selectedMaterial].shininess;
+			sum += modelMap[selectedModel];
+		}
+
+		gBenchmarkSink = gBenchmarkSink + sum + frame;
+	});
+
+	// the same frame through handles
+	double handleTime = time_per_frame(frames, [&](int frame) {
+		float sum = modelRegistry.get(modelHandles[0]) + materialRegistry.get(materialHandles[2]).shininess;
+
+		for (int i = 0; i < 2; i++)
+		{
+			const Material& material = materialRegistry.get(materialHandles[selectedMaterials[i]]);
+
+			sum += material.Ka.x + material.Kd.x + material.Ks.x + material.shininess;
+			sum += modelRegistry.get(modelHandles[selectedModels[i]]);
+		}
+
+		gBenchmarkSink = gBenchmarkSink + sum + frame;
+	});
+
+	std::cout << "Resource lookups over " << frames << " frames" << std::endl;
+	std::cout << "  map based:    " << mapTime << " us/frame" << std::endl;
+	std::cout << "  handle based: " << handleTime << " us/frame" << std::endl;
+	std::cout << "  speed up:     " << mapTime / handleTime << "x" << std::endl;
+}
+
+// compare bodies updated per millisecond by per-object glm matrices and by each orbit kernel
+void benchmark_orbit_system(int bodies, int frames)
+{
+	const float frameTime = 1.0f / 60.0f;
+	const SimdLevel levels[] = { SimdLevel::SCALAR, SimdLevel::SSE, SimdLevel::AVX2 };
+	const int levelCount = static_cast<int>(OrbitSystem::getBestSimdLevel()) + 1;
+
+	check_orbit_kernels();
+
+	OrbitSystem system;
+	add_random_bodies(&system, 1, bodies);
+	std::vector<InstanceData> instances(bodies);
+	glm::mat4 parent = glm::rotate(0.3f, glm::vec3(0.0f, 1.0f, 0.0f));
+
+	// per object state updated with a chain of glm matrices, as the scene objects used to be
+	struct Body { float orbitAngle, orbitSpeed, rotationAngle, rotationSpeed, orbitDistance, scale; };
+	std::vector<Body> objects(bodies);
+	for (int i = 0; i < bodies; i++)
+		objects[i] = { system.getOrbitAngle(i), 1.0f, system.getRotationAngle(i), 2.0f, 5.0f, 0.1f };
+
+	double glmTime = time_per_frame(frames, [&](int) {
+		for (int i = 0; i < bodies; i++)
+		{
+			Body& body = objects[i];
+			body.orbitAngle += body.orbitSpeed * frameTime;
+			body.rotationAngle += body.rotationSpeed * frameTime;
+
+			glm::mat4 model = parent
+				* glm::rotate(body.orbitAngle, glm::vec3(0.0f, 1.0f, 0.0f))
+				* glm::translate(glm::vec3(body.orbitDistance, 0.0f, 0.0f))
+				* glm::rotate(body.rotationAngle - body.orbitAngle, glm::vec3(0.0f, 1.0f, 0.0f))
+				* glm::scale(glm::vec3(body.scale));
+			glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+
+			instances[i].modelMatrix = model;
+			instances[i].normalMatrix[0] = glm::vec4(normalMatrix[0], 0.0f);
+			instances[i].normalMatrix[1] = glm::vec4(normalMatrix[1], 0.0f);
+			instances[i].normalMatrix[2] = glm::vec4(normalMatrix[2], 0.0f);
+		}
+		gBenchmarkSink = gBenchmarkSink + instances[bodies - 1].modelMatrix[3][0];
+	});
+
+	std::cout << "Orbit update of " << bodies << " bodies over " << frames << " frames" << std::endl;
+	std::cout << "  glm per object: " << bodies / (glmTime / 1000.0) << " bodies/ms" << std::endl;
+
+	for (int i = 0; i < levelCount; i++)
+	{
+		double kernelTime = time_per_frame(frames, [&](int) {
+			system.advance(frameTime, levels[i]);
+			system.computeTransforms(parent, instances.data(), 0.0f, levels[i]);
+			gBenchmarkSink = gBenchmarkSink + instances[bodies - 1].modelMatrix[3][0];
+		});
+
+		std::cout << "  " << OrbitSystem::getSimdLevelName(levels[i]) << " kernel: "
+			<< bodies / (kernelTime / 1000.0) << " bodies/ms, " << glmTime / kernelTime << "x" << std::endl;
+	}
+}
+
+// orbit and scene graph updates through the job system with 1 to N threads
+void benchmark_job_scaling(int bodies, int nodes, int frames)
+{
+	const float frameTime = 1.0f / 60.0f;
+	const int bodyGrainSize = 4096;
+	const int nodeGrainSize = 1024;
+	const int maxThreads = JobSystem::getDefaultWorkerCount() + 1;
+
+	OrbitSystem system;
+	add_random_bodies(&system, 1, bodies);
+	std::vector<InstanceData> instances(bodies);
+	glm::mat4 parent = glm::rotate(0.3f, glm::vec3(0.0f, 1.0f, 0.0f));
+
+	// a bushy random hierarchy, moving the root dirties every node
+	SceneGraph graph;
+	std::mt19937 random(3);
+	for (int i = 0; i < nodes; i++)
+	{
+		int parentNode = i == 0 ? SceneGraph::NO_PARENT : static_cast<int>(random() % i);
+		graph.addNode(parentNode, glm::translate(glm::vec3(0.1f, 0.0f, 0.0f)) * glm::rotate(0.01f * i, glm::vec3(0.0f, 1.0f, 0.0f)));
+	}
+
+	std::cout << "Job system scaling over " << frames << " frames, " << bodies << " orbit bodies, "
+		<< nodes << " scene graph nodes" << std::endl;
+
+	double oneThreadOrbitTime = 0.0;
+	double oneThreadGraphTime = 0.0;
+
+	for (int threads = 1; threads <= maxThreads; threads++)
+	{
+		JobSystem jobs(threads - 1);
+
+		double orbitTime = time_per_frame(frames, [&](int) {
+			jobs.parallelFor(bodies, bodyGrainSize, [&](int begin, int end) {
+				system.advance(frameTime, begin, end - begin);
+				system.computeTransforms(parent, instances.data(), begin, end - begin);
+			});
+			gBenchmarkSink = gBenchmarkSink + instances[bodies - 1].modelMatrix[3][0];
+		});
+
+		double graphTime = time_per_frame(frames, [&](int frame) {
+			graph.setLocalTransform(0, glm::rotate(0.01f * frame, glm::vec3(0.0f, 1.0f, 0.0f)));
+			graph.updateTransforms(jobs, nodeGrainSize);
+			gBenchmarkSink = gBenchmarkSink + graph.getWorldTransform(nodes - 1)[3][0];
+		});
+
+		if (threads == 1)
+		{
+			oneThreadOrbitTime = orbitTime;
+			oneThreadGraphTime = graphTime;
+		}
+
+		std::cout << "  " << threads << " threads: "
+			<< bodies / (orbitTime / 1000.0) << " bodies/ms (" << oneThreadOrbitTime / orbitTime << "x), "
+			<< nodes / (graphTime / 1000.0) << " nodes/ms (" << oneThreadGraphTime / graphTime << "x)" << std::endl;
+	}
+}
+
+// check the culling kernels against scalar, then compare objects culled per millisecond
+void benchmark_frustum_culling(int bodies, int frames)
+{
+	const SimdLevel levels[] = { SimdLevel::SCALAR, SimdLevel::SSE, SimdLevel::AVX2 };
+	const int levelCount = static_cast<int>(OrbitSystem::getBestSimdLevel()) + 1;
+	const int grainSize = 4096;
+	const int maxThreads = JobSystem::getDefaultWorkerCount() + 1;
+
+	check_cull_kernels();
+
+	// orbit bodies seen by the default camera of the scene, about half of them are in view
+	OrbitSystem system;
+	add_random_bodies(&system, 1, bodies);
+	std::vector<InstanceData> instances(bodies);
+	system.computeTransforms(glm::mat4(1.0f), instances.data());
+
+	glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 1.25f, 0.1f, 100.0f)
+		* glm::lookAt(glm::vec3(1.0f, 5.0f, 15.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = extract_frustum(viewProjection);
+
+	// a unit box like the placeholder model, off centre so the sphere centre moves with the matrix
+	MeshBounds bounds;
+	bounds.boxMin = glm::vec3(-0.5f, -0.25f, -0.5f);
+	bounds.boxMax = glm::vec3(0.5f, 0.75f, 0.5f);
+	bounds.sphereCenter = glm::vec3(0.0f, 0.25f, 0.0f);
+	bounds.sphereRadius = glm::length(glm::vec3(0.5f));
+
+	std::vector<unsigned char> visible[3];
+	for (int i = 0; i < levelCount; i++)
+		visible[i].resize(bodies);
+	int visibleCount = cull_spheres(frustum, bounds, &instances[0].modelMatrix, sizeof(InstanceData), bodies, visible[0].data());
+
+	std::cout << "Frustum culling of " << bodies << " bodies over " << frames << " frames, "
+		<< visibleCount << " visible" << std::endl;
+
+	double glmTime = time_per_frame(frames, [&](int) {
+		int count = 0;
+		for (int i = 0; i < bodies; i++)
+			count += is_sphere_visible(frustum, transform_bounding_sphere(bounds, instances[i].modelMatrix)) ? 1 : 0;
+		gBenchmarkSink = gBenchmarkSink + static_cast<float>(count);
+	});
+
+	std::cout << "  glm per object: " << bodies / (glmTime / 1000.0) << " bodies/ms" << std::endl;
+
+	for (int i = 0; i < levelCount; i++)
+	{
+		double kernelTime = time_per_frame(frames, [&](int) {
+			int count = cull_spheres(frustum, bounds, &instances[0].modelMatrix, sizeof(InstanceData), bodies,
+				visible[i].data(), levels[i]);
+			gBenchmarkSink = gBenchmarkSink + static_cast<float>(count);
+		});
+
+		std::cout << "  " << OrbitSystem::getSimdLevelName(levels[i]) << " kernel: "
+			<< bodies / (kernelTime / 1000.0) << " bodies/ms, " << glmTime / kernelTime << "x" << std::endl;
+	}
+
+	double oneThreadTime = 0.0;
+	for (int threads = 1; threads <= maxThreads; threads++)
+	{
+		JobSystem jobs(threads - 1);
+
+		double cullTime = time_per_frame(frames, [&](int) {
+			jobs.parallelFor(bodies, grainSize, [&](int begin, int end) {
+				cull_spheres(frustum, bounds, &instances[begin].modelMatrix, sizeof(InstanceData), end - begin,
+					visible[0].data() + begin);
+			});
+			gBenchmarkSink = gBenchmarkSink + visible[0][bodies - 1];
+		});
+
+		if (threads == 1)
+			oneThreadTime = cullTime;
+
+		std::cout << "  " << threads << " threads: " << bodies / (cullTime / 1000.0) << " bodies/ms ("
+			<< oneThreadTime / cullTime << "x)" << std::endl;
+	}
+}
+
+void benchmark_render_queue(int items, int frames)
+{
+	const int grainSize = 4096;
+	const int maxThreads = JobSystem::getDefaultWorkerCount() + 1;
+
+	// a few shaders and passes, many materials and meshes and random depths, like a large scene
+	std::mt19937 random(7);
+	std::vector<std::uint64_t> keys(items);
+	for (int i = 0; i < items; i++)
+	{
+		keys[i] = make_sort_key(static_cast<RenderPass>(random() % 2), random() % 4, random() % 256, random() % 4096,
+			quantize_depth(std::uniform_real_distribution<float>(0.1f, 100.0f)(random), 0.1f, 100.0f));
+	}
+
+	RenderQueue queue;
+	auto fill = [&]() {
+		queue.reset(items);
+		RenderItem* item = queue.reserve(items);
+		for (int i = 0; i < items; i++)
+			item[i] = { keys[i], static_cast<std::uint32_t>(i) };
+	};
+
+	// equal keys keep their submission order in both sorts, so the results must match item for item
+	std::vector<RenderItem> reference(items);
+	for (int i = 0; i < items; i++)
+		reference[i] = { keys[i], static_cast<std::uint32_t>(i) };
+	std::stable_sort(reference.begin(), reference.end(),
+		[](const RenderItem& a, const RenderItem& b) { return a.key < b.key; });
+
+	fill();
+	queue.sort();
+	bool match = true;
+	for (int i = 0; i < items && match; i++)
+		match = queue.getItems()[i].key == reference[i].key && queue.getItems()[i].value == reference[i].value;
+
+	std::cout << "Render queue of " << items << " items over " << frames << " frames, radix sort "
+		<< (match ? "matches" : "differs from") << " std::stable_sort in " << queue.getSortPasses() << " passes" << std::endl;
+
+	std::vector<RenderItem> sorted(items);
+	double stdTime = time_per_frame(frames, [&](int) {
+		for (int i = 0; i < items; i++)
+			sorted[i] = { keys[i], static_cast<std::uint32_t>(i) };
+		std::stable_sort(sorted.begin(), sorted.end(),
+			[](const RenderItem& a, const RenderItem& b) { return a.key < b.key; });
+		gBenchmarkSink = gBenchmarkSink + static_cast<float>(sorted[0].value);
+	});
+
+	double radixTime = time_per_frame(frames, [&](int) {
+		fill();
+		queue.sort();
+		gBenchmarkSink = gBenchmarkSink + static_cast<float>(queue.getItems()[0].value);
+	});
+
+	std::cout << "  std::stable_sort: " << items / (stdTime / 1000.0) << " items/ms" << std::endl;
+	std::cout << "  radix sort: " << items / (radixTime / 1000.0) << " items/ms, " << stdTime / radixTime << "x" << std::endl;
+
+	// each job reserves its chunk once, the way systems submit many items
+	double oneThreadTime = 0.0;
+	for (int threads = 1; threads <= maxThreads; threads++)
+	{
+		JobSystem jobs(threads - 1);
+
+		double submitTime = time_per_frame(frames, [&](int) {
+			queue.reset(items);
+			jobs.parallelFor(items, grainSize, [&](int begin, int end) {
+				RenderItem* item = queue.reserve(end - begin);
+				for (int i = begin; i < end; i++)
+					*item++ = { keys[i], static_cast<std::uint32_t>(i) };
+			});
+			gBenchmarkSink = gBenchmarkSink + static_cast<float>(queue.getCount());
+		});
+
+		if (threads == 1)
+			oneThreadTime = submitTime;
+
+		std::cout << "  " << threads << " threads submitting: " << items / (submitTime / 1000.0) << " items/ms ("
+			<< oneThreadTime / submitTime << "x)" << std::endl;
+	}
+}
+
+// CPU side load time of the scene's models through Assimp and through the binary mesh cache
+void benchmark_mesh_loading(int repetitions)
+{
+	const char* filenames[] = { "./models/sphere.obj", "./models/cube.obj", "./models/suzanne.obj", "./models/torus.obj" };
+
+	std::cout << "Mesh loading over " << repetitions << " repetitions" << std::endl;
+
+	for (const char* filename : filenames)
+	{
+		MeshData data;
+
+		// first load makes sure the cache is current so the second loop only reads it
+		if (!load_mesh_data(filename, VertexFormat::NORMAL, data))
+		{
+			std::cout << "  " << filename << ": failed to load" << std::endl;
+			continue;
+		}
+
+		double importTime = time_per_frame(repetitions, [&](int) {
+			load_mesh_data(filename, VertexFormat::NORMAL, data, false);
+			gBenchmarkSink = gBenchmarkSink + static_cast<float>(data.indexCount);
+		});
+
+		// touch every byte like glBufferData would, otherwise only the header page is read
+		double cacheTime = time_per_frame(repetitions, [&](int) {
+			load_mesh_data(filename, VertexFormat::NORMAL, data, true);
+
+			const unsigned char* vertices = static_cast<const unsigned char*>(data.vertices);
+			unsigned int sum = 0;
+			for (std::size_t i = 0; i < data.vertexCount * data.getVertexSize(); i += 64)
+				sum += vertices[i];
+			for (int i = 0; i < data.indexCount; i += 16)
+				sum += data.getIndex(i);
+			gBenchmarkSink = gBenchmarkSink + static_cast<float>(sum);
+		});
+
+		std::cout << "  " << filename << ": " << data.vertexCount << " vertices, " << data.indexCount << " indices, "
+			<< importTime / 1000.0 << " ms imported, " << cacheTime / 1000.0 << " ms cached ("
+			<< importTime / cacheTime << "x)" << std::endl;
+	}
+}
+
+// paths of the files in a directory whose names end in extension, sorted by name
+static std::vector<std::string> list_files(const std::string& directory, const std::string& extension)
+{
+	std::vector<std::string> names;
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA found;
+	HANDLE search = FindFirstFileA((directory + "/*" + extension).c_str(), &found);
+	if (search != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+				names.push_back(found.cFileName);
+		} while (FindNextFileA(search, &found));
+
+		FindClose(search);
+	}
+#else
+	if (DIR* search = opendir(directory.c_str()))
+	{
+		while (dirent* entry = readdir(search))
+		{
+			std::string name = entry->d_name;
+			if (name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0)
+				names.push_back(name);
+		}
+
+		closedir(search);
+	}
+#endif
+
+	std::sort(names.begin(), names.end());
+	for (std::string& name : names)
+		name = directory + "/" + name;
+
+	return names;
+}
+
+// undo narrow_indices so the mesh can go through optimize_mesh and the analysis again
+static void widen_indices(MeshData& data)
+{
+	if (data.indexType == GL_UNSIGNED_INT)
+		return;
+
+	std::vector<unsigned char> wide(data.indexCount * sizeof(GLuint));
+	GLuint* indices = reinterpret_cast<GLuint*>(wide.data());
+
+	for (int i = 0; i < data.indexCount; i++)
+		indices[i] = data.getIndex(i);
+
+	data.indexStorage.swap(wide);
+	data.indexType = GL_UNSIGNED_INT;
+	data.indices = data.indexStorage.data();
+}
+
+// vertex cache, vertex fetch and overdraw figures of every model in a directory as imported and after optimize_mesh
+void report_mesh_optimization(const char* directory)
+{
+	std::vector<std::string> filenames = list_files(directory, ".obj");
+
+	std::cout << "Mesh optimization for " << filenames.size() << " models in " << directory
+		<< " (ACMR and ATVR with a 16 vertex FIFO cache)" << std::endl;
+
+	for (const std::string& filename : filenames)
+	{
+		MeshData data;
+		if (!import_mesh(filename.c_str(), VertexFormat::NORMAL, data, false) || data.indexCount == 0)
+		{
+			std::cout << "  " << filename << ": failed to load" << std::endl;
+			continue;
+		}
+
+		widen_indices(data);
+		const GLuint* indices = static_cast<const GLuint*>(data.indices);
+		const std::size_t vertexSize = data.getVertexSize();
+		VertexCacheStats cacheBefore = analyze_vertex_cache(indices, data.indexCount, data.vertexCount);
+		OverdrawStats overdrawBefore = analyze_overdraw(indices, data.indexCount, data.vertices, data.vertexCount, vertexSize);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		optimize_mesh(data);
+		double optimizeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		VertexCacheStats cacheAfter = analyze_vertex_cache(indices, data.indexCount, data.vertexCount);
+		OverdrawStats overdrawAfter = analyze_overdraw(indices, data.indexCount, data.vertices, data.vertexCount, vertexSize);
+
+		std::cout << "  " << filename << ": " << data.indexCount / 3 << " triangles, optimized in " << optimizeTime << " ms" << std::endl
+			<< "    ACMR " << cacheBefore.acmr << " -> " << cacheAfter.acmr
+			<< ", ATVR " << cacheBefore.atvr << " -> " << cacheAfter.atvr
+			<< ", overdraw " << overdrawBefore.overdraw << " -> " << overdrawAfter.overdraw << std::endl;
+	}
+}
+
+// size of every model in a directory in float and packed vertex formats, and the error the packing adds
+void report_vertex_packing(const char* directory)
+{
+	std::vector<std::string> filenames = list_files(directory, ".obj");
+
+	std::cout << "Vertex packing for " << filenames.size() << " models in " << directory << std::endl;
+
+	for (const std::string& filename : filenames)
+	{
+		// packing runs after the optimizer, so both meshes keep their vertices in the same order
+		MeshData original;
+		MeshData packed;
+		if (!import_mesh(filename.c_str(), VertexFormat::NORM_TEX, original) ||
+			!import_mesh(filename.c_str(), VertexFormat::PACKED_TEX, packed) ||
+			original.vertexCount != packed.vertexCount || original.vertexCount == 0)
+		{
+			std::cout << "  " << filename << ": failed to load" << std::endl;
+			continue;
+		}
+
+		const float diagonal = glm::length(packed.positionScale);
+		float maxPositionError = 0.0f;
+		double sumPositionError = 0.0;
+		float maxNormalError = 0.0f;
+		double sumNormalError = 0.0;
+		float maxTexCoordError = 0.0f;
+
+		for (int i = 0; i < original.vertexCount; i++)
+		{
+			VertexNormTex expected = unpack_vertex(original, i);
+			VertexNormTex actual = unpack_vertex(packed, i);
+
+			glm::vec3 expectedPosition(expected.position[0], expected.position[1], expected.position[2]);
+			glm::vec3 actualPosition(actual.position[0], actual.position[1], actual.position[2]);
+			float positionError = glm::length(actualPosition - expectedPosition);
+
+			// angle between the normals in degrees, through atan2 because acos of a float is too coarse near 1
+			glm::vec3 expectedNormal(expected.normal[0], expected.normal[1], expected.normal[2]);
+			glm::vec3 actualNormal(actual.normal[0], actual.normal[1], actual.normal[2]);
+			float normalError = glm::degrees(std::atan2(glm::length(glm::cross(expectedNormal, actualNormal)),
+				glm::dot(expectedNormal, actualNormal)));
+
+			float texCoordError = std::max(std::abs(actual.texCoord[0] - expected.texCoord[0]),
+				std::abs(actual.texCoord[1] - expected.texCoord[1]));
+
+			maxPositionError = std::max(maxPositionError, positionError);
+			sumPositionError += positionError;
+			maxNormalError = std::max(maxNormalError, normalError);
+			sumNormalError += normalError;
+			maxTexCoordError = std::max(maxTexCoordError, texCoordError);
+		}
+
+		// the float mesh as it was stored before, with 32 bit indices
+		const std::size_t originalBytes = original.vertexCount * original.getVertexSize() + original.indexCount * sizeof(GLuint);
+		const std::size_t packedBytes = packed.vertexCount * packed.getVertexSize() + packed.indexCount * packed.getIndexSize();
+
+		std::cout << "  " << filename << ": " << originalBytes << " -> " << packedBytes << " bytes ("
+			<< static_cast<double>(packedBytes) / originalBytes * 100.0 << "%), "
+			<< (packed.indexType == GL_UNSIGNED_SHORT ? "16" : "32") << " bit indices" << std::endl
+			<< "    position error max " << maxPositionError << " mean " << sumPositionError / original.vertexCount
+			<< " (max " << (diagonal > 0.0f ? maxPositionError / diagonal * 100.0f : 0.0f) << "% of the bounds diagonal)"
+			<< ", normal error max " << maxNormalError << " mean " << sumNormalError / original.vertexCount << " degrees"
+			<< ", uv error max " << maxTexCoordError << std::endl;
+	}
+}
+
+// levels of detail built for every model in a directory, with their triangle counts and errors
+void report_lod_chains(const char* directory)
+{
+	std::vector<std::string> filenames = list_files(directory, ".obj");
+
+	std::cout << "Level of detail chains for " << filenames.size() << " models in " << directory << std::endl;
+
+	for (const std::string& filename : filenames)
+	{
+		MeshData data;
+		if (!import_mesh(filename.c_str(), VertexFormat::NORMAL, data, false) || data.indexCount == 0)
+		{
+			std::cout << "  " << filename << ": failed to load" << std::endl;
+			continue;
+		}
+
+		// errors relative to the size of the model, the simplifier needs the float mesh with 32 bit indices
+		widen_indices(data);
+
+		const VertexNormal* vertices = static_cast<const VertexNormal*>(data.vertices);
+		glm::vec3 minimum(vertices[0].position[0], vertices[0].position[1], vertices[0].position[2]);
+		glm::vec3 maximum = minimum;
+		for (int i = 1; i < data.vertexCount; i++)
+		{
+			glm::vec3 position(vertices[i].position[0], vertices[i].position[1], vertices[i].position[2]);
+			minimum = glm::min(minimum, position);
+			maximum = glm::max(maximum, position);
+		}
+		const float diagonal = glm::length(maximum - minimum);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		build_lod_chain(data);
+		double buildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		std::cout << "  " << filename << ": " << data.lods.size() << " levels built in " << buildTime << " ms" << std::endl;
+
+		for (std::size_t i = 0; i < data.lods.size(); i++)
+		{
+			const MeshLod& lod = data.lods[i];
+			std::cout << "    " << i << ": " << lod.indexCount / 3 << " triangles, error " << lod.error
+				<< " (" << (diagonal > 0.0f ? lod.error / diagonal * 100.0f : 0.0f) << "% of the bounds diagonal)" << std::endl;
+		}
+	}
+}
+
+// milliseconds each run of a micro-benchmark should last and runs whose median is reported, long runs average out
+// the clock's resolution and many runs keep one preempted run from moving the median
+static const double MICRO_BENCHMARK_RUN_TIME = 10.0;
+static const int MICRO_BENCHMARK_RUNS = 9;
+
+// time a function called with 0, 1, 2... in runs of calibrated length and return nanoseconds per call
+template <typename Function>
+static MicroBenchmarkResult run_micro_benchmark(const char* name, Function function)
+{
+	// double the calls per run until a run is long enough, which also warms the caches and branch predictors
+	int iterations = 1;
+	while (iterations < (1 << 28) && time_per_frame(iterations, function) * iterations < MICRO_BENCHMARK_RUN_TIME * 1000.0)
+		iterations *= 2;
+
+	std::vector<double> times(MICRO_BENCHMARK_RUNS);
+	for (double& time : times)
+		time = time_per_frame(iterations, function) * 1000.0;
+	std::sort(times.begin(), times.end());
+
+	MicroBenchmarkResult result;
+	result.name = name;
+	result.medianTime = times[times.size() / 2];
+	result.minTime = times.front();
+	result.spread = result.medianTime > 0.0 ? (times.back() - times.front()) / result.medianTime : 0.0;
+	result.iterations = iterations;
+
+	std::cout << "  " << name << ": " << result.medianTime << " ns (min " << result.minTime << " ns, spread "
+		<< result.spread * 100.0 << "%)" << std::endl;
+
+	return result;
+}
+
+std::vector<MicroBenchmarkResult> run_micro_benchmarks(ShaderProgram& shader)
+{
+	std::vector<MicroBenchmarkResult> results;
+
+	std::cout << "Micro-benchmarks, median of " << MICRO_BENCHMARK_RUNS << " runs per call" << std::endl;
+
+	// uniform setters find the uniform and compare the value with its shadow, the value never changes so
+	// nothing reaches the driver and only the lookups are timed
+	shader.use();
+	std::string runtimeName = "uPositionScale";
+	const glm::vec3 positionScale(1.0f);
+	Uniform<glm::vec3> positionScaleUniform = shader.getUniform<glm::vec3>(UNIFORM_NAME("uPositionScale"));
+
+	results.push_back(run_micro_benchmark("setUniform hashed at run time", [&](int) {
+		shader.setUniform(runtimeName.c_str(), positionScale);
+	}));
+	results.push_back(run_micro_benchmark("setUniform UNIFORM_NAME", [&](int) {
+		shader.setUniform(UNIFORM_NAME("uPositionScale"), positionScale);
+	}));
+	results.push_back(run_micro_benchmark("Uniform<T>::set", [&](int) {
+		positionScaleUniform.set(positionScale);
+	}));
+
+	// lights reach the shaders through FrameBlock, so its layout is what a frame builds per light
+	Light light;
+	light.pos = glm::vec3(0.0f, 5.0f, 0.0f);
+	light.dir = glm::vec3(0.3f, -0.7f, -0.5f);
+	light.La = glm::vec3(0.8f);
+	light.Ld = glm::vec3(0.8f);
+	light.Ls = glm::vec3(0.8f);
+	light.att = glm::vec3(1.0f, 0.0f, 0.0f);
+	light.innerAngle = 20.0f;
+	light.outerAngle = 30.0f;
+	light.type = SPOT_LIGHT;
+
+	results.push_back(run_micro_benchmark("Light::getBlock", [&](int i) {
+		light.Ld.x = 0.8f + (i & 1) * 0.1f;
+		LightBlock block = light.getBlock();
+		gBenchmarkSink = gBenchmarkSink + block.Ld.x;
+	}));
+
+	return results;
+}
+
+bool write_micro_benchmarks(const std::string& path, const std::vector<MicroBenchmarkResult>& results)
+{
+	std::ofstream file(path);
+	if (!file)
+	{
+		std::cerr << "Could not write the benchmarks to " << path << std::endl;
+		return false;
+	}
+
+	file.precision(10);
+
+	// benchmark names are literals without quotes or backslashes, so they need no escaping
+	file << "{\n  \"unit\": \"ns\",\n  \"benchmarks\": [";
+	for (std::size_t i = 0; i < results.size(); i++)
+	{
+		const MicroBenchmarkResult& result = results[i];
+		file << (i == 0 ? "\n" : ",\n") << "    { \"name\": \"" << result.name << "\", \"median\": " << result.medianTime
+			<< ", \"min\": " << result.minTime << ", \"spread\": " << result.spread
+			<< ", \"iterations\": " << result.iterations << " }";
+	}
+	file << "\n  ]\n}\n";
+
+	return static_cast<bool>(file);
+}
+
+// median times by name from a file written by write_micro_benchmarks, which has one benchmark per line
+static bool read_micro_benchmarks(const std::string& path, std::map<std::string, double>& medianTimes)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	const std::string nameKey = "\"name\": \"";
+	const std::string medianKey = "\"median\": ";
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		std::size_t name = line.find(nameKey);
+		std::size_t median = line.find(medianKey);
+		if (name == std::string::npos || median == std::string::npos)
+			continue;
+
+		name += nameKey.size();
+		std::size_t nameEnd = line.find('"', name);
+		if (nameEnd == std::string::npos)
+			continue;
+
+		medianTimes[line.substr(name, nameEnd - name)] = std::strtod(line.c_str() + median + medianKey.size(), nullptr);
+	}
+
+	return true;
+}
+
+bool compare_micro_benchmarks(const std::string& baselinePath, const std::vector<MicroBenchmarkResult>& results,
+	double maxSlowdown)
+{
+	std::map<std::string, double> baseline;
+	if (!read_micro_benchmarks(baselinePath, baseline))
+	{
+		std::cerr << "Could not read the benchmark baseline " << baselinePath << std::endl;
+		return false;
+	}
+
+	std::cout << "Micro-benchmarks against " << baselinePath << ", limit +" << maxSlowdown * 100.0 << "%" << std::endl;
+
+	bool passed = true;
+	for (const MicroBenchmarkResult& result : results)
+	{
+		auto entry = baseline.find(result.name);
+		if (entry == baseline.end() || entry->second <= 0.0)
+		{
+			std::cout << "  " << result.name << ": not in the baseline" << std::endl;
+			continue;
+		}
+
+		double change = result.medianTime / entry->second - 1.0;
+		bool slower = change > maxSlowdown;
+		passed = passed && !slower;
+
+		std::cout << "  " << result.name << ": " << entry->second << " -> " << result.medianTime << " ns ("
+			<< (change >= 0.0 ? "+" : "") << change * 100.0 << "%)" << (slower ? " REGRESSION" : "") << std::endl;
+	}
+
+	return passed;
+}
@@ -0,0 +1,58 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <string>
+#include <vector>
+
+class ShaderProgram;
+
+/*****************************************************************
+ * in-app benchmarks, results are written to the console
+ *****************************************************************/
+
+// compare per-frame resource lookups through string-keyed maps against registry handles
+void benchmark_resource_lookups(int frames = 100000);
+
+// compare bodies updated per millisecond by per-object glm matrices and by each orbit kernel
+void benchmark_orbit_system(int bodies = 200000, int frames = 50);
+// orbit and scene graph updates through the job system with 1 to N threads
+void benchmark_job_scaling(int bodies = 200000, int nodes = 100000, int frames = 20);
+
+// check that the SIMD culling kernels agree with the scalar one, then compare objects culled per millisecond by
+// per object glm tests, by each kernel and by the best kernel on 1 to N threads
+void benchmark_frustum_culling(int bodies = 200000, int frames = 50);
+// check the render queue's radix sort against std::stable_sort, then compare items sorted per millisecond by both
+// and items submitted per millisecond from 1 to N threads
+void benchmark_render_queue(int items = 200000, int frames = 50);
+
+// CPU side load time of the scene's models through Assimp and through the binary mesh cache
+void benchmark_mesh_loading(int repetitions = 20);
+// vertex cache, vertex fetch and overdraw figures of every model in a directory as imported and after optimize_mesh
+void report_mesh_optimization(const char* directory = "./models");
+// bytes per model in the float and packed vertex formats and the position, normal and uv error of packing
+void report_vertex_packing(const char* directory = "./models");
+// levels of detail built for every model in a directory, with their triangle counts and simplification errors
+void report_lod_chains(const char* directory = "./models");
+
+// nanoseconds per call of one micro-benchmark over repeated runs
+struct MicroBenchmarkResult
+{
+	std::string name;
+	double medianTime = 0.0;	// median of the runs, the figure to compare
+	double minTime = 0.0;
+	double spread = 0.0;		// (slowest - fastest) / median of the runs, how far to trust the median
+	int iterations = 0;			// calls per run, calibrated so each run takes a few milliseconds
+};
+
+// time the hot paths of a frame that need a GL context: uniform lookups and light blocks, shader must be the
+// lit animation shader and is left in use, the CPU hot paths are timed by the cpu_benchmarks target of the
+// CMake build
+std::vector<MicroBenchmarkResult> run_micro_benchmarks(ShaderProgram& shader);
+// write results as JSON, one benchmark per line, returns false if the file can't be written
+bool write_micro_benchmarks(const std::string& path, const std::vector<MicroBenchmarkResult>& results);
+// compare median times with a file written by write_micro_benchmarks, returns false if one is more than
+// maxSlowdown slower (0.1 is 10%) or the baseline can't be read
+bool compare_micro_benchmarks(const std::string& baselinePath, const std::vector<MicroBenchmarkResult>& results,
+	double maxSlowdown = 0.1);
+
+#endif
@@ -0,0 +1,359 @@
+#include "Culling.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CULLING_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define TARGET_SSE
+#define TARGET_AVX2
+#else
+// kernels are compiled for their instruction set and only called after a CPU check
+#define TARGET_SSE __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define CULLING_X86 0
+#endif
+
+// the scalar fallback must not be fused into FMA instructions or it stops matching the SIMD kernels
+#if defined(_MSC_VER)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+// objects processed per block by every kernel
+static const int BLOCK_SIZE = 8;
+static const int NUM_PLANES = 6;
+
+// model matrices of a block without their last row, one lane per object, column major
+struct MatrixBlock
+{
+	alignas(32) float m[12][BLOCK_SIZE];	// element k of column c at m[c * 3 + k]
+};
+
+// frustum planes and the model space sphere shared by all objects
+struct CullParameters
+{
+	float planes[NUM_PLANES][4];
+	float center[3];
+	float radius;
+};
+
+// copy the matrices of a block into lanes, they are spread through arrays of larger structs
+static void gather_block(const unsigned char* matrices, std::size_t stride, int lanes, MatrixBlock& block)
+{
+	for (int lane = 0; lane < lanes; lane++)
+	{
+		const float* m = reinterpret_cast<const float*>(matrices + lane * stride);
+
+		for (int column = 0; column < 4; column++)
+		{
+			for (int k = 0; k < 3; k++)
+				block.m[column * 3 + k][lane] = m[column * 4 + k];
+		}
+	}
+}
+
+/*************** scalar kernels ***************/
+
+static inline bool test_sphere_scalar(const CullParameters& cull, const MatrixBlock& block, int lane)
+{
+	const float x = cull.center[0], y = cull.center[1], z = cull.center[2];
+	float center[3];
+
+	for (int k = 0; k < 3; k++)
+		center[k] = ((block.m[k][lane] * x + block.m[3 + k][lane] * y) + block.m[6 + k][lane] * z) + block.m[9 + k][lane];
+
+	// squared lengths of the first three columns, the largest scales the radius
+	float scale[3];
+	for (int column = 0; column < 3; column++)
+	{
+		const float a = block.m[column * 3][lane], b = block.m[column * 3 + 1][lane], c = block.m[column * 3 + 2][lane];
+		scale[column] = (a * a + b * b) + c * c;
+	}
+
+	float largest = scale[0] > scale[1] ? scale[0] : scale[1];
+	largest = largest > scale[2] ? largest : scale[2];
+	const float radius = cull.radius * std::sqrt(largest);
+
+	bool visible = true;
+	for (int plane = 0; plane < NUM_PLANES; plane++)
+	{
+		const float* p = cull.planes[plane];
+		float distance = ((p[0] * center[0] + p[1] * center[1]) + p[2] * center[2]) + p[3];
+		visible = visible && !(distance < -radius);
+	}
+
+	return visible;
+}
+
+static int cull_block_scalar(const CullParameters& cull, const MatrixBlock& block, int lanes, unsigned char* visible)
+{
+	int visibleCount = 0;
+
+	for (int lane = 0; lane < lanes; lane++)
+	{
+		visible[lane] = test_sphere_scalar(cull, block, lane) ? 1 : 0;
+		visibleCount += visible[lane];
+	}
+
+	return visibleCount;
+}
+
+#if CULLING_X86
+
+/*************** SSE kernels ***************/
+
+// same operations as test_sphere_scalar, four lanes starting at lane, returns a bit per visible lane
+TARGET_SSE static inline int test_spheres_sse(const CullParameters& cull, const MatrixBlock& block, int lane)
+{
+	const __m128 x = _mm_set1_ps(cull.center[0]);
+	const __m128 y = _mm_set1_ps(cull.center[1]);
+	const __m128 z = _mm_set1_ps(cull.center[2]);
+	__m128 center[3];
+
+	for (int k = 0; k < 3; k++)
+	{
+		center[k] = _mm_add_ps(_mm_mul_ps(_mm_load_ps(block.m[k] + lane), x), _mm_mul_ps(_mm_load_ps(block.m[3 + k] + lane), y));
+		center[k] = _mm_add_ps(center[k], _mm_mul_ps(_mm_load_ps(block.m[6 + k] + lane), z));
+		center[k] = _mm_add_ps(center[k], _mm_load_ps(block.m[9 + k] + lane));
+	}
+
+	__m128 scale[3];
+	for (int column = 0; column < 3; column++)
+	{
+		__m128 a = _mm_load_ps(block.m[column * 3] + lane);
+		__m128 b = _mm_load_ps(block.m[column * 3 + 1] + lane);
+		__m128 c = _mm_load_ps(block.m[column * 3 + 2] + lane);
+		scale[column] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)), _mm_mul_ps(c, c));
+	}
+
+	// the order of the operands matches the comparisons of the scalar kernel
+	__m128 largest = _mm_max_ps(scale[0], scale[1]);
+	largest = _mm_max_ps(largest, scale[2]);
+	__m128 negativeRadius = _mm_xor_ps(_mm_mul_ps(_mm_set1_ps(cull.radius), _mm_sqrt_ps(largest)), _mm_set1_ps(-0.0f));
+
+	__m128 outside = _mm_setzero_ps();
+	for (int plane = 0; plane < NUM_PLANES; plane++)
+	{
+		const float* p = cull.planes[plane];
+		__m128 distance = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[0]), center[0]), _mm_mul_ps(_mm_set1_ps(p[1]), center[1]));
+		distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(p[2]), center[2]));
+		distance = _mm_add_ps(distance, _mm_set1_ps(p[3]));
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+	}
+
+	return ~_mm_movemask_ps(outside) & 0xf;
+}
+
+// write a byte per lane from a bit per lane and count the visible ones
+static inline int write_visible(int mask, int lanes, unsigned char* visible)
+{
+	int visibleCount = 0;
+
+	for (int lane = 0; lane < lanes; lane++)
+	{
+		visible[lane] = static_cast<unsigned char>((mask >> lane) & 1);
+		visibleCount += visible[lane];
+	}
+
+	return visibleCount;
+}
+
+TARGET_SSE static int cull_block_sse(const CullParameters& cull, const MatrixBlock& block, unsigned char* visible)
+{
+	int mask = test_spheres_sse(cull, block, 0) | (test_spheres_sse(cull, block, 4) << 4);
+	return write_visible(mask, BLOCK_SIZE, visible);
+}
+
+/*************** AVX2 kernels ***************/
+
+// same operations as test_sphere_scalar, a whole block at once
+TARGET_AVX2 static int cull_block_avx2(const CullParameters& cull, const MatrixBlock& block, unsigned char* visible)
+{
+	const __m256 x = _mm256_set1_ps(cull.center[0]);
+	const __m256 y = _mm256_set1_ps(cull.center[1]);
+	const __m256 z = _mm256_set1_ps(cull.center[2]);
+	__m256 center[3];
+
+	for (int k = 0; k < 3; k++)
+	{
+		center[k] = _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(block.m[k]), x), _mm256_mul_ps(_mm256_load_ps(block.m[3 + k]), y));
+		center[k] = _mm256_add_ps(center[k], _mm256_mul_ps(_mm256_load_ps(block.m[6 + k]), z));
+		center[k] = _mm256_add_ps(center[k], _mm256_load_ps(block.m[9 + k]));
+	}
+
+	__m256 scale[3];
+	for (int column = 0; column < 3; column++)
+	{
+		__m256 a = _mm256_load_ps(block.m[column * 3]);
+		__m256 b = _mm256_load_ps(block.m[column * 3 + 1]);
+		__m256 c = _mm256_load_ps(block.m[column * 3 + 2]);
+		scale[column] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b)), _mm256_mul_ps(c, c));
+	}
+
+	__m256 largest = _mm256_max_ps(scale[0], scale[1]);
+	largest = _mm256_max_ps(largest, scale[2]);
+	__m256 negativeRadius = _mm256_xor_ps(_mm256_mul_ps(_mm256_set1_ps(cull.radius), _mm256_sqrt_ps(largest)),
+		_mm256_set1_ps(-0.0f));
+
+	__m256 outside = _mm256_setzero_ps();
+	for (int plane = 0; plane < NUM_PLANES; plane++)
+	{
+		const float* p = cull.planes[plane];
+		__m256 distance = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p[0]), center[0]), _mm256_mul_ps(_mm256_set1_ps(p[1]), center[1]));
+		distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(p[2]), center[2]));
+		distance = _mm256_add_ps(distance, _mm256_set1_ps(p[3]));
+		outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, negativeRadius, _CMP_LT_OQ));
+	}
+
+	return write_visible(~_mm256_movemask_ps(outside) & 0xff, BLOCK_SIZE, visible);
+}
+
+#endif
+
+/*************** frustum tests ***************/
+
+Frustum extract_frustum(const glm::mat4& viewProjection)
+{
+	// clip space x, y and z lie within -w and w, each bound is a sum or difference of two rows (Gribb and Hartmann)
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+	Frustum frustum;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		frustum.planes[axis * 2] = rows[3] + rows[axis];
+		frustum.planes[axis * 2 + 1] = rows[3] - rows[axis];
+	}
+
+	// unit normals make the plane equation a distance, which the radii are compared with
+	for (glm::vec4& plane : frustum.planes)
+		plane = plane / glm::length(glm::vec3(plane));
+
+	return frustum;
+}
+
+glm::vec4 transform_bounding_sphere(const MeshBounds& bounds, const glm::mat4& modelMatrix)
+{
+	float scale = std::max(std::max(glm::dot(glm::vec3(modelMatrix[0]), glm::vec3(modelMatrix[0])),
+		glm::dot(glm::vec3(modelMatrix[1]), glm::vec3(modelMatrix[1]))),
+		glm::dot(glm::vec3(modelMatrix[2]), glm::vec3(modelMatrix[2])));
+
+	glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(bounds.sphereCenter, 1.0f));
+	return glm::vec4(center, bounds.sphereRadius * std::sqrt(scale));
+}
+
+void transform_bounding_box(const MeshBounds& bounds, const glm::mat4& modelMatrix, glm::vec3& boxMin, glm::vec3& boxMax)
+{
+	// each column adds its smaller and larger product to the translation (Arvo)
+	boxMin = glm::vec3(modelMatrix[3]);
+	boxMax = boxMin;
+
+	for (int column = 0; column < 3; column++)
+	{
+		glm::vec3 a = glm::vec3(modelMatrix[column]) * bounds.boxMin[column];
+		glm::vec3 b = glm::vec3(modelMatrix[column]) * bounds.boxMax[column];
+		boxMin += glm::min(a, b);
+		boxMax += glm::max(a, b);
+	}
+}
+
+bool is_sphere_visible(const Frustum& frustum, const glm::vec4& sphere)
+{
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		if (glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w < -sphere.w)
+			return false;
+	}
+
+	return true;
+}
+
+bool is_box_visible(const Frustum& frustum, const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		// the corner furthest along the normal is the last to leave the plane
+		glm::vec3 corner(plane.x >= 0.0f ? boxMax.x : boxMin.x, plane.y >= 0.0f ? boxMax.y : boxMin.y,
+			plane.z >= 0.0f ? boxMax.z : boxMin.z);
+
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			return false;
+	}
+
+	return true;
+}
+
+bool is_mesh_visible(const Frustum& frustum, const MeshBounds& bounds, const glm::mat4& modelMatrix)
+{
+	if (!is_sphere_visible(frustum, transform_bounding_sphere(bounds, modelMatrix)))
+		return false;
+
+	// the box is tighter for long thin meshes, whose spheres reach far past them
+	glm::vec3 boxMin, boxMax;
+	transform_bounding_box(bounds, modelMatrix, boxMin, boxMax);
+	return is_box_visible(frustum, boxMin, boxMax);
+}
+
+int cull_spheres(const Frustum& frustum, const MeshBounds& bounds, const glm::mat4* modelMatrices, std::size_t stride,
+	int count, unsigned char* visible, SimdLevel level)
+{
+	assert(stride >= sizeof(glm::mat4));
+
+	CullParameters cull;
+	for (int plane = 0; plane < NUM_PLANES; plane++)
+	{
+		for (int k = 0; k < 4; k++)
+			cull.planes[plane][k] = frustum.planes[plane][k];
+	}
+	for (int k = 0; k < 3; k++)
+		cull.center[k] = bounds.sphereCenter[k];
+	cull.radius = bounds.sphereRadius;
+
+	// never run a kernel the CPU does not support
+	if (level > OrbitSystem::getBestSimdLevel())
+		level = OrbitSystem::getBestSimdLevel();
+
+	const unsigned char* matrices = reinterpret_cast<const unsigned char*>(modelMatrices);
+	MatrixBlock block;
+	int visibleCount = 0;
+
+	for (int first = 0; first < count; first += BLOCK_SIZE)
+	{
+		int lanes = std::min(BLOCK_SIZE, count - first);
+		gather_block(matrices + first * stride, stride, lanes, block);
+
+		// partial blocks at the end go through the scalar kernel whatever the level
+		if (lanes < BLOCK_SIZE)
+		{
+			visibleCount += cull_block_scalar(cull, block, lanes, visible + first);
+			continue;
+		}
+
+		switch (level)
+		{
+#if CULLING_X86
+		case SimdLevel::AVX2:
+			visibleCount += cull_block_avx2(cull, block, visible + first);
+			break;
+		case SimdLevel::SSE:
+			visibleCount += cull_block_sse(cull, block, visible + first);
+			break;
+#endif
+		default:
+			visibleCount += cull_block_scalar(cull, block, lanes, visible + first);
+			break;
+		}
+	}
+
+	return visibleCount;
+}
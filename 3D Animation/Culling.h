@@ -0,0 +1,49 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <cstddef>
+
+#include "RenderTypes.h"
+#include "MeshCache.h"
+#include "OrbitSystem.h"
+
+// planes of a view frustum as (normal, distance) with unit normals pointing inwards,
+// a point p is inside a plane when dot(normal, p) + distance >= 0
+struct Frustum
+{
+	glm::vec4 planes[6];	// left, right, bottom, top, near, far
+};
+
+/*****************************************************************
+ * visibility tests against the view frustum
+ * objects are tested with the bounding sphere of their mesh moved
+ * by their model matrix, the radius grows with the largest scale
+ * of the matrix so the sphere stays conservative under any scale
+ * whole arrays of matrices are tested with SSE/AVX2 kernels, every
+ * kernel performs the same float operations in the same order so
+ * all instruction sets agree on every object
+ *****************************************************************/
+
+// frustum of a view projection matrix, in the space the matrix maps from
+Frustum extract_frustum(const glm::mat4& viewProjection);
+
+// sphere in world space of the model space bounds drawn with modelMatrix, xyz is the centre and w the radius
+glm::vec4 transform_bounding_sphere(const MeshBounds& bounds, const glm::mat4& modelMatrix);
+
+// world space box around the model space box drawn with modelMatrix
+void transform_bounding_box(const MeshBounds& bounds, const glm::mat4& modelMatrix, glm::vec3& boxMin, glm::vec3& boxMax);
+
+bool is_sphere_visible(const Frustum& frustum, const glm::vec4& sphere);
+// false if the box lies entirely outside one of the planes
+bool is_box_visible(const Frustum& frustum, const glm::vec3& boxMin, const glm::vec3& boxMax);
+
+// sphere and then box test of a model drawn with modelMatrix, for single objects
+bool is_mesh_visible(const Frustum& frustum, const MeshBounds& bounds, const glm::mat4& modelMatrix);
+
+// test the bounding sphere of bounds under count model matrices, which are stride bytes apart so they can be
+// read from inside an array of larger structs, visible[i] becomes 1 for matrices whose sphere touches the
+// frustum and 0 for the others, returns the number of visible ones
+int cull_spheres(const Frustum& frustum, const MeshBounds& bounds, const glm::mat4* modelMatrices, std::size_t stride,
+	int count, unsigned char* visible, SimdLevel level = OrbitSystem::getBestSimdLevel());
+
+#endif
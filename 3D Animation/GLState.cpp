@@ -0,0 +1,220 @@
+#include "GLState.h"
+
+GLuint GLState::sProgram = GLState::UNKNOWN;
+GLuint GLState::sVertexArray = GLState::UNKNOWN;
+GLuint GLState::sBuffers[GLState::NUM_BUFFER_TARGETS] = { GLState::UNKNOWN, GLState::UNKNOWN, GLState::UNKNOWN, GLState::UNKNOWN };
+GLState::IndexedBinding GLState::sUniformBindings[GLState::MAX_INDEXED_BINDINGS];
+GLenum GLState::sPolygonMode = GLState::UNKNOWN;
+GLState::Stats GLState::sCurrent;
+GLState::Stats GLState::sLastFrame;
+
+void GLState::useProgram(GLuint program)
+{
+	if (sProgram == program)
+	{
+		count(false);
+		return;
+	}
+
+	glUseProgram(program);
+	sProgram = program;
+	count(true);
+}
+
+void GLState::bindVertexArray(GLuint vertexArray)
+{
+	if (sVertexArray == vertexArray)
+	{
+		count(false);
+		return;
+	}
+
+	glBindVertexArray(vertexArray);
+	sVertexArray = vertexArray;
+	count(true);
+
+	// the element buffer binding belongs to the vertex array
+	sBuffers[getTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+	int index = getTargetIndex(target);
+
+	// targets that are not tracked are always passed through
+	if (index < 0)
+	{
+		glBindBuffer(target, buffer);
+		count(true);
+		return;
+	}
+
+	if (sBuffers[index] == buffer)
+	{
+		count(false);
+		return;
+	}
+
+	glBindBuffer(target, buffer);
+	sBuffers[index] = buffer;
+	count(true);
+}
+
+void GLState::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	// binding the whole buffer is recorded as a range of size 0
+	if (target == GL_UNIFORM_BUFFER && index < MAX_INDEXED_BINDINGS)
+	{
+		IndexedBinding& binding = sUniformBindings[index];
+
+		if (binding.buffer == buffer && binding.offset == 0 && binding.size == 0)
+		{
+			count(false);
+			return;
+		}
+
+		binding.buffer = buffer;
+		binding.offset = 0;
+		binding.size = 0;
+	}
+
+	glBindBufferBase(target, index, buffer);
+	count(true);
+
+	// indexed binds also change the generic binding of the target
+	int targetIndex = getTargetIndex(target);
+	if (targetIndex >= 0)
+		sBuffers[targetIndex] = buffer;
+}
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	if (target == GL_UNIFORM_BUFFER && index < MAX_INDEXED_BINDINGS)
+	{
+		IndexedBinding& binding = sUniformBindings[index];
+
+		if (binding.buffer == buffer && binding.offset == offset && binding.size == size)
+		{
+			count(false);
+			return;
+		}
+
+		binding.buffer = buffer;
+		binding.offset = offset;
+		binding.size = size;
+	}
+
+	glBindBufferRange(target, index, buffer, offset, size);
+	count(true);
+
+	// indexed binds also change the generic binding of the target
+	int targetIndex = getTargetIndex(target);
+	if (targetIndex >= 0)
+		sBuffers[targetIndex] = buffer;
+}
+
+void GLState::polygonMode(GLenum mode)
+{
+	if (sPolygonMode == mode)
+	{
+		count(false);
+		return;
+	}
+
+	glPolygonMode(GL_FRONT_AND_BACK, mode);
+	sPolygonMode = mode;
+	count(true);
+}
+
+// forget a deleted program
+void GLState::onProgramDeleted(GLuint program)
+{
+	if (sProgram == program)
+		sProgram = UNKNOWN;
+}
+
+// forget a deleted vertex array
+void GLState::onVertexArrayDeleted(GLuint vertexArray)
+{
+	// deleting the bound vertex array reverts the binding to 0
+	if (sVertexArray == vertexArray)
+	{
+		sVertexArray = 0;
+		sBuffers[getTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+	}
+}
+
+// forget a deleted buffer
+void GLState::onBufferDeleted(GLuint buffer)
+{
+	for (int i = 0; i < NUM_BUFFER_TARGETS; i++)
+	{
+		if (sBuffers[i] == buffer)
+			sBuffers[i] = UNKNOWN;
+	}
+
+	for (int i = 0; i < MAX_INDEXED_BINDINGS; i++)
+	{
+		if (sUniformBindings[i].buffer == buffer)
+			sUniformBindings[i].buffer = UNKNOWN;
+	}
+}
+
+// forget everything
+void GLState::invalidate()
+{
+	sProgram = UNKNOWN;
+	sVertexArray = UNKNOWN;
+	sPolygonMode = UNKNOWN;
+
+	for (int i = 0; i < NUM_BUFFER_TARGETS; i++)
+		sBuffers[i] = UNKNOWN;
+
+	for (int i = 0; i < MAX_INDEXED_BINDINGS; i++)
+		sUniformBindings[i].buffer = UNKNOWN;
+}
+
+// record a uniform upload that was issued or skipped
+void GLState::countUniform(bool issued)
+{
+	count(issued);
+}
+
+// move this frame's counters to the last frame counters
+void GLState::endFrame()
+{
+	sLastFrame = sCurrent;
+	sCurrent = Stats();
+}
+
+// counters of the last complete frame
+GLState::Stats& GLState::getFrameStats()
+{
+	return sLastFrame;
+}
+
+// index of a tracked buffer target, -1 if not tracked
+int GLState::getTargetIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER:
+		return 0;
+	case GL_ELEMENT_ARRAY_BUFFER:
+		return 1;
+	case GL_UNIFORM_BUFFER:
+		return 2;
+	case GL_DRAW_INDIRECT_BUFFER:
+		return 3;
+	default:
+		return -1;
+	}
+}
+
+void GLState::count(bool issued)
+{
+	if (issued)
+		sCurrent.issued++;
+	else
+		sCurrent.elided++;
+}
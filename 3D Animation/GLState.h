@@ -0,0 +1,70 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <GLEW/glew.h>
+
+/*****************************************************************
+ * shadow copy of the GL binding state
+ * calls that would not change the current state are skipped, all
+ * binds in the program go through here so the shadow stays correct
+ *****************************************************************/
+class GLState
+{
+public:
+	// number of calls passed to GL and skipped as redundant
+	struct Stats
+	{
+		int issued = 0;
+		int elided = 0;
+	};
+
+	static void useProgram(GLuint program);
+	static void bindVertexArray(GLuint vertexArray);
+	static void bindBuffer(GLenum target, GLuint buffer);
+	static void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	static void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+	static void polygonMode(GLenum mode);
+
+	// forget deleted objects, GL unbinds them implicitly
+	static void onProgramDeleted(GLuint program);
+	static void onVertexArrayDeleted(GLuint vertexArray);
+	static void onBufferDeleted(GLuint buffer);
+
+	// forget everything, call after code that makes its own GL calls (e.g. TwDraw)
+	static void invalidate();
+
+	// record a uniform upload that was issued or skipped, uniform values are shadowed per program
+	static void countUniform(bool issued);
+
+	// move this frame's counters to the last frame counters
+	static void endFrame();
+	// counters of the last complete frame
+	static Stats& getFrameStats();
+
+private:
+	static const int NUM_BUFFER_TARGETS = 4;
+	static const int MAX_INDEXED_BINDINGS = 36;
+	static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+	// buffer bound to an indexed binding point
+	struct IndexedBinding
+	{
+		GLuint buffer;
+		GLintptr offset;
+		GLsizeiptr size;
+	};
+
+	static GLuint sProgram;
+	static GLuint sVertexArray;
+	static GLuint sBuffers[NUM_BUFFER_TARGETS];
+	static IndexedBinding sUniformBindings[MAX_INDEXED_BINDINGS];
+	static GLenum sPolygonMode;
+
+	static Stats sCurrent;		// counters of the frame in progress
+	static Stats sLastFrame;	// counters of the last complete frame
+
+	static int getTargetIndex(GLenum target);
+	static void count(bool issued);
+};
+
+#endif
@@ -0,0 +1,316 @@
+#include "Headless.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef HEADLESS_EGL
+#include <EGL/eglext.h>
+#endif
+
+static void print_usage(const char* program)
+{
+	std::cerr << "usage: " << program << " [--headless] [--scenario <name>] [--frames <n>] [--warmup <n>] [--report <path>]"
+		" [--max-p99 <ms>] [--trace <path>] [--benchmarks <path> [--baseline <path>]]" << std::endl;
+}
+
+// value of an option that takes one, nullptr if it is the last argument
+static const char* get_option_value(int argc, char** argv, int& i)
+{
+	if (i + 1 >= argc)
+		return nullptr;
+
+	return argv[++i];
+}
+
+bool parse_headless_options(int argc, char** argv, HeadlessOptions& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char* argument = argv[i];
+		const char* value = nullptr;
+
+		if (std::strcmp(argument, "--headless") == 0)
+		{
+			options.enabled = true;
+			continue;
+		}
+
+		if (std::strcmp(argument, "--scenario") == 0 && (value = get_option_value(argc, argv, i)))
+			options.scenario = value;
+		else if (std::strcmp(argument, "--frames") == 0 && (value = get_option_value(argc, argv, i)))
+			options.frames = std::max(std::atoi(value), 1);
+		else if (std::strcmp(argument, "--warmup") == 0 && (value = get_option_value(argc, argv, i)))
+			options.warmupFrames = std::max(std::atoi(value), 0);
+		else if (std::strcmp(argument, "--report") == 0 && (value = get_option_value(argc, argv, i)))
+			options.reportPath = value;
+		else if (std::strcmp(argument, "--max-p99") == 0 && (value = get_option_value(argc, argv, i)))
+			options.maxFrameP99 = std::max(std::atof(value), 0.0);
+		else if (std::strcmp(argument, "--trace") == 0 && (value = get_option_value(argc, argv, i)))
+			options.tracePath = value;
+		else if (std::strcmp(argument, "--benchmarks") == 0 && (value = get_option_value(argc, argv, i)))
+			options.benchmarksPath = value;
+		else if (std::strcmp(argument, "--baseline") == 0 && (value = get_option_value(argc, argv, i)))
+			options.baselinePath = value;
+		else
+		{
+			std::cerr << "Unknown or incomplete argument " << argument << std::endl;
+			print_usage(argv[0]);
+			return false;
+		}
+	}
+
+	// the baseline is compared with the results of a benchmark run
+	if (!options.baselinePath.empty() && options.benchmarksPath.empty())
+	{
+		std::cerr << "--baseline needs --benchmarks" << std::endl;
+		print_usage(argv[0]);
+		return false;
+	}
+
+	return true;
+}
+
+OffscreenTarget::~OffscreenTarget()
+{
+	release();
+}
+
+bool OffscreenTarget::create(int width, int height)
+{
+	release();
+
+	glGenRenderbuffers(1, &mColor);
+	glBindRenderbuffer(GL_RENDERBUFFER, mColor);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &mDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, mDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+	glGenFramebuffers(1, &mFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColor);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepth);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cerr << "Offscreen framebuffer incomplete, status 0x" << std::hex << status << std::dec << std::endl;
+		release();
+		return false;
+	}
+
+	return true;
+}
+
+void OffscreenTarget::release()
+{
+	if (mFramebuffer != 0)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &mFramebuffer);
+	}
+
+	if (mColor != 0)
+		glDeleteRenderbuffers(1, &mColor);
+	if (mDepth != 0)
+		glDeleteRenderbuffers(1, &mDepth);
+
+	mFramebuffer = 0;
+	mColor = 0;
+	mDepth = 0;
+}
+
+#ifdef HEADLESS_EGL
+// whether a space separated EGL extension string names an extension
+static bool has_egl_extension(const char* extensions, const char* name)
+{
+	const std::size_t length = std::strlen(name);
+
+	for (const char* found = extensions; found && (found = std::strstr(found, name)); found += length)
+	{
+		if ((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == '\0'))
+			return true;
+	}
+
+	return false;
+}
+
+HeadlessContext::~HeadlessContext()
+{
+	release();
+}
+
+bool HeadlessContext::create()
+{
+	release();
+
+	// the surfaceless platform needs no display server, client extensions are queried without a display
+	const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+	if (!has_egl_extension(clientExtensions, "EGL_MESA_platform_surfaceless") || getPlatformDisplay == nullptr)
+	{
+		std::cerr << "EGL has no surfaceless platform (EGL_MESA_platform_surfaceless), headless runs need Mesa's EGL"
+			<< std::endl;
+		return false;
+	}
+
+	mDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	EGLint major = 0;
+	EGLint minor = 0;
+	if (mDisplay == EGL_NO_DISPLAY || !eglInitialize(mDisplay, &major, &minor))
+	{
+		std::cerr << "EGL initialisation failed, error 0x" << std::hex << eglGetError() << std::dec << std::endl;
+		mDisplay = EGL_NO_DISPLAY;
+		return false;
+	}
+
+	// a core profile context with no surface, and so no config, needs these on EGL 1.4
+	const char* extensions = eglQueryString(mDisplay, EGL_EXTENSIONS);
+	const char* required[] = { "EGL_KHR_create_context", "EGL_KHR_surfaceless_context", "EGL_KHR_no_config_context" };
+	for (const char* extension : required)
+	{
+		if (!has_egl_extension(extensions, extension))
+		{
+			std::cerr << "EGL " << major << "." << minor << " has no " << extension << std::endl;
+			release();
+			return false;
+		}
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cerr << "EGL has no desktop OpenGL" << std::endl;
+		release();
+		return false;
+	}
+
+	// the same context the window gets, OpenGL 3.3 core and forward compatible
+	const EGLint attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+		EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+		EGL_CONTEXT_FLAGS_KHR, EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE_BIT_KHR,
+		EGL_NONE
+	};
+
+	mContext = eglCreateContext(mDisplay, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+	if (mContext == EGL_NO_CONTEXT || !eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, mContext))
+	{
+		std::cerr << "EGL context creation failed, error 0x" << std::hex << eglGetError() << std::dec << std::endl;
+		release();
+		return false;
+	}
+
+	return true;
+}
+
+void HeadlessContext::release()
+{
+	if (mDisplay == EGL_NO_DISPLAY)
+		return;
+
+	eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (mContext != EGL_NO_CONTEXT)
+		eglDestroyContext(mDisplay, mContext);
+	eglTerminate(mDisplay);
+
+	mDisplay = EGL_NO_DISPLAY;
+	mContext = EGL_NO_CONTEXT;
+}
+#endif
+
+// text as a JSON string literal
+static std::string quote(const std::string& text)
+{
+	std::string quoted = "\"";
+
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			quoted += '\\';
+			quoted += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20)
+		{
+			char escaped[8];
+			std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			quoted += escaped;
+		}
+		else
+			quoted += c;
+	}
+
+	return quoted + "\"";
+}
+
+// stats as a JSON object, the closing brace is left at indent
+static void write_stats(std::ostream& file, const TimeStats& stats, const char* indent)
+{
+	file << "{\n"
+		<< indent << "  \"count\": " << stats.count << ",\n"
+		<< indent << "  \"mean\": " << stats.mean << ",\n"
+		<< indent << "  \"p50\": " << stats.p50 << ",\n"
+		<< indent << "  \"p90\": " << stats.p90 << ",\n"
+		<< indent << "  \"p95\": " << stats.p95 << ",\n"
+		<< indent << "  \"p99\": " << stats.p99 << ",\n"
+		<< indent << "  \"max\": " << stats.max << "\n"
+		<< indent << "}";
+}
+
+bool write_headless_report(const std::string& path, const HeadlessReport& report)
+{
+	std::ofstream file(path);
+	if (!file)
+	{
+		std::cerr << "Could not write the report to " << path << std::endl;
+		return false;
+	}
+
+	file.precision(10);
+
+	file << "{\n"
+		<< "  \"scenario\": " << quote(report.scenario) << ",\n"
+		<< "  \"renderer\": " << quote(report.renderer) << ",\n"
+		<< "  \"version\": " << quote(report.version) << ",\n"
+		<< "  \"width\": " << report.width << ",\n"
+		<< "  \"height\": " << report.height << ",\n"
+		<< "  \"frames\": " << report.frames << ",\n"
+		<< "  \"warmup_frames\": " << report.warmupFrames << ",\n"
+		<< "  \"startup_ms\": " << report.startupTime << ",\n"
+		<< "  \"load_ms\": " << report.loadTime << ",\n"
+		<< "  \"frame_time_ms\": ";
+	write_stats(file, report.frameTimes, "  ");
+
+	// CPU times of every pass and GPU times of the passes that draw
+	file << ",\n  \"passes\": {";
+	for (std::size_t i = 0; i < report.passes.size(); i++)
+	{
+		const PassTimes& pass = report.passes[i];
+
+		file << (i == 0 ? "\n" : ",\n") << "    " << quote(pass.name) << ": {\n      \"cpu_ms\": ";
+		write_stats(file, pass.cpuTimes, "      ");
+		if (pass.hasGpuTimes)
+		{
+			file << ",\n      \"gpu_ms\": ";
+			write_stats(file, pass.gpuTimes, "      ");
+		}
+		file << "\n    }";
+	}
+
+	file << "\n  },\n  \"per_frame\": {";
+
+	for (std::size_t i = 0; i < report.counters.size(); i++)
+		file << (i == 0 ? "\n" : ",\n") << "    " << quote(report.counters[i].first) << ": " << report.counters[i].second;
+
+	file << "\n  }\n}\n";
+
+	return static_cast<bool>(file);
+}
@@ -0,0 +1,115 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <GLEW/glew.h>
+
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#endif
+
+#include "Profiler.h"
+
+// command line of a headless run, a fixed number of frames of a named scenario drawn offscreen
+struct HeadlessOptions
+{
+	bool enabled = false;
+	std::string scenario = "default";
+	int frames = 1000;			// frames measured
+	int warmupFrames = 60;		// frames drawn once the scenario has loaded, before measuring
+	std::string reportPath = "headless_report.json";
+	double maxFrameP99 = 0.0;	// milliseconds the run fails beyond, 0 for no limit
+	std::string tracePath;		// trace recorded from the start and written at the end, windowed runs too
+	std::string benchmarksPath;	// micro-benchmark results written here instead of drawing any frames
+	std::string baselinePath;	// micro-benchmark results to compare with, slower ones fail the run
+};
+
+// read --headless, --scenario <name>, --frames <n>, --warmup <n>, --report <path>, --max-p99 <ms>, --trace <path>,
+// --benchmarks <path> and --baseline <path>
+// prints the usage and returns false on arguments it does not know
+bool parse_headless_options(int argc, char** argv, HeadlessOptions& options);
+
+/*****************************************************************
+ * framebuffer with colour and depth renderbuffers
+ * headless runs draw into it instead of a window's back buffer
+ *****************************************************************/
+class OffscreenTarget
+{
+public:
+	OffscreenTarget() = default;
+	~OffscreenTarget();
+
+	OffscreenTarget(const OffscreenTarget&) = delete;
+	OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+	// create the buffers and bind the framebuffer, returns false if it is incomplete
+	bool create(int width, int height);
+	void release();
+
+private:
+	GLuint mFramebuffer = 0;
+	GLuint mColor = 0;
+	GLuint mDepth = 0;
+};
+
+#ifdef HEADLESS_EGL
+/*****************************************************************
+ * OpenGL 3.3 core context without a window, a display or a GPU
+ * made through EGL on Mesa's surfaceless platform, which renders
+ * with llvmpipe when there is no GPU
+ * the context has no surface, headless runs draw into an
+ * OffscreenTarget, builds without HEADLESS_EGL make a hidden GLFW
+ * window instead, which needs a display before GLFW 3.4
+ *****************************************************************/
+class HeadlessContext
+{
+public:
+	HeadlessContext() = default;
+	~HeadlessContext();
+
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+	// create the context and make it current, prints what is missing and returns false if it can't
+	bool create();
+	void release();
+
+private:
+	EGLDisplay mDisplay = EGL_NO_DISPLAY;
+	EGLContext mContext = EGL_NO_CONTEXT;
+};
+#endif
+
+// CPU and GPU times of one pass over the measured frames
+struct PassTimes
+{
+	std::string name;
+	TimeStats cpuTimes;
+	bool hasGpuTimes = false;
+	TimeStats gpuTimes;
+};
+
+// results of a headless run
+struct HeadlessReport
+{
+	std::string scenario;
+	std::string renderer;		// GL_RENDERER and GL_VERSION of the context
+	std::string version;
+	int width = 0;
+	int height = 0;
+	int frames = 0;
+	int warmupFrames = 0;		// frames drawn before measuring, including those waiting for the scenario to load
+	double startupTime = 0.0;	// milliseconds from the start of main to the first frame
+	double loadTime = 0.0;		// milliseconds until the scenario was loaded and measuring could start
+	TimeStats frameTimes;
+	std::vector<PassTimes> passes;
+	std::vector<std::pair<std::string, double>> counters;	// per frame averages, e.g. draw calls
+};
+
+// write the report as JSON, returns false if the file can't be written
+bool write_headless_report(const std::string& path, const HeadlessReport& report);
+
+#endif
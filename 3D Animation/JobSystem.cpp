@@ -0,0 +1,290 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <string>
+
+#include "Trace.h"
+
+// queues of threads outside the pool, threads past this share the last one
+static const int MAX_EXTERNAL_THREADS = 8;
+
+// the pool the current thread last queued or waited on and its queue there
+static thread_local const JobSystem* tJobSystem = nullptr;
+static thread_local int tQueueIndex = 0;
+
+JobSystem::JobSystem(int workerCount) : mQueuedJobs(0), mSleepingWorkers(0), mNextBackgroundQueue(0), mStopping(false)
+{
+	start(workerCount);
+}
+
+JobSystem::~JobSystem()
+{
+	stop();
+}
+
+// stop the current workers and start workerCount new ones
+void JobSystem::start(int workerCount)
+{
+	stop();
+
+	mQueues.clear();
+	for (int i = 0; i < MAX_EXTERNAL_THREADS + workerCount; i++)
+		mQueues.emplace_back(new Queue());
+
+	mStopping = false;
+	for (int i = 0; i < workerCount; i++)
+		mWorkers.emplace_back(&JobSystem::workerLoop, this, MAX_EXTERNAL_THREADS + i);
+}
+
+// finish queued jobs and join the workers
+void JobSystem::stop()
+{
+	if (mWorkers.empty())
+		return;
+
+	// workers only leave once the queues are empty
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mStopping = true;
+	}
+	mWakeUp.notify_all();
+
+	for (std::thread& worker : mWorkers)
+		worker.join();
+
+	mWorkers.clear();
+}
+
+// queue a job, held back until dependency reaches zero
+void JobSystem::run(std::function<void()> function, JobCounter* counter, JobCounter* dependency)
+{
+	enqueue(std::move(function), counter, dependency, false);
+}
+
+// queue a job that only the workers run
+void JobSystem::runInBackground(std::function<void()> function, JobCounter* counter, JobCounter* dependency)
+{
+	enqueue(std::move(function), counter, dependency, true);
+}
+
+void JobSystem::enqueue(std::function<void()> function, JobCounter* counter, JobCounter* dependency, bool background)
+{
+	// count the job straight away so waiting on counter also covers held back jobs
+	if (counter != nullptr)
+		counter->mPending++;
+
+	if (dependency != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(dependency->mMutex);
+
+		if (dependency->mPending.load() > 0)
+		{
+			dependency->mContinuations.push_back({ std::move(function), counter, background });
+			return;
+		}
+	}
+
+	push({ std::move(function), counter }, background);
+}
+
+// run queued jobs on this thread until counter reaches zero
+void JobSystem::wait(JobCounter& counter)
+{
+	int queueIndex = getQueueIndex();
+
+	while (counter.mPending.load() > 0)
+	{
+		if (!tryRunJob(queueIndex))
+			std::this_thread::yield();
+	}
+
+	// the job that finished the counter may still hold its lock, take it once so the
+	// counter is not destroyed under it
+	std::lock_guard<std::mutex> lock(counter.mMutex);
+}
+
+// split [0, count) into chunks of grainSize and queue body(begin, end) for each chunk
+void JobSystem::parallelFor(int count, int grainSize, const std::function<void(int, int)>& body,
+	JobCounter& counter, JobCounter* dependency)
+{
+	grainSize = std::max(grainSize, 1);
+
+	for (int begin = 0; begin < count; begin += grainSize)
+	{
+		int end = std::min(begin + grainSize, count);
+		run([body, begin, end]() { body(begin, end); }, &counter, dependency);
+	}
+}
+
+void JobSystem::parallelFor(int count, int grainSize, const std::function<void(int, int)>& body)
+{
+	// a single chunk is not worth a trip through the queues
+	if (count <= grainSize)
+	{
+		if (count > 0)
+			body(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	parallelFor(count, grainSize, body, counter);
+	wait(counter);
+}
+
+int JobSystem::getThreadCount() const
+{
+	return static_cast<int>(mWorkers.size()) + 1;
+}
+
+int JobSystem::getDefaultWorkerCount()
+{
+	// hardware_concurrency may return 0 if it cannot tell
+	return std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0);
+}
+
+void JobSystem::workerLoop(int queueIndex)
+{
+	tJobSystem = this;
+	tQueueIndex = queueIndex;
+	TRACE_THREAD_NAME("worker " + std::to_string(queueIndex - MAX_EXTERNAL_THREADS + 1));
+
+	for (;;)
+	{
+		if (tryRunJob(queueIndex))
+			continue;
+
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		mSleepingWorkers++;
+		mWakeUp.wait(lock, [this]() { return mQueuedJobs.load() > 0 || mStopping.load(); });
+		mSleepingWorkers--;
+
+		if (mStopping.load() && mQueuedJobs.load() == 0)
+			break;
+	}
+
+	tJobSystem = nullptr;
+}
+
+// add a job to the queue of the current thread, or of a worker for a background job, and wake a worker
+void JobSystem::push(Job job, bool background)
+{
+	const int workerCount = static_cast<int>(mQueues.size()) - MAX_EXTERNAL_THREADS;
+	const int queueIndex = background && workerCount > 0
+		? MAX_EXTERNAL_THREADS + static_cast<int>(mNextBackgroundQueue++ % workerCount) : getQueueIndex();
+
+	Queue& queue = *mQueues[queueIndex];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(std::move(job));
+	}
+
+	mQueuedJobs++;
+
+	// a worker counts itself as sleeping before it checks for jobs under the lock,
+	// so either it sees the new job or it is already waiting and gets woken
+	if (mSleepingWorkers.load() > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mSleepMutex);
+		}
+		mWakeUp.notify_one();
+	}
+}
+
+// run one job from the thread's own queue or, on a worker, steal one, returns false if there was none
+bool JobSystem::tryRunJob(int queueIndex)
+{
+	const int queueCount = static_cast<int>(mQueues.size());
+	Job job;
+	bool found = false;
+
+	// newest job of the own queue first, its data is most likely still in cache
+	{
+		Queue& queue = *mQueues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (!queue.jobs.empty())
+		{
+			job = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+			found = true;
+		}
+	}
+
+	// otherwise the oldest job of another queue, threads outside the pool leave other threads' jobs to the workers
+	const bool worker = queueIndex >= MAX_EXTERNAL_THREADS;
+
+	for (int i = 1; i < queueCount && worker && !found; i++)
+	{
+		Queue& queue = *mQueues[(queueIndex + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (!queue.jobs.empty())
+		{
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			found = true;
+		}
+	}
+
+	if (!found)
+		return false;
+
+	mQueuedJobs--;
+	{
+		TRACE_SCOPE("job");
+		job.function();
+	}
+	finish(job);
+
+	return true;
+}
+
+// count a job as finished and release the jobs waiting for its counter
+void JobSystem::finish(Job& job)
+{
+	JobCounter* counter = job.counter;
+	if (counter == nullptr)
+		return;
+
+	std::vector<JobCounter::Continuation> continuations;
+	{
+		std::lock_guard<std::mutex> lock(counter->mMutex);
+
+		if (--counter->mPending > 0)
+			return;
+
+		continuations.swap(counter->mContinuations);
+	}
+
+	// the counter may be destroyed from here on
+	for (JobCounter::Continuation& continuation : continuations)
+		push({ std::move(continuation.function), continuation.counter }, continuation.background);
+}
+
+int JobSystem::getQueueIndex()
+{
+	if (tJobSystem != this)
+	{
+		tQueueIndex = registerExternalThread();
+		tJobSystem = this;
+	}
+
+	return tQueueIndex;
+}
+
+// give a thread outside the pool its queue, the same one each time it comes back from another pool
+int JobSystem::registerExternalThread()
+{
+	const std::thread::id id = std::this_thread::get_id();
+	std::lock_guard<std::mutex> lock(mExternalMutex);
+
+	auto position = std::find(mExternalThreads.begin(), mExternalThreads.end(), id);
+	if (position != mExternalThreads.end())
+		return static_cast<int>(position - mExternalThreads.begin());
+
+	if (mExternalThreads.size() < static_cast<std::size_t>(MAX_EXTERNAL_THREADS))
+		mExternalThreads.push_back(id);
+
+	return static_cast<int>(mExternalThreads.size()) - 1;
+}
@@ -0,0 +1,122 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+/*****************************************************************
+ * counts the unfinished jobs of a group, jobs can be made to wait
+ * for a counter so one group only starts after another finished
+ * a counter must outlive its jobs, wait on it before destroying it
+ *****************************************************************/
+class JobCounter
+{
+public:
+	JobCounter() : mPending(0) {}
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool isDone() const { return mPending.load() == 0; }
+
+private:
+	friend class JobSystem;
+
+	struct Continuation
+	{
+		std::function<void()> function;
+		JobCounter* counter;
+		bool background;
+	};
+
+	std::atomic<int> mPending;					// jobs added to the counter that have not finished
+	std::mutex mMutex;							// guards mContinuations and the transition to zero
+	std::vector<Continuation> mContinuations;	// jobs waiting for the counter to reach zero
+};
+
+/*****************************************************************
+ * pool of worker threads with one job queue per thread
+ * a thread takes new work from the back of its own queue and steals
+ * from the front of other queues when it runs dry, threads that
+ * wait on a counter run jobs instead of blocking
+ * threads outside the pool get a queue of their own the first time
+ * they queue or wait, and only ever run the jobs in it, so the render
+ * and simulation threads never pick up each other's work
+ *****************************************************************/
+class JobSystem
+{
+public:
+	// starts workerCount threads, 0 runs every job on the threads that wait
+	explicit JobSystem(int workerCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// stop the current workers and start workerCount new ones
+	void start(int workerCount);
+	// finish queued jobs and join the workers
+	void stop();
+
+	// queue a job, counted by counter if given and held back until dependency reaches zero
+	void run(std::function<void()> function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+	// the same but only the workers run it, for long jobs such as loads that must not hold up a thread waiting on
+	// a short parallelFor, without workers it is queued like run
+	void runInBackground(std::function<void()> function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+	// run queued jobs on this thread until counter reaches zero
+	void wait(JobCounter& counter);
+
+	// split [0, count) into chunks of grainSize and queue body(begin, end) for each chunk
+	void parallelFor(int count, int grainSize, const std::function<void(int, int)>& body,
+		JobCounter& counter, JobCounter* dependency = nullptr);
+	// the same but returns once every chunk has finished
+	void parallelFor(int count, int grainSize, const std::function<void(int, int)>& body);
+
+	// workers plus the thread that waits
+	int getThreadCount() const;
+
+	// one worker per hardware thread, less the thread that waits
+	static int getDefaultWorkerCount();
+
+private:
+	struct Job
+	{
+		std::function<void()> function;
+		JobCounter* counter;
+	};
+
+	// job queue of one thread, the queues of threads outside the pool come before the workers'
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::unique_ptr<Queue>> mQueues;
+	std::vector<std::thread> mWorkers;
+	std::atomic<int> mQueuedJobs;		// jobs in all queues
+	std::atomic<int> mSleepingWorkers;	// workers waiting on mWakeUp
+	std::atomic<unsigned> mNextBackgroundQueue;	// worker queue the next background job goes to
+	std::atomic<bool> mStopping;
+	std::mutex mSleepMutex;
+	std::condition_variable mWakeUp;
+	std::mutex mExternalMutex;					// guards mExternalThreads
+	std::vector<std::thread::id> mExternalThreads;	// threads outside the pool in the order of their queues
+
+	void workerLoop(int queueIndex);
+	void enqueue(std::function<void()> function, JobCounter* counter, JobCounter* dependency, bool background);
+	void push(Job job, bool background);
+	bool tryRunJob(int queueIndex);
+	void finish(Job& job);
+	int getQueueIndex();
+	int registerExternalThread();
+};
+
+#endif
@@ -0,0 +1,161 @@
+#include "KernelChecks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "RenderTypes.h"
+#include "Culling.h"
+
+void add_random_bodies(OrbitSystem* systems, int systemCount, int bodies)
+{
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> speed(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> angle(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> distance(0.0f, 20.0f);
+	std::uniform_real_distribution<float> scale(0.01f, 2.0f);
+
+	for (int i = 0; i < bodies; i++)
+	{
+		float orbitSpeed = speed(random);
+		float rotationSpeed = speed(random);
+		float orbitDistance = distance(random);
+		float bodyScale = scale(random);
+		float orbitAngle = angle(random);
+		float rotationAngle = angle(random);
+
+		for (int j = 0; j < systemCount; j++)
+			systems[j].addBody(orbitSpeed, rotationSpeed, orbitDistance, bodyScale, orbitAngle, rotationAngle);
+	}
+}
+
+// check that the SIMD orbit kernels match the scalar fallback bit for bit
+bool check_orbit_kernels(int bodies, int steps)
+{
+	const SimdLevel levels[] = { SimdLevel::SCALAR, SimdLevel::SSE, SimdLevel::AVX2 };
+	const int levelCount = static_cast<int>(OrbitSystem::getBestSimdLevel()) + 1;
+
+	OrbitSystem systems[3];
+	std::vector<InstanceData> instances[3];
+	add_random_bodies(systems, levelCount, bodies);
+	for (int i = 0; i < levelCount; i++)
+		instances[i].resize(bodies);
+
+	// a parent with rotation, translation and non-uniform scale
+	glm::mat4 parent = glm::translate(glm::vec3(1.0f, -2.0f, 3.0f))
+		* glm::rotate(0.7f, glm::vec3(1.0f, 0.0f, 0.0f))
+		* glm::scale(glm::vec3(2.0f, 0.5f, 1.0f));
+
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> time(0.0f, 0.1f);
+	bool match = true;
+
+	for (int step = 0; step < steps && match; step++)
+	{
+		float elapsed = time(random);
+
+		for (int i = 0; i < levelCount; i++)
+		{
+			systems[i].advance(elapsed, levels[i]);
+			systems[i].computeTransforms(parent, instances[i].data(), elapsed * 0.5f, levels[i]);
+		}
+
+		for (int i = 1; i < levelCount; i++)
+		{
+			if (std::memcmp(instances[0].data(), instances[i].data(), sizeof(InstanceData) * bodies) != 0)
+			{
+				std::cout << "Orbit kernel " << OrbitSystem::getSimdLevelName(levels[i])
+					<< " differs from scalar at step " << step << std::endl;
+				match = false;
+			}
+		}
+	}
+
+	if (match)
+		std::cout << "Orbit kernels up to " << OrbitSystem::getSimdLevelName(levels[levelCount - 1])
+			<< " match scalar over " << steps << " steps" << std::endl;
+
+	return match;
+}
+
+// check that the SIMD culling kernels agree with the scalar one on every object
+bool check_cull_kernels(int bodies, int steps)
+{
+	const SimdLevel levels[] = { SimdLevel::SCALAR, SimdLevel::SSE, SimdLevel::AVX2 };
+	const int levelCount = static_cast<int>(OrbitSystem::getBestSimdLevel()) + 1;
+
+	OrbitSystem system;
+	add_random_bodies(&system, 1, bodies);
+	std::vector<InstanceData> instances(bodies);
+	std::vector<glm::mat4> matrices(bodies);
+
+	// a unit box like the placeholder model, off centre so the sphere centre moves with the matrix
+	MeshBounds bounds;
+	bounds.boxMin = glm::vec3(-0.5f, -0.25f, -0.5f);
+	bounds.boxMax = glm::vec3(0.5f, 0.75f, 0.5f);
+	bounds.sphereCenter = glm::vec3(0.0f, 0.25f, 0.0f);
+	bounds.sphereRadius = glm::length(glm::vec3(0.5f));
+
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> time(0.0f, 0.1f);
+	std::vector<unsigned char> visible[3];
+	for (int i = 0; i < levelCount; i++)
+		visible[i].resize(bodies);
+	bool match = true;
+
+	for (int step = 0; step < steps && match; step++)
+	{
+		system.advance(time(random));
+		system.computeTransforms(glm::mat4(1.0f), instances.data());
+		for (int i = 0; i < bodies; i++)
+			matrices[i] = instances[i].modelMatrix;
+
+		// a camera circling the bodies, about three quarters of them are in view
+		const float angle = 0.1f * step;
+		glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 1.25f, 0.1f, 100.0f)
+			* glm::lookAt(glm::vec3(15.0f * std::sin(angle), 5.0f, 15.0f * std::cos(angle)), glm::vec3(0.0f),
+				glm::vec3(0.0f, 1.0f, 0.0f));
+		Frustum frustum = extract_frustum(viewProjection);
+
+		// ranges starting and ending anywhere in a block, so every partial block size is seen at both ends
+		const int first = std::min(step % 11, bodies);
+		const int count = std::max(bodies - first - step % 13, 0);
+
+		// matrices inside the instances and packed one after another
+		const glm::mat4* arrays[] = { &instances[first].modelMatrix, &matrices[first] };
+		const std::size_t strides[] = { sizeof(InstanceData), sizeof(glm::mat4) };
+
+		for (int array = 0; array < 2; array++)
+		{
+			int visibleCounts[3];
+			for (int i = 0; i < levelCount; i++)
+			{
+				std::fill(visible[i].begin(), visible[i].end(), static_cast<unsigned char>(2));
+				visibleCounts[i] = cull_spheres(frustum, bounds, arrays[array], strides[array], count, visible[i].data(),
+					levels[i]);
+			}
+
+			for (int i = 1; i < levelCount; i++)
+			{
+				if (visibleCounts[i] != visibleCounts[0] || visible[i] != visible[0])
+				{
+					std::cout << "Culling kernel " << OrbitSystem::getSimdLevelName(levels[i]) << " differs from scalar at step "
+						<< step << " with stride " << strides[array] << std::endl;
+					match = false;
+				}
+			}
+		}
+	}
+
+	if (match)
+		std::cout << "Culling kernels up to " << OrbitSystem::getSimdLevelName(levels[levelCount - 1])
+			<< " match scalar over " << steps << " steps" << std::endl;
+
+	return match;
+}
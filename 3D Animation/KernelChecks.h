@@ -0,0 +1,21 @@
+#ifndef KERNEL_CHECKS_H
+#define KERNEL_CHECKS_H
+
+#include "OrbitSystem.h"
+
+/*****************************************************************
+ * checks of the SIMD kernels against their scalar fallbacks, run
+ * by the benchmarks before timing them and by the tests of the
+ * CMake build, every instruction set the CPU has is checked
+ *****************************************************************/
+
+// add the same random bodies to each of systemCount orbit systems
+void add_random_bodies(OrbitSystem* systems, int systemCount, int bodies);
+
+// check that the SIMD orbit kernels match the scalar fallback bit for bit, returns true if they do
+bool check_orbit_kernels(int bodies = 1003, int steps = 100);
+// check that the SIMD culling kernels agree with the scalar one on every object and on the visible count, over
+// matrices in an array of instances and in a packed array, returns true if they do
+bool check_cull_kernels(int bodies = 1003, int steps = 100);
+
+#endif
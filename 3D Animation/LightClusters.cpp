@@ -0,0 +1,276 @@
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "GLState.h"
+#include "Trace.h"
+
+// lights bounded per job
+static const int LIGHT_GRAIN_SIZE = 128;
+
+float get_light_range(const Light& light)
+{
+	const float brightest = std::max(std::max(std::max(light.Ld.x, light.Ld.y), std::max(light.Ld.z, light.Ls.x)),
+		std::max(light.Ls.y, light.Ls.z));
+
+	// attenuation 1 / (c + l d + q d^2) falls to the cutoff where c + l d + q d^2 = brightest / cutoff
+	const float target = brightest / CLUSTER_LIGHT_CUTOFF - light.att.x;
+	if (target <= 0.0f)
+		return 0.0f;
+
+	if (light.att.z > 0.0f)
+		return (std::sqrt(light.att.y * light.att.y + 4.0f * light.att.z * target) - light.att.y) / (2.0f * light.att.z);
+	if (light.att.y > 0.0f)
+		return target / light.att.y;
+
+	return HUGE_VALF;
+}
+
+// tile of a normalised device coordinate, clamped to the grid
+static int get_tile(float ndc, int tiles)
+{
+	return std::min(std::max(static_cast<int>(std::floor((ndc * 0.5f + 0.5f) * tiles)), 0), tiles - 1);
+}
+
+// distance from a value to a range, 0 inside it
+static float get_range_distance(float value, float low, float high)
+{
+	return std::max(std::max(low - value, value - high), 0.0f);
+}
+
+// upload to a buffer backing a buffer texture, orphaning the storage used by the last frame
+// buffer textures need storage behind them, an empty upload keeps a few bytes
+static void upload_texture_buffer(GLuint buffer, const void* data, GLsizeiptr size)
+{
+	GLState::bindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, std::max(size, GLsizeiptr(16)), nullptr, GL_STREAM_DRAW);
+	if (size > 0)
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+}
+
+LightClusters::~LightClusters()
+{
+	release();
+}
+
+void LightClusters::create()
+{
+	release();
+
+	const GLenum formats[NUM_BUFFERS] = { GL_RG32UI, GL_R16UI, GL_RGBA32F };
+
+	glGenBuffers(NUM_BUFFERS, mBuffers);
+	glGenTextures(NUM_BUFFERS, mTextures);
+
+	for (int i = 0; i < NUM_BUFFERS; i++)
+	{
+		upload_texture_buffer(mBuffers[i], nullptr, 0);
+		glBindTexture(GL_TEXTURE_BUFFER, mTextures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], mBuffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	mBlock.create(sizeof(ClusterBlock));
+}
+
+void LightClusters::release()
+{
+	if (mTextures[0] != 0)
+		glDeleteTextures(NUM_BUFFERS, mTextures);
+
+	if (mBuffers[0] != 0)
+	{
+		for (GLuint buffer : mBuffers)
+			GLState::onBufferDeleted(buffer);
+		glDeleteBuffers(NUM_BUFFERS, mBuffers);
+	}
+
+	std::fill(mTextures, mTextures + NUM_BUFFERS, 0u);
+	std::fill(mBuffers, mBuffers + NUM_BUFFERS, 0u);
+}
+
+int LightClusters::getSlice(float depth) const
+{
+	int slice = static_cast<int>(std::floor(std::log(depth) * mSliceScale + mSliceBias));
+	return std::min(std::max(slice, 0), CLUSTER_SLICES - 1);
+}
+
+void LightClusters::build(const std::vector<Light>& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+	float nearPlane, float farPlane, JobSystem& jobs)
+{
+	TRACE_SCOPE("bin lights");
+
+	mLightCount = std::min(static_cast<int>(lights.size()), MAX_CLUSTER_LIGHTS);
+	mNear = nearPlane;
+	mFar = farPlane;
+	mSliceScale = CLUSTER_SLICES / std::log(farPlane / nearPlane);
+	mSliceBias = -std::log(nearPlane) * mSliceScale;
+	mProjectionScale = glm::vec2(projectionMatrix[0][0], projectionMatrix[1][1]);
+
+	mBounds.resize(mLightCount);
+	mLightData.resize(mLightCount * CLUSTER_LIGHT_TEXELS);
+
+	jobs.parallelFor(mLightCount, LIGHT_GRAIN_SIZE, [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+			prepareLight(lights[i], viewMatrix, i);
+	});
+
+	jobs.parallelFor(CLUSTER_SLICES, 1, [this](int begin, int end) {
+		TRACE_SCOPE("bin light slice");
+		for (int slice = begin; slice < end; slice++)
+			binSlice(slice);
+	});
+
+	// the cluster lists follow each other in the index buffer
+	mIndices.clear();
+	mMaxClusterLights = 0;
+
+	for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+	{
+		const std::vector<std::uint16_t>& list = mClusterLights[cluster];
+
+		mGrid[2 * cluster] = static_cast<std::uint32_t>(mIndices.size());
+		mGrid[2 * cluster + 1] = static_cast<std::uint32_t>(list.size());
+		mIndices.insert(mIndices.end(), list.begin(), list.end());
+		mMaxClusterLights = std::max(mMaxClusterLights, static_cast<int>(list.size()));
+	}
+}
+
+// bound a light in view space and write its texels
+void LightClusters::prepareLight(const Light& light, const glm::mat4& viewMatrix, int index)
+{
+	// lights reaching past the far plane are cut there, they would otherwise cover every cluster
+	const float range = std::min(get_light_range(light), mFar);
+	const glm::vec3 center = glm::vec3(viewMatrix * glm::vec4(light.pos, 1.0f));
+
+	LightBounds& bounds = mBounds[index];
+	bounds.center = center;
+	bounds.radius = range;
+
+	// view depths the sphere covers within the frustum
+	const float nearDepth = std::max(-center.z - range, mNear);
+	const float farDepth = std::min(-center.z + range, mFar);
+
+	if (range <= 0.0f || nearDepth > farDepth)
+	{
+		bounds.minSlice = 1;
+		bounds.maxSlice = 0;
+	}
+	else
+	{
+		bounds.minSlice = getSlice(nearDepth);
+		bounds.maxSlice = getSlice(farDepth);
+
+		// x / depth over the box around the sphere is smallest and largest at its corners
+		const float minX = std::min((center.x - range) / nearDepth, (center.x - range) / farDepth) * mProjectionScale.x;
+		const float maxX = std::max((center.x + range) / nearDepth, (center.x + range) / farDepth) * mProjectionScale.x;
+		const float minY = std::min((center.y - range) / nearDepth, (center.y - range) / farDepth) * mProjectionScale.y;
+		const float maxY = std::max((center.y + range) / nearDepth, (center.y + range) / farDepth) * mProjectionScale.y;
+
+		bounds.minX = get_tile(minX, CLUSTER_TILES_X);
+		bounds.maxX = get_tile(maxX, CLUSTER_TILES_X);
+		bounds.minY = get_tile(minY, CLUSTER_TILES_Y);
+		bounds.maxY = get_tile(maxY, CLUSTER_TILES_Y);
+	}
+
+	// point lights have a cone wider than any angle, so the shader treats both types alike
+	const bool spot = light.type == SPOT_LIGHT;
+	glm::vec4* texels = &mLightData[index * CLUSTER_LIGHT_TEXELS];
+
+	texels[0] = glm::vec4(light.pos, range);
+	texels[1] = glm::vec4(spot ? glm::normalize(light.dir) : glm::vec3(0.0f, -1.0f, 0.0f),
+		spot ? std::cos(glm::radians(light.outerAngle)) : -2.0f);
+	texels[2] = glm::vec4(light.Ld, spot ? std::cos(glm::radians(light.innerAngle)) : -1.0f);
+	texels[3] = glm::vec4(light.Ls, 0.0f);
+	texels[4] = glm::vec4(light.att, 0.0f);
+}
+
+// fill the light lists of a slice's clusters
+void LightClusters::binSlice(int slice)
+{
+	std::vector<std::uint16_t>* clusters = &mClusterLights[slice * CLUSTER_TILES_X * CLUSTER_TILES_Y];
+	for (int i = 0; i < CLUSTER_TILES_X * CLUSTER_TILES_Y; i++)
+		clusters[i].clear();
+
+	// view depths the slice spans, the inverse of getSlice
+	const float sliceNear = std::exp((slice - mSliceBias) / mSliceScale);
+	const float sliceFar = std::exp((slice + 1 - mSliceBias) / mSliceScale);
+
+	// view space extent of each column and row of tiles over the slice's depths
+	float tileMinX[CLUSTER_TILES_X];
+	float tileMaxX[CLUSTER_TILES_X];
+	float tileMinY[CLUSTER_TILES_Y];
+	float tileMaxY[CLUSTER_TILES_Y];
+
+	for (int x = 0; x < CLUSTER_TILES_X; x++)
+	{
+		const float low = (2.0f * x / CLUSTER_TILES_X - 1.0f) / mProjectionScale.x;
+		const float high = (2.0f * (x + 1) / CLUSTER_TILES_X - 1.0f) / mProjectionScale.x;
+		tileMinX[x] = std::min(low * sliceNear, low * sliceFar);
+		tileMaxX[x] = std::max(high * sliceNear, high * sliceFar);
+	}
+
+	for (int y = 0; y < CLUSTER_TILES_Y; y++)
+	{
+		const float low = (2.0f * y / CLUSTER_TILES_Y - 1.0f) / mProjectionScale.y;
+		const float high = (2.0f * (y + 1) / CLUSTER_TILES_Y - 1.0f) / mProjectionScale.y;
+		tileMinY[y] = std::min(low * sliceNear, low * sliceFar);
+		tileMaxY[y] = std::max(high * sliceNear, high * sliceFar);
+	}
+
+	// lights are added in index order, so the lists come out the same on any number of workers
+	for (int i = 0; i < mLightCount; i++)
+	{
+		const LightBounds& bounds = mBounds[i];
+		if (slice < bounds.minSlice || slice > bounds.maxSlice)
+			continue;
+
+		const float radiusSquared = bounds.radius * bounds.radius;
+		const float dz = get_range_distance(-bounds.center.z, sliceNear, sliceFar);
+
+		for (int y = bounds.minY; y <= bounds.maxY; y++)
+		{
+			const float dy = get_range_distance(bounds.center.y, tileMinY[y], tileMaxY[y]);
+			const float distanceYZ = dy * dy + dz * dz;
+			if (distanceYZ > radiusSquared)
+				continue;
+
+			for (int x = bounds.minX; x <= bounds.maxX; x++)
+			{
+				const float dx = get_range_distance(bounds.center.x, tileMinX[x], tileMaxX[x]);
+				if (dx * dx + distanceYZ <= radiusSquared)
+					clusters[y * CLUSTER_TILES_X + x].push_back(static_cast<std::uint16_t>(i));
+			}
+		}
+	}
+}
+
+void LightClusters::upload(const glm::vec4& viewport)
+{
+	TRACE_SCOPE("upload light clusters");
+
+	ClusterBlock block = {};
+	block.viewport = viewport;
+	block.depth = glm::vec4(mNear, mFar, mSliceScale, mSliceBias);
+	block.grid = glm::ivec4(CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES, mLightCount);
+	mBlock.update(0, sizeof(block), &block);
+
+	upload_texture_buffer(mBuffers[GRID_BUFFER], mGrid.data(), sizeof(std::uint32_t) * mGrid.size());
+	upload_texture_buffer(mBuffers[INDEX_BUFFER], mIndices.data(), sizeof(std::uint16_t) * mIndices.size());
+	upload_texture_buffer(mBuffers[LIGHT_BUFFER], mLightData.data(), sizeof(glm::vec4) * mLightData.size());
+}
+
+void LightClusters::bind() const
+{
+	const GLint units[NUM_BUFFERS] = { CLUSTER_GRID_UNIT, CLUSTER_INDEX_UNIT, CLUSTER_LIGHT_UNIT };
+
+	for (int i = 0; i < NUM_BUFFERS; i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + units[i]);
+		glBindTexture(GL_TEXTURE_BUFFER, mTextures[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	mBlock.bindBase(CLUSTER_BLOCK_BINDING);
+}
@@ -0,0 +1,104 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <cstdint>
+#include <vector>
+
+#include <GLEW/glew.h>
+
+#include "utilities.h"
+#include "JobSystem.h"
+#include "UniformBuffer.h"
+
+// clusters split the view into tiles across the viewport and slices along the view depth, slices are spaced
+// exponentially so near clusters are about as deep as they are wide
+const int CLUSTER_TILES_X = 16;
+const int CLUSTER_TILES_Y = 9;
+const int CLUSTER_SLICES = 24;
+const int CLUSTER_COUNT = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+
+const int MAX_CLUSTER_LIGHTS = 1024;	// lights binned per frame, light indices are 16 bit
+const int CLUSTER_LIGHT_TEXELS = 5;		// RGBA32F texels per light in the light buffer, see CLUSTER_LIGHT_TEXELS in animation.frag
+
+// lights reach until their attenuation falls to this share of their brightest colour, the shader fades them
+// out toward that range so no light ends at a cluster border
+const float CLUSTER_LIGHT_CUTOFF = 0.05f;
+
+// distance at which a point or spot light falls to the cutoff, lights without attenuation reach any distance
+float get_light_range(const Light& light);
+
+/*****************************************************************
+ * clustered forward lighting
+ * point and spot lights are binned into the clusters their range
+ * touches, each fragment shades only the lights of its cluster so
+ * the cost follows the lights per pixel, not the lights in view
+ * lights are bounded and binned on the workers, a job owns whole
+ * slices so no two jobs write the same cluster
+ * the lists go to the shaders as buffer textures, GL 3.3 has no
+ * storage buffers: the grid holds an offset and count per
+ * cluster into the index buffer, which points into the light data
+ *****************************************************************/
+class LightClusters
+{
+public:
+	LightClusters() = default;
+	~LightClusters();
+
+	LightClusters(const LightClusters&) = delete;
+	LightClusters& operator=(const LightClusters&) = delete;
+
+	// create the buffers, their textures and the cluster block
+	void create();
+	void release();
+
+	// bin the lights into the clusters of a view, lights past MAX_CLUSTER_LIGHTS are left out
+	// every light is shaded as a point light unless its type is SPOT_LIGHT
+	void build(const std::vector<Light>& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+		float nearPlane, float farPlane, JobSystem& jobs);
+	// upload the lists of the last build, viewport is x, y, width and height in pixels
+	void upload(const glm::vec4& viewport);
+	// bind the buffer textures to their units and the cluster block to its binding point
+	void bind() const;
+
+	int getLightCount() const { return mLightCount; }
+	// light indices of all clusters and the most lights in one cluster, of the last build
+	int getIndexCount() const { return static_cast<int>(mIndices.size()); }
+	int getMaxClusterLights() const { return mMaxClusterLights; }
+
+private:
+	enum { GRID_BUFFER, INDEX_BUFFER, LIGHT_BUFFER, NUM_BUFFERS };
+
+	// view space sphere of a light and the clusters its box covers, minSlice > maxSlice if it is out of view
+	struct LightBounds
+	{
+		glm::vec3 center;
+		float radius;
+		int minX, maxX;
+		int minY, maxY;
+		int minSlice, maxSlice;
+	};
+
+	GLuint mBuffers[NUM_BUFFERS] = {};
+	GLuint mTextures[NUM_BUFFERS] = {};
+	UniformBuffer mBlock;
+
+	float mNear = 0.1f;
+	float mFar = 100.0f;
+	float mSliceScale = 0.0f;		// slice = log(depth) * mSliceScale + mSliceBias
+	float mSliceBias = 0.0f;
+	glm::vec2 mProjectionScale;		// x and y scale of the projection matrix
+
+	int mLightCount = 0;
+	int mMaxClusterLights = 0;
+	std::vector<LightBounds> mBounds;
+	std::vector<glm::vec4> mLightData;			// CLUSTER_LIGHT_TEXELS per light
+	std::vector<std::vector<std::uint16_t>> mClusterLights = std::vector<std::vector<std::uint16_t>>(CLUSTER_COUNT);
+	std::vector<std::uint32_t> mGrid = std::vector<std::uint32_t>(2 * CLUSTER_COUNT);	// offset and count of each cluster
+	std::vector<std::uint16_t> mIndices;
+
+	void prepareLight(const Light& light, const glm::mat4& viewMatrix, int index);
+	void binSlice(int slice);
+	int getSlice(float depth) const;
+};
+
+#endif
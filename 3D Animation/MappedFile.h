@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+/*****************************************************************
+ * read only view of a whole file mapped into memory
+ * the operating system pages the file in on first access, nothing
+ * is copied until the data is used
+ *****************************************************************/
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile();
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// map filename, returns false if it cannot be opened or is empty
+	bool open(const char* filename);
+	void close();
+
+	const unsigned char* getData() const { return mData; }
+	std::size_t getSize() const { return mSize; }
+
+private:
+	const unsigned char* mData = nullptr;
+	std::size_t mSize = 0;
+#ifdef _WIN32
+	void* mFile = nullptr;		// file and mapping handles
+	void* mMapping = nullptr;
+#endif
+};
+
+#endif
@@ -0,0 +1,389 @@
+#include "MeshArena.h"
+#include "MeshCache.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <cassert>
+
+// bytes each buffer of an arena starts with, they double whenever an allocation does not fit
+static const std::size_t INITIAL_ARENA_BYTES = 4 << 20;
+
+FreeListAllocator::FreeListAllocator(std::size_t capacity)
+{
+	grow(capacity);
+}
+
+std::size_t FreeListAllocator::allocate(std::size_t size, std::size_t alignment)
+{
+	if (size == 0)
+		return 0;
+
+	for (std::size_t i = 0; i < mFree.size(); i++)
+	{
+		const Range range = mFree[i];
+		const std::size_t offset = (range.offset + alignment - 1) / alignment * alignment;
+		if (offset + size > range.offset + range.size)
+			continue;
+
+		// the space before and after the allocation stays free
+		const std::size_t end = offset + size;
+		mFree.erase(mFree.begin() + i);
+		if (end < range.offset + range.size)
+			mFree.insert(mFree.begin() + i, { end, range.offset + range.size - end });
+		if (offset > range.offset)
+			mFree.insert(mFree.begin() + i, { range.offset, offset - range.offset });
+
+		mUsed += size;
+		return offset;
+	}
+
+	return INVALID_OFFSET;
+}
+
+void FreeListAllocator::free(std::size_t offset, std::size_t size)
+{
+	if (size == 0)
+		return;
+
+	assert(offset + size <= mCapacity && size <= mUsed);
+
+	mUsed -= size;
+	insertFree(offset, size);
+}
+
+void FreeListAllocator::grow(std::size_t capacity)
+{
+	if (capacity <= mCapacity)
+		return;
+
+	insertFree(mCapacity, capacity - mCapacity);
+	mCapacity = capacity;
+}
+
+// add a free range and merge it with the free ranges it touches
+void FreeListAllocator::insertFree(std::size_t offset, std::size_t size)
+{
+	auto next = std::lower_bound(mFree.begin(), mFree.end(), offset,
+		[](const Range& range, std::size_t value) { return range.offset < value; });
+
+	assert(next == mFree.end() || offset + size <= next->offset);
+	assert(next == mFree.begin() || (next - 1)->offset + (next - 1)->size <= offset);
+
+	if (next != mFree.begin() && (next - 1)->offset + (next - 1)->size == offset)
+	{
+		// extend the range before, and swallow the one after if the gap is closed
+		Range& previous = *(next - 1);
+		previous.size += size;
+
+		if (next != mFree.end() && previous.offset + previous.size == next->offset)
+		{
+			previous.size += next->size;
+			mFree.erase(next);
+		}
+	}
+	else if (next != mFree.end() && offset + size == next->offset)
+	{
+		next->offset = offset;
+		next->size += size;
+	}
+	else
+	{
+		mFree.insert(next, { offset, size });
+	}
+}
+
+// arenas live until the process exits, so models destroyed with the globals can still return their ranges
+static std::vector<MeshArena*>& get_arenas()
+{
+	static std::vector<MeshArena*>* arenas = new std::vector<MeshArena*>();
+	return *arenas;
+}
+
+MeshArena& MeshArena::get(VertexFormat format, GLenum indexType)
+{
+	for (MeshArena* arena : get_arenas())
+	{
+		if (arena->mVertexFormat == format && arena->mIndexType == indexType)
+			return *arena;
+	}
+
+	get_arenas().push_back(new MeshArena(format, indexType));
+	return *get_arenas().back();
+}
+
+void MeshArena::releaseAll()
+{
+	for (MeshArena* arena : get_arenas())
+		arena->release();
+}
+
+std::size_t MeshArena::getTotalCapacityBytes()
+{
+	std::size_t bytes = 0;
+	for (const MeshArena* arena : get_arenas())
+		bytes += arena->getCapacityBytes();
+	return bytes;
+}
+
+std::size_t MeshArena::getTotalUsedBytes()
+{
+	std::size_t bytes = 0;
+	for (const MeshArena* arena : get_arenas())
+		bytes += arena->getUsedBytes();
+	return bytes;
+}
+
+MeshArena::MeshArena(VertexFormat format, GLenum indexType) : mVertexFormat(format), mIndexType(indexType)
+{}
+
+MeshArena::~MeshArena()
+{
+	release();
+}
+
+std::size_t MeshArena::getVertexSize() const
+{
+	return get_vertex_size(mVertexFormat);
+}
+
+std::size_t MeshArena::getIndexSize() const
+{
+	return mIndexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+std::size_t MeshArena::getCapacityBytes() const
+{
+	return mVertices.getCapacity() * getVertexSize() + mIndices.getCapacity() * getIndexSize();
+}
+
+std::size_t MeshArena::getUsedBytes() const
+{
+	return mVertices.getUsed() * getVertexSize() + mIndices.getUsed() * getIndexSize();
+}
+
+MeshAllocation MeshArena::allocate(std::size_t vertexCount, std::size_t indexCount)
+{
+	MeshAllocation allocation;
+	allocation.vertexCount = vertexCount;
+	allocation.indexCount = indexCount;
+
+	// double until the range fits at the end, the free space of a grown buffer joins its last free range
+	allocation.firstVertex = mVertices.allocate(vertexCount);
+	while (allocation.firstVertex == FreeListAllocator::INVALID_OFFSET)
+	{
+		std::size_t capacity = std::max(mVertices.getCapacity() * 2, INITIAL_ARENA_BYTES / getVertexSize());
+		growBuffer(mVertexBuffer, mVertices.getCapacity() * getVertexSize(), capacity * getVertexSize());
+		mVertices.grow(capacity);
+		allocation.firstVertex = mVertices.allocate(vertexCount);
+	}
+
+	allocation.firstIndex = mIndices.allocate(indexCount);
+	while (allocation.firstIndex == FreeListAllocator::INVALID_OFFSET)
+	{
+		std::size_t capacity = std::max(mIndices.getCapacity() * 2, INITIAL_ARENA_BYTES / getIndexSize());
+		growBuffer(mIndexBuffer, mIndices.getCapacity() * getIndexSize(), capacity * getIndexSize());
+		mIndices.grow(capacity);
+		allocation.firstIndex = mIndices.allocate(indexCount);
+	}
+
+	return allocation;
+}
+
+void MeshArena::free(const MeshAllocation& allocation)
+{
+	mVertices.free(allocation.firstVertex, allocation.vertexCount);
+	mIndices.free(allocation.firstIndex, allocation.indexCount);
+}
+
+void MeshArena::writeVertices(const MeshAllocation& allocation, std::size_t byteOffset, std::size_t size, const void* data)
+{
+	assert(byteOffset + size <= allocation.vertexCount * getVertexSize());
+
+	GLState::bindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, allocation.firstVertex * getVertexSize() + byteOffset, size, data);
+}
+
+void MeshArena::writeIndices(const MeshAllocation& allocation, std::size_t byteOffset, std::size_t size, const void* data)
+{
+	assert(byteOffset + size <= allocation.indexCount * getIndexSize());
+
+	// binding the index buffer would change whichever VAO is bound
+	GLState::bindVertexArray(0);
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, allocation.firstIndex * getIndexSize() + byteOffset, size, data);
+}
+
+GLuint MeshArena::getVertexArray()
+{
+	if (mVertexArray == 0)
+	{
+		glGenVertexArrays(1, &mVertexArray);
+		GLState::bindVertexArray(mVertexArray);
+		setVertexAttributes();
+	}
+
+	return mVertexArray;
+}
+
+GLuint MeshArena::getInstancedVertexArray(GLuint instanceBuffer, GLintptr instanceOffset)
+{
+	// the instanced VAO shares the arena buffers and adds the per instance attributes
+	if (mInstancedVertexArray == 0)
+	{
+		glGenVertexArrays(1, &mInstancedVertexArray);
+		GLState::bindVertexArray(mInstancedVertexArray);
+		setVertexAttributes();
+		mInstanceBuffer = 0;
+		mInstanceOffset = -1;
+	}
+
+	GLState::bindVertexArray(mInstancedVertexArray);
+
+	// only respecify the instance attributes when they point somewhere else
+	if (mInstanceBuffer != instanceBuffer || mInstanceOffset != instanceOffset)
+		setInstanceAttributes(instanceBuffer, instanceOffset);
+
+	return mInstancedVertexArray;
+}
+
+// delete the GL objects, the allocations stay as they are
+void MeshArena::release()
+{
+	if (mVertexArray != 0)
+	{
+		glDeleteVertexArrays(1, &mVertexArray);
+		GLState::onVertexArrayDeleted(mVertexArray);
+		mVertexArray = 0;
+	}
+	if (mInstancedVertexArray != 0)
+	{
+		glDeleteVertexArrays(1, &mInstancedVertexArray);
+		GLState::onVertexArrayDeleted(mInstancedVertexArray);
+		mInstancedVertexArray = 0;
+	}
+	if (mVertexBuffer != 0)
+	{
+		glDeleteBuffers(1, &mVertexBuffer);
+		GLState::onBufferDeleted(mVertexBuffer);
+		mVertexBuffer = 0;
+	}
+	if (mIndexBuffer != 0)
+	{
+		glDeleteBuffers(1, &mIndexBuffer);
+		GLState::onBufferDeleted(mIndexBuffer);
+		mIndexBuffer = 0;
+	}
+}
+
+// replace buffer by a larger one holding the same first oldBytes, the vertex arrays are rebuilt on next use
+void MeshArena::growBuffer(GLuint& buffer, std::size_t oldBytes, std::size_t newBytes)
+{
+	GLuint grown = 0;
+	glGenBuffers(1, &grown);
+
+	// the copy targets belong to no VAO, so index buffers can be bound there without unbinding one
+	GLState::bindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+
+	if (buffer != 0)
+	{
+		GLState::bindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+
+		glDeleteBuffers(1, &buffer);
+		GLState::onBufferDeleted(buffer);
+	}
+
+	buffer = grown;
+
+	// the vertex arrays still point at the old buffer
+	if (mVertexArray != 0)
+	{
+		glDeleteVertexArrays(1, &mVertexArray);
+		GLState::onVertexArrayDeleted(mVertexArray);
+		mVertexArray = 0;
+	}
+	if (mInstancedVertexArray != 0)
+	{
+		glDeleteVertexArrays(1, &mInstancedVertexArray);
+		GLState::onVertexArrayDeleted(mInstancedVertexArray);
+		mInstancedVertexArray = 0;
+	}
+}
+
+// point the per vertex attributes of the bound VAO at the arena buffers
+void MeshArena::setVertexAttributes() const
+{
+	GLState::bindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+
+	switch (mVertexFormat)
+	{
+	case VertexFormat::NORM_TEX:
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormTex), reinterpret_cast<void*>(offsetof(VertexNormTex, position)));
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormTex), reinterpret_cast<void*>(offsetof(VertexNormTex, normal)));
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexNormTex), reinterpret_cast<void*>(offsetof(VertexNormTex, texCoord)));
+		glEnableVertexAttribArray(2);
+		break;
+
+	// positions read as fractions of the mesh bounds and normals as the two octahedral components,
+	// the shaders decode both
+	case VertexFormat::PACKED:
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(VertexPacked), reinterpret_cast<void*>(offsetof(VertexPacked, position)));
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(VertexPacked), reinterpret_cast<void*>(offsetof(VertexPacked, normal)));
+		break;
+
+	case VertexFormat::PACKED_TEX:
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(VertexPackedTex), reinterpret_cast<void*>(offsetof(VertexPackedTex, position)));
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(VertexPackedTex), reinterpret_cast<void*>(offsetof(VertexPackedTex, normal)));
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(VertexPackedTex), reinterpret_cast<void*>(offsetof(VertexPackedTex, texCoord)));
+		glEnableVertexAttribArray(2);
+		break;
+
+	default:
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormal), reinterpret_cast<void*>(offsetof(VertexNormal, position)));
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormal), reinterpret_cast<void*>(offsetof(VertexNormal, normal)));
+		break;
+	}
+
+	// enable vertex attributes
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+}
+
+// point the per instance attributes of the bound VAO at an InstanceData array
+void MeshArena::setInstanceAttributes(GLuint instanceBuffer, GLintptr offset)
+{
+	GLState::bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+	// model matrix, one attribute per column
+	for (GLuint i = 0; i < 4; i++)
+	{
+		GLuint location = INSTANCE_MODEL_MATRIX_LOCATION + i;
+		GLintptr columnOffset = offset + offsetof(InstanceData, modelMatrix) + i * sizeof(glm::vec4);
+
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), reinterpret_cast<void*>(columnOffset));
+		glVertexAttribDivisor(location, 1);
+		glEnableVertexAttribArray(location);
+	}
+
+	// normal matrix, columns are padded to vec4
+	for (GLuint i = 0; i < 3; i++)
+	{
+		GLuint location = INSTANCE_NORMAL_MATRIX_LOCATION + i;
+		GLintptr columnOffset = offset + offsetof(InstanceData, normalMatrix) + i * sizeof(glm::vec4);
+
+		glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), reinterpret_cast<void*>(columnOffset));
+		glVertexAttribDivisor(location, 1);
+		glEnableVertexAttribArray(location);
+	}
+
+	// material index, read as an integer
+	GLintptr materialOffset = offset + offsetof(InstanceData, materialIndex);
+	glVertexAttribIPointer(INSTANCE_MATERIAL_LOCATION, 1, GL_INT, sizeof(InstanceData), reinterpret_cast<void*>(materialOffset));
+	glVertexAttribDivisor(INSTANCE_MATERIAL_LOCATION, 1);
+	glEnableVertexAttribArray(INSTANCE_MATERIAL_LOCATION);
+
+	mInstanceBuffer = instanceBuffer;
+	mInstanceOffset = offset;
+}
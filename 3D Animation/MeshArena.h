@@ -0,0 +1,133 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+#include "utilities.h"
+
+/*****************************************************************
+ * first fit allocator of ranges within a linear space, it only
+ * does the bookkeeping, the space itself lives elsewhere
+ * free ranges are kept sorted by offset and merged with their
+ * neighbours, so freeing everything leaves a single range
+ *****************************************************************/
+class FreeListAllocator
+{
+public:
+	static const std::size_t INVALID_OFFSET = static_cast<std::size_t>(-1);
+
+	explicit FreeListAllocator(std::size_t capacity = 0);
+
+	// offset of size units at a multiple of alignment, INVALID_OFFSET if no free range is large enough
+	std::size_t allocate(std::size_t size, std::size_t alignment = 1);
+	// return a range given out by allocate, with the size it was allocated with
+	void free(std::size_t offset, std::size_t size);
+	// add free space at the end
+	void grow(std::size_t capacity);
+
+	std::size_t getCapacity() const { return mCapacity; }
+	std::size_t getUsed() const { return mUsed; }
+	int getFreeRangeCount() const { return static_cast<int>(mFree.size()); }
+
+private:
+	struct Range
+	{
+		std::size_t offset;
+		std::size_t size;
+	};
+
+	std::vector<Range> mFree;	// sorted by offset, never adjacent
+	std::size_t mCapacity = 0;
+	std::size_t mUsed = 0;
+
+	void insertFree(std::size_t offset, std::size_t size);
+};
+
+// where a mesh lives within its arena
+struct MeshAllocation
+{
+	std::size_t firstVertex = 0;	// in vertices, the base vertex of draws
+	std::size_t vertexCount = 0;
+	std::size_t firstIndex = 0;		// in indices of the arena's index type
+	std::size_t indexCount = 0;
+};
+
+// command of glMultiDrawElementsIndirect, laid out as GL reads it
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/*****************************************************************
+ * shared vertex and index buffers of every mesh with one vertex
+ * format and index type, meshes are suballocated from them so all
+ * of them draw from the same vertex array with base vertex draws
+ * and can be drawn together with one multi draw call
+ * the buffers grow by copying on the GPU when they run out, the
+ * allocations keep their offsets
+ * GL thread only
+ *****************************************************************/
+class MeshArena
+{
+public:
+	// arena of a vertex format and index type, created on first use
+	static MeshArena& get(VertexFormat format, GLenum indexType);
+	// delete the buffers and vertex arrays of every arena, call before the GL context goes away
+	static void releaseAll();
+	// totals over all arenas, for the stats
+	static std::size_t getTotalCapacityBytes();
+	static std::size_t getTotalUsedBytes();
+
+	MeshArena(VertexFormat format, GLenum indexType);
+	~MeshArena();
+
+	MeshArena(const MeshArena&) = delete;
+	MeshArena& operator=(const MeshArena&) = delete;
+
+	// reserve room for a mesh, growing the buffers if needed
+	MeshAllocation allocate(std::size_t vertexCount, std::size_t indexCount);
+	void free(const MeshAllocation& allocation);
+
+	// copy vertices or indices into an allocation, starting byteOffset bytes into its vertices or indices
+	void writeVertices(const MeshAllocation& allocation, std::size_t byteOffset, std::size_t size, const void* data);
+	void writeIndices(const MeshAllocation& allocation, std::size_t byteOffset, std::size_t size, const void* data);
+
+	// vertex array reading the arena's buffers
+	GLuint getVertexArray();
+	// the same with the per instance attributes pointing at an array of InstanceData in instanceBuffer
+	// starting at byte offset instanceOffset
+	GLuint getInstancedVertexArray(GLuint instanceBuffer, GLintptr instanceOffset);
+
+	VertexFormat getVertexFormat() const { return mVertexFormat; }
+	GLenum getIndexType() const { return mIndexType; }
+	std::size_t getVertexSize() const;
+	std::size_t getIndexSize() const;
+	std::size_t getCapacityBytes() const;
+	std::size_t getUsedBytes() const;
+
+private:
+	VertexFormat mVertexFormat;
+	GLenum mIndexType;
+
+	GLuint mVertexBuffer = 0;
+	GLuint mIndexBuffer = 0;
+	FreeListAllocator mVertices;	// in vertices
+	FreeListAllocator mIndices;		// in indices
+
+	GLuint mVertexArray = 0;
+	GLuint mInstancedVertexArray = 0;
+	GLuint mInstanceBuffer = 0;			// buffer the instance attributes point at
+	GLintptr mInstanceOffset = -1;		// byte offset of the first instance
+
+	void release();
+	void growBuffer(GLuint& buffer, std::size_t oldBytes, std::size_t newBytes);
+	void setVertexAttributes() const;
+	void setInstanceAttributes(GLuint instanceBuffer, GLintptr offset);
+};
+
+#endif
@@ -0,0 +1,430 @@
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <assimp/Importer.hpp>      // C++ importer interface
+#include <assimp/scene.h>           // output data structure
+#include <assimp/postprocess.h>     // post processing flags
+
+// transform_vertices reads assimp's vertex arrays as xyz triples
+static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "aiVector3D is not three floats");
+
+// bump whenever the header, the vertex layouts or the import flags change so old caches are rebuilt
+static const std::uint32_t MESH_CACHE_VERSION = 6;
+static const char MESH_CACHE_MAGIC[4] = { 'M', 'E', 'S', 'H' };
+
+// alignment of the blobs within the cache file, the mapping itself starts on a page boundary
+static const std::uint64_t MESH_CACHE_ALIGNMENT = 16;
+
+// level of detail as stored in the cache
+struct MeshCacheLod
+{
+	std::uint32_t firstIndex;
+	std::uint32_t indexCount;
+	float error;
+};
+
+// start of every cache file, stored in native byte order
+struct MeshCacheHeader
+{
+	char magic[4];
+	std::uint32_t version;
+	std::uint64_t sourceHash;		// hash of the model file the cache was built from
+	std::uint32_t vertexFormat;		// VertexFormat
+	std::uint32_t vertexSize;		// bytes per vertex
+	std::uint32_t vertexCount;
+	std::uint32_t indexSize;		// bytes per index, 2 or 4
+	std::uint32_t indexCount;
+	std::uint32_t hasTexCoords;
+	float positionOffset[3];		// decode of packed positions
+	float positionScale[3];
+	std::uint32_t lodCount;			// 0 if the whole index buffer is the only level
+	MeshCacheLod lods[MAX_MESH_LODS];
+	float boxMin[3];				// bounds in model space
+	float boxMax[3];
+	float sphereCenter[3];
+	float sphereRadius;
+	std::uint32_t padding;			// written as zero so the offsets below are 8 byte aligned
+	std::uint64_t vertexOffset;		// byte offsets of the blobs from the start of the file
+	std::uint64_t indexOffset;
+};
+
+static std::uint64_t align_offset(std::uint64_t offset)
+{
+	return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+}
+
+std::string get_mesh_cache_path(const char* filename)
+{
+	return std::string(filename) + ".meshcache";
+}
+
+void compute_mesh_bounds(MeshData& data)
+{
+	data.bounds = MeshBounds();
+	if (data.vertexCount == 0)
+		return;
+
+	// both float formats start with the position
+	const unsigned char* vertices = static_cast<const unsigned char*>(data.vertices);
+	const std::size_t vertexSize = data.getVertexSize();
+
+	auto get_position = [&](int i) {
+		glm::vec3 position;
+		std::memcpy(&position, vertices + i * vertexSize, sizeof(position));
+		return position;
+	};
+
+	glm::vec3 boxMin = get_position(0);
+	glm::vec3 boxMax = boxMin;
+	for (int i = 1; i < data.vertexCount; i++)
+	{
+		glm::vec3 position = get_position(i);
+		boxMin = glm::min(boxMin, position);
+		boxMax = glm::max(boxMax, position);
+	}
+
+	glm::vec3 center = (boxMin + boxMax) * 0.5f;
+	float radiusSquared = 0.0f;
+	for (int i = 0; i < data.vertexCount; i++)
+	{
+		glm::vec3 offset = get_position(i) - center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+
+	data.bounds.boxMin = boxMin;
+	data.bounds.boxMax = boxMax;
+	data.bounds.sphereCenter = center;
+	data.bounds.sphereRadius = std::sqrt(radiusSquared);
+}
+
+bool hash_file(const char* filename, std::uint64_t& hash)
+{
+	MappedFile file;
+	if (!file.open(filename))
+		return false;
+
+	const unsigned char* data = file.getData();
+	const std::size_t size = file.getSize();
+
+	hash = 14695981039346656037ull;
+	for (std::size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+
+	return true;
+}
+
+// point data at the blobs of a cache file, false if the file is missing, stale or damaged
+static bool read_mesh_cache(const std::string& cachePath, std::uint64_t sourceHash, VertexFormat format, MeshData& data)
+{
+	MappedFile mapping;
+	if (!mapping.open(cachePath.c_str()) || mapping.getSize() < sizeof(MeshCacheHeader))
+		return false;
+
+	MeshCacheHeader header;
+	std::memcpy(&header, mapping.getData(), sizeof(header));
+
+	if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+		header.version != MESH_CACHE_VERSION ||
+		header.sourceHash != sourceHash ||
+		header.vertexFormat != static_cast<std::uint32_t>(format) ||
+		header.vertexSize != get_vertex_size(format) ||
+		(header.indexSize != sizeof(GLushort) && header.indexSize != sizeof(GLuint)) ||
+		header.lodCount > MAX_MESH_LODS)
+		return false;
+
+	for (std::uint32_t i = 0; i < header.lodCount; i++)
+	{
+		const MeshCacheLod& lod = header.lods[i];
+		if (static_cast<std::uint64_t>(lod.firstIndex) + lod.indexCount > header.indexCount)
+			return false;
+	}
+
+	// the blobs must lie within the file and be aligned for their element types
+	const std::uint64_t vertexBytes = static_cast<std::uint64_t>(header.vertexCount) * header.vertexSize;
+	const std::uint64_t indexBytes = static_cast<std::uint64_t>(header.indexCount) * header.indexSize;
+
+	if (header.vertexOffset % MESH_CACHE_ALIGNMENT != 0 || header.indexOffset % MESH_CACHE_ALIGNMENT != 0 ||
+		header.vertexOffset < sizeof(MeshCacheHeader) || header.vertexOffset + vertexBytes > header.indexOffset ||
+		header.indexOffset + indexBytes > mapping.getSize())
+		return false;
+
+	data.vertices = mapping.getData() + header.vertexOffset;
+	data.indices = mapping.getData() + header.indexOffset;
+	data.vertexCount = static_cast<int>(header.vertexCount);
+	data.indexCount = static_cast<int>(header.indexCount);
+	data.vertexFormat = format;
+	data.indexType = header.indexSize == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	data.hasTexCoords = header.hasTexCoords != 0;
+	data.positionOffset = glm::vec3(header.positionOffset[0], header.positionOffset[1], header.positionOffset[2]);
+	data.positionScale = glm::vec3(header.positionScale[0], header.positionScale[1], header.positionScale[2]);
+	data.lods.resize(header.lodCount);
+	for (std::uint32_t i = 0; i < header.lodCount; i++)
+	{
+		data.lods[i].firstIndex = static_cast<int>(header.lods[i].firstIndex);
+		data.lods[i].indexCount = static_cast<int>(header.lods[i].indexCount);
+		data.lods[i].error = header.lods[i].error;
+	}
+	data.bounds.boxMin = glm::vec3(header.boxMin[0], header.boxMin[1], header.boxMin[2]);
+	data.bounds.boxMax = glm::vec3(header.boxMax[0], header.boxMax[1], header.boxMax[2]);
+	data.bounds.sphereCenter = glm::vec3(header.sphereCenter[0], header.sphereCenter[1], header.sphereCenter[2]);
+	data.bounds.sphereRadius = header.sphereRadius;
+	data.fromCache = true;
+	data.mapping = std::move(mapping);
+
+	return true;
+}
+
+static void write_padding(std::ofstream& file, std::uint64_t bytes)
+{
+	static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+	file.write(zeros, static_cast<std::streamsize>(bytes));
+}
+
+// write data to a cache file, through a temporary file so a crash never leaves half a cache behind
+static bool write_mesh_cache(const std::string& cachePath, std::uint64_t sourceHash, const MeshData& data)
+{
+	const std::uint64_t vertexBytes = static_cast<std::uint64_t>(data.vertexCount) * data.getVertexSize();
+	const std::uint64_t indexBytes = static_cast<std::uint64_t>(data.indexCount) * data.getIndexSize();
+
+	MeshCacheHeader header = {};
+	std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	header.version = MESH_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.vertexFormat = static_cast<std::uint32_t>(data.vertexFormat);
+	header.vertexSize = static_cast<std::uint32_t>(data.getVertexSize());
+	header.vertexCount = static_cast<std::uint32_t>(data.vertexCount);
+	header.indexSize = static_cast<std::uint32_t>(data.getIndexSize());
+	header.indexCount = static_cast<std::uint32_t>(data.indexCount);
+	header.hasTexCoords = data.hasTexCoords ? 1 : 0;
+	for (int k = 0; k < 3; k++)
+	{
+		header.positionOffset[k] = data.positionOffset[k];
+		header.positionScale[k] = data.positionScale[k];
+	}
+	header.lodCount = static_cast<std::uint32_t>(std::min(data.lods.size(), static_cast<std::size_t>(MAX_MESH_LODS)));
+	for (std::uint32_t i = 0; i < header.lodCount; i++)
+	{
+		header.lods[i].firstIndex = static_cast<std::uint32_t>(data.lods[i].firstIndex);
+		header.lods[i].indexCount = static_cast<std::uint32_t>(data.lods[i].indexCount);
+		header.lods[i].error = data.lods[i].error;
+	}
+	for (int k = 0; k < 3; k++)
+	{
+		header.boxMin[k] = data.bounds.boxMin[k];
+		header.boxMax[k] = data.bounds.boxMax[k];
+		header.sphereCenter[k] = data.bounds.sphereCenter[k];
+	}
+	header.sphereRadius = data.bounds.sphereRadius;
+	header.vertexOffset = align_offset(sizeof(MeshCacheHeader));
+	header.indexOffset = align_offset(header.vertexOffset + vertexBytes);
+
+	const std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		write_padding(file, header.vertexOffset - sizeof(header));
+		file.write(static_cast<const char*>(data.vertices), static_cast<std::streamsize>(vertexBytes));
+		write_padding(file, header.indexOffset - header.vertexOffset - vertexBytes);
+		file.write(static_cast<const char*>(data.indices), static_cast<std::streamsize>(indexBytes));
+
+		if (!file.flush())
+		{
+			file.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	// rename does not replace an existing file everywhere
+	std::remove(cachePath.c_str());
+	if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+	{
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+// one mesh of a scene placed by a node that uses it
+struct MeshInstance
+{
+	const aiMesh* mesh;
+	glm::mat4 transform;	// node to scene root
+};
+
+// the meshes of node and its children with the transforms that place them, meshes missing positions,
+// normals or faces are left out
+static void collect_mesh_instances(const aiScene* scene, const aiNode* node, const glm::mat4& parent,
+	std::vector<MeshInstance>& instances)
+{
+	// assimp matrices are row major
+	glm::mat4 local;
+	for (int row = 0; row < 4; row++)
+	{
+		for (int column = 0; column < 4; column++)
+			local[column][row] = node->mTransformation[row][column];
+	}
+
+	const glm::mat4 transform = parent * local;
+
+	for (unsigned int i = 0; i < node->mNumMeshes; i++)
+	{
+		const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+		if (mesh->HasPositions() && mesh->HasNormals() && mesh->HasFaces())
+			instances.push_back({ mesh, transform });
+	}
+
+	for (unsigned int i = 0; i < node->mNumChildren; i++)
+		collect_mesh_instances(scene, node->mChildren[i], transform, instances);
+}
+
+bool import_mesh(const char* filename, VertexFormat format, MeshData& data, bool optimize)
+{
+	// Create an instance of the Importer class
+	Assimp::Importer importer;
+
+	// load model file with assimp
+	const aiScene* scene = importer.ReadFile(filename,
+		aiProcess_Triangulate |
+		aiProcess_GenSmoothNormals |
+		aiProcess_JoinIdenticalVertices);
+
+	// check whether scene was loaded
+	if (!scene || !scene->mRootNode)
+		return false;
+
+	// every mesh is merged in as often as nodes use it, in the space of the root node
+	std::vector<MeshInstance> instances;
+	collect_mesh_instances(scene, scene->mRootNode, glm::mat4(1.0f), instances);
+
+	// meshes are built with float vertices and 32 bit indices and packed at the end
+	const bool texture = is_textured(format);
+	data.vertexFormat = texture ? VertexFormat::NORM_TEX : VertexFormat::NORMAL;
+
+	// a model without positions, normals or faces is returned empty
+	if (instances.empty())
+		return true;
+
+	// texture coordinates (i.e. index 0) if any mesh has them, the others get zeros
+	std::size_t vertexCount = 0;
+	std::size_t indexCount = 0;
+	for (const MeshInstance& instance : instances)
+	{
+		data.hasTexCoords = data.hasTexCoords || (texture && instance.mesh->HasTextureCoords(0));
+		vertexCount += instance.mesh->mNumVertices;
+
+		// lines and points left over from the triangulation are not drawn
+		for (unsigned int i = 0; i < instance.mesh->mNumFaces; i++)
+		{
+			if (instance.mesh->mFaces[i].mNumIndices == 3)
+				indexCount += 3;
+		}
+	}
+
+	// get vertex and face data, counted first for a single allocation each
+	data.vertexCount = static_cast<int>(vertexCount);
+	data.vertexStorage.resize(vertexCount * data.getVertexSize());
+	data.indexStorage.resize(indexCount * sizeof(GLuint));
+
+	unsigned char* vertex = data.vertexStorage.data();
+	GLuint* indices = reinterpret_cast<GLuint*>(data.indexStorage.data());
+	GLuint baseVertex = 0;
+
+	for (const MeshInstance& instance : instances)
+	{
+		const aiMesh* mesh = instance.mesh;
+		transform_vertices(instance.transform, &mesh->mVertices[0].x, &mesh->mNormals[0].x,
+			static_cast<int>(mesh->mNumVertices), vertex, data.getVertexSize());
+
+		// get first vertex texture coordinate (i.e. index 0)
+		if (texture)
+		{
+			const bool hasTexCoords = mesh->HasTextureCoords(0);
+			for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+			{
+				VertexNormTex& textured = *reinterpret_cast<VertexNormTex*>(vertex + i * data.getVertexSize());
+				textured.texCoord[0] = hasTexCoords ? mesh->mTextureCoords[0][i].x : 0.0f;
+				textured.texCoord[1] = hasTexCoords ? mesh->mTextureCoords[0][i].y : 0.0f;
+			}
+		}
+
+		vertex += mesh->mNumVertices * data.getVertexSize();
+
+		// a mirroring transform turns the triangles inside out, swapping two corners turns them back
+		const bool mirrored = glm::determinant(glm::mat3(instance.transform)) < 0.0f;
+
+		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+		{
+			const aiFace& face = mesh->mFaces[i];
+			if (face.mNumIndices != 3)
+				continue;
+
+			*indices++ = baseVertex + face.mIndices[0];
+			*indices++ = baseVertex + face.mIndices[mirrored ? 2 : 1];
+			*indices++ = baseVertex + face.mIndices[mirrored ? 1 : 2];
+		}
+
+		baseVertex += mesh->mNumVertices;
+	}
+
+	data.indexCount = static_cast<int>(indexCount);
+	data.indexType = GL_UNSIGNED_INT;
+	data.vertices = data.vertexStorage.data();
+	data.indices = data.indexStorage.data();
+
+	// every level of detail uses the same vertices, so the bounds of all vertices cover them all
+	compute_mesh_bounds(data);
+
+	// simplify into levels of detail and reorder them for the vertex cache, overdraw and vertex fetch
+	if (optimize)
+	{
+		build_lod_chain(data);
+		optimize_mesh(data);
+	}
+
+	if (is_packed(format))
+		pack_vertices(data);
+
+	narrow_indices(data);
+
+	// importer's destructor will clean up
+	return true;
+}
+
+bool load_mesh_data(const char* filename, VertexFormat format, MeshData& data, bool useCache)
+{
+	data = MeshData();
+
+	// without a hash there is nothing to check a cache against, the import reports the error
+	std::uint64_t sourceHash = 0;
+	const bool hashed = useCache && hash_file(filename, sourceHash);
+	const std::string cachePath = get_mesh_cache_path(filename);
+
+	if (hashed && read_mesh_cache(cachePath, sourceHash, format, data))
+		return true;
+
+	if (!import_mesh(filename, format, data))
+		return false;
+
+	// a failed write only costs another import on the next start
+	if (hashed && data.indexCount > 0 && !write_mesh_cache(cachePath, sourceHash, data))
+		std::cerr << "Failed to write mesh cache: " << cachePath << std::endl;
+
+	return true;
+}
@@ -0,0 +1,128 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "RenderTypes.h"
+#include "MappedFile.h"
+
+/*****************************************************************
+ * vertices and indices of one mesh in the layout the GPU reads them
+ * the data lives either in the vectors below after an import or in
+ * the mapped cache file, so it can go straight to glBufferData
+ *****************************************************************/
+// bytes per vertex of a vertex format
+inline std::size_t get_vertex_size(VertexFormat format)
+{
+	switch (format)
+	{
+	case VertexFormat::NORM_TEX:
+		return sizeof(VertexNormTex);
+	case VertexFormat::PACKED:
+		return sizeof(VertexPacked);
+	case VertexFormat::PACKED_TEX:
+		return sizeof(VertexPackedTex);
+	default:
+		return sizeof(VertexNormal);
+	}
+}
+
+inline bool is_textured(VertexFormat format)
+{
+	return format == VertexFormat::NORM_TEX || format == VertexFormat::PACKED_TEX;
+}
+
+inline bool is_packed(VertexFormat format)
+{
+	return format == VertexFormat::PACKED || format == VertexFormat::PACKED_TEX;
+}
+
+// vertex format for a model loaded with or without texture coordinates, packed or as floats
+inline VertexFormat get_vertex_format(bool texture, bool packed)
+{
+	if (packed)
+		return texture ? VertexFormat::PACKED_TEX : VertexFormat::PACKED;
+
+	return texture ? VertexFormat::NORM_TEX : VertexFormat::NORMAL;
+}
+
+// most levels of detail a mesh is stored with
+const int MAX_MESH_LODS = 8;
+
+// one level of detail, a range of the index buffer drawn with the shared vertices
+struct MeshLod
+{
+	int firstIndex = 0;
+	int indexCount = 0;
+	float error = 0.0f;		// distance from the full detail surface in model units, see simplify_mesh
+};
+
+// bounding volumes of all vertices in model space, for culling
+struct MeshBounds
+{
+	glm::vec3 boxMin = glm::vec3(0.0f);
+	glm::vec3 boxMax = glm::vec3(0.0f);
+	glm::vec3 sphereCenter = glm::vec3(0.0f);
+	float sphereRadius = 0.0f;
+};
+
+struct MeshData
+{
+	const void* vertices = nullptr;		// laid out as vertexFormat says
+	const void* indices = nullptr;		// laid out as indexType says
+	int vertexCount = 0;
+	int indexCount = 0;
+	VertexFormat vertexFormat = VertexFormat::NORMAL;
+	GLenum indexType = GL_UNSIGNED_INT;	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	bool hasTexCoords = false;
+	bool fromCache = false;				// read from the binary cache instead of imported
+
+	// packed positions decode to positionOffset + position * positionScale, floats use 0 and 1
+	glm::vec3 positionOffset = glm::vec3(0.0f);
+	glm::vec3 positionScale = glm::vec3(1.0f);
+
+	// levels of detail from the finest, empty if the whole index buffer is the only level
+	std::vector<MeshLod> lods;
+
+	MeshBounds bounds;
+
+	// owners of the data, moving a MeshData keeps the pointers valid
+	std::vector<unsigned char> vertexStorage;
+	std::vector<unsigned char> indexStorage;
+	MappedFile mapping;
+
+	std::size_t getVertexSize() const { return get_vertex_size(vertexFormat); }
+	std::size_t getIndexSize() const { return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+	// index i whatever the index type
+	GLuint getIndex(int i) const
+	{
+		return indexType == GL_UNSIGNED_SHORT ? static_cast<const GLushort*>(indices)[i] : static_cast<const GLuint*>(indices)[i];
+	}
+};
+
+// fill data.bounds from the vertices, which must still be in a float format, i.e. before packing
+// the sphere is centred on the box, which is never far from the smallest sphere for the shapes models have
+void compute_mesh_bounds(MeshData& data);
+
+// binary mesh cache file written next to the source model
+std::string get_mesh_cache_path(const char* filename);
+
+// 64 bit FNV-1a hash of a file's contents, false if it cannot be read
+bool hash_file(const char* filename, std::uint64_t& hash);
+
+// import every mesh of a model with Assimp, placed by the transforms of the nodes that use them and merged
+// into one mesh in format, if optimize is set a chain of levels of detail is built and every level is
+// reordered for drawing, bounds are always computed
+// indices are 16 bit wherever the vertex count allows, a model without positions, normals or faces is returned empty
+// returns false if the model cannot be loaded
+bool import_mesh(const char* filename, VertexFormat format, MeshData& data, bool optimize = true);
+
+// load the merged meshes of a model, from its cache if the cache matches the source file and
+// through Assimp otherwise, in which case the cache is rewritten
+// returns false if the model cannot be loaded
+bool load_mesh_data(const char* filename, VertexFormat format, MeshData& data, bool useCache = true);
+
+#endif
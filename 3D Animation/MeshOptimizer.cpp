@@ -0,0 +1,501 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// scoring constants from Forsyth's "Linear-Speed Vertex Cache Optimisation"
+static const int FORSYTH_CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+// FIFO cache size the overdraw clustering keeps the order for, typical of current GPUs
+static const int OVERDRAW_CACHE_SIZE = 16;
+// smallest cluster created by a soft split, smaller ones cost more cache misses than they save overdraw
+static const int MIN_SOFT_CLUSTER_SIZE = 16;
+
+// resolution of the views the overdraw is measured from
+static const int OVERDRAW_GRID_SIZE = 256;
+
+static glm::vec3 get_position(const void* vertices, std::size_t vertexSize, GLuint vertex)
+{
+	glm::vec3 position;
+	std::memcpy(&position, static_cast<const unsigned char*>(vertices) + vertex * vertexSize, sizeof(position));
+	return position;
+}
+
+/*****************************************************************
+ * FIFO vertex cache simulated with time stamps: a vertex is in the
+ * cache while fewer than size vertices were added after it
+ *****************************************************************/
+class FifoCache
+{
+public:
+	FifoCache(int vertexCount, int size)
+		: mSize(size), mTime(size), mAddTimes(vertexCount, 0)
+	{}
+
+	// look up a vertex and add it on a miss, returns true on a miss
+	bool transform(GLuint vertex)
+	{
+		if (mTime - mAddTimes[vertex] < mSize)
+			return false;
+
+		mAddTimes[vertex] = mTime++;
+		return true;
+	}
+
+	// forget every vertex
+	void flush()
+	{
+		mTime += mSize;
+	}
+
+private:
+	int mSize;
+	int mTime;						// number of vertices added so far, offset so the cache starts empty
+	std::vector<int> mAddTimes;		// time each vertex was last added
+};
+
+static float get_vertex_score(int cachePosition, int remainingTriangles)
+{
+	// vertices without triangles left are never wanted again
+	if (remainingTriangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+
+	if (cachePosition >= 0)
+	{
+		// the last triangle's vertices score the same so its own order does not matter
+		if (cachePosition < 3)
+		{
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else
+		{
+			float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+			score = std::pow(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+		}
+	}
+
+	// favour vertices with few triangles left so they do not end up stranded
+	score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+
+	return score;
+}
+
+void optimize_vertex_cache(GLuint* indices, int indexCount, int vertexCount)
+{
+	const int triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// triangles using each vertex, the lists of all vertices share one array
+	std::vector<int> triangleOffsets(vertexCount + 1, 0);
+	for (int i = 0; i < triangleCount * 3; i++)
+		triangleOffsets[indices[i] + 1]++;
+	for (int i = 0; i < vertexCount; i++)
+		triangleOffsets[i + 1] += triangleOffsets[i];
+
+	std::vector<int> vertexTriangles(triangleCount * 3);
+	std::vector<int> remainingTriangles(vertexCount, 0);
+	for (int i = 0; i < triangleCount * 3; i++)
+	{
+		GLuint vertex = indices[i];
+		vertexTriangles[triangleOffsets[vertex] + remainingTriangles[vertex]++] = i / 3;
+	}
+
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (int i = 0; i < vertexCount; i++)
+		vertexScores[i] = get_vertex_score(-1, remainingTriangles[i]);
+
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<GLuint> output(triangleCount * 3);
+
+	int cache[FORSYTH_CACHE_SIZE + 3];
+	int cacheCount = 0;
+	int bestTriangle = -1;
+	int nextUnemitted = 0;
+
+	for (int i = 0; i < triangleCount; i++)
+	{
+		// nothing in the cache has triangles left, continue with the first unused triangle
+		if (bestTriangle < 0)
+		{
+			while (emitted[nextUnemitted])
+				nextUnemitted++;
+			bestTriangle = nextUnemitted;
+		}
+
+		const GLuint* triangle = indices + bestTriangle * 3;
+		std::copy(triangle, triangle + 3, output.begin() + i * 3);
+		emitted[bestTriangle] = 1;
+
+		// take the triangle off the lists of its vertices
+		for (int k = 0; k < 3; k++)
+		{
+			GLuint vertex = triangle[k];
+			int* list = &vertexTriangles[triangleOffsets[vertex]];
+			int last = --remainingTriangles[vertex];
+
+			for (int j = 0; j <= last; j++)
+			{
+				if (list[j] == bestTriangle)
+				{
+					std::swap(list[j], list[last]);
+					break;
+				}
+			}
+		}
+
+		// the triangle's vertices move to the front of the cache, the rest move back
+		int newCache[FORSYTH_CACHE_SIZE + 3];
+		int newCount = 0;
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (std::find(newCache, newCache + newCount, static_cast<int>(triangle[k])) == newCache + newCount)
+				newCache[newCount++] = triangle[k];
+		}
+
+		for (int j = 0; j < cacheCount; j++)
+		{
+			int vertex = cache[j];
+			if (vertex != static_cast<int>(triangle[0]) && vertex != static_cast<int>(triangle[1]) && vertex != static_cast<int>(triangle[2]))
+				newCache[newCount++] = vertex;
+		}
+
+		// rescore the vertices that moved, including those pushed out of the cache
+		for (int j = 0; j < newCount; j++)
+		{
+			int vertex = newCache[j];
+			cachePositions[vertex] = j < FORSYTH_CACHE_SIZE ? j : -1;
+			vertexScores[vertex] = get_vertex_score(cachePositions[vertex], remainingTriangles[vertex]);
+		}
+
+		// the next triangle is the best one touching the cache
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+
+		for (int j = 0; j < newCount; j++)
+		{
+			int vertex = newCache[j];
+			const int* list = &vertexTriangles[triangleOffsets[vertex]];
+
+			for (int t = 0; t < remainingTriangles[vertex]; t++)
+			{
+				const GLuint* candidate = indices + list[t] * 3;
+				float score = vertexScores[candidate[0]] + vertexScores[candidate[1]] + vertexScores[candidate[2]];
+
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = list[t];
+				}
+			}
+		}
+
+		cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+		std::copy(newCache, newCache + cacheCount, cache);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void optimize_overdraw(GLuint* indices, int indexCount, const void* vertices, int vertexCount,
+	std::size_t vertexSize, float threshold)
+{
+	const int triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+		return;
+
+	// hard boundaries, a triangle that misses on all three vertices starts over in any order
+	std::vector<int> hardClusters;
+	std::vector<int> hardMisses;
+	{
+		FifoCache cache(vertexCount, OVERDRAW_CACHE_SIZE);
+
+		for (int i = 0; i < triangleCount; i++)
+		{
+			int misses = cache.transform(indices[i * 3]) + cache.transform(indices[i * 3 + 1]) + cache.transform(indices[i * 3 + 2]);
+
+			if (i == 0 || misses == 3)
+			{
+				hardClusters.push_back(i);
+				hardMisses.push_back(0);
+			}
+
+			hardMisses.back() += misses;
+		}
+	}
+	hardClusters.push_back(triangleCount);
+
+	// soft boundaries, a hard cluster is cut wherever the part before the cut is still within the threshold
+	// of the whole cluster's ACMR when drawn from an empty cache
+	std::vector<int> clusters;
+	{
+		FifoCache cache(vertexCount, OVERDRAW_CACHE_SIZE);
+
+		for (std::size_t c = 0; c + 1 < hardClusters.size(); c++)
+		{
+			const int end = hardClusters[c + 1];
+			const float limit = threshold * hardMisses[c] / (end - hardClusters[c]);
+
+			int start = hardClusters[c];
+			int misses = 0;
+			clusters.push_back(start);
+			cache.flush();
+
+			for (int i = start; i < end; i++)
+			{
+				misses += cache.transform(indices[i * 3]) + cache.transform(indices[i * 3 + 1]) + cache.transform(indices[i * 3 + 2]);
+
+				int size = i + 1 - start;
+				if (size >= MIN_SOFT_CLUSTER_SIZE && end - (i + 1) >= MIN_SOFT_CLUSTER_SIZE &&
+					misses <= limit * size)
+				{
+					start = i + 1;
+					misses = 0;
+					clusters.push_back(start);
+					cache.flush();
+				}
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	const int clusterCount = static_cast<int>(clusters.size()) - 1;
+
+	// mesh centre
+	glm::vec3 meshCentre(0.0f);
+	for (int i = 0; i < vertexCount; i++)
+		meshCentre += get_position(vertices, vertexSize, i);
+	meshCentre /= static_cast<float>(std::max(vertexCount, 1));
+
+	// clusters facing away from the centre hide more of the mesh behind them
+	std::vector<float> sortKeys(clusterCount);
+	for (int c = 0; c < clusterCount; c++)
+	{
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+
+		for (int i = clusters[c]; i < clusters[c + 1]; i++)
+		{
+			glm::vec3 a = get_position(vertices, vertexSize, indices[i * 3]);
+			glm::vec3 b = get_position(vertices, vertexSize, indices[i * 3 + 1]);
+			glm::vec3 d = get_position(vertices, vertexSize, indices[i * 3 + 2]);
+
+			// area weighted, the cross product's length is twice the area
+			glm::vec3 cross = glm::cross(b - a, d - a);
+			float triangleArea = glm::length(cross);
+
+			centroid += (a + b + d) * (triangleArea / 3.0f);
+			normal += cross;
+			area += triangleArea;
+		}
+
+		float normalLength = glm::length(normal);
+		if (area > 0.0f && normalLength > 0.0f)
+			sortKeys[c] = glm::dot(centroid / area - meshCentre, normal / normalLength);
+		else
+			sortKeys[c] = 0.0f;
+	}
+
+	std::vector<int> order(clusterCount);
+	for (int c = 0; c < clusterCount; c++)
+		order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](int a, int b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<GLuint> output;
+	output.reserve(triangleCount * 3);
+	for (int c : order)
+		output.insert(output.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+int optimize_vertex_fetch(void* vertices, int vertexCount, std::size_t vertexSize, GLuint* indices, int indexCount)
+{
+	const GLuint UNUSED = std::numeric_limits<GLuint>::max();
+
+	// new index of each vertex in order of first use
+	std::vector<GLuint> remap(vertexCount, UNUSED);
+	GLuint nextVertex = 0;
+
+	for (int i = 0; i < indexCount; i++)
+	{
+		GLuint& vertex = remap[indices[i]];
+		if (vertex == UNUSED)
+			vertex = nextVertex++;
+
+		indices[i] = vertex;
+	}
+
+	unsigned char* data = static_cast<unsigned char*>(vertices);
+	std::vector<unsigned char> original(data, data + vertexCount * vertexSize);
+
+	for (int i = 0; i < vertexCount; i++)
+	{
+		if (remap[i] != UNUSED)
+			std::memcpy(data + remap[i] * vertexSize, original.data() + i * vertexSize, vertexSize);
+	}
+
+	return static_cast<int>(nextVertex);
+}
+
+void optimize_mesh(MeshData& data)
+{
+	// only float meshes with 32 bit indices in their own storage, i.e. before packing
+	if (data.indexCount == 0 || data.vertexStorage.empty() || data.indexStorage.empty() ||
+		is_packed(data.vertexFormat) || data.indexType != GL_UNSIGNED_INT)
+		return;
+
+	const std::size_t vertexSize = data.getVertexSize();
+	GLuint* indices = reinterpret_cast<GLuint*>(data.indexStorage.data());
+
+	// levels of detail are drawn on their own and reordered on their own, a mesh without them is one level
+	std::vector<MeshLod> lods = data.lods;
+	if (lods.empty())
+	{
+		lods.resize(1);
+		lods[0].indexCount = data.indexCount;
+	}
+
+	for (const MeshLod& lod : lods)
+	{
+		optimize_vertex_cache(indices + lod.firstIndex, lod.indexCount, data.vertexCount);
+		optimize_overdraw(indices + lod.firstIndex, lod.indexCount, data.vertexStorage.data(), data.vertexCount, vertexSize);
+	}
+
+	// the finest level uses every vertex the coarser ones do, so it decides the vertex order
+	data.vertexCount = optimize_vertex_fetch(data.vertexStorage.data(), data.vertexCount, vertexSize, indices, data.indexCount);
+
+	data.vertexStorage.resize(data.vertexCount * vertexSize);
+	data.vertices = data.vertexStorage.data();
+}
+
+VertexCacheStats analyze_vertex_cache(const GLuint* indices, int indexCount, int vertexCount, int cacheSize)
+{
+	VertexCacheStats stats;
+	if (indexCount < 3)
+		return stats;
+
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<char> used(vertexCount, 0);
+	int transformed = 0;
+	int usedCount = 0;
+
+	for (int i = 0; i < indexCount; i++)
+	{
+		transformed += cache.transform(indices[i]);
+
+		if (!used[indices[i]])
+		{
+			used[indices[i]] = 1;
+			usedCount++;
+		}
+	}
+
+	stats.acmr = static_cast<float>(transformed) / (indexCount / 3);
+	stats.atvr = static_cast<float>(transformed) / usedCount;
+
+	return stats;
+}
+
+OverdrawStats analyze_overdraw(const GLuint* indices, int indexCount, const void* vertices, int vertexCount,
+	std::size_t vertexSize)
+{
+	OverdrawStats stats;
+	if (indexCount < 3 || vertexCount == 0)
+		return stats;
+
+	// fit the mesh into the grid with the same scale on every axis
+	glm::vec3 minimum = get_position(vertices, vertexSize, 0);
+	glm::vec3 maximum = minimum;
+	for (int i = 1; i < vertexCount; i++)
+	{
+		glm::vec3 position = get_position(vertices, vertexSize, i);
+		minimum = glm::min(minimum, position);
+		maximum = glm::max(maximum, position);
+	}
+
+	glm::vec3 extent = maximum - minimum;
+	float largestExtent = std::max(std::max(extent.x, extent.y), extent.z);
+	float scale = largestExtent > 0.0f ? (OVERDRAW_GRID_SIZE - 1) / largestExtent : 0.0f;
+
+	std::vector<float> depthBuffer(OVERDRAW_GRID_SIZE * OVERDRAW_GRID_SIZE);
+	long long shaded = 0;
+	long long covered = 0;
+
+	// look along each axis from both sides, the screen axes are chosen so counter clockwise stays front facing
+	for (int view = 0; view < 6; view++)
+	{
+		int axis = view / 2;
+		bool positive = view % 2 == 0;
+		int u = positive ? (axis + 1) % 3 : (axis + 2) % 3;
+		int v = positive ? (axis + 2) % 3 : (axis + 1) % 3;
+		float depthSign = positive ? -1.0f : 1.0f;		// smaller depth is nearer the viewer
+
+		std::fill(depthBuffer.begin(), depthBuffer.end(), std::numeric_limits<float>::max());
+
+		for (int i = 0; i + 2 < indexCount; i += 3)
+		{
+			glm::vec3 screen[3];
+			for (int k = 0; k < 3; k++)
+			{
+				glm::vec3 position = (get_position(vertices, vertexSize, indices[i + k]) - minimum) * scale;
+				screen[k] = glm::vec3(position[u], position[v], depthSign * position[axis]);
+			}
+
+			// back faces are culled like on the GPU
+			float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) -
+				(screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+			if (area <= 0.0f)
+				continue;
+
+			int minX = std::max(static_cast<int>(std::floor(std::min(std::min(screen[0].x, screen[1].x), screen[2].x))), 0);
+			int minY = std::max(static_cast<int>(std::floor(std::min(std::min(screen[0].y, screen[1].y), screen[2].y))), 0);
+			int maxX = std::min(static_cast<int>(std::ceil(std::max(std::max(screen[0].x, screen[1].x), screen[2].x))), OVERDRAW_GRID_SIZE - 1);
+			int maxY = std::min(static_cast<int>(std::ceil(std::max(std::max(screen[0].y, screen[1].y), screen[2].y))), OVERDRAW_GRID_SIZE - 1);
+
+			for (int y = minY; y <= maxY; y++)
+			{
+				for (int x = minX; x <= maxX; x++)
+				{
+					// edge functions at the pixel centre
+					float px = x + 0.5f;
+					float py = y + 0.5f;
+					float w0 = (screen[2].x - screen[1].x) * (py - screen[1].y) - (screen[2].y - screen[1].y) * (px - screen[1].x);
+					float w1 = (screen[0].x - screen[2].x) * (py - screen[2].y) - (screen[0].y - screen[2].y) * (px - screen[2].x);
+					float w2 = (screen[1].x - screen[0].x) * (py - screen[0].y) - (screen[1].y - screen[0].y) * (px - screen[0].x);
+
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+						continue;
+
+					float depth = (w0 * screen[0].z + w1 * screen[1].z + w2 * screen[2].z) / area;
+					float& stored = depthBuffer[y * OVERDRAW_GRID_SIZE + x];
+
+					if (depth < stored)
+					{
+						stored = depth;
+						shaded++;
+					}
+				}
+			}
+		}
+
+		for (float depth : depthBuffer)
+			covered += depth != std::numeric_limits<float>::max();
+	}
+
+	stats.overdraw = covered > 0 ? static_cast<float>(shaded) / covered : 0.0f;
+
+	return stats;
+}
@@ -0,0 +1,51 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstddef>
+
+#include "MeshCache.h"
+
+/*****************************************************************
+ * import time reordering of triangle lists for the GPU
+ * triangles are reordered so vertices are reused while they are in
+ * the post transform cache, then clusters of triangles are sorted
+ * so outward facing parts draw first, and finally vertices are
+ * stored in the order they are first used
+ * vertex positions are read as three floats at the start of each
+ * vertex, which holds for every layout in RenderTypes.h
+ *****************************************************************/
+
+// vertex cache efficiency of a triangle list run through a FIFO cache of cacheSize vertices
+struct VertexCacheStats
+{
+	float acmr = 0.0f;		// vertices transformed per triangle, 0.5 is the best possible for big grids, 3 the worst
+	float atvr = 0.0f;		// vertices transformed per vertex used, 1 is the best possible
+};
+
+// pixels shaded per pixel covered, averaged over views along the positive and negative axes
+struct OverdrawStats
+{
+	float overdraw = 0.0f;	// 1 means every covered pixel was shaded once
+};
+
+// reorder triangles for post transform cache reuse with Forsyth's linear speed algorithm
+void optimize_vertex_cache(GLuint* indices, int indexCount, int vertexCount);
+
+// sort clusters of triangles so the ones facing away from the mesh centre are drawn first,
+// clusters only split where the vertex cache order allows, costing at most threshold times its ACMR
+void optimize_overdraw(GLuint* indices, int indexCount, const void* vertices, int vertexCount,
+	std::size_t vertexSize, float threshold = 1.05f);
+
+// store vertices in the order the indices first use them and remap the indices,
+// unused vertices are dropped, returns the new vertex count
+int optimize_vertex_fetch(void* vertices, int vertexCount, std::size_t vertexSize, GLuint* indices, int indexCount);
+
+// run all of the above on a float mesh with 32 bit indices that owns its vertices and indices,
+// each level of detail is reordered on its own
+void optimize_mesh(MeshData& data);
+
+VertexCacheStats analyze_vertex_cache(const GLuint* indices, int indexCount, int vertexCount, int cacheSize = 16);
+OverdrawStats analyze_overdraw(const GLuint* indices, int indexCount, const void* vertices, int vertexCount,
+	std::size_t vertexSize);
+
+#endif
@@ -0,0 +1,581 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <vector>
+
+// how a vertex may move, see classify_vertices
+enum class VertexKind : unsigned char
+{
+	MANIFOLD,	// inside the surface and alone at its position
+	BORDER,		// on one open edge loop of the surface
+	SEAM,		// one of two vertices at a position whose attributes differ, on one seam line
+	LOCKED		// corners of borders and seams and anything non-manifold
+};
+
+// open edges have their planes weighted up so borders and seams keep their outline
+static const double BORDER_WEIGHT = 10.0;
+// a pass accepts collapses up to this times the cost of the last one it needs, many are locked out by
+// their neighbours and wait for the next pass
+static const double PASS_COST_SCALE = 1.5;
+// smallest cosine of the angle a triangle may turn through in a collapse, about 75 degrees
+static const float MIN_FLIP_COSINE = 0.25f;
+
+// levels with fewer triangles are not worth switching to
+static const int MIN_LOD_TRIANGLES = 32;
+// a level has to get below this share of the triangles of the level before it
+static const float MIN_LOD_SHRINK = 0.85f;
+
+// entries of the open edge tables that are not a vertex
+static const GLuint NO_VERTEX = ~0u;
+static const GLuint MANY_VERTICES = ~0u - 1;
+
+/*****************************************************************
+ * sum of squared distances to a set of weighted planes, kept as
+ * the symmetric matrix of p.A.p + 2 b.p + c
+ *****************************************************************/
+struct Quadric
+{
+	double a00 = 0.0, a11 = 0.0, a22 = 0.0, a01 = 0.0, a02 = 0.0, a12 = 0.0;
+	double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+	double c = 0.0;
+	double weight = 0.0;
+};
+
+// add the plane normal.p + distance = 0, normal must have unit length
+static void add_plane(Quadric& quadric, const glm::vec3& normal, float distance, double weight)
+{
+	const double x = normal.x, y = normal.y, z = normal.z, d = distance;
+
+	quadric.a00 += weight * x * x;
+	quadric.a11 += weight * y * y;
+	quadric.a22 += weight * z * z;
+	quadric.a01 += weight * x * y;
+	quadric.a02 += weight * x * z;
+	quadric.a12 += weight * y * z;
+	quadric.b0 += weight * x * d;
+	quadric.b1 += weight * y * d;
+	quadric.b2 += weight * z * d;
+	quadric.c += weight * d * d;
+	quadric.weight += weight;
+}
+
+static void add_quadric(Quadric& quadric, const Quadric& other)
+{
+	quadric.a00 += other.a00;
+	quadric.a11 += other.a11;
+	quadric.a22 += other.a22;
+	quadric.a01 += other.a01;
+	quadric.a02 += other.a02;
+	quadric.a12 += other.a12;
+	quadric.b0 += other.b0;
+	quadric.b1 += other.b1;
+	quadric.b2 += other.b2;
+	quadric.c += other.c;
+	quadric.weight += other.weight;
+}
+
+// weighted mean of the squared distances from position to the planes
+static double get_quadric_error(const Quadric& quadric, const glm::vec3& position)
+{
+	if (quadric.weight <= 0.0)
+		return 0.0;
+
+	const double x = position.x, y = position.y, z = position.z;
+
+	double error = quadric.a00 * x * x + quadric.a11 * y * y + quadric.a22 * z * z +
+		2.0 * (quadric.a01 * x * y + quadric.a02 * x * z + quadric.a12 * y * z) +
+		2.0 * (quadric.b0 * x + quadric.b1 * y + quadric.b2 * z) + quadric.c;
+
+	// rounding can take a perfect fit just below zero
+	return std::max(error, 0.0) / quadric.weight;
+}
+
+// half edges leaving every vertex, the lists of all vertices share one array
+struct EdgeAdjacency
+{
+	std::vector<GLuint> offsets;
+	std::vector<GLuint> targets;
+};
+
+static void build_edge_adjacency(EdgeAdjacency& adjacency, const std::vector<GLuint>& indices, int vertexCount)
+{
+	adjacency.offsets.assign(vertexCount + 1, 0);
+	for (GLuint vertex : indices)
+		adjacency.offsets[vertex + 1]++;
+	for (int i = 0; i < vertexCount; i++)
+		adjacency.offsets[i + 1] += adjacency.offsets[i];
+
+	std::vector<GLuint> next(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+	adjacency.targets.resize(indices.size());
+
+	for (std::size_t i = 0; i < indices.size(); i += 3)
+	{
+		for (int k = 0; k < 3; k++)
+			adjacency.targets[next[indices[i + k]]++] = indices[i + (k + 1) % 3];
+	}
+}
+
+static bool has_edge(const EdgeAdjacency& adjacency, GLuint from, GLuint to)
+{
+	for (GLuint i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; i++)
+	{
+		if (adjacency.targets[i] == to)
+			return true;
+	}
+
+	return false;
+}
+
+// vertices at bitwise equal positions remap to the lowest of them and are linked in a ring by wedge
+static void build_position_remap(const std::vector<glm::vec3>& positions, std::vector<GLuint>& remap, std::vector<GLuint>& wedge)
+{
+	const GLuint vertexCount = static_cast<GLuint>(positions.size());
+
+	// compared as bits so NaNs sort like anything else
+	auto get_key = [&positions](GLuint vertex) {
+		std::uint32_t key[3];
+		std::memcpy(key, &positions[vertex], sizeof(key));
+		return std::make_tuple(key[0], key[1], key[2]);
+	};
+
+	std::vector<GLuint> order(vertexCount);
+	for (GLuint i = 0; i < vertexCount; i++)
+		order[i] = i;
+
+	std::sort(order.begin(), order.end(), [&get_key](GLuint a, GLuint b) {
+		return std::make_pair(get_key(a), a) < std::make_pair(get_key(b), b);
+	});
+
+	remap.resize(vertexCount);
+	wedge.resize(vertexCount);
+
+	for (GLuint begin = 0; begin < vertexCount;)
+	{
+		GLuint end = begin + 1;
+		while (end < vertexCount && get_key(order[end]) == get_key(order[begin]))
+			end++;
+
+		for (GLuint i = begin; i < end; i++)
+		{
+			remap[order[i]] = order[begin];
+			wedge[order[i]] = order[i + 1 < end ? i + 1 : begin];
+		}
+
+		begin = end;
+	}
+}
+
+// triangles around every position, indexed by the remapped vertex
+static void build_position_fans(std::vector<GLuint>& offsets, std::vector<GLuint>& triangles,
+	const std::vector<GLuint>& indices, const std::vector<GLuint>& remap)
+{
+	offsets.assign(remap.size() + 1, 0);
+	for (GLuint vertex : indices)
+		offsets[remap[vertex] + 1]++;
+	for (std::size_t i = 0; i < remap.size(); i++)
+		offsets[i + 1] += offsets[i];
+
+	std::vector<GLuint> next(offsets.begin(), offsets.end() - 1);
+	triangles.resize(indices.size());
+
+	for (std::size_t i = 0; i < indices.size(); i++)
+		triangles[next[remap[indices[i]]]++] = static_cast<GLuint>(i / 3);
+}
+
+// decide how every vertex may move from the open edges around it, open meaning no triangle uses the edge
+// the other way round: a vertex with no open edges is manifold, one with an edge in and an edge out on a
+// border, and a pair of vertices at one position whose open edges lead to the same neighbours is a seam
+static void classify_vertices(std::vector<VertexKind>& kinds, const EdgeAdjacency& adjacency,
+	const std::vector<GLuint>& remap, const std::vector<GLuint>& wedge)
+{
+	const GLuint vertexCount = static_cast<GLuint>(remap.size());
+
+	// the one neighbour each vertex has an open edge to and from, if there is exactly one
+	std::vector<GLuint> openIn(vertexCount, NO_VERTEX);
+	std::vector<GLuint> openOut(vertexCount, NO_VERTEX);
+
+	for (GLuint from = 0; from < vertexCount; from++)
+	{
+		for (GLuint i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; i++)
+		{
+			GLuint to = adjacency.targets[i];
+			if (has_edge(adjacency, to, from))
+				continue;
+
+			openOut[from] = openOut[from] == NO_VERTEX ? to : MANY_VERTICES;
+			openIn[to] = openIn[to] == NO_VERTEX ? from : MANY_VERTICES;
+		}
+	}
+
+	auto is_single = [](GLuint vertex) { return vertex != NO_VERTEX && vertex != MANY_VERTICES; };
+
+	kinds.assign(vertexCount, VertexKind::LOCKED);
+
+	for (GLuint vertex = 0; vertex < vertexCount; vertex++)
+	{
+		if (remap[vertex] != vertex)
+			continue;
+
+		if (wedge[vertex] == vertex)
+		{
+			if (openIn[vertex] == NO_VERTEX && openOut[vertex] == NO_VERTEX)
+				kinds[vertex] = VertexKind::MANIFOLD;
+			else if (is_single(openIn[vertex]) && is_single(openOut[vertex]))
+				kinds[vertex] = VertexKind::BORDER;
+		}
+		else if (wedge[wedge[vertex]] == vertex)
+		{
+			// the open edges of both sides have to run between the same two positions
+			GLuint other = wedge[vertex];
+
+			if (is_single(openIn[vertex]) && is_single(openOut[vertex]) &&
+				is_single(openIn[other]) && is_single(openOut[other]) &&
+				remap[openIn[vertex]] == remap[openOut[other]] &&
+				remap[openOut[vertex]] == remap[openIn[other]] &&
+				remap[openIn[vertex]] != remap[openOut[vertex]])
+				kinds[vertex] = VertexKind::SEAM;
+		}
+	}
+
+	for (GLuint vertex = 0; vertex < vertexCount; vertex++)
+		kinds[vertex] = kinds[remap[vertex]];
+}
+
+// collapse of vertex from onto vertex to, cost is the error of the merged quadric at to
+struct Collapse
+{
+	GLuint from;
+	GLuint to;
+	double cost;
+};
+
+// the cheaper allowed direction of every edge of the triangles
+static void pick_collapses(std::vector<Collapse>& collapses, const std::vector<GLuint>& indices,
+	const EdgeAdjacency& adjacency, const std::vector<VertexKind>& kinds, const std::vector<GLuint>& remap,
+	const std::vector<GLuint>& wedge, const std::vector<glm::vec3>& positions, const std::vector<Quadric>& quadrics)
+{
+	collapses.clear();
+
+	for (std::size_t i = 0; i < indices.size(); i += 3)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			const GLuint a = indices[i + k];
+			const GLuint b = indices[i + (k + 1) % 3];
+			const bool closed = has_edge(adjacency, b, a);
+
+			// closed edges are seen from the triangles on both sides, keep one
+			if (closed && remap[a] > remap[b])
+				continue;
+
+			// the other side of a seam edge, which has to collapse along with it
+			const bool twin = has_edge(adjacency, wedge[b], wedge[a]);
+
+			// borders and seams only slide along themselves
+			auto is_allowed = [&](GLuint from, GLuint to) {
+				switch (kinds[from])
+				{
+				case VertexKind::MANIFOLD:
+					return true;
+				case VertexKind::BORDER:
+					return kinds[to] == VertexKind::BORDER && !closed;
+				case VertexKind::SEAM:
+					return kinds[to] == VertexKind::SEAM && !closed && twin;
+				default:
+					return false;
+				}
+			};
+
+			const bool forward = is_allowed(a, b);
+			const bool backward = is_allowed(b, a);
+			if (!forward && !backward)
+				continue;
+
+			// both directions merge the same quadrics and differ in where the vertex ends up
+			Quadric merged = quadrics[remap[a]];
+			add_quadric(merged, quadrics[remap[b]]);
+
+			const double forwardCost = forward ? get_quadric_error(merged, positions[b]) : DBL_MAX;
+			const double backwardCost = backward ? get_quadric_error(merged, positions[a]) : DBL_MAX;
+
+			if (forwardCost <= backwardCost)
+				collapses.push_back({ a, b, forwardCost });
+			else
+				collapses.push_back({ b, a, backwardCost });
+		}
+	}
+}
+
+// number of triangles a collapse removes, or -1 if it would turn one of the remaining triangles over or
+// close to edge on, which leaves slivers that flip with the next collapse
+static int check_collapse(const Collapse& collapse, const std::vector<GLuint>& indices, const std::vector<GLuint>& fanOffsets,
+	const std::vector<GLuint>& fanTriangles, const std::vector<GLuint>& remap, const std::vector<glm::vec3>& positions)
+{
+	const GLuint fromPosition = remap[collapse.from];
+	const GLuint toPosition = remap[collapse.to];
+	int removed = 0;
+
+	for (GLuint i = fanOffsets[fromPosition]; i < fanOffsets[fromPosition + 1]; i++)
+	{
+		const GLuint* triangle = &indices[fanTriangles[i] * 3];
+		glm::vec3 corners[3];
+		int moved = 0;
+		bool degenerate = false;
+
+		for (int k = 0; k < 3; k++)
+		{
+			corners[k] = positions[triangle[k]];
+			if (remap[triangle[k]] == fromPosition)
+				moved = k;
+			if (remap[triangle[k]] == toPosition)
+				degenerate = true;
+		}
+
+		if (degenerate)
+		{
+			removed++;
+			continue;
+		}
+
+		glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+		corners[moved] = positions[collapse.to];
+		glm::vec3 after = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+
+		if (glm::dot(before, after) <= MIN_FLIP_COSINE * glm::length(before) * glm::length(after))
+			return -1;
+	}
+
+	return removed;
+}
+
+int simplify_mesh(GLuint* destination, const GLuint* indices, int indexCount, const void* vertices, int vertexCount,
+	std::size_t vertexSize, int targetIndexCount, float targetError, float* error)
+{
+	if (error != nullptr)
+		*error = 0.0f;
+
+	std::vector<glm::vec3> positions(vertexCount);
+	for (int i = 0; i < vertexCount; i++)
+		std::memcpy(&positions[i], static_cast<const unsigned char*>(vertices) + i * vertexSize, sizeof(glm::vec3));
+
+	std::vector<GLuint> remap;
+	std::vector<GLuint> wedge;
+	build_position_remap(positions, remap, wedge);
+
+	// triangles with two corners at one position cover nothing and would confuse the classification
+	std::vector<GLuint> result;
+	result.reserve(indexCount);
+
+	for (int i = 0; i + 2 < indexCount; i += 3)
+	{
+		const GLuint a = indices[i];
+		const GLuint b = indices[i + 1];
+		const GLuint c = indices[i + 2];
+
+		if (remap[a] != remap[b] && remap[b] != remap[c] && remap[a] != remap[c])
+			result.insert(result.end(), { a, b, c });
+	}
+
+	EdgeAdjacency adjacency;
+	build_edge_adjacency(adjacency, result, vertexCount);
+
+	std::vector<VertexKind> kinds;
+	classify_vertices(kinds, adjacency, remap, wedge);
+
+	// quadric of every position from the planes of its triangles, weighted by area, and from planes
+	// standing on the open edges through it
+	std::vector<Quadric> quadrics(vertexCount);
+
+	for (std::size_t i = 0; i < result.size(); i += 3)
+	{
+		const glm::vec3& p0 = positions[result[i]];
+		glm::vec3 normal = glm::cross(positions[result[i + 1]] - p0, positions[result[i + 2]] - p0);
+		float length = glm::length(normal);
+		if (length == 0.0f)
+			continue;
+
+		normal = normal / length;
+
+		Quadric plane;
+		add_plane(plane, normal, -glm::dot(normal, p0), 0.5 * length);
+		for (int k = 0; k < 3; k++)
+			add_quadric(quadrics[remap[result[i + k]]], plane);
+
+		for (int k = 0; k < 3; k++)
+		{
+			const GLuint from = result[i + k];
+			const GLuint to = result[i + (k + 1) % 3];
+			if (has_edge(adjacency, to, from))
+				continue;
+
+			glm::vec3 edge = positions[to] - positions[from];
+			glm::vec3 edgeNormal = glm::cross(edge, normal);
+			float edgeLength = glm::length(edgeNormal);
+			if (edgeLength == 0.0f)
+				continue;
+
+			edgeNormal = edgeNormal / edgeLength;
+
+			Quadric edgePlane;
+			add_plane(edgePlane, edgeNormal, -glm::dot(edgeNormal, positions[from]), BORDER_WEIGHT * edgeLength * edgeLength);
+			add_quadric(quadrics[remap[from]], edgePlane);
+			add_quadric(quadrics[remap[to]], edgePlane);
+		}
+	}
+
+	const double maxCost = static_cast<double>(targetError) * targetError;
+	const int targetTriangles = std::max(targetIndexCount, 0) / 3;
+	int triangleCount = static_cast<int>(result.size() / 3);
+	double resultCost = 0.0;
+	bool relaxed = false;	// the last pass found nothing under its own limit
+
+	std::vector<Collapse> collapses;
+	std::vector<GLuint> fanOffsets;
+	std::vector<GLuint> fanTriangles;
+	std::vector<GLuint> collapseRemap(vertexCount);
+	std::vector<char> locked(vertexCount);
+
+	// each pass collapses independent edges cheapest first, then rewrites the triangles
+	while (triangleCount > targetTriangles)
+	{
+		build_edge_adjacency(adjacency, result, vertexCount);
+		build_position_fans(fanOffsets, fanTriangles, result, remap);
+		pick_collapses(collapses, result, adjacency, kinds, remap, wedge, positions, quadrics);
+
+		if (collapses.empty())
+			break;
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		// most collapses remove two triangles
+		const std::size_t goal = static_cast<std::size_t>(triangleCount - targetTriangles + 1) / 2;
+		double passCost = maxCost;
+		if (!relaxed && goal < collapses.size())
+			passCost = std::min(passCost, collapses[goal].cost * PASS_COST_SCALE);
+
+		for (int i = 0; i < vertexCount; i++)
+			collapseRemap[i] = static_cast<GLuint>(i);
+		std::fill(locked.begin(), locked.end(), 0);
+
+		int collapsed = 0;
+
+		for (const Collapse& collapse : collapses)
+		{
+			if (triangleCount <= targetTriangles || collapse.cost > passCost)
+				break;
+
+			const GLuint fromPosition = remap[collapse.from];
+			const GLuint toPosition = remap[collapse.to];
+			if (locked[fromPosition] || locked[toPosition])
+				continue;
+
+			int removed = check_collapse(collapse, result, fanOffsets, fanTriangles, remap, positions);
+			if (removed < 0)
+				continue;
+
+			// the other side of a seam moves to the other vertex at the target position
+			collapseRemap[collapse.from] = collapse.to;
+			if (kinds[collapse.from] == VertexKind::SEAM)
+				collapseRemap[wedge[collapse.from]] = wedge[collapse.to];
+
+			add_quadric(quadrics[toPosition], quadrics[fromPosition]);
+			resultCost = std::max(resultCost, collapse.cost);
+			triangleCount -= removed;
+			collapsed++;
+
+			// the triangles around the moved vertex change shape, their corners stay put for the rest of
+			// the pass so the flip checks of later collapses see the current triangles
+			for (GLuint i = fanOffsets[fromPosition]; i < fanOffsets[fromPosition + 1]; i++)
+			{
+				for (int k = 0; k < 3; k++)
+					locked[remap[result[fanTriangles[i] * 3 + k]]] = 1;
+			}
+		}
+
+		if (collapsed == 0)
+		{
+			// the cheapest collapses all turned triangles over, try the dearer ones once before stopping
+			if (relaxed || passCost >= maxCost)
+				break;
+
+			relaxed = true;
+			continue;
+		}
+
+		relaxed = false;
+
+		// move the collapsed corners and drop the triangles that lost their area
+		std::size_t count = 0;
+		for (std::size_t i = 0; i < result.size(); i += 3)
+		{
+			const GLuint a = collapseRemap[result[i]];
+			const GLuint b = collapseRemap[result[i + 1]];
+			const GLuint c = collapseRemap[result[i + 2]];
+
+			if (remap[a] != remap[b] && remap[b] != remap[c] && remap[a] != remap[c])
+			{
+				result[count++] = a;
+				result[count++] = b;
+				result[count++] = c;
+			}
+		}
+
+		result.resize(count);
+		triangleCount = static_cast<int>(count / 3);
+	}
+
+	if (error != nullptr)
+		*error = static_cast<float>(std::sqrt(resultCost));
+
+	std::copy(result.begin(), result.end(), destination);
+	return static_cast<int>(result.size());
+}
+
+void build_lod_chain(MeshData& data, int maxLods, float reduction)
+{
+	// only float meshes with 32 bit indices in their own storage, i.e. before packing
+	if (data.indexCount == 0 || data.vertexStorage.empty() || data.indexStorage.empty() ||
+		is_packed(data.vertexFormat) || data.indexType != GL_UNSIGNED_INT)
+		return;
+
+	const GLuint* original = reinterpret_cast<const GLuint*>(data.indexStorage.data());
+	std::vector<GLuint> chain(original, original + data.indexCount);
+	std::vector<GLuint> level(data.indexCount);
+
+	data.lods.assign(1, MeshLod());
+	data.lods[0].indexCount = data.indexCount;
+
+	// every level is simplified from the full mesh so its error is measured against the original surface
+	while (static_cast<int>(data.lods.size()) < std::min(maxLods, MAX_MESH_LODS))
+	{
+		const MeshLod& previous = data.lods.back();
+		const int target = static_cast<int>(previous.indexCount / 3 * reduction) * 3;
+		if (target < MIN_LOD_TRIANGLES * 3)
+			break;
+
+		float error = 0.0f;
+		int count = simplify_mesh(level.data(), original, data.indexCount, data.vertexStorage.data(), data.vertexCount,
+			data.getVertexSize(), target, FLT_MAX, &error);
+
+		// locked vertices stop the simplifier, a level that barely shrinks is not worth drawing
+		if (count > previous.indexCount * MIN_LOD_SHRINK)
+			break;
+
+		MeshLod lod;
+		lod.firstIndex = static_cast<int>(chain.size());
+		lod.indexCount = count;
+		lod.error = std::max(error, previous.error);	// coarser levels never claim to be closer
+
+		chain.insert(chain.end(), level.begin(), level.begin() + count);
+		data.lods.push_back(lod);
+	}
+
+	data.indexStorage.resize(chain.size() * sizeof(GLuint));
+	std::memcpy(data.indexStorage.data(), chain.data(), data.indexStorage.size());
+	data.indexCount = static_cast<int>(chain.size());
+	data.indices = data.indexStorage.data();
+}
@@ -0,0 +1,32 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <cfloat>
+#include <cstddef>
+
+#include "MeshCache.h"
+
+/*****************************************************************
+ * import time simplification into levels of detail
+ * edges are collapsed cheapest first, the cost of moving a vertex
+ * is its quadric error: the area weighted squared distance from the
+ * planes of the original triangles around it (Garland and Heckbert)
+ * vertices only move onto other vertices, so every level is an
+ * index buffer over the same vertices
+ * borders stay on the border, the two sides of an attribute seam
+ * collapse together and corners of either never move
+ *****************************************************************/
+
+// simplify a triangle list until it has at most targetIndexCount indices or the next collapse would
+// move the surface further than targetError in model units, whichever comes first
+// writes the remaining triangles to destination, which has room for indexCount indices, and returns their index count
+// error receives the distance of the result from the original surface, as measured by the quadrics
+int simplify_mesh(GLuint* destination, const GLuint* indices, int indexCount, const void* vertices, int vertexCount,
+	std::size_t vertexSize, int targetIndexCount, float targetError = FLT_MAX, float* error = nullptr);
+
+// replace the index buffer of a float mesh with 32 bit indices that owns its storage by a chain of levels
+// of detail, each level about reduction times the triangles of the one before, fills data.lods
+// the chain ends early once the simplifier cannot shrink a level much further
+void build_lod_chain(MeshData& data, int maxLods = MAX_MESH_LODS, float reduction = 0.5f);
+
+#endif
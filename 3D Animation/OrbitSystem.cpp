@@ -0,0 +1,673 @@
+#include "OrbitSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "RenderTypes.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define ORBIT_SYSTEM_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE
+#define TARGET_AVX2
+#else
+// kernels are compiled for their instruction set and only called after a CPU check
+#define TARGET_SSE __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define ORBIT_SYSTEM_X86 0
+#endif
+
+// the scalar fallback must not be fused into FMA instructions or it stops matching the SIMD kernels
+#if defined(_MSC_VER)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+static const float TWO_PI = 6.28318530717958647692f;
+static const float INV_TWO_PI = 0.15915494309189533577f;
+static const float TWO_OVER_PI = 0.63661977236758134308f;
+
+// pi/2 split into parts with few mantissa bits so the range reduction stays accurate
+static const float PIO2_A = 1.5703125f;
+static const float PIO2_B = 4.837512969970703125e-4f;
+static const float PIO2_C = 7.54978995489188216e-8f;
+
+// minimax polynomials for sine and cosine on [-pi/4, pi/4]
+static const float SIN_P0 = -1.9515295891e-4f;
+static const float SIN_P1 = 8.3321608736e-3f;
+static const float SIN_P2 = -1.6666654611e-1f;
+static const float COS_P0 = 2.443315711809948e-5f;
+static const float COS_P1 = -1.388731625493765e-3f;
+static const float COS_P2 = 4.166664568298827e-2f;
+
+// bodies processed per block by every kernel
+static const int BLOCK_SIZE = 8;
+
+// per body factors of the matrices, one lane per body of a block
+// world = parent * translate(x, 0, z) * rotateY * scale and normal = parent normal * rotateY / scale
+struct FactorBlock
+{
+	alignas(32) float scaledCos[BLOCK_SIZE];		// scale * cos(rotation)
+	alignas(32) float scaledSin[BLOCK_SIZE];		// scale * sin(rotation)
+	alignas(32) float scale[BLOCK_SIZE];
+	alignas(32) float translateX[BLOCK_SIZE];		// distance * cos(orbit)
+	alignas(32) float translateZ[BLOCK_SIZE];		// -distance * sin(orbit)
+	alignas(32) float normalCos[BLOCK_SIZE];		// cos(rotation) / scale
+	alignas(32) float normalSin[BLOCK_SIZE];		// sin(rotation) / scale
+	alignas(32) float inverseScale[BLOCK_SIZE];
+};
+
+// parent model and normal matrix columns shared by all bodies
+struct ParentColumns
+{
+	alignas(16) float model[4][4];
+	alignas(16) float normal[3][4];		// w is zero
+};
+
+// raw views of the body arrays passed to the kernels
+struct BodyArrays
+{
+	const float* orbitAngles;
+	const float* orbitSpeeds;
+	const float* rotationAngles;
+	const float* rotationSpeeds;
+	const float* orbitDistances;
+	const float* scales;
+	int count;
+	float time;		// seconds after the stored angles to evaluate the bodies at
+};
+
+/*************** scalar kernels ***************/
+
+// angle wrapped to [-pi, pi]
+static inline float wrap_angle(float angle)
+{
+	float turns = std::nearbyint(angle * INV_TWO_PI);
+	return angle - turns * TWO_PI;
+}
+
+// sine and cosine from one range reduction, accurate for angles within a few turns of zero
+static inline void sin_cos(float x, float& sine, float& cosine)
+{
+	float quadrant = std::nearbyint(x * TWO_OVER_PI);
+	int q = static_cast<int>(quadrant);
+
+	float r = ((x - quadrant * PIO2_A) - quadrant * PIO2_B) - quadrant * PIO2_C;
+	float z = r * r;
+	float s = ((SIN_P0 * z + SIN_P1) * z + SIN_P2) * z * r + r;
+	float c = ((COS_P0 * z + COS_P1) * z + COS_P2) * z * z - 0.5f * z + 1.0f;
+
+	// odd quadrants swap sine and cosine, the sign follows the quadrant
+	sine = (q & 1) ? c : s;
+	cosine = (q & 1) ? s : c;
+	if (q & 2)
+		sine = -sine;
+	if ((q + 1) & 2)
+		cosine = -cosine;
+}
+
+static void advance_scalar(float* angles, const float* speeds, int count, float time)
+{
+	for (int i = 0; i < count; i++)
+		angles[i] = wrap_angle(angles[i] + speeds[i] * time);
+}
+
+static void compute_factors_scalar(const BodyArrays& bodies, int body, FactorBlock& factors, int lane)
+{
+	float orbitSin, orbitCos, rotationSin, rotationCos;
+	sin_cos(bodies.orbitAngles[body] + bodies.orbitSpeeds[body] * bodies.time, orbitSin, orbitCos);
+	sin_cos(bodies.rotationAngles[body] + bodies.rotationSpeeds[body] * bodies.time, rotationSin, rotationCos);
+
+	float distance = bodies.orbitDistances[body];
+	float scale = bodies.scales[body];
+	float inverseScale = 1.0f / scale;
+
+	factors.scaledCos[lane] = scale * rotationCos;
+	factors.scaledSin[lane] = scale * rotationSin;
+	factors.scale[lane] = scale;
+	factors.translateX[lane] = distance * orbitCos;
+	factors.translateZ[lane] = -(distance * orbitSin);
+	factors.normalCos[lane] = rotationCos * inverseScale;
+	factors.normalSin[lane] = rotationSin * inverseScale;
+	factors.inverseScale[lane] = inverseScale;
+}
+
+static void write_body_scalar(const ParentColumns& parent, const FactorBlock& factors, int lane, InstanceData& instance)
+{
+	const float (*p)[4] = parent.model;
+	const float (*n)[4] = parent.normal;
+	float* model = &instance.modelMatrix[0][0];
+	float* normal = &instance.normalMatrix[0][0];
+
+	float scaledCos = factors.scaledCos[lane];
+	float scaledSin = factors.scaledSin[lane];
+	float normalCos = factors.normalCos[lane];
+	float normalSin = factors.normalSin[lane];
+
+	for (int k = 0; k < 4; k++)
+	{
+		model[k] = p[0][k] * scaledCos + p[2][k] * -scaledSin;
+		model[4 + k] = p[1][k] * factors.scale[lane];
+		model[8 + k] = p[0][k] * scaledSin + p[2][k] * scaledCos;
+		model[12 + k] = (p[0][k] * factors.translateX[lane] + p[2][k] * factors.translateZ[lane]) + p[3][k];
+
+		normal[k] = n[0][k] * normalCos + n[2][k] * -normalSin;
+		normal[4 + k] = n[1][k] * factors.inverseScale[lane];
+		normal[8 + k] = n[0][k] * normalSin + n[2][k] * normalCos;
+	}
+}
+
+static void compute_transforms_scalar(const BodyArrays& bodies, const ParentColumns& parent, InstanceData* instances)
+{
+	FactorBlock factors;
+
+	for (int first = 0; first < bodies.count; first += BLOCK_SIZE)
+	{
+		int lanes = std::min(BLOCK_SIZE, bodies.count - first);
+
+		for (int lane = 0; lane < lanes; lane++)
+			compute_factors_scalar(bodies, first + lane, factors, lane);
+		for (int lane = 0; lane < lanes; lane++)
+			write_body_scalar(parent, factors, lane, instances[first + lane]);
+	}
+}
+
+#if ORBIT_SYSTEM_X86
+
+/*************** SSE kernels ***************/
+
+// rounds to the nearest integer like std::nearbyint in the default rounding mode
+TARGET_SSE static inline __m128 round_sse(__m128 x)
+{
+	return _mm_cvtepi32_ps(_mm_cvtps_epi32(x));
+}
+
+TARGET_SSE static inline __m128 select_sse(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// same operations as sin_cos, four angles at a time
+TARGET_SSE static inline void sin_cos_sse(__m128 x, __m128& sine, __m128& cosine)
+{
+	__m128 quadrant = round_sse(_mm_mul_ps(x, _mm_set1_ps(TWO_OVER_PI)));
+	__m128i q = _mm_cvtps_epi32(quadrant);
+
+	__m128 r = _mm_sub_ps(x, _mm_mul_ps(quadrant, _mm_set1_ps(PIO2_A)));
+	r = _mm_sub_ps(r, _mm_mul_ps(quadrant, _mm_set1_ps(PIO2_B)));
+	r = _mm_sub_ps(r, _mm_mul_ps(quadrant, _mm_set1_ps(PIO2_C)));
+	__m128 z = _mm_mul_ps(r, r);
+
+	__m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_P0), z), _mm_set1_ps(SIN_P1));
+	s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(SIN_P2));
+	s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), r), r);
+
+	__m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_P0), z), _mm_set1_ps(COS_P1));
+	c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(COS_P2));
+	c = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(c, z), z), _mm_mul_ps(_mm_set1_ps(0.5f), z));
+	c = _mm_add_ps(c, _mm_set1_ps(1.0f));
+
+	// odd quadrants swap sine and cosine, bit 1 of the quadrant moves into the sign bit
+	__m128i one = _mm_set1_epi32(1);
+	__m128i two = _mm_set1_epi32(2);
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+	__m128 sineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30));
+	__m128 cosineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30));
+
+	sine = _mm_xor_ps(select_sse(swap, c, s), sineSign);
+	cosine = _mm_xor_ps(select_sse(swap, s, c), cosineSign);
+}
+
+TARGET_SSE static void advance_sse(float* angles, const float* speeds, int count, float time)
+{
+	__m128 elapsed = _mm_set1_ps(time);
+	int i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 angle = _mm_add_ps(_mm_loadu_ps(angles + i), _mm_mul_ps(_mm_loadu_ps(speeds + i), elapsed));
+		__m128 turns = round_sse(_mm_mul_ps(angle, _mm_set1_ps(INV_TWO_PI)));
+		_mm_storeu_ps(angles + i, _mm_sub_ps(angle, _mm_mul_ps(turns, _mm_set1_ps(TWO_PI))));
+	}
+
+	advance_scalar(angles + i, speeds + i, count - i, time);
+}
+
+// factors of four bodies starting at body into lanes starting at lane
+TARGET_SSE static void compute_factors_sse(const BodyArrays& bodies, int body, FactorBlock& factors, int lane)
+{
+	__m128 orbitSin, orbitCos, rotationSin, rotationCos;
+	__m128 time = _mm_set1_ps(bodies.time);
+	sin_cos_sse(_mm_add_ps(_mm_loadu_ps(bodies.orbitAngles + body), _mm_mul_ps(_mm_loadu_ps(bodies.orbitSpeeds + body), time)),
+		orbitSin, orbitCos);
+	sin_cos_sse(_mm_add_ps(_mm_loadu_ps(bodies.rotationAngles + body), _mm_mul_ps(_mm_loadu_ps(bodies.rotationSpeeds + body), time)),
+		rotationSin, rotationCos);
+
+	__m128 distance = _mm_loadu_ps(bodies.orbitDistances + body);
+	__m128 scale = _mm_loadu_ps(bodies.scales + body);
+	__m128 inverseScale = _mm_div_ps(_mm_set1_ps(1.0f), scale);
+	__m128 signBit = _mm_set1_ps(-0.0f);
+
+	_mm_storeu_ps(factors.scaledCos + lane, _mm_mul_ps(scale, rotationCos));
+	_mm_storeu_ps(factors.scaledSin + lane, _mm_mul_ps(scale, rotationSin));
+	_mm_storeu_ps(factors.scale + lane, scale);
+	_mm_storeu_ps(factors.translateX + lane, _mm_mul_ps(distance, orbitCos));
+	_mm_storeu_ps(factors.translateZ + lane, _mm_xor_ps(_mm_mul_ps(distance, orbitSin), signBit));
+	_mm_storeu_ps(factors.normalCos + lane, _mm_mul_ps(rotationCos, inverseScale));
+	_mm_storeu_ps(factors.normalSin + lane, _mm_mul_ps(rotationSin, inverseScale));
+	_mm_storeu_ps(factors.inverseScale + lane, inverseScale);
+}
+
+// same operations as write_body_scalar, one matrix column at a time
+TARGET_SSE static inline void write_body_sse(const __m128* p, const __m128* n, const FactorBlock& factors, int lane, InstanceData& instance)
+{
+	float* model = &instance.modelMatrix[0][0];
+	float* normal = &instance.normalMatrix[0][0];
+
+	__m128 scaledCos = _mm_set1_ps(factors.scaledCos[lane]);
+	__m128 scaledSin = _mm_set1_ps(factors.scaledSin[lane]);
+	__m128 normalCos = _mm_set1_ps(factors.normalCos[lane]);
+	__m128 normalSin = _mm_set1_ps(factors.normalSin[lane]);
+
+	_mm_storeu_ps(model, _mm_add_ps(_mm_mul_ps(p[0], scaledCos), _mm_mul_ps(p[2], _mm_set1_ps(-factors.scaledSin[lane]))));
+	_mm_storeu_ps(model + 4, _mm_mul_ps(p[1], _mm_set1_ps(factors.scale[lane])));
+	_mm_storeu_ps(model + 8, _mm_add_ps(_mm_mul_ps(p[0], scaledSin), _mm_mul_ps(p[2], scaledCos)));
+	_mm_storeu_ps(model + 12, _mm_add_ps(_mm_add_ps(_mm_mul_ps(p[0], _mm_set1_ps(factors.translateX[lane])),
+		_mm_mul_ps(p[2], _mm_set1_ps(factors.translateZ[lane]))), p[3]));
+
+	_mm_storeu_ps(normal, _mm_add_ps(_mm_mul_ps(n[0], normalCos), _mm_mul_ps(n[2], _mm_set1_ps(-factors.normalSin[lane]))));
+	_mm_storeu_ps(normal + 4, _mm_mul_ps(n[1], _mm_set1_ps(factors.inverseScale[lane])));
+	_mm_storeu_ps(normal + 8, _mm_add_ps(_mm_mul_ps(n[0], normalSin), _mm_mul_ps(n[2], normalCos)));
+}
+
+TARGET_SSE static void compute_transforms_sse(const BodyArrays& bodies, const ParentColumns& parent, InstanceData* instances)
+{
+	__m128 p[4], n[3];
+	for (int i = 0; i < 4; i++)
+		p[i] = _mm_load_ps(parent.model[i]);
+	for (int i = 0; i < 3; i++)
+		n[i] = _mm_load_ps(parent.normal[i]);
+
+	FactorBlock factors;
+
+	for (int first = 0; first < bodies.count; first += BLOCK_SIZE)
+	{
+		int lanes = std::min(BLOCK_SIZE, bodies.count - first);
+
+		if (lanes == BLOCK_SIZE)
+		{
+			compute_factors_sse(bodies, first, factors, 0);
+			compute_factors_sse(bodies, first + 4, factors, 4);
+		}
+		else
+		{
+			for (int lane = 0; lane < lanes; lane++)
+				compute_factors_scalar(bodies, first + lane, factors, lane);
+		}
+
+		for (int lane = 0; lane < lanes; lane++)
+			write_body_sse(p, n, factors, lane, instances[first + lane]);
+	}
+}
+
+/*************** AVX2 kernels ***************/
+
+TARGET_AVX2 static inline __m256 round_avx2(__m256 x)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtps_epi32(x));
+}
+
+TARGET_AVX2 static inline __m256 select_avx2(__m256 mask, __m256 a, __m256 b)
+{
+	return _mm256_or_ps(_mm256_and_ps(mask, a), _mm256_andnot_ps(mask, b));
+}
+
+// same operations as sin_cos, eight angles at a time
+TARGET_AVX2 static inline void sin_cos_avx2(__m256 x, __m256& sine, __m256& cosine)
+{
+	__m256 quadrant = round_avx2(_mm256_mul_ps(x, _mm256_set1_ps(TWO_OVER_PI)));
+	__m256i q = _mm256_cvtps_epi32(quadrant);
+
+	__m256 r = _mm256_sub_ps(x, _mm256_mul_ps(quadrant, _mm256_set1_ps(PIO2_A)));
+	r = _mm256_sub_ps(r, _mm256_mul_ps(quadrant, _mm256_set1_ps(PIO2_B)));
+	r = _mm256_sub_ps(r, _mm256_mul_ps(quadrant, _mm256_set1_ps(PIO2_C)));
+	__m256 z = _mm256_mul_ps(r, r);
+
+	__m256 s = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_P0), z), _mm256_set1_ps(SIN_P1));
+	s = _mm256_add_ps(_mm256_mul_ps(s, z), _mm256_set1_ps(SIN_P2));
+	s = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(s, z), r), r);
+
+	__m256 c = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(COS_P0), z), _mm256_set1_ps(COS_P1));
+	c = _mm256_add_ps(_mm256_mul_ps(c, z), _mm256_set1_ps(COS_P2));
+	c = _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(c, z), z), _mm256_mul_ps(_mm256_set1_ps(0.5f), z));
+	c = _mm256_add_ps(c, _mm256_set1_ps(1.0f));
+
+	__m256i one = _mm256_set1_epi32(1);
+	__m256i two = _mm256_set1_epi32(2);
+	__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+	__m256 sineSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+	__m256 cosineSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+
+	sine = _mm256_xor_ps(select_avx2(swap, c, s), sineSign);
+	cosine = _mm256_xor_ps(select_avx2(swap, s, c), cosineSign);
+}
+
+TARGET_AVX2 static void advance_avx2(float* angles, const float* speeds, int count, float time)
+{
+	__m256 elapsed = _mm256_set1_ps(time);
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 angle = _mm256_add_ps(_mm256_loadu_ps(angles + i), _mm256_mul_ps(_mm256_loadu_ps(speeds + i), elapsed));
+		__m256 turns = round_avx2(_mm256_mul_ps(angle, _mm256_set1_ps(INV_TWO_PI)));
+		_mm256_storeu_ps(angles + i, _mm256_sub_ps(angle, _mm256_mul_ps(turns, _mm256_set1_ps(TWO_PI))));
+	}
+
+	advance_scalar(angles + i, speeds + i, count - i, time);
+}
+
+// factors of a full block of bodies starting at body
+TARGET_AVX2 static void compute_factors_avx2(const BodyArrays& bodies, int body, FactorBlock& factors)
+{
+	__m256 orbitSin, orbitCos, rotationSin, rotationCos;
+	__m256 time = _mm256_set1_ps(bodies.time);
+	sin_cos_avx2(_mm256_add_ps(_mm256_loadu_ps(bodies.orbitAngles + body), _mm256_mul_ps(_mm256_loadu_ps(bodies.orbitSpeeds + body), time)),
+		orbitSin, orbitCos);
+	sin_cos_avx2(_mm256_add_ps(_mm256_loadu_ps(bodies.rotationAngles + body), _mm256_mul_ps(_mm256_loadu_ps(bodies.rotationSpeeds + body), time)),
+		rotationSin, rotationCos);
+
+	__m256 distance = _mm256_loadu_ps(bodies.orbitDistances + body);
+	__m256 scale = _mm256_loadu_ps(bodies.scales + body);
+	__m256 inverseScale = _mm256_div_ps(_mm256_set1_ps(1.0f), scale);
+	__m256 signBit = _mm256_set1_ps(-0.0f);
+
+	_mm256_store_ps(factors.scaledCos, _mm256_mul_ps(scale, rotationCos));
+	_mm256_store_ps(factors.scaledSin, _mm256_mul_ps(scale, rotationSin));
+	_mm256_store_ps(factors.scale, scale);
+	_mm256_store_ps(factors.translateX, _mm256_mul_ps(distance, orbitCos));
+	_mm256_store_ps(factors.translateZ, _mm256_xor_ps(_mm256_mul_ps(distance, orbitSin), signBit));
+	_mm256_store_ps(factors.normalCos, _mm256_mul_ps(rotationCos, inverseScale));
+	_mm256_store_ps(factors.normalSin, _mm256_mul_ps(rotationSin, inverseScale));
+	_mm256_store_ps(factors.inverseScale, inverseScale);
+}
+
+// trigonometry runs eight bodies wide, matrices are written a column at a time with SSE
+TARGET_AVX2 static void compute_transforms_avx2(const BodyArrays& bodies, const ParentColumns& parent, InstanceData* instances)
+{
+	__m128 p[4], n[3];
+	for (int i = 0; i < 4; i++)
+		p[i] = _mm_load_ps(parent.model[i]);
+	for (int i = 0; i < 3; i++)
+		n[i] = _mm_load_ps(parent.normal[i]);
+
+	FactorBlock factors;
+
+	for (int first = 0; first < bodies.count; first += BLOCK_SIZE)
+	{
+		int lanes = std::min(BLOCK_SIZE, bodies.count - first);
+
+		if (lanes == BLOCK_SIZE)
+		{
+			compute_factors_avx2(bodies, first, factors);
+		}
+		else
+		{
+			for (int lane = 0; lane < lanes; lane++)
+				compute_factors_scalar(bodies, first + lane, factors, lane);
+		}
+
+		for (int lane = 0; lane < lanes; lane++)
+			write_body_sse(p, n, factors, lane, instances[first + lane]);
+	}
+}
+
+#endif
+
+/*************** OrbitSystem ***************/
+
+// best instruction set supported by the CPU and operating system
+static SimdLevel detect_simd_level()
+{
+#if ORBIT_SYSTEM_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool avx2 = false;
+
+	if (maxLeaf >= 7 && osxsave && avx)
+	{
+		// the operating system must also save the upper halves of the registers
+		bool ymmState = (_xgetbv(0) & 0x6) == 0x6;
+		__cpuidex(info, 7, 0);
+		avx2 = ymmState && (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	bool sse2 = __builtin_cpu_supports("sse2") != 0;
+	bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+
+	if (avx2)
+		return SimdLevel::AVX2;
+	if (sse2)
+		return SimdLevel::SSE;
+#endif
+
+	return SimdLevel::SCALAR;
+}
+
+SimdLevel OrbitSystem::getBestSimdLevel()
+{
+	static const SimdLevel level = detect_simd_level();
+	return level;
+}
+
+const char* OrbitSystem::getSimdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::SSE: return "SSE";
+	case SimdLevel::AVX2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+// add a body and return its index
+int OrbitSystem::addBody(float orbitSpeed, float rotationSpeed, float orbitDistance, float scale,
+	float orbitAngle, float rotationAngle)
+{
+	mOrbitAngles.push_back(wrap_angle(orbitAngle));
+	mOrbitSpeeds.push_back(orbitSpeed);
+	mRotationAngles.push_back(wrap_angle(rotationAngle));
+	mRotationSpeeds.push_back(rotationSpeed);
+	mOrbitDistances.push_back(orbitDistance);
+	mScales.push_back(scale);
+
+	return getBodyCount() - 1;
+}
+
+// remove all bodies
+void OrbitSystem::clear()
+{
+	mOrbitAngles.clear();
+	mOrbitSpeeds.clear();
+	mRotationAngles.clear();
+	mRotationSpeeds.clear();
+	mOrbitDistances.clear();
+	mScales.clear();
+}
+
+void OrbitSystem::reserve(int bodyCount)
+{
+	mOrbitAngles.reserve(bodyCount);
+	mOrbitSpeeds.reserve(bodyCount);
+	mRotationAngles.reserve(bodyCount);
+	mRotationSpeeds.reserve(bodyCount);
+	mOrbitDistances.reserve(bodyCount);
+	mScales.reserve(bodyCount);
+}
+
+void OrbitSystem::setOrbitSpeed(int body, float orbitSpeed)
+{
+	mOrbitSpeeds[body] = orbitSpeed;
+}
+
+void OrbitSystem::setRotationSpeed(int body, float rotationSpeed)
+{
+	mRotationSpeeds[body] = rotationSpeed;
+}
+
+void OrbitSystem::setOrbitDistance(int body, float orbitDistance)
+{
+	mOrbitDistances[body] = orbitDistance;
+}
+
+void OrbitSystem::setScale(int body, float scale)
+{
+	assert(scale != 0.0f);
+	mScales[body] = scale;
+}
+
+float OrbitSystem::getOrbitAngle(int body) const
+{
+	return mOrbitAngles[body];
+}
+
+float OrbitSystem::getRotationAngle(int body) const
+{
+	return mRotationAngles[body];
+}
+
+int OrbitSystem::getBodyCount() const
+{
+	return static_cast<int>(mOrbitAngles.size());
+}
+
+// advance all angles by their speed times the elapsed time
+void OrbitSystem::advance(float time, SimdLevel level)
+{
+	advance(time, 0, getBodyCount(), level);
+}
+
+// advance the angles of a range of bodies
+void OrbitSystem::advance(float time, int firstBody, int bodyCount, SimdLevel level)
+{
+	assert(firstBody >= 0 && firstBody + bodyCount <= getBodyCount());
+
+	const int count = bodyCount;
+	if (count == 0)
+		return;
+
+	float* orbitAngles = mOrbitAngles.data() + firstBody;
+	float* rotationAngles = mRotationAngles.data() + firstBody;
+	const float* orbitSpeeds = mOrbitSpeeds.data() + firstBody;
+	const float* rotationSpeeds = mRotationSpeeds.data() + firstBody;
+
+	// never run a kernel the CPU does not support
+	if (level > getBestSimdLevel())
+		level = getBestSimdLevel();
+
+	switch (level)
+	{
+#if ORBIT_SYSTEM_X86
+	case SimdLevel::AVX2:
+		advance_avx2(orbitAngles, orbitSpeeds, count, time);
+		advance_avx2(rotationAngles, rotationSpeeds, count, time);
+		break;
+	case SimdLevel::SSE:
+		advance_sse(orbitAngles, orbitSpeeds, count, time);
+		advance_sse(rotationAngles, rotationSpeeds, count, time);
+		break;
+#endif
+	default:
+		advance_scalar(orbitAngles, orbitSpeeds, count, time);
+		advance_scalar(rotationAngles, rotationSpeeds, count, time);
+		break;
+	}
+}
+
+// write model and normal matrices of all bodies below parent
+void OrbitSystem::computeTransforms(const glm::mat4& parentMatrix, InstanceData* instances, float time, SimdLevel level) const
+{
+	computeTransforms(parentMatrix, instances, 0, getBodyCount(), time, level);
+}
+
+// write model and normal matrices of a range of bodies
+void OrbitSystem::computeTransforms(const glm::mat4& parentMatrix, InstanceData* instances, int firstBody, int bodyCount,
+	float time, SimdLevel level) const
+{
+	assert(firstBody >= 0 && firstBody + bodyCount <= getBodyCount());
+
+	BodyArrays bodies = { mOrbitAngles.data() + firstBody, mOrbitSpeeds.data() + firstBody,
+		mRotationAngles.data() + firstBody, mRotationSpeeds.data() + firstBody,
+		mOrbitDistances.data() + firstBody, mScales.data() + firstBody, bodyCount, time };
+	if (bodies.count == 0)
+		return;
+
+	instances += firstBody;
+
+	// the parent's normal matrix is computed once, the bodies only add a rotation and uniform scale
+	glm::mat3 parentNormal = glm::transpose(glm::inverse(glm::mat3(parentMatrix)));
+
+	ParentColumns parent;
+	for (int i = 0; i < 4; i++)
+	{
+		for (int k = 0; k < 4; k++)
+			parent.model[i][k] = parentMatrix[i][k];
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		for (int k = 0; k < 3; k++)
+			parent.normal[i][k] = parentNormal[i][k];
+		parent.normal[i][3] = 0.0f;
+	}
+
+	if (level > getBestSimdLevel())
+		level = getBestSimdLevel();
+
+	switch (level)
+	{
+#if ORBIT_SYSTEM_X86
+	case SimdLevel::AVX2:
+		compute_transforms_avx2(bodies, parent, instances);
+		break;
+	case SimdLevel::SSE:
+		compute_transforms_sse(bodies, parent, instances);
+		break;
+#endif
+	default:
+		compute_transforms_scalar(bodies, parent, instances);
+		break;
+	}
+}
+
+// transform of one body relative to the parent
+glm::mat4 OrbitSystem::getLocalTransform(int body, float time) const
+{
+	BodyArrays bodies = { mOrbitAngles.data(), mOrbitSpeeds.data(), mRotationAngles.data(), mRotationSpeeds.data(),
+		mOrbitDistances.data(), mScales.data(), getBodyCount(), time };
+	FactorBlock factors;
+	compute_factors_scalar(bodies, body, factors, 0);
+
+	glm::mat4 transform(1.0f);
+	transform[0] = glm::vec4(factors.scaledCos[0], 0.0f, -factors.scaledSin[0], 0.0f);
+	transform[1] = glm::vec4(0.0f, factors.scale[0], 0.0f, 0.0f);
+	transform[2] = glm::vec4(factors.scaledSin[0], 0.0f, factors.scaledCos[0], 0.0f);
+	transform[3] = glm::vec4(factors.translateX[0], 0.0f, factors.translateZ[0], 1.0f);
+
+	return transform;
+}
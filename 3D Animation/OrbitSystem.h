@@ -0,0 +1,74 @@
+#ifndef ORBIT_SYSTEM_H
+#define ORBIT_SYSTEM_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+struct InstanceData;
+
+// instruction sets the orbit kernels can run with
+enum class SimdLevel
+{
+	SCALAR,
+	SSE,
+	AVX2
+};
+
+/*****************************************************************
+ * bodies orbiting a common parent, stored as structure of arrays
+ * each body orbits at a distance around the parent's y axis while
+ * spinning about its own y axis, angles are advanced and matrices
+ * built for whole arrays at once with SSE/AVX2 kernels
+ * every kernel performs the same float operations in the same
+ * order, so all instruction sets produce bitwise identical results
+ *****************************************************************/
+class OrbitSystem
+{
+public:
+	// add a body and return its index
+	int addBody(float orbitSpeed, float rotationSpeed, float orbitDistance, float scale,
+		float orbitAngle = 0.0f, float rotationAngle = 0.0f);
+	// remove all bodies
+	void clear();
+	void reserve(int bodyCount);
+
+	void setOrbitSpeed(int body, float orbitSpeed);
+	void setRotationSpeed(int body, float rotationSpeed);
+	void setOrbitDistance(int body, float orbitDistance);
+	void setScale(int body, float scale);
+
+	float getOrbitAngle(int body) const;
+	float getRotationAngle(int body) const;
+	int getBodyCount() const;
+
+	// advance all angles by their speed times the elapsed time, angles are kept within [-pi, pi]
+	void advance(float time, SimdLevel level = getBestSimdLevel());
+	// write model and normal matrices of all bodies below parent, material indices are left as they are
+	// bodies are placed where they will be time seconds after their stored angles, which interpolates
+	// between two simulation steps without changing the state
+	void computeTransforms(const glm::mat4& parentMatrix, InstanceData* instances, float time = 0.0f,
+		SimdLevel level = getBestSimdLevel()) const;
+
+	// the same for bodies [firstBody, firstBody + bodyCount) only, so ranges can be updated on different threads
+	// instances is indexed by body, the range writes instances[firstBody] onwards
+	void advance(float time, int firstBody, int bodyCount, SimdLevel level = getBestSimdLevel());
+	void computeTransforms(const glm::mat4& parentMatrix, InstanceData* instances, int firstBody, int bodyCount,
+		float time = 0.0f, SimdLevel level = getBestSimdLevel()) const;
+
+	// transform of one body relative to the parent time seconds after its stored angles, for nodes in the scene graph
+	glm::mat4 getLocalTransform(int body, float time = 0.0f) const;
+
+	// best instruction set supported by the CPU and operating system
+	static SimdLevel getBestSimdLevel();
+	static const char* getSimdLevelName(SimdLevel level);
+
+private:
+	std::vector<float> mOrbitAngles;		// radians around the parent
+	std::vector<float> mOrbitSpeeds;		// radians per second around the parent
+	std::vector<float> mRotationAngles;		// radians about the body's own axis
+	std::vector<float> mRotationSpeeds;		// radians per second about the body's own axis
+	std::vector<float> mOrbitDistances;		// distance from the parent
+	std::vector<float> mScales;				// uniform scale of the body
+};
+
+#endif
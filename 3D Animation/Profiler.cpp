@@ -0,0 +1,213 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// smallest time at least percent of the samples are within, times must be sorted
+static double get_percentile(const std::vector<double>& times, double percent)
+{
+	std::size_t rank = static_cast<std::size_t>(std::ceil(percent / 100.0 * times.size()));
+	return times[std::min(std::max(rank, std::size_t(1)), times.size()) - 1];
+}
+
+TimeStats compute_time_stats(std::vector<double> times)
+{
+	TimeStats stats;
+	if (times.empty())
+		return stats;
+
+	std::sort(times.begin(), times.end());
+
+	double sum = 0.0;
+	for (double time : times)
+		sum += time;
+
+	stats.count = static_cast<int>(times.size());
+	stats.mean = sum / times.size();
+	stats.p50 = get_percentile(times, 50.0);
+	stats.p90 = get_percentile(times, 90.0);
+	stats.p95 = get_percentile(times, 95.0);
+	stats.p99 = get_percentile(times, 99.0);
+	stats.max = times.back();
+
+	return stats;
+}
+
+TimeHistory::TimeHistory(int capacity)
+	: mSamples(std::max(capacity, 1))
+{
+}
+
+void TimeHistory::add(double time)
+{
+	const int capacity = getCapacity();
+
+	if (mCount < capacity)
+	{
+		mSamples[(mFirst + mCount) % capacity] = time;
+		mCount++;
+	}
+	else
+	{
+		mSamples[mFirst] = time;
+		mFirst = (mFirst + 1) % capacity;
+	}
+}
+
+void TimeHistory::clear()
+{
+	mFirst = 0;
+	mCount = 0;
+}
+
+void TimeHistory::setCapacity(int capacity)
+{
+	capacity = std::max(capacity, 1);
+	if (capacity == getCapacity())
+		return;
+
+	const int keep = std::min(mCount, capacity);
+	std::vector<double> samples(capacity);
+	for (int i = 0; i < keep; i++)
+		samples[i] = get(mCount - keep + i);
+
+	mSamples.swap(samples);
+	mFirst = 0;
+	mCount = keep;
+}
+
+double TimeHistory::get(int i) const
+{
+	assert(i >= 0 && i < mCount);
+	return mSamples[(mFirst + i) % getCapacity()];
+}
+
+TimeStats TimeHistory::getStats() const
+{
+	std::vector<double> times(mCount);
+	for (int i = 0; i < mCount; i++)
+		times[i] = get(i);
+
+	return compute_time_stats(std::move(times));
+}
+
+Profiler::~Profiler()
+{
+	release();
+}
+
+int Profiler::addScope(const char* name, bool gpu)
+{
+	Scope scope;
+	scope.name = name;
+	scope.gpu = gpu;
+	scope.cpuTimes.setCapacity(mHistorySize);
+	scope.gpuTimes.setCapacity(mHistorySize);
+
+	if (gpu)
+		glGenQueries(QUERY_FRAMES, scope.queries);
+
+	mScopes.push_back(scope);
+	return static_cast<int>(mScopes.size()) - 1;
+}
+
+void Profiler::beginFrame()
+{
+	mFrame++;
+	const int slot = getQuerySlot();
+
+	// the queries of this slot were issued QUERY_FRAMES frames ago and are about to be reused
+	for (Scope& scope : mScopes)
+	{
+		if (!scope.pending[slot])
+			continue;
+
+		scope.pending[slot] = false;
+
+		GLint available = 0;
+		glGetQueryObjectiv(scope.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			mDroppedQueries++;
+			continue;
+		}
+
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(scope.queries[slot], GL_QUERY_RESULT, &nanoseconds);
+		scope.gpuTimes.add(nanoseconds / 1e6);
+	}
+
+	mFrameStart = Clock::now();
+}
+
+void Profiler::endFrame()
+{
+	mFrameTimes.add(std::chrono::duration<double, std::milli>(Clock::now() - mFrameStart).count());
+}
+
+void Profiler::begin(int scope)
+{
+	Scope& timed = mScopes[scope];
+	assert(!timed.active);
+
+	timed.active = true;
+	timed.start = Clock::now();
+
+	if (timed.gpu)
+		glBeginQuery(GL_TIME_ELAPSED, timed.queries[getQuerySlot()]);
+}
+
+void Profiler::end(int scope)
+{
+	Scope& timed = mScopes[scope];
+	if (!timed.active)
+		return;
+
+	if (timed.gpu)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		timed.pending[getQuerySlot()] = true;
+	}
+
+	timed.active = false;
+	timed.cpuTimes.add(std::chrono::duration<double, std::milli>(Clock::now() - timed.start).count());
+}
+
+void Profiler::setHistorySize(int frames)
+{
+	mHistorySize = std::max(frames, 1);
+	mFrameTimes.setCapacity(mHistorySize);
+
+	for (Scope& scope : mScopes)
+	{
+		scope.cpuTimes.setCapacity(mHistorySize);
+		scope.gpuTimes.setCapacity(mHistorySize);
+	}
+}
+
+void Profiler::reset()
+{
+	mFrameTimes.clear();
+	mDroppedQueries = 0;
+
+	for (Scope& scope : mScopes)
+	{
+		scope.cpuTimes.clear();
+		scope.gpuTimes.clear();
+		std::fill(scope.pending, scope.pending + QUERY_FRAMES, false);
+	}
+}
+
+void Profiler::release()
+{
+	for (Scope& scope : mScopes)
+	{
+		if (scope.gpu && scope.queries[0] != 0)
+			glDeleteQueries(QUERY_FRAMES, scope.queries);
+
+		std::fill(scope.queries, scope.queries + QUERY_FRAMES, 0u);
+		std::fill(scope.pending, scope.pending + QUERY_FRAMES, false);
+		scope.gpu = false;
+	}
+}
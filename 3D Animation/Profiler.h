@@ -0,0 +1,139 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <vector>
+
+#include <GLEW/glew.h>
+
+// distribution of times in milliseconds, percentiles by nearest rank
+struct TimeStats
+{
+	int count = 0;
+	double mean = 0.0;
+	double p50 = 0.0;
+	double p90 = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+	double max = 0.0;
+};
+
+TimeStats compute_time_stats(std::vector<double> times);
+
+/*****************************************************************
+ * the last samples of a time, oldest first
+ * the newest sample replaces the oldest once the history is full
+ *****************************************************************/
+class TimeHistory
+{
+public:
+	explicit TimeHistory(int capacity = 240);
+
+	void add(double time);
+	void clear();
+	// keeps the newest samples that still fit
+	void setCapacity(int capacity);
+
+	int getCount() const { return mCount; }
+	int getCapacity() const { return static_cast<int>(mSamples.size()); }
+	// sample i, 0 is the oldest
+	double get(int i) const;
+	double getLatest() const { return mCount > 0 ? get(mCount - 1) : 0.0; }
+
+	TimeStats getStats() const;
+
+private:
+	std::vector<double> mSamples;
+	int mFirst = 0;		// index of the oldest sample
+	int mCount = 0;
+};
+
+/*****************************************************************
+ * CPU and GPU times of named scopes, the passes of a frame
+ * CPU times come from a steady clock, GPU times from one ring of
+ * GL_TIME_ELAPSED queries per scope, read QUERY_FRAMES frames after
+ * they were issued so reading never waits for the GPU
+ * GPU scopes can't overlap, GL has one time elapsed query at a time
+ * all calls are made on the GL thread
+ *****************************************************************/
+class Profiler
+{
+public:
+	static const int QUERY_FRAMES = 4;		// frames a GPU time is read after, queries per scope
+
+	Profiler() = default;
+	~Profiler();
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	// add a scope and return its index, gpu also times it on the GPU, which needs a GL context
+	int addScope(const char* name, bool gpu);
+
+	// read the GPU times that are ready and start timing a frame
+	void beginFrame();
+	// the time since beginFrame goes into the frame history
+	void endFrame();
+
+	void begin(int scope);
+	void end(int scope);
+
+	// frames kept in every history, the stats are over this many frames
+	void setHistorySize(int frames);
+	// forget all samples, e.g. after warming up, GPU times already in flight are dropped
+	void reset();
+	// delete the queries while the context is current
+	void release();
+
+	int getScopeCount() const { return static_cast<int>(mScopes.size()); }
+	const char* getName(int scope) const { return mScopes[scope].name; }
+	bool hasGpuTimes(int scope) const { return mScopes[scope].gpu; }
+
+	const TimeHistory& getFrameTimes() const { return mFrameTimes; }
+	const TimeHistory& getCpuTimes(int scope) const { return mScopes[scope].cpuTimes; }
+	const TimeHistory& getGpuTimes(int scope) const { return mScopes[scope].gpuTimes; }
+
+	// GPU times that were not ready when their query was needed again
+	int getDroppedQueries() const { return mDroppedQueries; }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Scope
+	{
+		const char* name;
+		bool gpu;
+		TimeHistory cpuTimes;
+		TimeHistory gpuTimes;
+		Clock::time_point start;
+		bool active = false;
+		GLuint queries[QUERY_FRAMES] = {};
+		bool pending[QUERY_FRAMES] = {};	// issued and not read yet
+	};
+
+	std::vector<Scope> mScopes;
+	TimeHistory mFrameTimes;
+	Clock::time_point mFrameStart;
+	int mFrame = 0;
+	int mHistorySize = 240;
+	int mDroppedQueries = 0;
+
+	int getQuerySlot() const { return mFrame % QUERY_FRAMES; }
+};
+
+// times a scope from construction to destruction
+class ProfileScope
+{
+public:
+	ProfileScope(Profiler& profiler, int scope) : mProfiler(profiler), mScope(scope) { mProfiler.begin(mScope); }
+	~ProfileScope() { mProfiler.end(mScope); }
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	Profiler& mProfiler;
+	int mScope;
+};
+
+#endif
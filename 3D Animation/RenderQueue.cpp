@@ -0,0 +1,155 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cassert>
+
+static const int SORT_DEPTH_SHIFT = 0;
+static const int SORT_MESH_SHIFT = SORT_DEPTH_SHIFT + SORT_DEPTH_BITS;
+static const int SORT_MATERIAL_SHIFT = SORT_MESH_SHIFT + SORT_MESH_BITS;
+static const int SORT_SHADER_SHIFT = SORT_MATERIAL_SHIFT + SORT_MATERIAL_BITS;
+static const int SORT_PASS_SHIFT = SORT_SHADER_SHIFT + SORT_SHADER_BITS;
+static_assert(SORT_PASS_SHIFT + SORT_PASS_BITS == 64, "sort key fields must fill 64 bits");
+
+// radix sort digits
+static const int DIGIT_BITS = 8;
+static const int DIGIT_COUNT = 64 / DIGIT_BITS;
+static const int BUCKET_COUNT = 1 << DIGIT_BITS;
+
+static std::uint64_t get_mask(int bits)
+{
+	return (std::uint64_t(1) << bits) - 1;
+}
+
+static std::uint32_t get_field(std::uint64_t key, int shift, int bits)
+{
+	return static_cast<std::uint32_t>((key >> shift) & get_mask(bits));
+}
+
+std::uint64_t make_sort_key(RenderPass pass, std::uint32_t shader, std::uint32_t material, std::uint32_t mesh, std::uint32_t depth)
+{
+	return (static_cast<std::uint64_t>(pass) & get_mask(SORT_PASS_BITS)) << SORT_PASS_SHIFT |
+		(shader & get_mask(SORT_SHADER_BITS)) << SORT_SHADER_SHIFT |
+		(material & get_mask(SORT_MATERIAL_BITS)) << SORT_MATERIAL_SHIFT |
+		(mesh & get_mask(SORT_MESH_BITS)) << SORT_MESH_SHIFT |
+		(depth & get_mask(SORT_DEPTH_BITS)) << SORT_DEPTH_SHIFT;
+}
+
+RenderPass get_sort_pass(std::uint64_t key)
+{
+	return static_cast<RenderPass>(get_field(key, SORT_PASS_SHIFT, SORT_PASS_BITS));
+}
+
+std::uint32_t get_sort_shader(std::uint64_t key)
+{
+	return get_field(key, SORT_SHADER_SHIFT, SORT_SHADER_BITS);
+}
+
+std::uint32_t get_sort_material(std::uint64_t key)
+{
+	return get_field(key, SORT_MATERIAL_SHIFT, SORT_MATERIAL_BITS);
+}
+
+std::uint32_t get_sort_mesh(std::uint64_t key)
+{
+	return get_field(key, SORT_MESH_SHIFT, SORT_MESH_BITS);
+}
+
+std::uint32_t get_sort_depth(std::uint64_t key)
+{
+	return get_field(key, SORT_DEPTH_SHIFT, SORT_DEPTH_BITS);
+}
+
+std::uint32_t quantize_depth(float depth, float nearPlane, float farPlane)
+{
+	const float maxDepth = static_cast<float>(get_mask(SORT_DEPTH_BITS));
+	float fraction = (depth - nearPlane) / (farPlane - nearPlane);
+
+	// written so NaN ends up at the near plane
+	if (!(fraction > 0.0f))
+		return 0;
+	if (fraction >= 1.0f)
+		return static_cast<std::uint32_t>(maxDepth);
+
+	return static_cast<std::uint32_t>(fraction * maxDepth);
+}
+
+void RenderQueue::reset(int maxItems)
+{
+	if (mItems.size() < static_cast<std::size_t>(maxItems))
+	{
+		mItems.resize(maxItems);
+		mScratch.resize(maxItems);
+	}
+
+	mCount.store(0, std::memory_order_relaxed);
+}
+
+RenderItem* RenderQueue::reserve(int count)
+{
+	int first = mCount.fetch_add(count, std::memory_order_relaxed);
+	assert(first + count <= static_cast<int>(mItems.size()));
+
+	return mItems.data() + first;
+}
+
+void RenderQueue::submit(std::uint64_t key, std::uint32_t value)
+{
+	RenderItem* item = reserve(1);
+	item->key = key;
+	item->value = value;
+}
+
+void RenderQueue::sort()
+{
+	const int count = getCount();
+	mSortPasses = 0;
+
+	if (count < 2)
+		return;
+
+	// histograms of every digit in one read of the keys
+	int histograms[DIGIT_COUNT][BUCKET_COUNT] = {};
+
+	for (int i = 0; i < count; i++)
+	{
+		std::uint64_t key = mItems[i].key;
+		for (int digit = 0; digit < DIGIT_COUNT; digit++)
+			histograms[digit][(key >> (digit * DIGIT_BITS)) & (BUCKET_COUNT - 1)]++;
+	}
+
+	// least significant digit first, each pass is stable so the order of the earlier digits survives
+	for (int digit = 0; digit < DIGIT_COUNT; digit++)
+	{
+		const int shift = digit * DIGIT_BITS;
+		int* histogram = histograms[digit];
+
+		// a digit all keys share leaves the order as it is, e.g. the pass and shader bytes of the fleet
+		if (histogram[(mItems[0].key >> shift) & (BUCKET_COUNT - 1)] == count)
+			continue;
+
+		int offset = 0;
+		for (int bucket = 0; bucket < BUCKET_COUNT; bucket++)
+		{
+			int bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+
+		const RenderItem* source = mItems.data();
+		RenderItem* target = mScratch.data();
+		for (int i = 0; i < count; i++)
+			target[histogram[(source[i].key >> shift) & (BUCKET_COUNT - 1)]++] = source[i];
+
+		mItems.swap(mScratch);
+		mSortPasses++;
+	}
+}
+
+int RenderQueue::findFirst(std::uint64_t key) const
+{
+	const RenderItem* end = mItems.data() + getCount();
+	const RenderItem* item = std::lower_bound(mItems.data(), end, key,
+		[](const RenderItem& item, std::uint64_t value) { return item.key < value; });
+
+	return static_cast<int>(item - mItems.data());
+}
@@ -0,0 +1,79 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// fields of a sort key from the most to the least significant, so items sort by pass first and depth last
+const int SORT_PASS_BITS = 4;
+const int SORT_SHADER_BITS = 8;
+const int SORT_MATERIAL_BITS = 12;
+const int SORT_MESH_BITS = 16;
+const int SORT_DEPTH_BITS = 24;
+
+// passes in the order they are drawn
+enum class RenderPass { SOLID, LINES };
+
+// one draw of a frame, value tells the system that submitted it what to draw
+struct RenderItem
+{
+	std::uint64_t key;
+	std::uint32_t value;
+};
+
+// pack the fields of a sort key, each field is cut to its bits
+std::uint64_t make_sort_key(RenderPass pass, std::uint32_t shader, std::uint32_t material, std::uint32_t mesh, std::uint32_t depth);
+
+RenderPass get_sort_pass(std::uint64_t key);
+std::uint32_t get_sort_shader(std::uint64_t key);
+std::uint32_t get_sort_material(std::uint64_t key);
+std::uint32_t get_sort_mesh(std::uint64_t key);
+std::uint32_t get_sort_depth(std::uint64_t key);
+
+// depth between the near and far planes as SORT_DEPTH_BITS bits, nearer is smaller so opaque items
+// draw front to back, depths outside the planes are clamped
+std::uint32_t quantize_depth(float depth, float nearPlane, float farPlane);
+
+/*****************************************************************
+ * draws of one frame, submitted in any order and drawn in the order
+ * of their sort keys so shader and mesh changes are grouped and
+ * opaque draws go front to back
+ * several threads can reserve items at once, each fills its own
+ * range, sorting is a radix sort over the bytes of the keys that
+ * skips bytes every key shares
+ * storage grows to the largest frame and is reused after that
+ *****************************************************************/
+class RenderQueue
+{
+public:
+	RenderQueue() : mCount(0) {}
+
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator=(const RenderQueue&) = delete;
+
+	// empty the queue with room for maxItems, call before any thread submits
+	void reset(int maxItems);
+	// count consecutive items to fill in, safe to call from several threads
+	RenderItem* reserve(int count);
+	void submit(std::uint64_t key, std::uint32_t value);
+
+	// sort by key, items with equal keys keep the order they have in the queue
+	void sort();
+
+	// first item with a key of at least key, getCount if there is none, for sorted queues
+	int findFirst(std::uint64_t key) const;
+
+	const RenderItem* getItems() const { return mItems.data(); }
+	int getCount() const { return mCount.load(std::memory_order_relaxed); }
+	// byte passes the last sort needed, 0 to 8
+	int getSortPasses() const { return mSortPasses; }
+
+private:
+	std::vector<RenderItem> mItems;
+	std::vector<RenderItem> mScratch;	// target of every other radix pass
+	std::atomic<int> mCount;
+	int mSortPasses = 0;
+};
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef RENDER_TYPES_H
+#define RENDER_TYPES_H
+
+#include <cmath>
+#include <vector>
+
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+/*****************************************************************
+ * vertex, instance and uniform block layouts shared by the CPU
+ * modules and the shaders, with the shapes generated on the CPU
+ * only the GL types and glm are needed, so the CPU modules build
+ * without a window system, see utilities.h for the rest
+ *****************************************************************/
+
+// vertex attribute format
+struct VertexColor
+{
+	GLfloat position[3];
+	GLfloat color[3];
+};
+
+struct VertexNormal
+{
+	GLfloat position[3];
+	GLfloat normal[3];
+};
+
+struct VertexNormTex
+{
+	GLfloat position[3];
+	GLfloat normal[3];
+	GLfloat texCoord[2];
+};
+
+struct VertexNormTex2
+{
+	GLfloat position[3];
+	GLfloat normal[3];
+	GLfloat texCoord1[2];
+	GLfloat texCoord2[2];
+};
+
+// packed vertex formats, see VertexPacking.h
+// positions are normalized to the mesh bounds and decoded by the shader with the mesh's scale and offset
+struct VertexPacked
+{
+	GLushort position[4];	// unsigned normalized, w is padding
+	GLshort normal[2];		// signed normalized octahedral encoding
+};
+
+struct VertexPackedTex
+{
+	GLushort position[4];
+	GLshort normal[2];
+	GLhalf texCoord[2];		// half floats
+};
+
+// layout of a mesh's vertex buffer
+enum class VertexFormat
+{
+	NORMAL,			// VertexNormal
+	NORM_TEX,		// VertexNormTex
+	PACKED,			// VertexPacked
+	PACKED_TEX		// VertexPackedTex
+};
+
+// uniform block binding points, must match the blocks declared in the shaders
+const GLuint FRAME_BLOCK_BINDING = 0;		// camera and light data, bound once per frame
+const GLuint MATERIAL_BLOCK_BINDING = 1;	// table of all materials
+const GLuint OBJECT_BLOCK_BINDING = 2;		// per object matrices and material index
+const GLuint CLUSTER_BLOCK_BINDING = 3;		// cluster grid of the clustered lights, see LightClusters.h
+const int MAX_MATERIALS = 16;				// size of the material table, see MAX_MATERIALS in animation.frag
+const int MAX_LIGHTS = 4;					// size of the light array in FrameBlock, see MAX_LIGHTS in the shaders
+
+// texture units of the clustered light buffers, unit 0 is left to the diffuse texture
+const GLint CLUSTER_GRID_UNIT = 1;			// offset and count of each cluster's light indices
+const GLint CLUSTER_INDEX_UNIT = 2;			// light indices of all clusters
+const GLint CLUSTER_LIGHT_UNIT = 3;			// light data
+
+// Light::type values, also the LIGHT_TYPE of a shader variant
+const int POINT_LIGHT = 1;
+const int DIRECTIONAL_LIGHT = 2;
+const int SPOT_LIGHT = 3;
+
+// std140 layout of the Light struct in the shaders
+struct LightBlock
+{
+	glm::vec3 pos;
+	float innerCos;		// spotlight cone as cosines, full intensity within the inner angle
+	glm::vec3 dir;
+	float outerCos;
+	glm::vec3 La;
+	float pad0;
+	glm::vec3 Ld;
+	float pad1;
+	glm::vec3 Ls;
+	float pad2;
+	glm::vec3 att;
+	float pad3;
+};
+
+// std140 layout of the Material struct in the shaders
+struct MaterialBlock
+{
+	glm::vec3 Ka;
+	float pad0;
+	glm::vec3 Kd;
+	float pad1;
+	glm::vec3 Ks;
+	float shininess;	// packed into the last component of Ks
+};
+
+// std140 layout of FrameBlock in the shaders
+struct FrameBlock
+{
+	glm::mat4 viewProjectionMatrix;
+	glm::vec3 viewpoint;
+	float pad0;
+	LightBlock lights[MAX_LIGHTS];	// the shader variant reads its LIGHT_COUNT first lights
+};
+
+// std140 layout of ClusterBlock in the shaders
+struct ClusterBlock
+{
+	glm::vec4 viewport;		// x, y, width and height in pixels
+	glm::vec4 depth;		// near and far plane, scale and bias taking the log of a view depth to its slice
+	glm::ivec4 grid;		// tiles across, tiles up, slices and lights
+};
+
+// std140 layout of ObjectBlock in the shaders
+struct ObjectBlock
+{
+	glm::mat4 modelMatrix;
+	glm::vec4 normalMatrix[3];	// mat3 columns are padded to vec4
+	GLint materialIndex;
+	GLint pad[3];
+};
+
+// per instance data of instanced draws, see INSTANCED in animation.vert
+struct InstanceData
+{
+	glm::mat4 modelMatrix;
+	glm::vec4 normalMatrix[3];	// mat3 columns, w is unused
+	GLint materialIndex;		// slot in the material table
+	GLint pad[3];
+};
+
+// vertex attribute locations of the per instance data
+const GLuint INSTANCE_MODEL_MATRIX_LOCATION = 3;	// mat4, uses locations 3 to 6
+const GLuint INSTANCE_NORMAL_MATRIX_LOCATION = 7;	// mat3, uses locations 7 to 9
+const GLuint INSTANCE_MATERIAL_LOCATION = 10;		// int
+
+static_assert(sizeof(LightBlock) == 96, "LightBlock does not match std140 layout");
+static_assert(sizeof(MaterialBlock) == 48, "MaterialBlock does not match std140 layout");
+static_assert(sizeof(FrameBlock) == 80 + 96 * MAX_LIGHTS, "FrameBlock does not match std140 layout");
+static_assert(sizeof(ClusterBlock) == 48, "ClusterBlock does not match std140 layout");
+static_assert(sizeof(ObjectBlock) == 128, "ObjectBlock does not match std140 layout");
+static_assert(sizeof(InstanceData) == 128, "InstanceData should stay 16 byte aligned");
+static_assert(sizeof(VertexPacked) == 12, "VertexPacked should have no padding");
+static_assert(sizeof(VertexPackedTex) == 16, "VertexPackedTex should have no padding");
+
+// generate vertices for a circle based on a radius and number of slices
+inline void generate_circle(const float radius, const unsigned int slices, const float scale_factor, std::vector<GLfloat>& vertices)
+{
+	float slice_angle = glm::two_pi<float>() / slices;	// angle of each slice
+	float angle = 0;			// angle used to generate x and y coordinates
+	float x, y, z = 0.0f;		// (x, y, z) coordinates
+
+	// generate vertex coordinates for a circle
+	for (unsigned int i = 0; i <= slices; i++)
+	{
+		// generates the circle on the x/z axis
+		x = radius * std::cos(angle) * scale_factor;
+		z = radius * std::sin(angle) * scale_factor;
+		y = 0.0f;
+
+		vertices.push_back(x);
+		vertices.push_back(y);
+		vertices.push_back(z);
+
+		// update to next angle
+		angle += slice_angle;
+	}
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef RESOURCE_REGISTRY_H
+#define RESOURCE_REGISTRY_H
+
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*****************************************************************
+ * registry that stores resources in an array of slots that keep
+ * their address as resources are added, so references held by
+ * async loads stay valid, names are resolved to integer handles
+ * once at load time, after that resources are accessed by handle
+ * without any string work
+ *****************************************************************/
+template <typename T>
+class ResourceRegistry
+{
+public:
+	// index of the resource slot plus the generation of the slot when the
+	// handle was created, a removed resource invalidates all its handles
+	struct Handle
+	{
+		static const uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+		uint32_t index = INVALID_INDEX;
+		uint32_t generation = 0;
+
+		bool isValid() const { return index != INVALID_INDEX; }
+		bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(const Handle& other) const { return !(*this == other); }
+	};
+
+	// add a named resource and return its handle, returns the existing handle if the name is taken
+	Handle add(const std::string& name)
+	{
+		auto position = mHandles.find(name);
+		if (position != mHandles.end())
+			return position->second;
+
+		Handle handle;
+
+		// reuse a removed slot if there is one
+		if (!mFreeSlots.empty())
+		{
+			handle.index = mFreeSlots.back();
+			mFreeSlots.pop_back();
+			mNames[handle.index] = name;
+		}
+		else
+		{
+			handle.index = static_cast<uint32_t>(mResources.size());
+			mResources.emplace_back();
+			mGenerations.push_back(0);
+			mNames.push_back(name);
+		}
+
+		handle.generation = mGenerations[handle.index];
+		mHandles[name] = handle;
+
+		return handle;
+	}
+
+	// find a resource by name, returns an invalid handle if not found
+	Handle find(const std::string& name) const
+	{
+		auto position = mHandles.find(name);
+		if (position == mHandles.end())
+			return Handle();
+
+		return position->second;
+	}
+
+	// remove a resource, all existing handles to it become stale
+	void remove(Handle handle)
+	{
+		if (!isValid(handle))
+			return;
+
+		mResources[handle.index] = T();		// release the resource
+		mGenerations[handle.index]++;
+		mHandles.erase(mNames[handle.index]);
+		mNames[handle.index].clear();
+		mFreeSlots.push_back(handle.index);
+	}
+
+	// check whether a handle refers to a live resource
+	bool isValid(Handle handle) const
+	{
+		return handle.index < mGenerations.size() && mGenerations[handle.index] == handle.generation;
+	}
+
+	// access a resource by handle
+	T& get(Handle handle)
+	{
+		assert(isValid(handle));
+		return mResources[handle.index];
+	}
+
+	const T& get(Handle handle) const
+	{
+		assert(isValid(handle));
+		return mResources[handle.index];
+	}
+
+	const std::string& getName(Handle handle) const
+	{
+		assert(isValid(handle));
+		return mNames[handle.index];
+	}
+
+	// number of slots, including removed ones
+	int getSlotCount() const
+	{
+		return static_cast<int>(mResources.size());
+	}
+
+private:
+	std::deque<T> mResources;					// resource slots, a deque so adding never moves them
+	std::vector<uint32_t> mGenerations;			// generation of each slot
+	std::vector<std::string> mNames;			// name of each slot, only used at load time
+	std::vector<uint32_t> mFreeSlots;			// removed slots available for reuse
+	std::unordered_map<std::string, Handle> mHandles;	// name to handle lookup
+};
+
+#endif
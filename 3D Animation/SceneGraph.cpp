@@ -0,0 +1,161 @@
+#include "SceneGraph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+#include "JobSystem.h"
+
+SceneGraph::SceneGraph() : mFirstDirty(0)
+{}
+
+// add a node below parent and return its index
+int SceneGraph::addNode(int parent, const glm::mat4& localTransform)
+{
+	int node = static_cast<int>(mParents.size());
+
+	// parents must already exist so that they are updated before their children
+	assert(parent == NO_PARENT || (parent >= 0 && parent < node));
+
+	mParents.push_back(parent);
+	mDepths.push_back(parent == NO_PARENT ? 0 : mDepths[parent] + 1);
+	mLocalTransforms.push_back(localTransform);
+	mWorldTransforms.push_back(localTransform);
+	mDirty.push_back(1);
+
+	if (mDepths[node] >= static_cast<int>(mLevels.size()))
+		mLevels.resize(mDepths[node] + 1);
+	mLevels[mDepths[node]].push_back(node);
+
+	mFirstDirty = std::min(mFirstDirty, node);
+
+	return node;
+}
+
+// remove all nodes
+void SceneGraph::clear()
+{
+	mParents.clear();
+	mDepths.clear();
+	mLocalTransforms.clear();
+	mWorldTransforms.clear();
+	mDirty.clear();
+	mLevels.clear();
+	mFirstDirty = 0;
+}
+
+// set a node's transform relative to its parent
+void SceneGraph::setLocalTransform(int node, const glm::mat4& localTransform)
+{
+	mLocalTransforms[node] = localTransform;
+	mDirty[node] = 1;
+	mFirstDirty = std::min(mFirstDirty, node);
+}
+
+const glm::mat4& SceneGraph::getLocalTransform(int node) const
+{
+	return mLocalTransforms[node];
+}
+
+const glm::mat4& SceneGraph::getWorldTransform(int node) const
+{
+	return mWorldTransforms[node];
+}
+
+int SceneGraph::getParent(int node) const
+{
+	return mParents[node];
+}
+
+int SceneGraph::getDepth(int node) const
+{
+	return mDepths[node];
+}
+
+int SceneGraph::getNodeCount() const
+{
+	return static_cast<int>(mParents.size());
+}
+
+// recompute world transforms of dirty nodes and their descendants
+int SceneGraph::updateTransforms()
+{
+	const int nodeCount = getNodeCount();
+	int updated = 0;
+
+	// nothing changed since the last update
+	if (mFirstDirty >= nodeCount)
+		return 0;
+
+	for (int i = mFirstDirty; i < nodeCount; i++)
+	{
+		if (updateNode(i))
+			updated++;
+	}
+
+	// flags can only be cleared once all children have seen them
+	std::memset(&mDirty[mFirstDirty], 0, nodeCount - mFirstDirty);
+	mFirstDirty = nodeCount;
+
+	return updated;
+}
+
+// recompute world transforms level by level across the job system
+int SceneGraph::updateTransforms(JobSystem& jobs, int grainSize)
+{
+	const int nodeCount = getNodeCount();
+
+	// small updates are cheaper than handing out jobs
+	if (nodeCount - mFirstDirty <= grainSize)
+		return updateTransforms();
+
+	std::atomic<int> updated(0);
+	std::vector<JobCounter> levelCounters(mLevels.size());
+
+	for (size_t level = 0; level < mLevels.size(); level++)
+	{
+		// nodes before the first dirty one are neither dirty nor below a dirty parent
+		const std::vector<int>& nodes = mLevels[level];
+		const int first = static_cast<int>(std::lower_bound(nodes.begin(), nodes.end(), mFirstDirty) - nodes.begin());
+		JobCounter* parentLevel = level > 0 ? &levelCounters[level - 1] : nullptr;
+
+		jobs.parallelFor(static_cast<int>(nodes.size()) - first, grainSize, [this, &nodes, &updated, first](int begin, int end) {
+			int count = 0;
+			for (int i = first + begin; i < first + end; i++)
+			{
+				if (updateNode(nodes[i]))
+					count++;
+			}
+			updated += count;
+		}, levelCounters[level], parentLevel);
+	}
+
+	for (JobCounter& counter : levelCounters)
+		jobs.wait(counter);
+
+	std::memset(&mDirty[mFirstDirty], 0, nodeCount - mFirstDirty);
+	mFirstDirty = nodeCount;
+
+	return updated.load();
+}
+
+// recompute a node's world transform if it or its parent is dirty
+bool SceneGraph::updateNode(int node)
+{
+	int parent = mParents[node];
+
+	// a node is dirty if it changed or its parent's world transform changed
+	if (parent != NO_PARENT && mDirty[parent])
+		mDirty[node] = 1;
+
+	if (!mDirty[node])
+		return false;
+
+	if (parent == NO_PARENT)
+		mWorldTransforms[node] = mLocalTransforms[node];
+	else
+		mWorldTransforms[node] = mWorldTransforms[parent] * mLocalTransforms[node];
+
+	return true;
+}
@@ -0,0 +1,55 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+class JobSystem;
+
+/*****************************************************************
+ * scene graph that stores its nodes in flat arrays
+ * a node's parent is always stored before the node itself, so one
+ * forward pass over the arrays propagates transforms to any depth
+ *****************************************************************/
+class SceneGraph
+{
+public:
+	static const int NO_PARENT = -1;
+
+	SceneGraph();
+
+	// add a node below parent and return its index
+	int addNode(int parent = NO_PARENT, const glm::mat4& localTransform = glm::mat4(1.0f));
+	// remove all nodes
+	void clear();
+
+	// set a node's transform relative to its parent, marks the node dirty
+	void setLocalTransform(int node, const glm::mat4& localTransform);
+
+	const glm::mat4& getLocalTransform(int node) const;
+	const glm::mat4& getWorldTransform(int node) const;
+	int getParent(int node) const;
+	int getDepth(int node) const;
+	int getNodeCount() const;
+
+	// recompute world transforms of dirty nodes and their descendants
+	// returns the number of world transforms that were recomputed
+	int updateTransforms();
+	// the same with each level of the hierarchy split into chunks of grainSize nodes across the
+	// job system, a level only starts once its parents' level has finished
+	int updateTransforms(JobSystem& jobs, int grainSize = 1024);
+
+private:
+	std::vector<int> mParents;					// parent index of each node
+	std::vector<int> mDepths;					// number of ancestors of each node
+	std::vector<glm::mat4> mLocalTransforms;	// transform relative to parent
+	std::vector<glm::mat4> mWorldTransforms;	// transform relative to world
+	std::vector<unsigned char> mDirty;			// local transform changed since last update
+	int mFirstDirty;							// lowest dirty index, nothing before it needs updating
+	std::vector<std::vector<int>> mLevels;		// node indices by depth, in increasing order
+
+	// recompute a node's world transform if it or its parent is dirty, returns true if it was recomputed
+	bool updateNode(int node);
+};
+
+#endif
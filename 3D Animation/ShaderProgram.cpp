@@ -1,216 +1,801 @@
 #include "ShaderProgram.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <cstdio>
+
+// bump whenever the header changes so old caches are rebuilt
+static const uint32_t PROGRAM_CACHE_VERSION = 1;
+static const char PROGRAM_CACHE_MAGIC[4] = { 'P', 'R', 'O', 'G' };
+
+// start of every program cache file, stored in native byte order, the driver's binary follows
+struct ProgramCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceHash;		// hash of the shader sources the binary was built from
+	uint64_t driverHash;		// hash of the GL vendor, renderer and version, binaries only load into the same driver
+	uint32_t binaryFormat;		// format glGetProgramBinary returned
+	uint32_t binarySize;		// bytes of the binary
+};
+
+// FNV-1a hash of a block of bytes, continuing from hash
+static uint64_t hash_bytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// hash of a shader pair, the lengths go in first so moving text from one file to the other changes it
+static uint64_t hash_sources(const std::string& vShaderString, const std::string& fShaderString)
+{
+	const uint64_t sizes[2] = { vShaderString.size(), fShaderString.size() };
+	uint64_t hash = hash_bytes(sizes, sizeof(sizes));
+	hash = hash_bytes(vShaderString.data(), vShaderString.size(), hash);
+	return hash_bytes(fShaderString.data(), fShaderString.size(), hash);
+}
+
+static uint64_t get_driver_hash()
+{
+	const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	uint64_t hash = hash_bytes(nullptr, 0);
+
+	for (GLenum name : names)
+	{
+		const char* text = reinterpret_cast<const char*>(glGetString(name));
+		if (text != nullptr)
+			hash = hash_bytes(text, std::strlen(text) + 1, hash);
+	}
+
+	return hash;
+}
+
+// get a shader source file, false if it can't be opened
+static bool read_source(const std::string& filename, std::string& source)
+{
+	std::ifstream file(filename, std::ios::in);
+	if (!file.is_open())
+		return false;
+
+	std::stringstream stream;
+	stream << file.rdbuf();		// read buffer contents
+	source = stream.str();		// convert stream into string
+	return true;
+}
+
+// program binaries are core in 4.1, a 3.3 context may have them as an extension but a driver may offer no formats
+static bool has_program_binaries()
+{
+	static int formats = -1;
+
+	if (formats < 0)
+	{
+		formats = 0;
+		if (GLEW_ARB_get_program_binary)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	}
+
+	return formats > 0;
+}
+
+// let the driver compile on as many threads as it likes, where it can compile in the background at all
+static void set_compiler_threads()
+{
+#ifdef GL_KHR_parallel_shader_compile
+	static bool set = false;
+
+	if (!set && GLEW_KHR_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+	set = true;
+#endif
+}
+
+// source with defines after its #version line, which has to come first
+static std::string add_defines(std::string source, const std::string& defines)
+{
+	if (defines.empty())
+		return source;
+
+	size_t version = source.find("#version");
+	if (version == std::string::npos)
+		return defines + source;
+
+	size_t lineEnd = source.find('\n', version);
+	if (lineEnd == std::string::npos)
+		return source + "\n" + defines;
+
+	source.insert(lineEnd + 1, defines);
+	return source;
+}
+
+// binary cache file of a program, next to its vertex shader, variants built with defines get one each
+static std::string get_program_cache_path(const std::string& vShaderFilename, const std::string& fShaderFilename,
+	const std::string& defines)
+{
+	size_t slash = fShaderFilename.find_last_of("/\\");
+	std::string path = vShaderFilename + "." + fShaderFilename.substr(slash == std::string::npos ? 0 : slash + 1);
+
+	if (!defines.empty())
+	{
+		char variant[24];
+		std::snprintf(variant, sizeof(variant), ".%016llx",
+			static_cast<unsigned long long>(hash_bytes(defines.data(), defines.size())));
+		path += variant;
+	}
+
+	return path + ".programcache";
+}
+
+// link program from a cached binary, false if the cache is missing, stale or rejected by the driver
+static bool load_program_cache(const std::string& cachePath, uint64_t sourceHash, GLuint program)
+{
+	if (!has_program_binaries())
+		return false;
+
+	std::ifstream file(cachePath, std::ios::binary);
+	ProgramCacheHeader header;
+	if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+
+	if (std::memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) != 0 ||
+		header.version != PROGRAM_CACHE_VERSION ||
+		header.sourceHash != sourceHash ||
+		header.driverHash != get_driver_hash() ||
+		header.binarySize == 0)
+		return false;
+
+	std::vector<char> binary(header.binarySize);
+	if (!file.read(binary.data(), static_cast<std::streamsize>(binary.size())))
+		return false;
+
+	// a driver update can reject binaries of the same version string, the link status says so
+	glProgramBinary(program, header.binaryFormat, binary.data(), static_cast<GLsizei>(header.binarySize));
+
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	return status == GL_TRUE;
+}
+
+// write the binary of a linked program, through a temporary file so a crash never leaves half a cache behind
+static bool write_program_cache(const std::string& cachePath, uint64_t sourceHash, GLuint program)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	ProgramCacheHeader header = {};
+	std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+	header.version = PROGRAM_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.driverHash = get_driver_hash();
+	header.binaryFormat = format;
+	header.binarySize = static_cast<uint32_t>(length);
+
+	const std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(binary.data(), length);
+
+		if (!file.flush())
+		{
+			file.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	// rename does not replace an existing file everywhere
+	std::remove(cachePath.c_str());
+	if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+	{
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+// print the log of a shader that failed to compile, returns true if it did
+static bool report_compile_error(GLuint shader, const std::string& filename)
+{
+	if (shader == 0)
+		return false;
+
+	GLint status = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+	if (status != GL_FALSE)
+		return false;
+
+	// output error message
+	std::cerr << "Failed to compile " << filename << std::endl;
+
+	// output error log
+	int infoLogLength;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLogLength);
+	std::string errorMessage(infoLogLength, ' ');
+	glGetShaderInfoLog(shader, infoLogLength, nullptr, &errorMessage[0]);
+	std::cerr << errorMessage << std::endl;
+
+	return true;
+}
 
 ShaderProgram::ShaderProgram() : mProgramID(0)
 {}
 
 ShaderProgram::~ShaderProgram()
 {
+	releasePending();
+	releasePrevious();
+
 	// check if shader program exists
 	if (mProgramID != 0)
 	{
 		// delete the shader program
 		glDeleteProgram(mProgramID);
+		GLState::onProgramDeleted(mProgramID);
 	}
 }
 
+ShaderProgram::ShaderProgram(ShaderProgram&& other) noexcept
+	: mProgramID(other.mProgramID), mName(std::move(other.mName)), mVShaderFilename(std::move(other.mVShaderFilename)),
+	mFShaderFilename(std::move(other.mFShaderFilename)), mDefines(std::move(other.mDefines)), mSourceHash(other.mSourceHash), mPending(std::move(other.mPending)),
+	mPrevious(std::move(other.mPrevious)),
+	mUniforms(std::move(other.mUniforms)),
+	mUniformBlocks(std::move(other.mUniformBlocks)), mReportedNames(std::move(other.mReportedNames)),
+	mUniformShadow(std::move(other.mUniformShadow))
+{
+	// other no longer owns the programs or the build
+	other.mProgramID = 0;
+	other.mPending = PendingBuild();
+	other.mPrevious = PreviousProgram();
+}
+
+ShaderProgram& ShaderProgram::operator=(ShaderProgram&& other) noexcept
+{
+	if (this != &other)
+	{
+		releasePending();
+		releasePrevious();
+
+		if (mProgramID != 0)
+		{
+			glDeleteProgram(mProgramID);
+			GLState::onProgramDeleted(mProgramID);
+		}
+
+		mProgramID = other.mProgramID;
+		mName = std::move(other.mName);
+		mVShaderFilename = std::move(other.mVShaderFilename);
+		mFShaderFilename = std::move(other.mFShaderFilename);
+		mDefines = std::move(other.mDefines);
+		mSourceHash = other.mSourceHash;
+		mPending = std::move(other.mPending);
+		mPrevious = std::move(other.mPrevious);
+		mUniforms = std::move(other.mUniforms);
+		mUniformBlocks = std::move(other.mUniformBlocks);
+		mReportedNames = std::move(other.mReportedNames);
+		mUniformShadow = std::move(other.mUniformShadow);
+
+		// other no longer owns the programs or the build
+		other.mProgramID = 0;
+		other.mPending = PendingBuild();
+		other.mPrevious = PreviousProgram();
+	}
+
+	return *this;
+}
+
 // compile and link a vertex and fragment shader pair
 void ShaderProgram::compileAndLink(const std::string vShaderFilename, const std::string fShaderFilename)
 {
-	GLint status;	// used for checking compile and link status
+	if (!beginBuild(vShaderFilename, fShaderFilename) || !finishBuild())
+		exit(EXIT_FAILURE);
+}
 
+bool ShaderProgram::beginBuild(const std::string& vShaderFilename, const std::string& fShaderFilename,
+	const std::string& defines)
+{
 /****************************************************************
  * Step 1: read vertex and fragment shader source code from files
  ****************************************************************/
 	std::string vShaderString;	// to store vertex shader code
 	std::string fShaderString;	// to store fragment shader code
-	std::ifstream vShaderFile(vShaderFilename, std::ios::in); 	// open file
-	std::ifstream fShaderFile(fShaderFilename, std::ios::in); 	// open file
 
-	// if file successfully opened, get the shader source code
-	if (vShaderFile.is_open())
-	{
-		std::stringstream stream;
-		stream << vShaderFile.rdbuf();	// read buffer contents
-		vShaderString = stream.str();	// convert stream into string
-		vShaderFile.close();			// close file
-	}
-	else
+	if (!read_source(vShaderFilename, vShaderString))
 	{
-		// output error message and exit
 		std::cerr << "Failed to open: " << vShaderFilename << std::endl;
-		exit(EXIT_FAILURE);
+		return false;
 	}
 
-	// if file successfully opened, get the shader source code
-	if (fShaderFile.is_open())
-	{
-		std::stringstream stream;
-		stream << fShaderFile.rdbuf();	// read buffer contents
-		fShaderString = stream.str();	// convert stream into string
-		fShaderFile.close();			// close file
-	}
-	else
+	if (!read_source(fShaderFilename, fShaderString))
 	{
-		// output error message and exit
 		std::cerr << "Failed to open: " << fShaderFilename << std::endl;
-		exit(EXIT_FAILURE);
+		return false;
 	}
 
+	startBuild(vShaderFilename, fShaderFilename, defines, std::move(vShaderString), std::move(fShaderString));
+	return true;
+}
+
+void ShaderProgram::startBuild(const std::string& vShaderFilename, const std::string& fShaderFilename,
+	const std::string& defines, std::string vShaderString, std::string fShaderString)
+{
+	releasePending();
+
+	// the defines are part of the source, so each variant is hashed and cached on its own
+	vShaderString = add_defines(std::move(vShaderString), defines);
+	fShaderString = add_defines(std::move(fShaderString), defines);
+
+	mPending.vShaderFilename = vShaderFilename;
+	mPending.fShaderFilename = fShaderFilename;
+	mPending.defines = defines;
+	mPending.sourceHash = hash_sources(vShaderString, fShaderString);
+
+	// hot reload watches the latest sources, even if they fail to build
+	mVShaderFilename = vShaderFilename;
+	mFShaderFilename = fShaderFilename;
+	mDefines = defines;
+	mSourceHash = mPending.sourceHash;
+
 /****************************************************************
- * Step 2: Create and compile shader objects
+ * Step 2: load the program from the binary cache if it is current
  ****************************************************************/
-	 // create shader objects
-	GLuint vShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint fShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+	const std::string cachePath = get_program_cache_path(vShaderFilename, fShaderFilename, defines);
+
+	mPending.program = glCreateProgram();
+	if (load_program_cache(cachePath, mPending.sourceHash, mPending.program))
+		return;
+
+	// a rejected binary leaves the program unlinked, start again with a clean one
+	glDeleteProgram(mPending.program);
+	mPending.program = glCreateProgram();
+
+	// the binary can only be read back if this is asked for before linking
+	if (has_program_binaries())
+		glProgramParameteri(mPending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+/****************************************************************
+ * Step 3: create and compile shader objects, attach and link
+ * nothing is queried here so the driver can work in the background
+ ****************************************************************/
+	set_compiler_threads();
+
+	mPending.vShader = glCreateShader(GL_VERTEX_SHADER);
+	mPending.fShader = glCreateShader(GL_FRAGMENT_SHADER);
 
 	// provide source code for shaders
 	const GLchar *vShaderCode = vShaderString.c_str();
 	const GLchar *fShaderCode = fShaderString.c_str();
-	glShaderSource(vShaderID, 1, &vShaderCode, nullptr);
-	glShaderSource(fShaderID, 1, &fShaderCode, nullptr);
+	glShaderSource(mPending.vShader, 1, &vShaderCode, nullptr);
+	glShaderSource(mPending.fShader, 1, &fShaderCode, nullptr);
 
 	// compile shaders
-	glCompileShader(vShaderID);
-	glCompileShader(fShaderID);
+	glCompileShader(mPending.vShader);
+	glCompileShader(mPending.fShader);
 
-	// check vertex shader compile status
-	status = GL_FALSE;
-	glGetShaderiv(vShaderID, GL_COMPILE_STATUS, &status);
-
-	if (status == GL_FALSE)
-	{
-		// output error message
-		std::cerr << "Failed to compile " << vShaderFilename << std::endl;
+	// attach shaders to the program object and link it
+	glAttachShader(mPending.program, mPending.vShader);
+	glAttachShader(mPending.program, mPending.fShader);
+	glLinkProgram(mPending.program);
+}
 
-		// output error log
-		int infoLogLength;
-		glGetShaderiv(vShaderID, GL_INFO_LOG_LENGTH, &infoLogLength);
-		std::string errorMessage(infoLogLength, ' ');
-		glGetShaderInfoLog(vShaderID, infoLogLength, nullptr, &errorMessage[0]);
-		std::cerr << errorMessage << std::endl;
+bool ShaderProgram::finishBuild()
+{
+	if (!isBuilding())
+		return false;
 
-		exit(EXIT_FAILURE);
-	}
+	const std::string name = mPending.vShaderFilename + "/" + mPending.fShaderFilename;
+	const bool fromCache = mPending.vShader == 0;
 
-	// check fragment shader compile status
-	status = GL_FALSE;
-	glGetShaderiv(fShaderID, GL_COMPILE_STATUS, &status);
+/****************************************************************
+ * Step 4: check the compile and link status, waits for the driver
+ ****************************************************************/
+	GLint status = GL_FALSE;
+	glGetProgramiv(mPending.program, GL_LINK_STATUS, &status);
 
 	if (status == GL_FALSE)
 	{
-		// output error message
-		std::cerr << "Failed to compile " << fShaderFilename << std::endl;
-
-		// output error log
-		int infoLogLength;
-		glGetShaderiv(fShaderID, GL_INFO_LOG_LENGTH, &infoLogLength);
-		std::string errorMessage(infoLogLength, ' ');
-		glGetShaderInfoLog(fShaderID, infoLogLength, nullptr, &errorMessage[0]);
-		std::cerr << errorMessage << std::endl;
+		// a shader that failed to compile says more than the link log
+		bool compileFailed = report_compile_error(mPending.vShader, mPending.vShaderFilename);
+		compileFailed = report_compile_error(mPending.fShader, mPending.fShaderFilename) || compileFailed;
+
+		if (!compileFailed)
+		{
+			// output error message
+			std::cerr << "Failed to link shader program " << name << std::endl;
+
+			// output error log
+			int infoLogLength;
+			glGetProgramiv(mPending.program, GL_INFO_LOG_LENGTH, &infoLogLength);
+			std::string errorMessage(infoLogLength, ' ');
+			glGetProgramInfoLog(mPending.program, infoLogLength, nullptr, &errorMessage[0]);
+			std::cerr << errorMessage << std::endl;
+		}
+
+		releasePending();
+		return false;
+	}
 
-		exit(EXIT_FAILURE);
+	// a failed write only costs another compile on the next start
+	if (!fromCache && has_program_binaries())
+	{
+		const std::string cachePath = get_program_cache_path(mPending.vShaderFilename, mPending.fShaderFilename,
+			mPending.defines);
+		if (!write_program_cache(cachePath, mPending.sourceHash, mPending.program))
+			std::cerr << "Failed to write program cache: " << cachePath << std::endl;
 	}
 
 /****************************************************************
- * Step 3: Attach shaders to program object and link
+ * Step 5: swap the new program in
  ****************************************************************/
-	// create program object
-	mProgramID = glCreateProgram();
+	// flag shaders for deletion (will not actually be deleted until detached from program)
+	if (!fromCache)
+	{
+		glDeleteShader(mPending.vShader);
+		glDeleteShader(mPending.fShader);
+	}
 
-	// attach shaders to the program object
-	glAttachShader(mProgramID, vShaderID);
-	glAttachShader(mProgramID, fShaderID);
+	// the replaced program stays until the next build, the owner may still go back to it with restorePrevious
+	releasePrevious();
+	mPrevious.program = mProgramID;
+	mPrevious.name = std::move(mName);
+	mPrevious.uniforms = std::move(mUniforms);
+	mPrevious.uniformBlocks = std::move(mUniformBlocks);
+	mPrevious.uniformShadow = std::move(mUniformShadow);
 
-	// link program object
-	glLinkProgram(mProgramID);
+	mProgramID = mPending.program;
+	mName = name;
+	mPending = PendingBuild();
 
-	// check link status
-	status = GL_FALSE;
-	glGetProgramiv(mProgramID, GL_LINK_STATUS, &status);
+/****************************************************************
+ * Step 6: Find active uniforms and uniform blocks
+ ****************************************************************/
+	reflectUniforms();
+	return true;
+}
 
-	if (status == GL_FALSE)
+bool ShaderProgram::updateBuild()
+{
+	if (!isBuilding())
+		return false;
+
+	// without the extension there is no way to ask, the status checks wait for the driver instead
+#ifdef GL_KHR_parallel_shader_compile
+	if (GLEW_KHR_parallel_shader_compile)
 	{
-		// output error message
-		std::cerr << "Failed to link shader program." << std::endl;
+		GLint completed = GL_FALSE;
+		glGetProgramiv(mPending.program, GL_COMPLETION_STATUS_KHR, &completed);
+		if (completed == GL_FALSE)
+			return false;
+	}
+#endif
 
-		// output error log
-		int infoLogLength;
-		glGetShaderiv(mProgramID, GL_INFO_LOG_LENGTH, &infoLogLength);
-		std::string errorMessage(infoLogLength, ' ');
-		glGetShaderInfoLog(mProgramID, infoLogLength, nullptr, &errorMessage[0]);
-		std::cerr << errorMessage << std::endl;
+	return finishBuild();
+}
 
-		exit(EXIT_FAILURE);
+bool ShaderProgram::reloadIfChanged()
+{
+	// nothing to reload before the first build
+	if (mVShaderFilename.empty())
+		return false;
+
+	// an editor may replace a file rather than write it, so it can be missing for a moment
+	std::string vShaderString;
+	std::string fShaderString;
+	if (!read_source(mVShaderFilename, vShaderString) || !read_source(mFShaderFilename, fShaderString))
+		return false;
+
+	if (hash_sources(add_defines(vShaderString, mDefines), add_defines(fShaderString, mDefines)) == mSourceHash)
+		return false;
+
+	std::cout << "Reloading " << mVShaderFilename << "/" << mFShaderFilename << std::endl;
+	startBuild(mVShaderFilename, mFShaderFilename, mDefines, vShaderString, fShaderString);
+	return true;
+}
+
+bool ShaderProgram::restorePrevious()
+{
+	if (mPrevious.program == 0)
+		return false;
+
+	std::cerr << "Keeping the previous build of " << mPrevious.name << std::endl;
+
+	glDeleteProgram(mProgramID);
+	GLState::onProgramDeleted(mProgramID);
+
+	mProgramID = mPrevious.program;
+	mName = std::move(mPrevious.name);
+	mUniforms = std::move(mPrevious.uniforms);
+	mUniformBlocks = std::move(mPrevious.uniformBlocks);
+	mUniformShadow = std::move(mPrevious.uniformShadow);
+	mReportedNames.clear();
+
+	mPrevious = PreviousProgram();
+	return true;
+}
+
+// delete the program replaced by the last build
+void ShaderProgram::releasePrevious()
+{
+	if (mPrevious.program != 0)
+	{
+		glDeleteProgram(mPrevious.program);
+		GLState::onProgramDeleted(mPrevious.program);
 	}
 
-	// flag shaders for deletion (will not actually be deleted until detached from program)
-	glDeleteShader(vShaderID);
-	glDeleteShader(fShaderID);
+	mPrevious = PreviousProgram();
+}
+
+// delete the objects of the pending build
+void ShaderProgram::releasePending()
+{
+	if (mPending.vShader != 0)
+		glDeleteShader(mPending.vShader);
+	if (mPending.fShader != 0)
+		glDeleteShader(mPending.fShader);
+	if (mPending.program != 0)
+		glDeleteProgram(mPending.program);
+
+	mPending = PendingBuild();
 }
 
 // use the shader program
 void ShaderProgram::use()
 {
-	// use the shader program
-	glUseProgram(mProgramID);
+	// use the shader program, skipped if it is already in use
+	GLState::useProgram(mProgramID);
+}
+
+void ShaderProgram::setUniform(const UniformName& name, const glm::vec2& vector)
+{
+	setUniformValue(name, vector);
 }
 
-void ShaderProgram::setUniform(const char *name, const glm::vec2& vector)
+void ShaderProgram::setUniform(const UniformName& name, const glm::vec3& vector)
 {
-	glUniform2fv(getUniformLocation(name), 1, &vector[0]);
+	setUniformValue(name, vector);
 }
 
-void ShaderProgram::setUniform(const char *name, const glm::vec3& vector)
+void ShaderProgram::setUniform(const UniformName& name, const glm::vec4& vector)
 {
-	glUniform3fv(getUniformLocation(name), 1, &vector[0]);
+	setUniformValue(name, vector);
 }
 
-void ShaderProgram::setUniform(const char *name, const glm::vec4& vector)
+void ShaderProgram::setUniform(const UniformName& name, const glm::mat3& matrix)
 {
-	glUniform4fv(getUniformLocation(name), 1, &vector[0]);
+	setUniformValue(name, matrix);
 }
 
-void ShaderProgram::setUniform(const char* name, const glm::mat3& matrix)
+void ShaderProgram::setUniform(const UniformName& name, const glm::mat4& matrix)
 {
-	glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &matrix[0][0]);
+	setUniformValue(name, matrix);
 }
 
-void ShaderProgram::setUniform(const char *name, const glm::mat4& matrix)
+void ShaderProgram::setUniform(const UniformName& name, float value)
 {
-	glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &matrix[0][0]);
+	setUniformValue(name, value);
 }
 
-void ShaderProgram::setUniform(const char *name, float value)
+void ShaderProgram::setUniform(const UniformName& name, int value)
 {
-	glUniform1f(getUniformLocation(name), value);
+	setUniformValue(name, value);
 }
 
-void ShaderProgram::setUniform(const char *name, int value)
+void ShaderProgram::setUniform(const UniformName& name, bool value)
 {
-	glUniform1i(getUniformLocation(name), value);
+	setUniformValue(name, value);
 }
 
-void ShaderProgram::setUniform(const char *name, bool value)
+// check whether a uniform is active after linking
+bool ShaderProgram::hasUniform(const UniformName& name) const
 {
-	glUniform1i(getUniformLocation(name), value);
+	return findUniform(name) != nullptr;
 }
 
-// get uniform variable locations
-GLint ShaderProgram::getUniformLocation(const char *name)
+// check whether a uniform block is active after linking
+bool ShaderProgram::hasUniformBlock(const UniformName& name) const
 {
-	// find whether location already stored
-	auto position = mUniformLocations.find(name);
+	return findUniformBlock(name) != nullptr;
+}
 
-	// if not stored
-	if (position == mUniformLocations.end()) {
-		// find the uniform's location
-		GLint location = glGetUniformLocation(mProgramID, name);
+// assign a uniform block to a binding point
+void ShaderProgram::bindUniformBlock(const UniformName& blockName, GLuint bindingPoint)
+{
+	const UniformBlockInfo* block = findUniformBlock(blockName);
 
-		// store location in map
-		mUniformLocations[name] = location;
-		return location;
+	// block is not declared or was optimised out
+	if (block == nullptr)
+	{
+		std::cerr << "Unknown uniform block " << blockName.name << " in " << mName << std::endl;
+		return;
 	}
 
-	// return uniform's location
-	return position->second;
-}
\ No newline at end of file
+	glUniformBlockBinding(mProgramID, block->index, bindingPoint);
+}
+
+// enumerate active uniforms and uniform blocks
+void ShaderProgram::reflectUniforms()
+{
+	GLint count = 0;
+	GLint maxNameLength = 0;
+
+	mUniforms.clear();
+	mUniformBlocks.clear();
+	mReportedNames.clear();
+
+	// uniforms in the default block, block members have no location and are skipped
+	glGetProgramiv(mProgramID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(mProgramID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	std::vector<GLchar> nameBuffer(std::max(maxNameLength, 1));
+
+	for (GLint i = 0; i < count; i++)
+	{
+		UniformInfo uniform;
+		GLsizei nameLength = 0;
+
+		glGetActiveUniform(mProgramID, i, static_cast<GLsizei>(nameBuffer.size()), &nameLength,
+			&uniform.size, &uniform.type, nameBuffer.data());
+		uniform.name.assign(nameBuffer.data(), nameLength);
+		uniform.location = glGetUniformLocation(mProgramID, uniform.name.c_str());
+
+		if (uniform.location < 0)
+			continue;
+
+		// arrays are reported as name[0], also make them findable by their plain name
+		size_t bracket = uniform.name.find("[0]");
+		if (bracket != std::string::npos && bracket + 3 == uniform.name.size())
+			uniform.name.erase(bracket);
+
+		uniform.hash = hash_uniform_name(uniform.name.c_str());
+		mUniforms.push_back(uniform);
+	}
+
+	// uniform blocks
+	glGetProgramiv(mProgramID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	glGetProgramiv(mProgramID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxNameLength);
+
+	nameBuffer.resize(std::max(maxNameLength, 1));
+
+	for (GLint i = 0; i < count; i++)
+	{
+		UniformBlockInfo block;
+		GLsizei nameLength = 0;
+
+		glGetActiveUniformBlockName(mProgramID, i, static_cast<GLsizei>(nameBuffer.size()), &nameLength, nameBuffer.data());
+		glGetActiveUniformBlockiv(mProgramID, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+		block.name.assign(nameBuffer.data(), nameLength);
+		block.index = static_cast<GLuint>(i);
+		block.hash = hash_uniform_name(block.name.c_str());
+		mUniformBlocks.push_back(block);
+	}
+
+	// sort by hash for binary search
+	std::sort(mUniforms.begin(), mUniforms.end(),
+		[](const UniformInfo& a, const UniformInfo& b) { return a.hash < b.hash; });
+	std::sort(mUniformBlocks.begin(), mUniformBlocks.end(),
+		[](const UniformBlockInfo& a, const UniformBlockInfo& b) { return a.hash < b.hash; });
+
+	// one value shadow per uniform, cleared so the first upload is never skipped
+	mUniformShadow.assign(mUniforms.size() * UNIFORM_SHADOW_SIZE, 0);
+
+	for (size_t i = 0; i < mUniforms.size(); i++)
+		mUniforms[i].shadowOffset = static_cast<int>(i * UNIFORM_SHADOW_SIZE);
+
+	// two names with the same hash cannot be told apart
+	for (size_t i = 1; i < mUniforms.size(); i++)
+	{
+		if (mUniforms[i].hash == mUniforms[i - 1].hash)
+		{
+			std::cerr << "Uniform names " << mUniforms[i - 1].name << " and " << mUniforms[i].name
+				<< " in " << mName << " have the same hash" << std::endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+// find an active uniform by name, the hash narrows it down and the name confirms it
+// active uniform hashes are unique, see reflectUniforms
+const ShaderProgram::UniformInfo* ShaderProgram::findUniform(const UniformName& name) const
+{
+	auto position = std::lower_bound(mUniforms.begin(), mUniforms.end(), name.hash,
+		[](const UniformInfo& uniform, uint32_t value) { return uniform.hash < value; });
+
+	if (position == mUniforms.end() || position->hash != name.hash || position->name != name.name)
+		return nullptr;
+
+	return &*position;
+}
+
+// find an active uniform block by name, blocks may share a hash so every block with it is compared
+const ShaderProgram::UniformBlockInfo* ShaderProgram::findUniformBlock(const UniformName& name) const
+{
+	auto position = std::lower_bound(mUniformBlocks.begin(), mUniformBlocks.end(), name.hash,
+		[](const UniformBlockInfo& block, uint32_t value) { return block.hash < value; });
+
+	for (; position != mUniformBlocks.end() && position->hash == name.hash; ++position)
+	{
+		if (position->name == name.name)
+			return &*position;
+	}
+
+	return nullptr;
+}
+
+// report an unknown uniform name once instead of silently writing to location -1
+void ShaderProgram::reportUnknownUniform(const UniformName& name)
+{
+	if (std::find(mReportedNames.begin(), mReportedNames.end(), name.hash) == mReportedNames.end())
+	{
+		std::cerr << "Unknown uniform " << name.name << " in " << mName << std::endl;
+		mReportedNames.push_back(name.hash);
+	}
+}
+
+// report a value of the wrong type once instead of uploading it with the wrong glUniform call
+void ShaderProgram::reportWrongUniformType(const UniformName& name)
+{
+	if (std::find(mReportedNames.begin(), mReportedNames.end(), name.hash) == mReportedNames.end())
+	{
+		std::cerr << "Uniform " << name.name << " in " << mName << " set with the wrong type" << std::endl;
+		mReportedNames.push_back(name.hash);
+	}
+}
+
+// write a value to a uniform location of the program in use
+void upload_uniform(GLint location, const glm::vec2& vector)
+{
+	glUniform2fv(location, 1, &vector[0]);
+}
+
+void upload_uniform(GLint location, const glm::vec3& vector)
+{
+	glUniform3fv(location, 1, &vector[0]);
+}
+
+void upload_uniform(GLint location, const glm::vec4& vector)
+{
+	glUniform4fv(location, 1, &vector[0]);
+}
+
+void upload_uniform(GLint location, const glm::mat3& matrix)
+{
+	glUniformMatrix3fv(location, 1, GL_FALSE, &matrix[0][0]);
+}
+
+void upload_uniform(GLint location, const glm::mat4& matrix)
+{
+	glUniformMatrix4fv(location, 1, GL_FALSE, &matrix[0][0]);
+}
+
+void upload_uniform(GLint location, float value)
+{
+	glUniform1f(location, value);
+}
+
+void upload_uniform(GLint location, int value)
+{
+	glUniform1i(location, value);
+}
+
+void upload_uniform(GLint location, bool value)
+{
+	glUniform1i(location, value);
+}
@@ -5,36 +5,295 @@
 #include <fstream>
 #include <sstream>
 #include <string>
-#include <map>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
 #include <GLEW/glew.h>
 #include <glm/glm.hpp>
 
+#include "GLState.h"
+
+// FNV-1a hash of a uniform name, evaluated at compile time for string literals
+constexpr uint32_t hash_uniform_name(const char* name, uint32_t hash = 2166136261u)
+{
+	return *name == '\0' ? hash : hash_uniform_name(name + 1, (hash ^ static_cast<uint8_t>(*name)) * 16777619u);
+}
+
+// uniform name together with its hash
+struct UniformName
+{
+	const char* name;
+	uint32_t hash;
+
+	// hashes the name, use UNIFORM_NAME to force this to happen at compile time
+	constexpr UniformName(const char* name) : name(name), hash(hash_uniform_name(name)) {}
+	constexpr UniformName(const char* name, uint32_t hash) : name(name), hash(hash) {}
+};
+
+// uniform name hashed at compile time, e.g. shader.setUniform(UNIFORM_NAME("uColor"), colour)
+#define UNIFORM_NAME(literal) UniformName(literal, std::integral_constant<uint32_t, hash_uniform_name(literal)>::value)
+
+// GL uniform types that can be set from a C++ type
+template <typename T> struct UniformType;
+template <> struct UniformType<glm::vec2> { static bool matches(GLenum type) { return type == GL_FLOAT_VEC2; } };
+template <> struct UniformType<glm::vec3> { static bool matches(GLenum type) { return type == GL_FLOAT_VEC3; } };
+template <> struct UniformType<glm::vec4> { static bool matches(GLenum type) { return type == GL_FLOAT_VEC4; } };
+template <> struct UniformType<glm::mat3> { static bool matches(GLenum type) { return type == GL_FLOAT_MAT3; } };
+template <> struct UniformType<glm::mat4> { static bool matches(GLenum type) { return type == GL_FLOAT_MAT4; } };
+template <> struct UniformType<float> { static bool matches(GLenum type) { return type == GL_FLOAT; } };
+template <> struct UniformType<bool> { static bool matches(GLenum type) { return type == GL_BOOL || type == GL_INT; } };
+template <> struct UniformType<int>
+{
+	// integers also set sampler units
+	static bool matches(GLenum type)
+	{
+		return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_3D
+			|| type == GL_SAMPLER_CUBE || type == GL_SAMPLER_2D_SHADOW || type == GL_SAMPLER_BUFFER
+			|| type == GL_INT_SAMPLER_BUFFER || type == GL_UNSIGNED_INT_SAMPLER_BUFFER;
+	}
+};
+
+// write a value to a uniform location of the program in use
+void upload_uniform(GLint location, const glm::vec2& vector);
+void upload_uniform(GLint location, const glm::vec3& vector);
+void upload_uniform(GLint location, const glm::vec4& vector);
+void upload_uniform(GLint location, const glm::mat3& matrix);
+void upload_uniform(GLint location, const glm::mat4& matrix);
+void upload_uniform(GLint location, float value);
+void upload_uniform(GLint location, int value);
+void upload_uniform(GLint location, bool value);
+
+// per uniform storage for the last value uploaded: a flag byte, padding, then the value
+const int UNIFORM_SHADOW_VALUE_OFFSET = 8;
+const int UNIFORM_SHADOW_SIZE = UNIFORM_SHADOW_VALUE_OFFSET + sizeof(glm::mat4);
+
+/*****************************************************************
+ * typed handle to a uniform whose location was resolved at link
+ * time, keep it and set values without any lookup
+ *****************************************************************/
+template <typename T>
+class Uniform
+{
+public:
+	Uniform() : mLocation(-1), mShadow(nullptr) {}
+	Uniform(GLint location, unsigned char* shadow) : mLocation(location), mShadow(shadow) {}
+
+	// set the value, the owning program must be in use
+	// skipped if the program already holds the same value
+	void set(const T& value) const
+	{
+		static_assert(sizeof(T) <= sizeof(glm::mat4), "uniform type too large for the value shadow");
+
+		if (mShadow != nullptr)
+		{
+			unsigned char* shadowValue = mShadow + UNIFORM_SHADOW_VALUE_OFFSET;
+
+			if (mShadow[0] != 0 && std::memcmp(shadowValue, &value, sizeof(T)) == 0)
+			{
+				GLState::countUniform(false);
+				return;
+			}
+
+			mShadow[0] = 1;
+			std::memcpy(shadowValue, &value, sizeof(T));
+		}
+
+		upload_uniform(mLocation, value);
+		GLState::countUniform(true);
+	}
+
+	bool isValid() const { return mLocation >= 0; }
+	GLint getLocation() const { return mLocation; }
+
+private:
+	GLint mLocation;			// uniform location in the owning program
+	unsigned char* mShadow;		// last value uploaded, owned by the program
+};
+
 class ShaderProgram
 {
 public:
 	ShaderProgram();
 	~ShaderProgram();
 
-	// compile and link a vertex and fragment shader pair
+	// programs own a GL object so they can be moved but not copied
+	ShaderProgram(ShaderProgram&& other) noexcept;
+	ShaderProgram& operator=(ShaderProgram&& other) noexcept;
+	ShaderProgram(const ShaderProgram&) = delete;
+	ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+	// compile and link a vertex and fragment shader pair, exits on failure
 	void compileAndLink(const std::string vShaderFilename, const std::string fShaderFilename);
+
+	// start building the program from a vertex and fragment shader pair without waiting for the driver, from the
+	// program binary cache if it holds these sources for this driver, returns false if a file can't be read
+	// the program in use until then stays valid, a build that is still running is replaced
+	// defines are lines such as "#define INSTANCED\n" inserted after the #version line of both shaders
+	bool beginBuild(const std::string& vShaderFilename, const std::string& fShaderFilename,
+		const std::string& defines = std::string());
+	// wait for the build and swap it in, returns false and keeps the previous program if it failed
+	bool finishBuild();
+	// swap the build in once the driver is done, never waits where GL_KHR_parallel_shader_compile is supported
+	// returns true when a new program was swapped in, its uniform handles and block bindings must be set up again
+	bool updateBuild();
+	// swap back the program the last build replaced, for owners that find the new one lacks what they set
+	// returns false if the last build replaced nothing
+	bool restorePrevious();
+	bool isBuilding() const { return mPending.program != 0; }
+
+	// rebuild in the background if a source file changed since the last build, returns true if it started one
+	bool reloadIfChanged();
+
 	// use the shader program
 	void use();
 
-	// functions to set shader uniform variables
-	void setUniform(const char *name, const glm::vec2& vector);
-	void setUniform(const char *name, const glm::vec3& vector);
-	void setUniform(const char *name, const glm::vec4& vector);
-	void setUniform(const char* name, const glm::mat3& matrix);
-	void setUniform(const char *name, const glm::mat4& matrix);
-	void setUniform(const char *name, float value);
-	void setUniform(const char *name, int value);
-	void setUniform(const char *name, bool value);
+	// get a typed handle to an active uniform, exits if the name or type is wrong
+	// handles stay valid until the program is linked again
+	template <typename T>
+	Uniform<T> getUniform(const UniformName& name)
+	{
+		const UniformInfo* uniform = findUniform(name);
+
+		if (uniform == nullptr)
+		{
+			std::cerr << "Unknown uniform " << name.name << " in " << mName << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		if (!UniformType<T>::matches(uniform->type))
+		{
+			std::cerr << "Uniform " << name.name << " in " << mName << " set with the wrong type" << std::endl;
+			exit(EXIT_FAILURE);
+		}
+
+		return Uniform<T>(uniform->location, &mUniformShadow[uniform->shadowOffset]);
+	}
+
+	// get a typed handle to an active uniform, reports a wrong name or type once and returns an invalid handle
+	// for programs rebuilt while running, where a shader edit can drop a uniform
+	template <typename T>
+	Uniform<T> tryGetUniform(const UniformName& name)
+	{
+		const UniformInfo* uniform = findUniform(name);
+
+		if (uniform == nullptr)
+		{
+			reportUnknownUniform(name);
+			return Uniform<T>();
+		}
+		if (!UniformType<T>::matches(uniform->type))
+		{
+			reportWrongUniformType(name);
+			return Uniform<T>();
+		}
+
+		return Uniform<T>(uniform->location, &mUniformShadow[uniform->shadowOffset]);
+	}
+
+	// check whether a uniform or uniform block is active after linking
+	bool hasUniform(const UniformName& name) const;
+	bool hasUniformBlock(const UniformName& name) const;
+
+	// functions to set shader uniform variables by name, unknown names and wrong types are reported once and ignored
+	void setUniform(const UniformName& name, const glm::vec2& vector);
+	void setUniform(const UniformName& name, const glm::vec3& vector);
+	void setUniform(const UniformName& name, const glm::vec4& vector);
+	void setUniform(const UniformName& name, const glm::mat3& matrix);
+	void setUniform(const UniformName& name, const glm::mat4& matrix);
+	void setUniform(const UniformName& name, float value);
+	void setUniform(const UniformName& name, int value);
+	void setUniform(const UniformName& name, bool value);
+
+	// assign a uniform block to a binding point
+	void bindUniformBlock(const UniformName& blockName, GLuint bindingPoint);
+
+	// report a uniform name that can't be set, once per name
+	void reportUnknownUniform(const UniformName& name);
 
 private:
+	// active uniform found by reflection after linking
+	struct UniformInfo
+	{
+		uint32_t hash;		// hash of the name
+		GLint location;		// uniform location
+		GLenum type;		// GL type of the uniform
+		GLint size;			// number of array elements
+		int shadowOffset;	// offset of the value shadow in mUniformShadow
+		std::string name;
+	};
+
+	// active uniform block found by reflection after linking
+	struct UniformBlockInfo
+	{
+		uint32_t hash;		// hash of the name
+		GLuint index;		// block index
+		GLint dataSize;		// size of the block in bytes
+		std::string name;
+	};
+
+	// program being compiled and linked, it replaces the current one once it is done
+	struct PendingBuild
+	{
+		GLuint program = 0;
+		GLuint vShader = 0;			// 0 when the program came from the binary cache
+		GLuint fShader = 0;
+		std::string vShaderFilename;
+		std::string fShaderFilename;
+		std::string defines;
+		uint64_t sourceHash = 0;
+	};
+
+	// program replaced by the last build and what was found in it, kept until the next build
+	struct PreviousProgram
+	{
+		GLuint program = 0;
+		std::string name;
+		std::vector<UniformInfo> uniforms;
+		std::vector<UniformBlockInfo> uniformBlocks;
+		std::vector<unsigned char> uniformShadow;	// handles into it stay valid while it is kept
+	};
+
 	GLuint mProgramID = 0;							// shader program handle
-	std::map<std::string, GLint> mUniformLocations;	// uniform locations
+	std::string mName;								// shader file names, for error messages
+	std::string mVShaderFilename;					// sources of the latest build, for hot reload
+	std::string mFShaderFilename;
+	std::string mDefines;
+	uint64_t mSourceHash = 0;						// hash of the sources of the latest build, defines included
+	PendingBuild mPending;
+	PreviousProgram mPrevious;
+	std::vector<UniformInfo> mUniforms;				// active uniforms sorted by hash
+	std::vector<UniformBlockInfo> mUniformBlocks;	// active uniform blocks sorted by hash
+	std::vector<uint32_t> mReportedNames;			// unknown names already reported
+	std::vector<unsigned char> mUniformShadow;		// last value uploaded to each uniform
+
+	void reflectUniforms();							// enumerate active uniforms and blocks
+	void releasePending();							// delete the objects of the pending build
+	void releasePrevious();							// delete the program replaced by the last build
+	void startBuild(const std::string& vShaderFilename, const std::string& fShaderFilename, const std::string& defines,
+		std::string vShaderString, std::string fShaderString);
+	const UniformInfo* findUniform(const UniformName& name) const;
+	const UniformBlockInfo* findUniformBlock(const UniformName& name) const;
+	void reportWrongUniformType(const UniformName& name);
+
+	// set a uniform by name through its value shadow
+	template <typename T>
+	void setUniformValue(const UniformName& name, const T& value)
+	{
+		const UniformInfo* uniform = findUniform(name);
+
+		if (uniform == nullptr)
+		{
+			reportUnknownUniform(name);
+			return;
+		}
+		if (!UniformType<T>::matches(uniform->type))
+		{
+			reportWrongUniformType(name);
+			return;
+		}
 
-	GLint getUniformLocation(const char *name);		// get uniform variable locations
+		Uniform<T>(uniform->location, &mUniformShadow[uniform->shadowOffset]).set(value);
+	}
 };
 
 #endif
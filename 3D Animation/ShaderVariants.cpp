@@ -0,0 +1,126 @@
+#include "ShaderVariants.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+std::uint32_t make_variant_key(const ShaderFeatures& features)
+{
+	const std::uint32_t lightType = static_cast<std::uint32_t>(std::min(std::max(features.lightType, POINT_LIGHT), SPOT_LIGHT));
+	const std::uint32_t lightCount = static_cast<std::uint32_t>(std::min(std::max(features.lightCount, 1), MAX_LIGHTS));
+
+	return lightType | (lightCount - 1) << 2 | (features.textured ? 1u : 0u) << 5 | (features.instanced ? 1u : 0u) << 6
+		| (features.clustered ? 1u : 0u) << 7;
+}
+
+ShaderFeatures get_variant_features(std::uint32_t key)
+{
+	ShaderFeatures features;
+	features.lightType = static_cast<int>(key & 3);
+	features.lightCount = static_cast<int>((key >> 2) & 7) + 1;
+	features.textured = (key >> 5 & 1) != 0;
+	features.instanced = (key >> 6 & 1) != 0;
+	features.clustered = (key >> 7 & 1) != 0;
+	return features;
+}
+
+std::string get_variant_defines(std::uint32_t key)
+{
+	const ShaderFeatures features = get_variant_features(key);
+
+	std::string defines = "#define LIGHT_TYPE " + std::to_string(features.lightType) + "\n"
+		+ "#define LIGHT_COUNT " + std::to_string(features.lightCount) + "\n";
+	if (features.textured)
+		defines += "#define TEXTURED\n";
+	if (features.instanced)
+		defines += "#define INSTANCED\n";
+	if (features.clustered)
+		defines += "#define CLUSTERED\n";
+
+	return defines;
+}
+
+void ShaderVariants::init(const std::string& vShaderFilename, const std::string& fShaderFilename, SetupFunction setup)
+{
+	release();
+
+	mVShaderFilename = vShaderFilename;
+	mFShaderFilename = fShaderFilename;
+	mSetup = setup;
+}
+
+ShaderVariants::Variant& ShaderVariants::getVariant(std::uint32_t key)
+{
+	auto found = mVariants.find(key);
+	if (found != mVariants.end())
+		return found->second;
+
+	Variant& variant = mVariants[key];
+	variant.index = static_cast<int>(mVariants.size()) - 1;
+
+	// missing files are reported by the build and leave the variant failed
+	variant.program.beginBuild(mVShaderFilename, mFShaderFilename, get_variant_defines(key));
+	return variant;
+}
+
+void ShaderVariants::prepare(std::uint32_t key)
+{
+	getVariant(key);
+}
+
+ShaderProgram* ShaderVariants::get(std::uint32_t key)
+{
+	Variant& variant = getVariant(key);
+
+	if (!variant.ready && variant.program.isBuilding())
+	{
+		if (variant.program.finishBuild())
+			setup(key, variant);
+		else
+			std::cerr << "Shader variant " << key << " failed to build with\n" << get_variant_defines(key);
+	}
+
+	return variant.ready ? &variant.program : nullptr;
+}
+
+int ShaderVariants::getIndex(std::uint32_t key)
+{
+	return getVariant(key).index;
+}
+
+void ShaderVariants::update(bool reload)
+{
+	for (auto& entry : mVariants)
+	{
+		Variant& variant = entry.second;
+
+		if (reload)
+			variant.program.reloadIfChanged();
+
+		// rebuilds keep the last good program until they succeed
+		if (variant.program.updateBuild())
+			setup(entry.first, variant);
+	}
+}
+
+// set up a program that was just swapped in, a rebuild that can't be set up goes back to the last good program
+void ShaderVariants::setup(std::uint32_t key, Variant& variant)
+{
+	if (mSetup(key, variant.program))
+	{
+		variant.ready = true;
+		return;
+	}
+
+	if (variant.ready && variant.program.restorePrevious())
+		return;
+
+	// the first build of a variant has nothing to go back to
+	std::cerr << "Shader variant " << key << " lacks uniforms the app sets, built with\n" << get_variant_defines(key);
+	exit(EXIT_FAILURE);
+}
+
+void ShaderVariants::release()
+{
+	mVariants.clear();
+}
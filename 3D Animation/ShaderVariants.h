@@ -0,0 +1,83 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+#include "utilities.h"
+#include "ShaderProgram.h"
+
+// features a lit shader is specialised for, each becomes a #define of its variant so the shaders never
+// branch on them
+struct ShaderFeatures
+{
+	int lightType = DIRECTIONAL_LIGHT;	// LIGHT_TYPE, every light of the variant is shaded as this Light::type
+	int lightCount = 1;					// LIGHT_COUNT, the first 1 to MAX_LIGHTS lights of FrameBlock
+	bool textured = false;				// TEXTURED, diffuse reflection modulated by the texture on unit 0
+	bool instanced = false;				// INSTANCED, matrices and material index from InstanceData, not ObjectBlock
+	bool clustered = false;				// CLUSTERED, plus the point and spot lights of the fragment's cluster, see LightClusters.h
+};
+
+// key of a variant: light type in bits 0-1, light count - 1 in bits 2-4, textured in bit 5, instanced in bit 6 and
+// clustered in bit 7
+std::uint32_t make_variant_key(const ShaderFeatures& features);
+ShaderFeatures get_variant_features(std::uint32_t key);
+// the #define lines a variant is compiled with
+std::string get_variant_defines(std::uint32_t key);
+
+/*****************************************************************
+ * specialised programs of one vertex and fragment shader pair, one
+ * per combination of ShaderFeatures that is drawn with
+ * a variant is built the first time it is asked for and kept by
+ * its key, the program binary cache makes later runs cheap
+ *****************************************************************/
+class ShaderVariants
+{
+public:
+	// called once a variant is built or rebuilt, to bind its uniform blocks and resolve its uniforms, returns false
+	// if the program lacks a uniform the app sets: a rebuild is then dropped for the previous program, a first
+	// build exits
+	typedef std::function<bool(std::uint32_t key, ShaderProgram& program)> SetupFunction;
+
+	ShaderVariants() = default;
+	ShaderVariants(const ShaderVariants&) = delete;
+	ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+	void init(const std::string& vShaderFilename, const std::string& fShaderFilename, SetupFunction setup);
+
+	// start building a variant without waiting for it, for variants that will be drawn soon
+	void prepare(std::uint32_t key);
+	// program of a variant, built first if it is new, nullptr if it failed to build
+	ShaderProgram* get(std::uint32_t key);
+	// number of a variant from 0 in the order they were first asked for, for render queue sort keys
+	int getIndex(std::uint32_t key);
+	int getCount() const { return static_cast<int>(mVariants.size()); }
+
+	// swap in finished builds and, if reload is set, rebuild variants whose files changed, failed ones included
+	void update(bool reload);
+
+	// delete all variants
+	void release();
+
+private:
+	struct Variant
+	{
+		ShaderProgram program;
+		int index = 0;
+		bool ready = false;		// built and set up at least once
+	};
+
+	std::string mVShaderFilename;
+	std::string mFShaderFilename;
+	SetupFunction mSetup;
+	std::map<std::uint32_t, Variant> mVariants;
+
+	// the variant of a key, its build is started if it is new
+	Variant& getVariant(std::uint32_t key);
+	// set up a variant whose build was swapped in
+	void setup(std::uint32_t key, Variant& variant);
+};
+
+#endif
@@ -1,218 +1,230 @@
 #include "SimpleModel.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
 
 SimpleModel::SimpleModel()
 {}
 
 SimpleModel::~SimpleModel()
 {
-	// delete mesh buffers
-	if (mMesh.VBO != 0)
-		glDeleteBuffers(1, &mMesh.VBO);
-	if (mMesh.IBO != 0)
-		glDeleteBuffers(1, &mMesh.IBO);
-	if (mMesh.VAO != 0)
-		glDeleteVertexArrays(1, &mMesh.VAO);
+	release();
+}
 
-	mIsValid = false;
+SimpleModel::SimpleModel(SimpleModel&& other) noexcept
+	: mIsValid(other.mIsValid), mIsEmpty(other.mIsEmpty), mMesh(std::move(other.mMesh)), mUploadedBytes(other.mUploadedBytes)
+{
+	// other no longer owns the buffers
+	other.mMesh = Mesh();
+	other.mIsValid = false;
+	other.mIsEmpty = false;
 }
 
-void SimpleModel::loadModel(const char *filename, bool texture)
+SimpleModel& SimpleModel::operator=(SimpleModel&& other) noexcept
 {
-	// Create an instance of the Importer class
-	Assimp::Importer importer;
+	if (this != &other)
+	{
+		release();
 
-	// load model file with assimp 
-	const aiScene *scene = importer.ReadFile(filename,
-		aiProcess_Triangulate |
-		aiProcess_GenSmoothNormals |
-		aiProcess_JoinIdenticalVertices);
+		mIsValid = other.mIsValid;
+		mIsEmpty = other.mIsEmpty;
+		mMesh = std::move(other.mMesh);
+		mUploadedBytes = other.mUploadedBytes;
 
-	// check whether scene was loaded
-	if (!scene)
-	{
-		// output error message and exit
-		std::cerr << "Failed to open: " << filename << std::endl;
-		exit(EXIT_FAILURE);
+		// other no longer owns the buffers
+		other.mMesh = Mesh();
+		other.mIsValid = false;
+		other.mIsEmpty = false;
 	}
 
-	// only loads first mesh
-	if(!texture)
-		loadMesh(scene->mMeshes[0]);
-	else
-		loadMeshWithTexture(scene->mMeshes[0]);
-
-	// importer's destructor will clean up
+	return *this;
 }
 
-void SimpleModel::drawModel()
+// return the mesh's ranges to its arena
+void SimpleModel::release()
 {
-	if (mIsValid)
-	{
-		glBindVertexArray(mMesh.VAO);		// make mesh VAO active
-		glDrawElements(GL_TRIANGLES, mMesh.numOfIndices, GL_UNSIGNED_INT, 0);	// render vertices
-	}
+	if (mMesh.arena != nullptr)
+		mMesh.arena->free(mMesh.allocation);
+
+	mMesh = Mesh();
+	mIsValid = false;
+	mIsEmpty = false;
+	mUploadedBytes = 0;
 }
 
-void SimpleModel::loadMesh(const aiMesh *mesh)
+void SimpleModel::loadModel(const char *filename, bool texture, bool packed)
 {
-	// mesh data
-	std::vector<VertexNormal> vertices;
-	std::vector<GLint> indices;
+	auto start = std::chrono::steady_clock::now();
 
-	// check if mesh contains vertex coordinates, normals and faces
-	if (!mesh->HasPositions() || !mesh->HasNormals() || !mesh->HasFaces())
+	// read the mesh from its binary cache or import it
+	MeshData data;
+	if (!load_mesh_data(filename, get_vertex_format(texture, packed), data))
 	{
-		mIsValid = false;
-		return;
+		// output error message and exit
+		std::cerr << "Failed to open: " << filename << std::endl;
+		exit(EXIT_FAILURE);
 	}
 
-	// get vertex data
-	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-	{
-		VertexNormal vertex;	// for vertex data
+	std::size_t byteBudget = std::numeric_limits<std::size_t>::max();
+	uploadMesh(data, byteBudget);
 
-		// get vertex position
-		vertex.position[0] = mesh->mVertices[i].x;
-		vertex.position[1] = mesh->mVertices[i].y;
-		vertex.position[2] = mesh->mVertices[i].z;
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "Loaded " << filename << (data.fromCache ? " from mesh cache" : " through Assimp")
+		<< " in " << elapsed.count() << " ms" << std::endl;
+}
 
-		// get vertex normal
-		vertex.normal[0] = mesh->mNormals[i].x;
-		vertex.normal[1] = mesh->mNormals[i].y;
-		vertex.normal[2] = mesh->mNormals[i].z;
+int SimpleModel::getTriangleCount(int lod) const
+{
+	if (lod < 0 || lod >= getLodCount())
+		return 0;
 
-		// append vertex data
-		vertices.push_back(vertex);
-	}
+	return mMesh.lods[lod].indexCount / 3;
+}
 
-	// get face data
-	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
-	{
-		for (unsigned int j = 0; j < mesh->mFaces[i].mNumIndices; j++)
-		{
-			// append face index
-			indices.push_back(mesh->mFaces[i].mIndices[j]);
-		}
-	}
+float SimpleModel::getLodError(int lod) const
+{
+	if (lod < 0 || lod >= getLodCount())
+		return 0.0f;
 
-	// store total number of indices
-	mMesh.numOfIndices = static_cast<int>(indices.size());
+	return mMesh.lods[lod].error;
+}
 
-	// generate identifier for VBOs and copy data to GPU
-	glGenBuffers(1, &mMesh.VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, mMesh.VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(VertexNormal) * vertices.size(), &vertices[0], GL_STATIC_DRAW);
+int SimpleModel::selectLod(float pixelsPerUnit, int currentLod, float maxPixelError, float hysteresis) const
+{
+	if (getLodCount() == 0)
+		return 0;
 
-	// generate identifier for IBO and copy data to GPU
-	glGenBuffers(1, &mMesh.IBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mMesh.IBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLint) * indices.size(), &indices[0], GL_STATIC_DRAW);
+	int lod = std::min(std::max(currentLod, 0), getLodCount() - 1);
 
-	// generate identifiers for VAO and supply information
-	glGenVertexArrays(1, &mMesh.VAO);
-	glBindVertexArray(mMesh.VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, mMesh.VBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mMesh.IBO);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormal), reinterpret_cast<void*>(offsetof(VertexNormal, position)));
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormal), reinterpret_cast<void*>(offsetof(VertexNormal, normal)));
+	// finer while the current level is visibly off
+	while (lod > 0 && mMesh.lods[lod].error * pixelsPerUnit > maxPixelError)
+		lod--;
 
-	// enable vertex attributes
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
+	// coarser only while the next level is well inside the limit
+	while (lod + 1 < getLodCount() && mMesh.lods[lod + 1].error * pixelsPerUnit <= maxPixelError * hysteresis)
+		lod++;
 
-	// unbind VAO
-	glBindVertexArray(0);
+	return lod;
+}
 
-	mIsValid = true;
+// first index of a level within the arena's index buffer
+static std::size_t get_first_index(const Mesh& mesh, int lod)
+{
+	return mesh.allocation.firstIndex + mesh.lods[lod].firstIndex;
 }
 
-void SimpleModel::loadMeshWithTexture(const aiMesh* mesh)
+// byte offset of a level in the index buffer, as glDrawElements takes it
+static const void* get_index_offset(const Mesh& mesh, int lod)
 {
-	// mesh data
-	std::vector<VertexNormTex> vertices;
-	std::vector<GLint> indices;
+	return reinterpret_cast<const void*>(get_first_index(mesh, lod) * mesh.arena->getIndexSize());
+}
 
-	// check if mesh contains vertex coordinates, normals and faces
-	if (!mesh->HasPositions() || !mesh->HasNormals() || !mesh->HasFaces())
-	{
-		mIsValid = false;
-		return;
-	}
-	// check if mesh contains texture coordinates (i.e. index 0)
-	if (mesh->HasTextureCoords(0))
+void SimpleModel::drawModel(int lod)
+{
+	if (mIsValid)
 	{
-		mMesh.hasTexCoords = true;
+		lod = std::min(std::max(lod, 0), getLodCount() - 1);
+
+		// every model of the arena shares its VAO, so the bind is skipped between them
+		GLState::bindVertexArray(mMesh.arena->getVertexArray());
+		glDrawElementsBaseVertex(GL_TRIANGLES, mMesh.lods[lod].indexCount, mMesh.indexType, get_index_offset(mMesh, lod),
+			static_cast<GLint>(mMesh.allocation.firstVertex));	// render vertices
 	}
+}
 
-	// get vertex data
-	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-	{
-		VertexNormTex vertex;	// for vertex data
+void SimpleModel::drawInstanced(GLuint instanceBuffer, GLsizei firstInstance, GLsizei instanceCount, int lod)
+{
+	if (!mIsValid || instanceCount <= 0)
+		return;
+
+	// without base instances the instance attributes have to point at the first instance
+	mMesh.arena->getInstancedVertexArray(instanceBuffer, static_cast<GLintptr>(firstInstance) * sizeof(InstanceData));
 
-		// get vertex position
-		vertex.position[0] = mesh->mVertices[i].x;
-		vertex.position[1] = mesh->mVertices[i].y;
-		vertex.position[2] = mesh->mVertices[i].z;
+	lod = std::min(std::max(lod, 0), getLodCount() - 1);
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, mMesh.lods[lod].indexCount, mMesh.indexType, get_index_offset(mMesh, lod),
+		instanceCount, static_cast<GLint>(mMesh.allocation.firstVertex));
+}
 
-		// get vertex normal
-		vertex.normal[0] = mesh->mNormals[i].x;
-		vertex.normal[1] = mesh->mNormals[i].y;
-		vertex.normal[2] = mesh->mNormals[i].z;
+DrawElementsIndirectCommand SimpleModel::getDrawCommand(int lod, GLuint instanceCount, GLuint baseInstance) const
+{
+	DrawElementsIndirectCommand command = {};
+	if (!mIsValid)
+		return command;
+
+	lod = std::min(std::max(lod, 0), getLodCount() - 1);
+	command.count = static_cast<GLuint>(mMesh.lods[lod].indexCount);
+	command.instanceCount = instanceCount;
+	command.firstIndex = static_cast<GLuint>(get_first_index(mMesh, lod));
+	command.baseVertex = static_cast<GLint>(mMesh.allocation.firstVertex);
+	command.baseInstance = baseInstance;
+	return command;
+}
 
-		// get first vertex texture coordinate (i.e. index 0)
-		if (mMesh.hasTexCoords)
+// copy up to byteBudget bytes of a mesh to the GPU and take them off the budget, call again with the
+// same data until it returns true, the model is only drawn once the whole mesh is there
+bool SimpleModel::uploadMesh(const MeshData& data, std::size_t& byteBudget)
+{
+	const std::size_t vertexBytes = data.vertexCount * data.getVertexSize();
+	const std::size_t indexBytes = data.indexCount * data.getIndexSize();
+
+	// the first call reserves the mesh's ranges in the arena of its format
+	if (mMesh.arena == nullptr)
+	{
+		release();
+
+		// a mesh without positions, normals or faces is loaded but not drawn
+		if (data.indexCount == 0)
 		{
-			vertex.texCoord[0] = mesh->mTextureCoords[0][i].x;
-			vertex.texCoord[1] = mesh->mTextureCoords[0][i].y;
+			mIsEmpty = true;
+			return true;
 		}
-		else
+
+		mMesh.numOfIndices = data.indexCount;
+		mMesh.hasTexCoords = data.hasTexCoords;
+		mMesh.vertexFormat = data.vertexFormat;
+		mMesh.indexType = data.indexType;
+		mMesh.positionOffset = data.positionOffset;
+		mMesh.positionScale = data.positionScale;
+		mMesh.lods = data.lods;
+		mMesh.bounds = data.bounds;
+		mMesh.arena = &MeshArena::get(data.vertexFormat, data.indexType);
+		mMesh.allocation = mMesh.arena->allocate(data.vertexCount, data.indexCount);
+		mUploadedBytes = 0;
+
+		// a mesh without levels of detail is its own only level
+		if (mMesh.lods.empty())
 		{
-			vertex.texCoord[0] = vertex.texCoord[1] = 0.0f;
+			mMesh.lods.resize(1);
+			mMesh.lods[0].indexCount = data.indexCount;
 		}
-
-		// append vertex data
-		vertices.push_back(vertex);
 	}
 
-	// get face data
-	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+	// vertices first, then indices, straight from the mapped cache file if the mesh came from there
+	while (mUploadedBytes < vertexBytes + indexBytes && byteBudget > 0)
 	{
-		for (unsigned int j = 0; j < mesh->mFaces[i].mNumIndices; j++)
+		std::size_t size;
+
+		if (mUploadedBytes < vertexBytes)
 		{
-			// append face index
-			indices.push_back(mesh->mFaces[i].mIndices[j]);
+			size = std::min(byteBudget, vertexBytes - mUploadedBytes);
+			mMesh.arena->writeVertices(mMesh.allocation, mUploadedBytes, size, static_cast<const char*>(data.vertices) + mUploadedBytes);
+		}
+		else
+		{
+			std::size_t offset = mUploadedBytes - vertexBytes;
+			size = std::min(byteBudget, indexBytes - offset);
+			mMesh.arena->writeIndices(mMesh.allocation, offset, size, static_cast<const char*>(data.indices) + offset);
 		}
-	}
-
-	// store total number of indices
-	mMesh.numOfIndices = indices.size();
-
-	// generate identifier for VBOs and copy data to GPU
-	glGenBuffers(1, &mMesh.VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, mMesh.VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(VertexNormTex), &vertices[0], GL_STATIC_DRAW);
-
-	// generate identifier for IBO and copy data to GPU
-	glGenBuffers(1, &mMesh.IBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mMesh.IBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLint), &indices[0], GL_STATIC_DRAW);
-
-	// generate identifiers for VAO and supply information
-	glGenVertexArrays(1, &mMesh.VAO);
-	glBindVertexArray(mMesh.VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, mMesh.VBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mMesh.IBO);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormTex), reinterpret_cast<void*>(offsetof(VertexNormTex, position)));
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormTex), reinterpret_cast<void*>(offsetof(VertexNormTex, normal)));
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexNormTex), reinterpret_cast<void*>(offsetof(VertexNormTex, texCoord)));
 
-	// enable vertex attributes
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glEnableVertexAttribArray(2);
+		mUploadedBytes += size;
+		byteBudget -= size;
+	}
 
-	// unbind VAO
-	glBindVertexArray(0);
+	if (mUploadedBytes < vertexBytes + indexBytes)
+		return false;
 
 	mIsValid = true;
+	return true;
 }
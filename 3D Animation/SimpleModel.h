@@ -1,25 +1,32 @@
 #ifndef SIMPLE_MODEL_H
 #define SIMPLE_MODEL_H
 
-#include <assimp/Importer.hpp>      // C++ importer interface
-#include <assimp/scene.h>           // output data structure
-#include <assimp/postprocess.h>     // post processing flags
+#include <vector>
 
 #include "utilities.h"
 #include "ShaderProgram.h"
+#include "MeshCache.h"
+#include "MeshArena.h"
 
 struct Mesh
 {
-    // OpenGL buffer objects
-    GLuint VBO = 0;
-    GLuint IBO = 0;
-    GLuint VAO = 0;
+    // ranges of the shared vertex and index buffers of the mesh's format
+    MeshArena* arena = nullptr;
+    MeshAllocation allocation;
     int numOfIndices = 0;
     bool hasTexCoords = false;
+    VertexFormat vertexFormat = VertexFormat::NORMAL;
+    GLenum indexType = GL_UNSIGNED_INT;
+    glm::vec3 positionOffset = glm::vec3(0.0f);    // decode of packed positions, see MeshData
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    std::vector<MeshLod> lods;          // ranges of the index buffer from the finest, at least one once uploaded
+    MeshBounds bounds;                  // model space bounds of the vertices
 };
 
 /*****************************************************************
- * simple model class that loads the first mesh of a model
+ * simple model class that loads all meshes of a model merged into
+ * one, the mesh is suballocated from the MeshArena of its format
+ * so models draw from shared buffers and vertex arrays
  *****************************************************************/
 class SimpleModel
 {
@@ -27,15 +34,59 @@ public:
     SimpleModel();
     ~SimpleModel();
 
-    void loadModel(const char *filename, bool texture = false);
-    void drawModel();
+    // models own their arena allocations so they can be moved but not copied
+    SimpleModel(SimpleModel&& other) noexcept;
+    SimpleModel& operator=(SimpleModel&& other) noexcept;
+    SimpleModel(const SimpleModel&) = delete;
+    SimpleModel& operator=(const SimpleModel&) = delete;
+
+    // load the meshes of a model file, through its binary cache when that is up to date
+    // packed stores the vertices in the packed formats of VertexPacking.h
+    void loadModel(const char *filename, bool texture = false, bool packed = false);
+    // copy up to byteBudget bytes of a mesh to the GPU and take them off the budget,
+    // call again with the same data until it returns true
+    bool uploadMesh(const MeshData& data, std::size_t& byteBudget);
+    // the whole mesh is on the GPU, or the model has no faces and nothing to upload
+    bool isLoaded() const { return mIsValid || mIsEmpty; }
+    // loaded without faces, the model is skipped rather than drawn
+    bool isEmpty() const { return mIsEmpty; }
+
+    // values for the vertex decode uniforms of the shaders, uPositionOffset, uPositionScale and uOctahedralNormals
+    const glm::vec3& getPositionOffset() const { return mMesh.positionOffset; }
+    const glm::vec3& getPositionScale() const { return mMesh.positionScale; }
+    bool hasOctahedralNormals() const { return is_packed(mMesh.vertexFormat); }
+
+    // bounding box and sphere in model space, for culling
+    const MeshBounds& getBounds() const { return mMesh.bounds; }
+
+    // levels of detail, 0 is the full mesh
+    int getLodCount() const { return static_cast<int>(mMesh.lods.size()); }
+    int getTriangleCount(int lod = 0) const;
+    // distance of a level from the full mesh in model units
+    float getLodError(int lod) const;
+    // coarsest level whose error covers at most maxPixelError pixels, errors are turned into pixels by
+    // multiplying with pixelsPerUnit, levels only get coarser than currentLod once the error of the
+    // coarser level is below hysteresis times the limit, so a model at the boundary does not flicker
+    int selectLod(float pixelsPerUnit, int currentLod, float maxPixelError, float hysteresis) const;
+
+    void drawModel(int lod = 0);
+    // draw instanceCount copies of the model in one call, the per instance
+    // model matrices and material indices are read from an array of
+    // InstanceData in instanceBuffer starting at firstInstance
+    void drawInstanced(GLuint instanceBuffer, GLsizei firstInstance, GLsizei instanceCount, int lod = 0);
+    // the same draw as a command for glMultiDrawElementsIndirect with the VAO of getArena(), the instances
+    // start at baseInstance of the array the VAO's instance attributes point at, all zero until loaded
+    DrawElementsIndirectCommand getDrawCommand(int lod, GLuint instanceCount, GLuint baseInstance) const;
+    // arena the mesh lives in, nullptr until the upload has started
+    MeshArena* getArena() const { return mMesh.arena; }
 
 private:
     bool mIsValid = false;
+    bool mIsEmpty = false;
     Mesh mMesh;
+    std::size_t mUploadedBytes = 0;     // bytes of the mesh copied by uploadMesh so far
  
-    void loadMesh(const aiMesh *mesh);
-    void loadMeshWithTexture(const aiMesh* mesh);
+    void release();
 };
 
 #endif
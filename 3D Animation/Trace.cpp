@@ -0,0 +1,189 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// events each thread keeps, a power of two
+static const std::uint64_t RING_SIZE = 1 << 16;
+
+std::atomic<bool> gTraceEnabled(false);
+
+struct TraceEvent
+{
+	const char* name;
+	std::int64_t time;	// nanoseconds since the first event of the process
+	char phase;			// 'B' or 'E'
+};
+
+// written only by its thread, read by trace_dump while the thread may still be writing
+struct ThreadBuffer
+{
+	std::vector<TraceEvent> events = std::vector<TraceEvent>(RING_SIZE);
+	std::atomic<std::uint64_t> written{ 0 };	// events ever recorded, the next one goes to written % RING_SIZE
+	std::string name;
+	int id = 0;
+};
+
+// buffers of all threads that recorded, kept after their thread exits so its events can still be dumped
+static std::mutex gBuffersMutex;
+static std::vector<std::shared_ptr<ThreadBuffer>> gBuffers;
+static int gNextThreadId = 1;
+static std::atomic<std::int64_t> gStartTime(0);
+
+static thread_local std::shared_ptr<ThreadBuffer> tBuffer;
+static thread_local std::string tThreadName;
+
+static std::int64_t get_trace_time()
+{
+	static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+// buffer of the calling thread, created by its first event
+static ThreadBuffer& get_thread_buffer()
+{
+	if (!tBuffer)
+	{
+		std::shared_ptr<ThreadBuffer> buffer = std::make_shared<ThreadBuffer>();
+
+		std::lock_guard<std::mutex> lock(gBuffersMutex);
+		buffer->id = gNextThreadId++;
+		buffer->name = tThreadName.empty() ? "thread " + std::to_string(buffer->id) : tThreadName;
+		gBuffers.push_back(buffer);
+		tBuffer = buffer;
+	}
+
+	return *tBuffer;
+}
+
+void trace_record(const char* name, char phase)
+{
+	ThreadBuffer& buffer = get_thread_buffer();
+	const std::uint64_t index = buffer.written.load(std::memory_order_relaxed);
+
+	buffer.events[index & (RING_SIZE - 1)] = { name, get_trace_time(), phase };
+	buffer.written.store(index + 1, std::memory_order_release);
+}
+
+void trace_start()
+{
+	{
+		// threads that exited since the last recording have nothing new to dump
+		std::lock_guard<std::mutex> lock(gBuffersMutex);
+		gBuffers.erase(std::remove_if(gBuffers.begin(), gBuffers.end(),
+			[](const std::shared_ptr<ThreadBuffer>& buffer) { return buffer.use_count() == 1; }), gBuffers.end());
+	}
+
+	gStartTime.store(get_trace_time());
+	gTraceEnabled.store(true);
+}
+
+void trace_stop()
+{
+	gTraceEnabled.store(false);
+}
+
+void trace_set_thread_name(const std::string& name)
+{
+	tThreadName = name;
+
+	if (tBuffer)
+	{
+		std::lock_guard<std::mutex> lock(gBuffersMutex);
+		tBuffer->name = name;
+	}
+}
+
+// copy the events of a buffer that are still in its ring, oldest first
+static void copy_events(const ThreadBuffer& buffer, std::vector<TraceEvent>& events)
+{
+	const std::uint64_t end = buffer.written.load(std::memory_order_acquire);
+	std::uint64_t begin = end > RING_SIZE ? end - RING_SIZE : 0;
+
+	events.clear();
+	for (std::uint64_t i = begin; i < end; i++)
+		events.push_back(buffer.events[i & (RING_SIZE - 1)]);
+
+	// events the thread wrote during the copy may have replaced the oldest ones copied
+	const std::uint64_t written = buffer.written.load(std::memory_order_acquire);
+	if (written > RING_SIZE && written - RING_SIZE > begin)
+	{
+		std::uint64_t overwritten = std::min(written - RING_SIZE - begin, end - begin);
+		events.erase(events.begin(), events.begin() + static_cast<std::ptrdiff_t>(overwritten));
+	}
+}
+
+bool trace_dump(const std::string& path)
+{
+	std::ofstream file(path);
+	if (!file)
+	{
+		std::cerr << "Could not write the trace to " << path << std::endl;
+		return false;
+	}
+
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+	{
+		std::lock_guard<std::mutex> lock(gBuffersMutex);
+		buffers = gBuffers;
+	}
+
+	const std::int64_t startTime = gStartTime.load();
+	std::vector<TraceEvent> events;
+	int depth = 0;		// begun events of the thread not ended yet
+	bool first = true;
+	int eventCount = 0;
+
+	file.setf(std::ios::fixed);
+	file.precision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	for (const std::shared_ptr<ThreadBuffer>& buffer : buffers)
+	{
+		std::string name;
+		{
+			std::lock_guard<std::mutex> lock(gBuffersMutex);
+			name = buffer->name;
+		}
+
+		file << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+			<< ",\"args\":{\"name\":\"" << name << "\"}}";
+		first = false;
+
+		copy_events(*buffer, events);
+		depth = 0;
+
+		for (const TraceEvent& event : events)
+		{
+			if (event.time < startTime)
+				continue;
+
+			// ends whose begin was overwritten or recorded before the start are dropped
+			if (event.phase == 'E')
+			{
+				if (depth == 0)
+					continue;
+				depth--;
+			}
+			else
+				depth++;
+
+			file << ",\n{\"name\":\"" << (event.phase == 'B' ? event.name : "") << "\",\"ph\":\"" << event.phase
+				<< "\",\"pid\":1,\"tid\":" << buffer->id << ",\"ts\":" << (event.time - startTime) / 1000.0 << "}";
+			eventCount++;
+		}
+	}
+
+	file << "\n]}\n";
+
+	if (file)
+		std::cout << "Trace of " << eventCount << " events written to " << path << std::endl;
+
+	return static_cast<bool>(file);
+}
@@ -0,0 +1,90 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <string>
+
+// set to 0 to compile the trace macros out entirely
+#ifndef ENABLE_TRACING
+#define ENABLE_TRACING 1
+#endif
+
+/*****************************************************************
+ * timeline of begin and end events on every thread, written as
+ * Chrome trace-event JSON for chrome://tracing or Perfetto
+ * each thread records into its own ring buffer without locks, a
+ * full ring overwrites its oldest events
+ * while recording is off an event costs one relaxed atomic load
+ * event names must outlive the trace, use string literals
+ *****************************************************************/
+
+extern std::atomic<bool> gTraceEnabled;
+
+inline bool trace_is_enabled()
+{
+	return gTraceEnabled.load(std::memory_order_relaxed);
+}
+
+// start recording, events from before the start are left out of later dumps
+void trace_start();
+void trace_stop();
+
+// write the recorded events of all threads, returns false if the file can't be written
+bool trace_dump(const std::string& path);
+
+// name of the calling thread in dumps
+void trace_set_thread_name(const std::string& name);
+
+void trace_record(const char* name, char phase);
+
+inline void trace_begin(const char* name)
+{
+	if (trace_is_enabled())
+		trace_record(name, 'B');
+}
+
+inline void trace_end()
+{
+	if (trace_is_enabled())
+		trace_record(nullptr, 'E');
+}
+
+// records a begin event on construction and the matching end event on destruction
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* name) : mActive(trace_is_enabled())
+	{
+		if (mActive)
+			trace_record(name, 'B');
+	}
+
+	~TraceScope()
+	{
+		if (mActive)
+			trace_record(nullptr, 'E');
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	bool mActive;	// recording was on at the begin, so the end is recorded even if it was turned off since
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if ENABLE_TRACING
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_BEGIN(name) trace_begin(name)
+#define TRACE_END() trace_end()
+#define TRACE_THREAD_NAME(name) trace_set_thread_name(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END() ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif
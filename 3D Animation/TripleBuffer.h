@@ -0,0 +1,62 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/*****************************************************************
+ * lock free hand over of values from one producer thread to one
+ * consumer thread through three buffers
+ * the producer fills its own buffer and swaps it with the shared
+ * one, the consumer swaps the shared one with its own when it
+ * holds something newer, neither side ever waits for the other
+ *****************************************************************/
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : mShared(1), mWrite(0), mRead(2) {}
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	// producer: buffer to fill, it still holds whatever was written to it last time
+	T& getWriteBuffer()
+	{
+		return mBuffers[mWrite];
+	}
+
+	// producer: hand the write buffer to the consumer and take the shared buffer in its place
+	void publish()
+	{
+		int previous = mShared.exchange(mWrite | NEW_FLAG, std::memory_order_acq_rel);
+		mWrite = previous & INDEX_MASK;
+	}
+
+	// consumer: take the newest published buffer, returns false if nothing was published since the last call
+	bool acquire()
+	{
+		if ((mShared.load(std::memory_order_relaxed) & NEW_FLAG) == 0)
+			return false;
+
+		int previous = mShared.exchange(mRead, std::memory_order_acq_rel);
+		mRead = previous & INDEX_MASK;
+		return true;
+	}
+
+	// consumer: buffer taken by the last acquire, unchanged until the next one
+	const T& getReadBuffer() const
+	{
+		return mBuffers[mRead];
+	}
+
+private:
+	static const int INDEX_MASK = 3;
+	static const int NEW_FLAG = 4;
+
+	T mBuffers[3];
+	std::atomic<int> mShared;	// shared buffer index, NEW_FLAG is set while it holds an unread value
+	int mWrite;					// buffer owned by the producer
+	int mRead;					// buffer owned by the consumer
+};
+
+#endif
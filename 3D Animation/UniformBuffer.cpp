@@ -0,0 +1,109 @@
+#include "UniformBuffer.h"
+#include "GLState.h"
+
+UniformBuffer::UniformBuffer()
+{}
+
+UniformBuffer::~UniformBuffer()
+{
+	release();
+}
+
+UniformBuffer::UniformBuffer(UniformBuffer&& other) noexcept
+	: mBufferID(other.mBufferID), mSize(other.mSize)
+{
+	// other no longer owns the buffer
+	other.mBufferID = 0;
+	other.mSize = 0;
+}
+
+UniformBuffer& UniformBuffer::operator=(UniformBuffer&& other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+
+		mBufferID = other.mBufferID;
+		mSize = other.mSize;
+
+		// other no longer owns the buffer
+		other.mBufferID = 0;
+		other.mSize = 0;
+	}
+
+	return *this;
+}
+
+// allocate the buffer, optionally with initial contents
+void UniformBuffer::create(GLsizeiptr size, const void* data, GLenum usage)
+{
+	if (mBufferID == 0)
+		glGenBuffers(1, &mBufferID);
+
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, mBufferID);
+	glBufferData(GL_UNIFORM_BUFFER, size, data, usage);
+
+	mSize = size;
+}
+
+// copy data into the buffer
+void UniformBuffer::update(GLintptr offset, GLsizeiptr size, const void* data)
+{
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, mBufferID);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+}
+
+// bind the whole buffer to a uniform block binding point
+void UniformBuffer::bindBase(GLuint bindingPoint) const
+{
+	GLState::bindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, mBufferID);
+}
+
+// bind part of the buffer to a uniform block binding point
+void UniformBuffer::bindRange(GLuint bindingPoint, GLintptr offset, GLsizeiptr size) const
+{
+	GLState::bindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, mBufferID, offset, size);
+}
+
+GLuint UniformBuffer::getID() const
+{
+	return mBufferID;
+}
+
+GLsizeiptr UniformBuffer::getSize() const
+{
+	return mSize;
+}
+
+// required alignment of bindRange offsets
+GLintptr UniformBuffer::getOffsetAlignment()
+{
+	static GLint alignment = 0;
+
+	// only query the driver once
+	if (alignment == 0)
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+	return alignment;
+}
+
+// round size up to the offset alignment
+GLintptr UniformBuffer::alignSize(GLintptr size)
+{
+	GLintptr alignment = getOffsetAlignment();
+
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+// delete the buffer
+void UniformBuffer::release()
+{
+	if (mBufferID != 0)
+	{
+		glDeleteBuffers(1, &mBufferID);
+		GLState::onBufferDeleted(mBufferID);
+	}
+
+	mBufferID = 0;
+	mSize = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <GLEW/glew.h>
+
+/*****************************************************************
+ * wrapper around a uniform buffer object
+ * the contents must follow the std140 layout of the shader block
+ *****************************************************************/
+class UniformBuffer
+{
+public:
+	UniformBuffer();
+	~UniformBuffer();
+
+	// buffers own a GL object so they can be moved but not copied
+	UniformBuffer(UniformBuffer&& other) noexcept;
+	UniformBuffer& operator=(UniformBuffer&& other) noexcept;
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	// allocate the buffer, optionally with initial contents
+	void create(GLsizeiptr size, const void* data = nullptr, GLenum usage = GL_DYNAMIC_DRAW);
+	// copy data into the buffer
+	void update(GLintptr offset, GLsizeiptr size, const void* data);
+
+	// bind the whole buffer to a uniform block binding point
+	void bindBase(GLuint bindingPoint) const;
+	// bind part of the buffer, offset must be a multiple of getOffsetAlignment()
+	void bindRange(GLuint bindingPoint, GLintptr offset, GLsizeiptr size) const;
+
+	GLuint getID() const;
+	GLsizeiptr getSize() const;
+
+	// required alignment of bindRange offsets
+	static GLintptr getOffsetAlignment();
+	// round size up to the offset alignment
+	static GLintptr alignSize(GLintptr size);
+
+private:
+	GLuint mBufferID = 0;	// buffer handle
+	GLsizeiptr mSize = 0;	// buffer size in bytes
+
+	void release();
+};
+
+#endif
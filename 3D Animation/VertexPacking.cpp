@@ -0,0 +1,281 @@
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// largest value of the 16 bit normalized formats
+static const float UNSIGNED_NORM_MAX = 65535.0f;
+static const float SIGNED_NORM_MAX = 32767.0f;
+
+// -1 or 1, never 0, so normals on the octahedron's edges fold the right way
+static float sign_not_zero(float value)
+{
+	return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+void encode_octahedral(const glm::vec3& normal, GLshort encoded[2])
+{
+	float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	if (sum == 0.0f)
+	{
+		encoded[0] = encoded[1] = 0;
+		return;
+	}
+
+	// project onto the octahedron and fold the lower half over the upper one
+	glm::vec3 projected = normal / sum;
+	float u = projected.x;
+	float v = projected.y;
+
+	if (projected.z < 0.0f)
+	{
+		u = (1.0f - std::abs(projected.y)) * sign_not_zero(projected.x);
+		v = (1.0f - std::abs(projected.x)) * sign_not_zero(projected.y);
+	}
+
+	// of the four roundings keep the one that decodes closest to the normal
+	glm::vec3 target = normal / glm::length(normal);
+	float bestDot = -2.0f;
+
+	for (int i = 0; i < 4; i++)
+	{
+		float scaledU = u * SIGNED_NORM_MAX;
+		float scaledV = v * SIGNED_NORM_MAX;
+		GLshort candidate[2] = {
+			static_cast<GLshort>(std::max(std::min((i & 1) ? std::ceil(scaledU) : std::floor(scaledU), SIGNED_NORM_MAX), -SIGNED_NORM_MAX)),
+			static_cast<GLshort>(std::max(std::min((i & 2) ? std::ceil(scaledV) : std::floor(scaledV), SIGNED_NORM_MAX), -SIGNED_NORM_MAX))
+		};
+
+		float cosine = glm::dot(decode_octahedral(candidate), target);
+		if (cosine > bestDot)
+		{
+			bestDot = cosine;
+			encoded[0] = candidate[0];
+			encoded[1] = candidate[1];
+		}
+	}
+}
+
+glm::vec3 decode_octahedral(const GLshort encoded[2])
+{
+	// same steps as decode_octahedral in the vertex shaders
+	float u = std::max(encoded[0] / SIGNED_NORM_MAX, -1.0f);
+	float v = std::max(encoded[1] / SIGNED_NORM_MAX, -1.0f);
+	glm::vec3 normal(u, v, 1.0f - std::abs(u) - std::abs(v));
+
+	float fold = std::max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -fold : fold;
+	normal.y += normal.y >= 0.0f ? -fold : fold;
+
+	return normal / glm::length(normal);
+}
+
+GLhalf float_to_half(float value)
+{
+	std::uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	const std::uint32_t sign = (bits >> 16) & 0x8000;
+	const int exponent = static_cast<int>((bits >> 23) & 0xFF);
+	std::uint32_t mantissa = bits & 0x7FFFFF;
+
+	// infinity and NaN, NaN keeps a mantissa bit
+	if (exponent == 0xFF)
+		return static_cast<GLhalf>(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+
+	const int halfExponent = exponent - 127 + 15;
+
+	// too large for a half
+	if (halfExponent >= 31)
+		return static_cast<GLhalf>(sign | 0x7C00);
+
+	std::uint32_t half;
+	std::uint32_t rest;
+	std::uint32_t halfway;
+
+	if (halfExponent <= 0)
+	{
+		// denormal half, anything below half the smallest denormal is zero
+		if (halfExponent < -10)
+			return static_cast<GLhalf>(sign);
+
+		mantissa |= 0x800000;
+		const int shift = 14 - halfExponent;
+		half = mantissa >> shift;
+		rest = mantissa & ((1u << shift) - 1);
+		halfway = 1u << (shift - 1);
+	}
+	else
+	{
+		half = (static_cast<std::uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+		rest = mantissa & 0x1FFF;
+		halfway = 0x1000;
+	}
+
+	// round to nearest even, a carry moves into the exponent as it should
+	if (rest > halfway || (rest == halfway && (half & 1) != 0))
+		half++;
+
+	return static_cast<GLhalf>(sign | half);
+}
+
+float half_to_float(GLhalf value)
+{
+	const std::uint32_t sign = static_cast<std::uint32_t>(value & 0x8000) << 16;
+	const std::uint32_t exponent = (value >> 10) & 0x1F;
+	const std::uint32_t mantissa = value & 0x3FF;
+
+	if (exponent == 0)
+	{
+		// zero and denormals
+		float magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+		return sign != 0 ? -magnitude : magnitude;
+	}
+
+	std::uint32_t bits;
+	if (exponent == 31)
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	else
+		bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+
+	float result;
+	std::memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+void transform_vertices(const glm::mat4& transform, const float* positions, const float* normals, int count,
+	unsigned char* vertices, std::size_t vertexSize)
+{
+	const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+	// written in place, both float formats start with the position and the normal
+	for (int i = 0; i < count; i++, positions += 3, normals += 3, vertices += vertexSize)
+	{
+		VertexNormal& placed = *reinterpret_cast<VertexNormal*>(vertices);
+
+		glm::vec3 position = glm::vec3(transform * glm::vec4(positions[0], positions[1], positions[2], 1.0f));
+		glm::vec3 normal = glm::normalize(normalMatrix * glm::vec3(normals[0], normals[1], normals[2]));
+
+		for (int k = 0; k < 3; k++)
+		{
+			placed.position[k] = position[k];
+			placed.normal[k] = normal[k];
+		}
+	}
+}
+
+void pack_vertices(MeshData& data)
+{
+	// only float meshes in their own storage
+	if (is_packed(data.vertexFormat) || data.vertexStorage.empty())
+		return;
+
+	const bool textured = is_textured(data.vertexFormat);
+	const std::size_t floatSize = data.getVertexSize();
+	const VertexFormat packedFormat = textured ? VertexFormat::PACKED_TEX : VertexFormat::PACKED;
+	const std::size_t packedSize = get_vertex_size(packedFormat);
+
+	// VertexNormal is the start of VertexNormTex, so both are read as VertexNormTex
+	auto read_vertex = [&](int vertex) {
+		VertexNormTex source = {};
+		std::memcpy(&source, data.vertexStorage.data() + vertex * floatSize, floatSize);
+		return source;
+	};
+
+	// the bounds the positions are stored as fractions of
+	glm::vec3 minimum(0.0f);
+	glm::vec3 maximum(0.0f);
+	for (int i = 0; i < data.vertexCount; i++)
+	{
+		VertexNormTex source = read_vertex(i);
+		glm::vec3 position(source.position[0], source.position[1], source.position[2]);
+
+		minimum = i == 0 ? position : glm::min(minimum, position);
+		maximum = i == 0 ? position : glm::max(maximum, position);
+	}
+
+	data.positionOffset = minimum;
+	data.positionScale = maximum - minimum;
+
+	std::vector<unsigned char> packed(data.vertexCount * packedSize);
+
+	for (int i = 0; i < data.vertexCount; i++)
+	{
+		VertexNormTex source = read_vertex(i);
+
+		// VertexPacked is the start of VertexPackedTex, so both are written as VertexPackedTex
+		VertexPackedTex vertex = {};
+
+		for (int k = 0; k < 3; k++)
+		{
+			float scale = data.positionScale[k];
+			float fraction = scale > 0.0f ? (source.position[k] - minimum[k]) / scale : 0.0f;
+			vertex.position[k] = static_cast<GLushort>(std::min(std::max(std::round(fraction * UNSIGNED_NORM_MAX), 0.0f), UNSIGNED_NORM_MAX));
+		}
+
+		encode_octahedral(glm::vec3(source.normal[0], source.normal[1], source.normal[2]), vertex.normal);
+
+		if (textured)
+		{
+			vertex.texCoord[0] = float_to_half(source.texCoord[0]);
+			vertex.texCoord[1] = float_to_half(source.texCoord[1]);
+		}
+
+		std::memcpy(packed.data() + i * packedSize, &vertex, packedSize);
+	}
+
+	data.vertexStorage.swap(packed);
+	data.vertexFormat = packedFormat;
+	data.vertices = data.vertexStorage.data();
+}
+
+void narrow_indices(MeshData& data)
+{
+	// 16 bit indices reach vertices 0 to 65535
+	if (data.indexType != GL_UNSIGNED_INT || data.indexStorage.empty() || data.vertexCount > 65536)
+		return;
+
+	std::vector<unsigned char> narrow(data.indexCount * sizeof(GLushort));
+	GLushort* indices = reinterpret_cast<GLushort*>(narrow.data());
+
+	for (int i = 0; i < data.indexCount; i++)
+		indices[i] = static_cast<GLushort>(data.getIndex(i));
+
+	data.indexStorage.swap(narrow);
+	data.indexType = GL_UNSIGNED_SHORT;
+	data.indices = data.indexStorage.data();
+}
+
+VertexNormTex unpack_vertex(const MeshData& data, int vertex)
+{
+	const std::size_t vertexSize = data.getVertexSize();
+	const unsigned char* source = static_cast<const unsigned char*>(data.vertices) + vertex * vertexSize;
+	VertexNormTex result = {};
+
+	if (!is_packed(data.vertexFormat))
+	{
+		std::memcpy(&result, source, vertexSize);
+		return result;
+	}
+
+	VertexPackedTex packed = {};
+	std::memcpy(&packed, source, vertexSize);
+
+	// what the normalized attributes and the shader decode produce
+	for (int k = 0; k < 3; k++)
+		result.position[k] = data.positionOffset[k] + packed.position[k] / UNSIGNED_NORM_MAX * data.positionScale[k];
+
+	glm::vec3 normal = decode_octahedral(packed.normal);
+	result.normal[0] = normal.x;
+	result.normal[1] = normal.y;
+	result.normal[2] = normal.z;
+
+	if (is_textured(data.vertexFormat))
+	{
+		result.texCoord[0] = half_to_float(packed.texCoord[0]);
+		result.texCoord[1] = half_to_float(packed.texCoord[1]);
+	}
+
+	return result;
+}
@@ -0,0 +1,36 @@
+#ifndef VERTEX_PACKING_H
+#define VERTEX_PACKING_H
+
+#include "MeshCache.h"
+
+/*****************************************************************
+ * compression of float vertices to VertexPacked/VertexPackedTex
+ * positions become 16 bit fractions of the mesh bounds, normals a
+ * 16 bit octahedral encoding and texture coordinates half floats,
+ * half the bytes of the float formats for the vertex shader to read
+ * the shaders undo it with the decode helpers in animation.vert
+ *****************************************************************/
+
+// write count imported vertices into the position and normal of NORMAL or NORM_TEX vertices vertexSize bytes apart,
+// positions and normals are xyz triples, moved by transform and its normal matrix, the normals renormalised
+void transform_vertices(const glm::mat4& transform, const float* positions, const float* normals, int count,
+	unsigned char* vertices, std::size_t vertexSize);
+
+// convert a NORMAL or NORM_TEX mesh in its own storage to PACKED or PACKED_TEX
+void pack_vertices(MeshData& data);
+
+// store 32 bit indices as 16 bit when every vertex can still be reached
+void narrow_indices(MeshData& data);
+
+// float copy of one vertex of any format, as the GPU decodes it
+VertexNormTex unpack_vertex(const MeshData& data, int vertex);
+
+// octahedral encoding of a unit vector, picks the rounding with the smallest angular error
+void encode_octahedral(const glm::vec3& normal, GLshort encoded[2]);
+glm::vec3 decode_octahedral(const GLshort encoded[2]);
+
+// IEEE half float conversion, rounds to nearest even
+GLhalf float_to_half(float value);
+float half_to_float(GLhalf value);
+
+#endif
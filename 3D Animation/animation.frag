@@ -1,17 +1,48 @@
 #version 330 core
 
+// the program is built in variants, see ShaderVariants.h, which insert these defines after the #version line
+// LIGHT_TYPE	type of every light, POINT_LIGHT, DIRECTIONAL_LIGHT or SPOT_LIGHT
+// LIGHT_COUNT	number of lights shaded, the first LIGHT_COUNT of uLights
+// TEXTURED		diffuse reflection is modulated by uTexture
+// CLUSTERED	the point and spot lights of the fragment's cluster are shaded too, see LightClusters.h
+#define POINT_LIGHT 1
+#define DIRECTIONAL_LIGHT 2
+#define SPOT_LIGHT 3
+
+#ifndef LIGHT_TYPE
+#define LIGHT_TYPE DIRECTIONAL_LIGHT
+#endif
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 1
+#endif
+
+// size of the material table, must match MAX_MATERIALS in RenderTypes.h
+#define MAX_MATERIALS 16
+// size of the light array, must match MAX_LIGHTS in RenderTypes.h
+#define MAX_LIGHTS 4
+// texels per clustered light, must match CLUSTER_LIGHT_TEXELS in LightClusters.h
+#define CLUSTER_LIGHT_TEXELS 5
+
 // interpolated values from the vertex shaders
 in vec3 vPosition;
 in vec3 vNormal;
+flat in int vMaterialIndex;
+#ifdef TEXTURED
+in vec2 vTexCoord;
+#endif
 
 
 // light properties
 struct Light
 {
+	vec3 pos;
+	float innerCos;		// spotlight cone as cosines
 	vec3 dir;
+	float outerCos;
 	vec3 La;
 	vec3 Ld;
 	vec3 Ls;
+	vec3 att;			// constant, linear and quadratic attenuation
 };
 
 // material properties
@@ -24,41 +55,151 @@ struct Material
 };
 
 
-// uniform input data
-uniform vec3 uViewpoint;
-uniform Light uLight;
-uniform Material uMaterial;
+// per-frame data, shared with the vertex shader
+layout(std140) uniform FrameBlock
+{
+	mat4 uViewProjectionMatrix;
+	vec3 uViewpoint;
+	Light uLights[MAX_LIGHTS];
+};
 
-// output data
-out vec3 fColor;
+// table of all materials
+layout(std140) uniform MaterialBlock
+{
+	Material uMaterials[MAX_MATERIALS];
+};
 
+#ifdef TEXTURED
+uniform sampler2D uTexture;
+#endif
 
-void main()
+#ifdef CLUSTERED
+// cluster grid of the clustered lights
+layout(std140) uniform ClusterBlock
 {
-	// fragment normal
-    vec3 n = normalize(vNormal);
+	vec4 uClusterViewport;	// x, y, width and height in pixels
+	vec4 uClusterDepth;		// near and far plane, scale and bias taking the log of a view depth to its slice
+	ivec4 uClusterGrid;		// tiles across, tiles up, slices and lights
+};
 
-	// vector toward the viewer
-	vec3 v = normalize(uViewpoint - vPosition);
+uniform usamplerBuffer uClusters;		// offset and count of each cluster's light indices
+uniform usamplerBuffer uClusterIndices;	// light indices of all clusters
+uniform samplerBuffer uClusterLights;	// CLUSTER_LIGHT_TEXELS texels per light
+#endif
 
+// output data
+out vec3 fColor;
+
+
+// ambient, diffuse and specular light reflected toward the viewer
+vec3 shade(Light light, Material material, vec3 kd, vec3 n, vec3 v)
+{
+#if LIGHT_TYPE == DIRECTIONAL_LIGHT
 	// vector towards the light
-    vec3 l = normalize(-uLight.dir);
+	vec3 l = normalize(-light.dir);
+	float intensity = 1.0f;
+#else
+	vec3 toLight = light.pos - vPosition;
+	float lightDistance = length(toLight);
+	vec3 l = toLight / lightDistance;
+	float intensity = 1.0f / (light.att.x + light.att.y * lightDistance + light.att.z * lightDistance * lightDistance);
+#if LIGHT_TYPE == SPOT_LIGHT
+	// full intensity within the inner cone, fading out to the outer one
+	intensity *= smoothstep(light.outerCos, light.innerCos, dot(-l, normalize(light.dir)));
+#endif
+#endif
 
 	// halfway vector
 	vec3 h = normalize(l + v);
 
 	// calculate ambient, diffuse and specular intensities
-	vec3 Ia = uLight.La * uMaterial.Ka;
+	vec3 Ia = light.La * material.Ka;
 	vec3 Id = vec3(0.0f);
 	vec3 Is = vec3(0.0f);
 	float dotLN = max(dot(l, n), 0.0f);
 
 	if(dotLN > 0.0f)
 	{
-		Id = uLight.Ld * uMaterial.Kd * dotLN;
-	    Is = uLight.Ls * uMaterial.Ks * pow(max(dot(n, h), 0.0f), uMaterial.shininess);
+		Id = light.Ld * kd * dotLN;
+	    Is = light.Ls * material.Ks * pow(max(dot(n, h), 0.0f), material.shininess);
+	}
+
+	return Ia + intensity * (Id + Is);
+}
+
+#ifdef CLUSTERED
+// diffuse and specular light of the lights binned into the fragment's cluster
+vec3 shade_clustered(Material material, vec3 kd, vec3 n, vec3 v)
+{
+	// view depth of the fragment from its window depth
+	float nearPlane = uClusterDepth.x;
+	float farPlane = uClusterDepth.y;
+	float depth = 2.0f * nearPlane * farPlane / (farPlane + nearPlane - (2.0f * gl_FragCoord.z - 1.0f) * (farPlane - nearPlane));
+
+	vec2 screen = (gl_FragCoord.xy - uClusterViewport.xy) / uClusterViewport.zw;
+	ivec2 tile = clamp(ivec2(screen * vec2(uClusterGrid.xy)), ivec2(0), uClusterGrid.xy - 1);
+	int slice = clamp(int(floor(log(depth) * uClusterDepth.z + uClusterDepth.w)), 0, uClusterGrid.z - 1);
+	int cluster = (slice * uClusterGrid.y + tile.y) * uClusterGrid.x + tile.x;
+
+	uvec2 list = texelFetch(uClusters, cluster).xy;
+	vec3 color = vec3(0.0f);
+
+	for (uint i = 0u; i < list.y; i++)
+	{
+		int first = int(texelFetch(uClusterIndices, int(list.x + i)).x) * CLUSTER_LIGHT_TEXELS;
+		vec4 position = texelFetch(uClusterLights, first);			// w is the range
+		vec4 direction = texelFetch(uClusterLights, first + 1);		// w is the cosine of the outer cone
+		vec4 diffuse = texelFetch(uClusterLights, first + 2);		// w is the cosine of the inner cone
+		vec3 specular = texelFetch(uClusterLights, first + 3).rgb;
+		vec3 att = texelFetch(uClusterLights, first + 4).xyz;
+
+		vec3 toLight = position.xyz - vPosition;
+		float lightDistance = length(toLight);
+		vec3 l = toLight / lightDistance;
+
+		// attenuation fades to 0 at the range the light was binned with, point lights have cones wider than any angle
+		float fade = clamp(1.0f - pow(lightDistance / position.w, 4.0f), 0.0f, 1.0f);
+		float intensity = fade * fade / (att.x + att.y * lightDistance + att.z * lightDistance * lightDistance);
+		intensity *= smoothstep(direction.w, diffuse.w, dot(-l, direction.xyz));
+
+		float dotLN = max(dot(l, n), 0.0f);
+		if (dotLN > 0.0f)
+		{
+			vec3 h = normalize(l + v);
+			color += intensity * (diffuse.rgb * kd * dotLN + specular * material.Ks * pow(max(dot(n, h), 0.0f), material.shininess));
+		}
 	}
 
+	return color;
+}
+#endif
+
+void main()
+{
+	// material of this object
+	Material material = uMaterials[vMaterialIndex];
+
+#ifdef TEXTURED
+	vec3 kd = material.Kd * texture(uTexture, vTexCoord).rgb;
+#else
+	vec3 kd = material.Kd;
+#endif
+
+	// fragment normal
+    vec3 n = normalize(vNormal);
+
+	// vector toward the viewer
+	vec3 v = normalize(uViewpoint - vPosition);
+
+	// the light count is a constant, so the loop can be unrolled
+	vec3 color = vec3(0.0f);
+	for (int i = 0; i < LIGHT_COUNT; i++)
+		color += shade(uLights[i], material, kd, n, v);
+
+#ifdef CLUSTERED
+	color += shade_clustered(material, kd, n, v);
+#endif
+
 	// set output color
-	fColor = Ia + Id + Is;
-}
\ No newline at end of file
+	fColor = color;
+}
@@ -1,25 +1,110 @@
 #version 330 core
 
+// the program is built in variants, see ShaderVariants.h, which insert these defines after the #version line
+// LIGHT_TYPE and LIGHT_COUNT are only used by the fragment shader
+// INSTANCED	matrices and material index are per instance attributes instead of ObjectBlock
+// TEXTURED		texture coordinates are passed on to the fragment shader
+
+// size of the light array, must match MAX_LIGHTS in RenderTypes.h
+#define MAX_LIGHTS 4
+
 // input data
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
+#ifdef TEXTURED
+layout(location = 2) in vec2 aTexCoord;
+#endif
+
+#ifdef INSTANCED
+// per instance input data, see InstanceData in RenderTypes.h
+layout(location = 3) in mat4 aModelMatrix;
+layout(location = 7) in mat3 aNormalMatrix;
+layout(location = 10) in int aMaterialIndex;
+#endif
+
+// light properties
+struct Light
+{
+	vec3 pos;
+	float innerCos;
+	vec3 dir;
+	float outerCos;
+	vec3 La;
+	vec3 Ld;
+	vec3 Ls;
+	vec3 att;
+};
+
+// per-frame data, shared with the fragment shader
+layout(std140) uniform FrameBlock
+{
+	mat4 uViewProjectionMatrix;
+	vec3 uViewpoint;
+	Light uLights[MAX_LIGHTS];
+};
 
-// uniform input data
-uniform mat4 uModelViewProjectionMatrix;
-uniform mat4 uModelMatrix;
-uniform mat3 uNormalMatrix;
+#ifndef INSTANCED
+// per-object data
+layout(std140) uniform ObjectBlock
+{
+	mat4 uModelMatrix;
+	mat3 uNormalMatrix;
+	int uMaterialIndex;
+};
+#endif
+
+// decoding of the vertex format, see VertexPacking.h
+// float vertices use an offset of 0, a scale of 1 and plain normals
+uniform vec3 uPositionOffset;		// packed positions are fractions of the mesh bounds
+uniform vec3 uPositionScale;
+uniform bool uOctahedralNormals;	// normals are the two octahedral components
 
 // output data
 out vec3 vPosition;
 out vec3 vNormal;
+flat out int vMaterialIndex;
+#ifdef TEXTURED
+out vec2 vTexCoord;
+#endif
+
+// unit normal from its octahedral encoding
+vec3 decode_octahedral(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -fold : fold;
+	normal.y += normal.y >= 0.0f ? -fold : fold;
+	return normalize(normal);
+}
 
 void main()
 {
+#ifdef INSTANCED
+	mat4 modelMatrix = aModelMatrix;
+	mat3 normalMatrix = aNormalMatrix;
+	int materialIndex = aMaterialIndex;
+#else
+	mat4 modelMatrix = uModelMatrix;
+	mat3 normalMatrix = uNormalMatrix;
+	int materialIndex = uMaterialIndex;
+#endif
+
+	// object space vertex
+	vec3 localPosition = uPositionOffset + aPosition * uPositionScale;
+	vec3 localNormal = uOctahedralNormals ? decode_octahedral(aNormal.xy) : aNormal;
+
+	// world space vertex position
+	vec4 position = modelMatrix * vec4(localPosition, 1.0f);
+
 	// set vertex position
-    gl_Position = uModelViewProjectionMatrix * vec4(aPosition, 1.0f);
+    gl_Position = uViewProjectionMatrix * position;
 
 	// set vertex shader output
 	// will be interpolated for each fragment
-	vPosition = (uModelMatrix * vec4(aPosition, 1.0f)).xyz;
-	vNormal = uNormalMatrix * aNormal;
+	vPosition = position.xyz;
+	vNormal = normalMatrix * localNormal;
+	vMaterialIndex = materialIndex;
+#ifdef TEXTURED
+	vTexCoord = aTexCoord;
+#endif
 }
@@ -1,13 +1,37 @@
 // include C++ headers
 #define _USE_MATH_DEFINES
 #include <cstdio>
+#include <algorithm>
 #include <iostream>
 #include <cmath>
 #include <vector>
 #include <string>
+#include <random>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include "utilities.h"
 #include "SimpleModel.h"
+#include "SceneGraph.h"
+#include "ResourceRegistry.h"
+#include "ShaderVariants.h"
+#include "Benchmarks.h"
+#include "UniformBuffer.h"
+#include "GLState.h"
+#include "OrbitSystem.h"
+#include "JobSystem.h"
+#include "LightClusters.h"
+#include "TripleBuffer.h"
+#include "AssetLoader.h"
+#include "Culling.h"
+#include "MeshArena.h"
+#include "RenderQueue.h"
+#include "Headless.h"
+#include "Profiler.h"
+#include "Trace.h"
 
 // include OpenGL related headers
 #include <GLEW/glew.h>
@@ -23,30 +47,258 @@ float gFrameRate = 60.0f;
 float gFrameTime = 1 / gFrameRate;
 
 // scene variables
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
 glm::mat4 gViewMatrix;			// view matrix
 glm::mat4 gProjectionMatrix;	// projection matrix
-std::map<std::string, glm::mat4> gModelMatrix;			// model matrix
-Light gLight;			// light properties
+SceneGraph gSceneGraph;			// node hierarchy holding the model matrices, placed by the render thread
+Light gLights[MAX_LIGHTS];		// light properties, the first gLightCount are shaded
+int gLightType = DIRECTIONAL_LIGHT;	// every light is shaded as this type, it picks the lit shader variant
+int gLightCount = 1;
+
+// clustered lights, point and spot lights circling the scene, binned into the clusters of the view every frame
+struct ClusterLightOrbit
+{
+	float radius;
+	float height;
+	float speed;	// radians per second
+	float phase;
+};
+int gClusterLightCount = 0;		// 0 turns the clustered lights off
+std::vector<Light> gClusterLights;
+std::vector<ClusterLightOrbit> gClusterLightOrbits;
+LightClusters gLightClusters;
+int gClusterLightRefs = 0;		// light indices in all clusters in the last frame
+int gMaxClusterLights = 0;		// most lights in one cluster in the last frame
+
+// scene graph node indices
+struct SceneNodes
+{
+	int sphere = SceneGraph::NO_PARENT;
+	int orbitObj1 = SceneGraph::NO_PARENT;
+	int orbitObj2 = SceneGraph::NO_PARENT;
+	int orbitPath1 = SceneGraph::NO_PARENT;
+	int orbitPath2 = SceneGraph::NO_PARENT;
+} gNodes;
 
 // Materials Globals
 enum class MaterialType { PEARL, JADE, BRASS }; // enum for material type
-std::map<std::string, Material> gMaterials; // stores material values
-std::map<std::string, MaterialType> gSelectedMaterials; // stores the material type for obj 1 and 2
+const int NUM_MATERIAL_TYPES = 3;
+ResourceRegistry<Material> gMaterials; // stores material values
+ResourceRegistry<Material>::Handle gMaterialHandles[NUM_MATERIAL_TYPES]; // material handle for each material type
+MaterialType gSelectedMaterials[2]; // stores the material type for obj 1 and 2
 
 // Model globals
 enum class ModelType { SPHERE, CUBE, SUZANNE, TORUS }; // enum for model types
-std::map<std::string, SimpleModel> gModels; // stores models
-std::map<std::string, ModelType> gSelectedModels; // stores selected model for obj 1 and 2
+const int NUM_MODEL_TYPES = 4;
+ResourceRegistry<SimpleModel> gModels; // stores models
+ResourceRegistry<SimpleModel>::Handle gModelHandles[NUM_MODEL_TYPES]; // model handle for each model type
+ModelType gSelectedModels[2]; // stores selected model for obj 1 and 2
 
 // shaders global
-std::map<std::string, ShaderProgram> gShaders; // holds multiple shaders
+ResourceRegistry<ShaderProgram> gShaders; // holds multiple shaders
+ResourceRegistry<ShaderProgram>::Handle gSimpleShader; // flat colour shader for the orbit paths
+ShaderVariants gLitShaders; // lit shaders for the models, one variant per light setup and vertex source
+std::uint32_t gObjectShaderKey = 0; // variants drawn this frame, picked by build_render_queue
+std::uint32_t gFleetShaderKey = 0;
+
+// shader files are checked for changes this often while hot reload is on, changed ones are rebuilt in the background
+const double SHADER_RELOAD_INTERVAL = 0.5;
+bool gHotReloadShaders = false;
+double gLastShaderCheck = 0.0;
+
+// uniforms of the simple shader, resolved once after linking
+struct SimpleShaderUniforms
+{
+	Uniform<glm::mat4> modelViewProjectionMatrix;
+	Uniform<glm::vec3> color;
+} gSimpleUniforms;
+
+// vertex format decode uniforms of the lit shaders, set for every model drawn
+struct VertexDecodeUniforms
+{
+	Uniform<glm::vec3> positionOffset;
+	Uniform<glm::vec3> positionScale;
+	Uniform<bool> octahedralNormals;
+
+	void set(const SimpleModel& model) const
+	{
+		positionOffset.set(model.getPositionOffset());
+		positionScale.set(model.getPositionScale());
+		octahedralNormals.set(model.hasOctahedralNormals());
+	}
+
+	// positions already decoded by the instance model matrices, see fold_position_decode
+	void setDecodedByInstances(const SimpleModel& model) const
+	{
+		positionOffset.set(glm::vec3(0.0f));
+		positionScale.set(glm::vec3(1.0f));
+		octahedralNormals.set(model.hasOctahedralNormals());
+	}
+};
+
+std::map<std::uint32_t, VertexDecodeUniforms> gLitDecode;	// decode uniforms of each lit shader variant
+
+// uniform buffers
+const int NUM_OBJECTS = 3;				// sphere and the two orbit objects
+UniformBuffer gFrameUniforms;			// camera and light, updated once per frame
+UniformBuffer gMaterialUniforms;		// table of all materials indexed by registry slot
+UniformBuffer gObjectUniforms;			// per object matrices, one aligned slot per object
+std::vector<unsigned char> gObjectData;	// CPU copy of the object slots
+GLintptr gObjectStride = 0;				// aligned size of one object slot
+
+// levels of detail, each model is drawn with the coarsest level whose error stays within gLodPixelError pixels
+const float LOD_HYSTERESIS = 0.75f;		// a coarser level is only taken once its error is below this share of the limit
+int gObjectLods[NUM_OBJECTS] = {};		// level each object was last drawn with
+double gTrianglesDrawn = 0.0;			// triangles submitted in the last frame
+double gTrianglesFullDetail = 0.0;		// triangles the same draws would have had at full detail
+
+// objects whose bounding volumes touch the view frustum and objects left out, fleet bodies included
+int gVisibleObjects = 0;
+int gCulledObjects = 0;
+
+// scale of the level of detail errors, measured once per frame
+struct LodView
+{
+	glm::vec3 cameraPosition;
+	float pixelsPerUnit;	// pixels covered by one unit one unit in front of the camera
+};
 
 // controls
 bool gWireframe = false;	// wireframe control
+float gLodPixelError = 1.0f;	// largest simplification error on screen in pixels, 0 draws everything at full detail
+bool gVSync = true;			// wait for vertical sync, turn off to run uncapped
 float gOrbitSpeed[2] = { 0.5f, 0.5f }; // stores orbit speeds for both objects
 float gRotationSpeed[2] = { 1.0f, 1.0f }; // stores rotation speed for both objects
 float gOrbitDistance[2] = { 4.0f, 3.0f };
 
+const int MAX_FLEET_SIZE = 500000;
+int gFleetSize = 0;		// requested number of fleet bodies
+
+// simulation inputs, copied from the controls by the render thread every frame
+struct SimulationInput
+{
+	float orbitSpeed[2];
+	float rotationSpeed;
+	int fleetSize;
+};
+std::mutex gSimulationInputMutex;
+SimulationInput gSimulationInput;
+
+// how the fleet bodies map to models and materials, shared by every state until the fleet is rebuilt
+struct FleetLayout
+{
+	std::vector<GLint> materials;			// material slot of each body
+	int first[NUM_MODEL_TYPES] = {};		// first body of each model type
+	int count[NUM_MODEL_TYPES] = {};		// number of bodies of each model type
+};
+
+// simulation state handed to the render thread, holds the state one step before the newest so
+// the render thread can place the scene anywhere within the last step
+struct SimulationState
+{
+	OrbitSystem sceneOrbits;
+	OrbitSystem fleetOrbits;
+	std::shared_ptr<const FleetLayout> fleetLayout;
+	double displayTime = 0.0;	// clock time at which this state is shown, the step after it is shown SIMULATION_STEP later
+	double simulatedTime = 0.0;	// simulated time of this state
+};
+TripleBuffer<SimulationState> gSnapshots;
+
+// simulation thread, advances the state in fixed steps of simulated time
+const double SIMULATION_STEP = 1.0 / 120.0;	// seconds of simulated time per step
+const int MAX_CATCH_UP_STEPS = 8;			// steps run back to back before falling behind is accepted
+std::thread gSimulationThread;
+std::atomic<bool> gSimulationRunning(false);
+std::atomic<float> gSimulationRateValue(0.0f);	// steps per second measured by the simulation thread
+std::atomic<int> gDroppedStepsValue(0);			// steps skipped because the simulation fell behind
+float gSimulationRate = 0.0f;					// copies for the UI
+int gDroppedSteps = 0;
+
+// worker threads for simulation and matrix work, GL calls stay on the main thread
+JobSystem gJobSystem;
+const int FLEET_GRAIN_SIZE = 4096;		// fleet bodies per job
+
+// models are read on the workers and uploaded a slice per frame
+AssetLoader gAssetLoader(gJobSystem);
+const std::size_t UPLOAD_BUDGET = 1 << 20;	// bytes of mesh data copied to the GPU per frame
+const bool PACKED_VERTICES = true;			// load models in the packed vertex formats, see VertexPacking.h
+int gAssetsLoaded = 0;						// copies for the UI
+float gAssetLoadTime = 0.0f;
+
+// simulation thread state
+OrbitSystem gSceneOrbits;		// body 0 orbits the sphere and body 1 orbits body 0
+OrbitSystem gFleetOrbits;		// fleet of small bodies orbiting the sphere, grouped by model type
+std::shared_ptr<const FleetLayout> gFleetLayout;
+
+// fleet bodies of one model at one level of detail, drawn with one instanced call
+struct FleetBatch
+{
+	int first = 0;
+	int count = 0;
+};
+const int NUM_FLEET_BATCHES = NUM_MODEL_TYPES * MAX_MESH_LODS;
+
+// render thread state, the fleet is drawn with one instanced call per model and level of detail
+std::vector<InstanceData> gFleetPlaced;		// instance data placed between the last two steps, by body
+std::vector<InstanceData> gFleetInstances;	// the same sorted into batches
+std::vector<unsigned char> gFleetLods;		// level of each body, kept between frames for the hysteresis
+std::vector<unsigned char> gFleetVisible;	// 1 for bodies inside the view frustum
+int gFleetVisibleCount = 0;					// bodies in the batches, the rest of gFleetInstances is unused
+std::vector<int> gFleetChunkCounts;			// bodies of each batch in each job's chunk
+FleetBatch gFleetBatches[NUM_MODEL_TYPES][MAX_MESH_LODS];
+SimpleModel* gFleetModels[NUM_MODEL_TYPES];	// models the batches were made for, placeholders included
+GLuint gInstanceVBO = 0;	// per instance data buffer of the fleet
+
+// models sharing a mesh arena are drawn with one glMultiDrawElementsIndirect where the driver has it,
+// the instances of each command start at its base instance
+bool gMultiDrawIndirect = false;
+GLuint gIndirectBuffer = 0;								// draw commands of the fleet, filled every frame
+std::vector<DrawElementsIndirectCommand> gFleetCommands;
+int gFleetDrawCalls = 0;								// draw calls of the fleet in the last frame
+
+// draws of a frame in the order of their sort keys, built by prepare_scene and drawn by render_scene
+// the value of an item is its kind in the high bits and the object, path or fleet index in the low ones
+enum class DrawKind { OBJECT, FLEET, ORBIT_PATH };
+const int NUM_ORBIT_PATHS = 2;
+const int MAX_RENDER_ITEMS = NUM_OBJECTS + 1 + NUM_ORBIT_PATHS;
+const int DRAW_INDEX_BITS = 16;
+RenderQueue gRenderQueue;
+bool gObjectVisible[NUM_OBJECTS] = {};	// objects in the queue this frame
+int gShaderChanges = 0;					// shader switches in the last frame
+int gDrawCalls = 0;						// draw calls in the last frame, the fleet's included
+
+// CPU times of every pass of a frame and GPU times of the passes that draw, scopes are added in init()
+struct ProfilePasses
+{
+	int update = 0;		// simulation input, model uploads and placing the scene and the fleet, fleet culling included
+	int culling = 0;	// culling the scene objects, picking their levels of detail and sorting the render queue
+	int lights = 0;		// moving and binning the clustered lights and uploading their lists
+	int opaque = 0;
+	int lines = 0;
+	int ui = 0;			// tweak bar and frame graph
+} gPasses;
+const int NUM_PROFILE_PASSES = 6;
+Profiler gProfiler;
+
+// rolling frame stats for the UI, updated once a second
+float gFramePercentiles[4] = {};			// p50, p95, p99 and max frame time in milliseconds
+float gPassCpuP95[NUM_PROFILE_PASSES] = {};
+float gPassGpuP95[NUM_PROFILE_PASSES] = {};
+
+// frame graph in the bottom left corner, frame times in green, opaque pass GPU times in orange and
+// a grey line at 60 frames per second
+const int GRAPH_WIDTH = 300;
+const int GRAPH_HEIGHT = 100;
+const float GRAPH_RANGE_MS = 50.0f;		// frame time at the top of the graph
+bool gShowFrameGraph = true;
+GLuint gGraphVBO = 0;
+GLuint gGraphVAO = 0;
+std::vector<glm::vec3> gGraphVertices;
+
+// timeline traces, T starts recording and writes the trace on the next press
+std::string gTracePath = "trace.json";
+
 // orbit path globals
 std::vector<GLfloat> gVertices;
 GLuint gVBO = 0;		// vertex buffer object identifier
@@ -56,30 +308,327 @@ glm::vec3 OrbitPath2(0.0f);
 glm::vec3 orbitColour = { 1.0f, 0.0f, 0.0f };
 #define MAXSLICES 64
 
-// generate vertices for a circle based on a radius and number of slices
-void generate_circle(const float radius, const unsigned int slices, const float scale_factor, std::vector<GLfloat>& vertices)
+// look up resources by type, the handles are resolved once in init()
+static Material& get_material(MaterialType type)
+{
+	return gMaterials.get(gMaterialHandles[static_cast<int>(type)]);
+}
+
+// models that are still loading are drawn as the placeholder, models loaded without faces are skipped
+static SimpleModel& get_model(ModelType type)
+{
+	SimpleModel& model = gModels.get(gModelHandles[static_cast<int>(type)]);
+	return model.isLoaded() ? model : gAssetLoader.getPlaceholder();
+}
+
+// scene object drawn from each uniform buffer slot
+struct SceneObject
 {
-	float slice_angle = M_PI * 2.0f / slices;	// angle of each slice
-	float angle = 0;			// angle used to generate x and y coordinates
-	float x, y, z = 0.0f;		// (x, y, z) coordinates
+	int node;
+	ModelType model;
+	MaterialType material;
+};
 
-	// generate vertex coordinates for a circle
-	for (int i = 0; i <= slices; i++)
+static SceneObject get_scene_object(int slot)
+{
+	switch (slot)
 	{
-		// generates the circle on the x/z axis
-		x = radius * cos(angle) * scale_factor;
-		z = radius * sin(angle) * scale_factor;
-		y = 0.0f;
+	case 1: return { gNodes.orbitObj1, gSelectedModels[0], gSelectedMaterials[0] };
+	case 2: return { gNodes.orbitObj2, gSelectedModels[1], gSelectedMaterials[1] };
+	default: return { gNodes.sphere, ModelType::SPHERE, MaterialType::BRASS };
+	}
+}
 
-		vertices.push_back(x);
-		vertices.push_back(y);
-		vertices.push_back(z);
+static std::uint32_t make_draw_value(DrawKind kind, int index)
+{
+	return static_cast<std::uint32_t>(kind) << DRAW_INDEX_BITS | static_cast<std::uint32_t>(index);
+}
+
+static DrawKind get_draw_kind(std::uint32_t value)
+{
+	return static_cast<DrawKind>(value >> DRAW_INDEX_BITS);
+}
+
+static int get_draw_index(std::uint32_t value)
+{
+	return static_cast<int>(value & ((1u << DRAW_INDEX_BITS) - 1));
+}
+
+// mesh field of a sort key, models that are still loading share the placeholder's 0
+static std::uint32_t get_mesh_sort_id(ModelType type, int lod)
+{
+	ResourceRegistry<SimpleModel>::Handle handle = gModelHandles[static_cast<int>(type)];
+	if (!gModels.get(handle).isLoaded())
+		return 0;
+
+	return (handle.index + 1) * MAX_MESH_LODS + lod;
+}
+
+// distance in front of the camera of a model's origin, as the depth field of a sort key
+static std::uint32_t get_depth_sort_id(const glm::mat4& modelMatrix)
+{
+	float depth = -(gViewMatrix * modelMatrix[3]).z;
+	return quantize_depth(depth, NEAR_PLANE, FAR_PLANE);
+}
+
+// camera position and error scale for the level of detail selection
+static LodView get_lod_view()
+{
+	LodView view;
+	view.cameraPosition = glm::vec3(glm::inverse(gViewMatrix)[3]);
+	view.pixelsPerUnit = gProjectionMatrix[1][1] * 0.5f * gWindowHeight;
+	return view;
+}
+
+// level of detail of a model drawn with modelMatrix, starting from the level it had last frame
+static int select_lod(const SimpleModel& model, const glm::mat4& modelMatrix, const LodView& view, int currentLod)
+{
+	// errors grow with the largest scale of the model and shrink with the distance, which is
+	// clamped to the near plane
+	float scale = std::max(std::max(glm::length(glm::vec3(modelMatrix[0])), glm::length(glm::vec3(modelMatrix[1]))),
+		glm::length(glm::vec3(modelMatrix[2])));
+	float distance = std::max(glm::length(glm::vec3(modelMatrix[3]) - view.cameraPosition), 0.1f);
+
+	return model.selectLod(view.pixelsPerUnit * scale / distance, currentLod, gLodPixelError, LOD_HYSTERESIS);
+}
 
-		// update to next angle
-		angle += slice_angle;
+// resolve the vertex decode uniforms of a lit shader, returns false if one is missing
+static bool get_vertex_decode_uniforms(ShaderProgram& shader, VertexDecodeUniforms& uniforms)
+{
+	uniforms.positionOffset = shader.tryGetUniform<glm::vec3>(UNIFORM_NAME("uPositionOffset"));
+	uniforms.positionScale = shader.tryGetUniform<glm::vec3>(UNIFORM_NAME("uPositionScale"));
+	uniforms.octahedralNormals = shader.tryGetUniform<bool>(UNIFORM_NAME("uOctahedralNormals"));
+	return uniforms.positionOffset.isValid() && uniforms.positionScale.isValid() && uniforms.octahedralNormals.isValid();
+}
+
+// upload the material table, materials are indexed by their registry slot
+static void upload_materials()
+{
+	static_assert(NUM_MATERIAL_TYPES <= MAX_MATERIALS, "more material types than the material table holds");
+
+	MaterialBlock materials[MAX_MATERIALS] = {};
+
+	for (int i = 0; i < NUM_MATERIAL_TYPES; i++)
+	{
+		ResourceRegistry<Material>::Handle handle = gMaterialHandles[i];
+
+		// registry slots are reused, so an index can pass the table even when the type count does not
+		if (handle.index >= static_cast<uint32_t>(MAX_MATERIALS))
+		{
+			std::cerr << "Material index " << handle.index << " is outside the material table of " << MAX_MATERIALS << std::endl;
+			exit(EXIT_FAILURE);
+		}
+
+		materials[handle.index] = gMaterials.get(handle).getBlock();
+	}
+
+	gMaterialUniforms.create(sizeof(materials), materials, GL_STATIC_DRAW);
+}
+
+// write an object's matrices and material index into its uniform buffer slot
+static void set_object_block(int slot, const glm::mat4& modelMatrix, MaterialType material)
+{
+	ObjectBlock* block = reinterpret_cast<ObjectBlock*>(&gObjectData[slot * gObjectStride]);
+	glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(modelMatrix)));
+
+	block->modelMatrix = modelMatrix;
+	block->normalMatrix[0] = glm::vec4(normalMatrix[0], 0.0f);
+	block->normalMatrix[1] = glm::vec4(normalMatrix[1], 0.0f);
+	block->normalMatrix[2] = glm::vec4(normalMatrix[2], 0.0f);
+	block->materialIndex = static_cast<GLint>(gMaterialHandles[static_cast<int>(material)].index);
+}
+
+// create the fleet bodies, bodies are grouped by model type so each model is one draw
+static void generate_fleet(int size)
+{
+	std::mt19937 random(1234);	// fixed seed so runs are comparable
+	std::uniform_real_distribution<float> distance(5.5f, 9.0f);
+	std::uniform_real_distribution<float> speed(0.1f, 0.6f);
+	std::uniform_real_distribution<float> angle(0.0f, 2.0f * static_cast<float>(M_PI));
+	std::uniform_real_distribution<float> scale(0.03f, 0.1f);
+	std::uniform_int_distribution<int> material(0, NUM_MATERIAL_TYPES - 1);
+
+	// states still held by the render thread keep the old layout
+	std::shared_ptr<FleetLayout> layout = std::make_shared<FleetLayout>();
+
+	gFleetOrbits.clear();
+	gFleetOrbits.reserve(size);
+	layout->materials.resize(size);
+
+	// split the bodies evenly between the models
+	int first = 0;
+	for (int type = 0; type < NUM_MODEL_TYPES; type++)
+	{
+		layout->first[type] = first;
+		layout->count[type] = size / NUM_MODEL_TYPES + (type < size % NUM_MODEL_TYPES ? 1 : 0);
+		first += layout->count[type];
+	}
+
+	for (GLint& materialIndex : layout->materials)
+	{
+		float orbitAngle = angle(random);
+		float orbitSpeed = speed(random);
+		float rotationAngle = angle(random);
+		float rotationSpeed = speed(random) * 4.0f;
+		float orbitDistance = distance(random);
+
+		gFleetOrbits.addBody(orbitSpeed, rotationSpeed, orbitDistance, scale(random), orbitAngle, rotationAngle);
+		materialIndex = static_cast<GLint>(gMaterialHandles[material(random)].index);
+	}
+
+	gFleetLayout = layout;
+}
+
+// create the clustered lights, every third one a spotlight, each circling the scene at its own height and speed
+static void generate_cluster_lights(int count)
+{
+	std::mt19937 random(4321);	// fixed seed so runs are comparable
+	std::uniform_real_distribution<float> radius(2.0f, 10.0f);
+	std::uniform_real_distribution<float> height(-3.0f, 3.0f);
+	std::uniform_real_distribution<float> speed(-0.5f, 0.5f);
+	std::uniform_real_distribution<float> angle(0.0f, 2.0f * static_cast<float>(M_PI));
+	std::uniform_real_distribution<float> colour(0.2f, 1.0f);
+	std::uniform_real_distribution<float> halfDistance(0.3f, 0.8f);
+
+	gClusterLights.resize(count);
+	gClusterLightOrbits.resize(count);
+
+	for (int i = 0; i < count; i++)
+	{
+		ClusterLightOrbit& orbit = gClusterLightOrbits[i];
+		orbit.radius = radius(random);
+		orbit.height = height(random);
+		orbit.speed = speed(random);
+		orbit.phase = angle(random);
+
+		Light& light = gClusterLights[i];
+		light.type = i % 3 == 2 ? SPOT_LIGHT : POINT_LIGHT;
+		light.La = glm::vec3(0.0f);
+		light.Ld.r = colour(random);
+		light.Ld.g = colour(random);
+		light.Ld.b = colour(random);
+		light.Ls = light.Ld;
+		light.innerAngle = 15.0f;
+		light.outerAngle = 25.0f;
+
+		// half strength at halfDistance, the cluster range follows from CLUSTER_LIGHT_CUTOFF
+		float distance = halfDistance(random);
+		light.att = glm::vec3(1.0f, 0.0f, 1.0f / (distance * distance));
 	}
 }
 
+// move the clustered lights along their circles, spotlights face the centre of the scene
+static void place_cluster_lights(float time)
+{
+	for (std::size_t i = 0; i < gClusterLights.size(); i++)
+	{
+		const ClusterLightOrbit& orbit = gClusterLightOrbits[i];
+		const float angle = orbit.phase + orbit.speed * time;
+
+		Light& light = gClusterLights[i];
+		light.pos = glm::vec3(std::cos(angle) * orbit.radius, orbit.height, std::sin(angle) * orbit.radius);
+		light.dir = glm::normalize(-light.pos);
+	}
+}
+
+// resolve uniform handles of the simple shader, again whenever it is rebuilt, returns false and keeps the handles
+// of the last build if one is missing
+static bool setup_shaders()
+{
+	// mistyped names are caught here
+	ShaderProgram& shader = gShaders.get(gSimpleShader);
+	SimpleShaderUniforms uniforms;
+	uniforms.modelViewProjectionMatrix = shader.tryGetUniform<glm::mat4>(UNIFORM_NAME("uModelViewProjectionMatrix"));
+	uniforms.color = shader.tryGetUniform<glm::vec3>(UNIFORM_NAME("uColor"));
+
+	if (!uniforms.modelViewProjectionMatrix.isValid() || !uniforms.color.isValid())
+		return false;
+
+	gSimpleUniforms = uniforms;
+	return true;
+}
+
+// connect a lit shader variant's uniform blocks to their binding points and resolve its vertex decode uniforms,
+// again whenever it is rebuilt, textured variants sample unit 0, the default of their sampler
+// returns false if a decode uniform is missing, the variant then keeps its last build
+static bool setup_lit_shader(std::uint32_t key, ShaderProgram& shader)
+{
+	shader.bindUniformBlock("FrameBlock", FRAME_BLOCK_BINDING);
+	shader.bindUniformBlock("MaterialBlock", MATERIAL_BLOCK_BINDING);
+	if (!get_variant_features(key).instanced)
+		shader.bindUniformBlock("ObjectBlock", OBJECT_BLOCK_BINDING);
+
+	if (get_variant_features(key).clustered)
+	{
+		shader.bindUniformBlock("ClusterBlock", CLUSTER_BLOCK_BINDING);
+		shader.use();
+		shader.setUniform(UNIFORM_NAME("uClusters"), CLUSTER_GRID_UNIT);
+		shader.setUniform(UNIFORM_NAME("uClusterIndices"), CLUSTER_INDEX_UNIT);
+		shader.setUniform(UNIFORM_NAME("uClusterLights"), CLUSTER_LIGHT_UNIT);
+	}
+
+	VertexDecodeUniforms decode;
+	if (!get_vertex_decode_uniforms(shader, decode))
+		return false;
+
+	gLitDecode[key] = decode;
+	return true;
+}
+
+// key of the lit shader variant for the current light settings, the models are loaded without texture
+// coordinates and no texture is bound, so the TEXTURED variant is never selected
+static std::uint32_t get_lit_shader_key(bool instanced)
+{
+	ShaderFeatures features;
+	features.lightType = gLightType;
+	features.lightCount = gLightCount;
+	features.instanced = instanced;
+	features.clustered = gClusterLightCount > 0;
+	return make_variant_key(features);
+}
+
+// shader field of the sort key of a lit shader variant, variants are numbered after the registry shaders
+static std::uint32_t get_lit_shader_sort_id(std::uint32_t key)
+{
+	return static_cast<std::uint32_t>(gShaders.getSlotCount() + gLitShaders.getIndex(key));
+}
+
+// use a lit shader variant, built first if it is new, returns its decode uniforms or nullptr if it failed to build
+static const VertexDecodeUniforms* use_lit_shader(std::uint32_t key)
+{
+	ShaderProgram* shader = gLitShaders.get(key);
+	if (shader == nullptr)
+		return nullptr;
+
+	shader->use();
+	return &gLitDecode[key];
+}
+
+// seconds on a steady high resolution clock, shared by the simulation and render threads
+static double get_clock_time()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// swap in shaders whose rebuild finished and, with hot reload on, start rebuilding those whose files changed
+// a shader that fails to build is reported and the previous one kept
+static void update_shaders()
+{
+	bool reload = false;
+	if (gHotReloadShaders && get_clock_time() - gLastShaderCheck > SHADER_RELOAD_INTERVAL)
+	{
+		gShaders.get(gSimpleShader).reloadIfChanged();
+		gLastShaderCheck = get_clock_time();
+		reload = true;
+	}
+
+	// a rebuild without the uniforms set here is dropped for the last good build
+	if (gShaders.get(gSimpleShader).updateBuild() && !setup_shaders())
+		gShaders.get(gSimpleShader).restorePrevious();
+
+	gLitShaders.update(reload);
+}
+
 // function initialise scene and render settings
 static void init(GLFWwindow* window)
 {
@@ -88,9 +637,15 @@ static void init(GLFWwindow* window)
 
 	glEnable(GL_DEPTH_TEST); // enable debth buffer test
 
-	// link shaders
-	gShaders["Simple"].compileAndLink("simpleColor.vert", "simpleColor.frag");
-	gShaders["Animation"].compileAndLink("animation.vert", "animation.frag");
+	// start building the shaders, the driver compiles them while the rest of the scene is set up
+	// lit variants for other light settings are built when they are first drawn
+	gSimpleShader = gShaders.add("Simple");
+	if (!gShaders.get(gSimpleShader).beginBuild("simpleColor.vert", "simpleColor.frag"))
+		exit(EXIT_FAILURE);
+
+	gLitShaders.init("animation.vert", "animation.frag", setup_lit_shader);
+	gLitShaders.prepare(get_lit_shader_key(false));
+	gLitShaders.prepare(get_lit_shader_key(true));
 
 
 	// initialise view matrix
@@ -100,51 +655,98 @@ static void init(GLFWwindow* window)
 	// initialise projection matrix
 	// FOV is 60 to increase the view
 	gProjectionMatrix = glm::perspective(glm::radians(60.0f),
-		static_cast<float>(gWindowWidth) / gWindowHeight, 0.1f, 100.0f);
+		static_cast<float>(gWindowWidth) / gWindowHeight, NEAR_PLANE, FAR_PLANE);
 
 	// view port is moved slightly to the right
 	glViewport(gWindowWidth / 6.0f, 0.0f, gWindowWidth, gWindowHeight);
 
+	// register materials, names are only used here
+	gMaterialHandles[static_cast<int>(MaterialType::PEARL)] = gMaterials.add("Pearl");
+	gMaterialHandles[static_cast<int>(MaterialType::JADE)] = gMaterials.add("Jade");
+	gMaterialHandles[static_cast<int>(MaterialType::BRASS)] = gMaterials.add("Brass");
+
 	// defining materials
-	gMaterials["Pearl"].Ka = glm::vec3(0.25f, 0.21f, 0.21f);
-	gMaterials["Pearl"].Kd = glm::vec3(1.0f, 0.83f, 0.83f);
-	gMaterials["Pearl"].Ks = glm::vec3(0.3f, 0.3f, 0.3f);
-	gMaterials["Pearl"].shininess = 11.3f;
-
-	gMaterials["Jade"].Ka = glm::vec3(0.14f, 0.22f, 0.16f);
-	gMaterials["Jade"].Kd = glm::vec3(0.53f, 0.89f, 0.63f);
-	gMaterials["Jade"].Ks = glm::vec3(0.3f, 0.3f, 0.3f);
-	gMaterials["Jade"].shininess = 12.8f;
-
-	gMaterials["Brass"].Ka = glm::vec3(0.33f, 0.22f, 0.03f);
-	gMaterials["Brass"].Kd = glm::vec3(0.78f, 0.57f, 0.11f);
-	gMaterials["Brass"].Ks = glm::vec3(0.99f, 0.94f, 0.8f);
-	gMaterials["Brass"].shininess = 27.9f;
-
-	// initialise point light properties
-	gLight.dir = glm::vec3(0.3f, -0.7f, -0.5f);
-	gLight.La = glm::vec3(0.8f);
-	gLight.Ld = glm::vec3(0.8f);
-	gLight.Ls = glm::vec3(0.8f);
-
-	// initialise model matrices
-	gModelMatrix["Sphere"] = glm::mat4(1.0f);
-	gModelMatrix["OrbitObj1"] = glm::mat4(1.0f);
-	gModelMatrix["OrbitObj2"] = glm::mat4(1.0f);
-	gModelMatrix["OrbitPath1"] = glm::mat4(1.0f);
-	gModelMatrix["OrbitPath2"] = glm::mat4(1.0f);
+	get_material(MaterialType::PEARL).Ka = glm::vec3(0.25f, 0.21f, 0.21f);
+	get_material(MaterialType::PEARL).Kd = glm::vec3(1.0f, 0.83f, 0.83f);
+	get_material(MaterialType::PEARL).Ks = glm::vec3(0.3f, 0.3f, 0.3f);
+	get_material(MaterialType::PEARL).shininess = 11.3f;
+
+	get_material(MaterialType::JADE).Ka = glm::vec3(0.14f, 0.22f, 0.16f);
+	get_material(MaterialType::JADE).Kd = glm::vec3(0.53f, 0.89f, 0.63f);
+	get_material(MaterialType::JADE).Ks = glm::vec3(0.3f, 0.3f, 0.3f);
+	get_material(MaterialType::JADE).shininess = 12.8f;
+
+	get_material(MaterialType::BRASS).Ka = glm::vec3(0.33f, 0.22f, 0.03f);
+	get_material(MaterialType::BRASS).Kd = glm::vec3(0.78f, 0.57f, 0.11f);
+	get_material(MaterialType::BRASS).Ks = glm::vec3(0.99f, 0.94f, 0.8f);
+	get_material(MaterialType::BRASS).shininess = 27.9f;
+
+	// initialise light properties, the lights sit around the scene and face its centre so any type lights it
+	// only the first light adds ambient light
+	const glm::vec3 lightPositions[MAX_LIGHTS] = {
+		glm::vec3(-3.0f, 7.0f, 5.0f), glm::vec3(8.0f, 3.0f, 0.0f), glm::vec3(-8.0f, 3.0f, -2.0f), glm::vec3(0.0f, -6.0f, 6.0f)
+	};
+	const glm::vec3 lightColours[MAX_LIGHTS] = {
+		glm::vec3(0.8f), glm::vec3(0.8f, 0.5f, 0.3f), glm::vec3(0.3f, 0.5f, 0.8f), glm::vec3(0.4f, 0.7f, 0.4f)
+	};
 
-	// initialise material/model types
-	gSelectedMaterials["Obj1"] = MaterialType::JADE;
-	gSelectedMaterials["Obj2"] = MaterialType::PEARL;
-	gSelectedModels["Obj1"] = ModelType::SUZANNE;
-	gSelectedModels["Obj2"] = ModelType::CUBE;
+	for (int i = 0; i < MAX_LIGHTS; i++)
+	{
+		gLights[i].type = DIRECTIONAL_LIGHT;
+		gLights[i].pos = lightPositions[i];
+		gLights[i].dir = glm::normalize(-lightPositions[i]);
+		gLights[i].La = i == 0 ? glm::vec3(0.8f) : glm::vec3(0.0f);
+		gLights[i].Ld = lightColours[i];
+		gLights[i].Ls = lightColours[i];
+		gLights[i].att = glm::vec3(1.0f, 0.02f, 0.005f);
+		gLights[i].innerAngle = 20.0f;
+		gLights[i].outerAngle = 30.0f;
+	}
+
+	// buffers of the clustered lights, filled every frame they are on
+	gLightClusters.create();
+
+	// create uniform buffers, frame and material blocks stay bound for the whole run
+	upload_materials();
+	gMaterialUniforms.bindBase(MATERIAL_BLOCK_BINDING);
+
+	gFrameUniforms.create(sizeof(FrameBlock));
+	gFrameUniforms.bindBase(FRAME_BLOCK_BINDING);
+
+	gObjectStride = UniformBuffer::alignSize(sizeof(ObjectBlock));
+	gObjectData.resize(NUM_OBJECTS * gObjectStride);
+	gObjectUniforms.create(gObjectData.size());
+
+	// build scene hierarchy, object 2 orbits object 1 which orbits the sphere
+	gJobSystem.start(JobSystem::getDefaultWorkerCount());
+
+	gNodes.sphere = gSceneGraph.addNode();
+	gNodes.orbitObj1 = gSceneGraph.addNode(gNodes.sphere);
+	gNodes.orbitObj2 = gSceneGraph.addNode(gNodes.orbitObj1);
+	gNodes.orbitPath1 = gSceneGraph.addNode(gNodes.sphere);
+	gNodes.orbitPath2 = gSceneGraph.addNode(gNodes.orbitObj1);	// moves with the first orbit object
 
-	// load models
-	gModels["Sphere"].loadModel("./models/sphere.obj");
-	gModels["Cube"].loadModel("./models/cube.obj");
-	gModels["Suzanne"].loadModel("./models/suzanne.obj");
-	gModels["Torus"].loadModel("./models/torus.obj");
+	// object 2 always shows the same side to object 1, so its rotation follows its orbit
+	gSceneOrbits.addBody(gOrbitSpeed[0], gRotationSpeed[0], gOrbitDistance[0], 0.7f);
+	gSceneOrbits.addBody(gOrbitSpeed[1], gOrbitSpeed[1], gOrbitDistance[1], 0.4f);
+
+	// initialise material/model types
+	gSelectedMaterials[0] = MaterialType::JADE;
+	gSelectedMaterials[1] = MaterialType::PEARL;
+	gSelectedModels[0] = ModelType::SUZANNE;
+	gSelectedModels[1] = ModelType::CUBE;
+
+	// register and load models
+	gModelHandles[static_cast<int>(ModelType::SPHERE)] = gModels.add("Sphere");
+	gModelHandles[static_cast<int>(ModelType::CUBE)] = gModels.add("Cube");
+	gModelHandles[static_cast<int>(ModelType::SUZANNE)] = gModels.add("Suzanne");
+	gModelHandles[static_cast<int>(ModelType::TORUS)] = gModels.add("Torus");
+
+	// the first frames show placeholders while the models load in the background
+	gAssetLoader.loadModel(gModels.get(gModelHandles[static_cast<int>(ModelType::SPHERE)]), "./models/sphere.obj", false, PACKED_VERTICES);
+	gAssetLoader.loadModel(gModels.get(gModelHandles[static_cast<int>(ModelType::CUBE)]), "./models/cube.obj", false, PACKED_VERTICES);
+	gAssetLoader.loadModel(gModels.get(gModelHandles[static_cast<int>(ModelType::SUZANNE)]), "./models/suzanne.obj", false, PACKED_VERTICES);
+	gAssetLoader.loadModel(gModels.get(gModelHandles[static_cast<int>(ModelType::TORUS)]), "./models/torus.obj", false, PACKED_VERTICES);
 
 	// generates the orbit paths based on the orbit distances
 	generate_circle(gOrbitDistance[0], MAXSLICES, 1.0f, gVertices);
@@ -152,50 +754,368 @@ static void init(GLFWwindow* window)
 
 	// create VBO and buffer the data
 	glGenBuffers(1, &gVBO);					// generate unused VBO identifier
-	glBindBuffer(GL_ARRAY_BUFFER, gVBO);	// bind the VBO
+	GLState::bindBuffer(GL_ARRAY_BUFFER, gVBO);	// bind the VBO
 	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * gVertices.size(), &gVertices[0], GL_DYNAMIC_DRAW);
 
 	// create VAO, specify VBO data and format of the data
 	glGenVertexArrays(1, &gVAO);			// generate unused VAO identifier
-	glBindVertexArray(gVAO);				// create VAO
-	glBindBuffer(GL_ARRAY_BUFFER, gVBO);	// bind the VBO
+	GLState::bindVertexArray(gVAO);				// create VAO
+	GLState::bindBuffer(GL_ARRAY_BUFFER, gVBO);	// bind the VBO
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);	// specify format of the data
 
 	glEnableVertexAttribArray(0);	// enable vertex attributes
+
+	// buffer for the per instance data of the fleet, filled every frame
+	glGenBuffers(1, &gInstanceVBO);
+
+	// multi draw indirect is core in 4.3, base instances in 4.2, a 3.3 context has them as extensions
+	gMultiDrawIndirect = GLEW_ARB_draw_indirect && GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+	if (gMultiDrawIndirect)
+		glGenBuffers(1, &gIndirectBuffer);
+
+	// passes in the order of the UI arrays, the CPU only passes have no GPU work to time
+	gPasses.update = gProfiler.addScope("update", false);
+	gPasses.culling = gProfiler.addScope("culling", false);
+	gPasses.lights = gProfiler.addScope("lights", false);
+	gPasses.opaque = gProfiler.addScope("opaque", true);
+	gPasses.lines = gProfiler.addScope("lines", true);
+	gPasses.ui = gProfiler.addScope("ui", true);
+
+	// frame graph vertices are uploaded every frame, in the layout of the orbit paths
+	glGenBuffers(1, &gGraphVBO);
+	glGenVertexArrays(1, &gGraphVAO);
+	GLState::bindVertexArray(gGraphVAO);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, gGraphVBO);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(0);
+
+	// the first frame needs every shader
+	if (!gShaders.get(gSimpleShader).finishBuild() ||
+		gLitShaders.get(get_lit_shader_key(false)) == nullptr ||
+		gLitShaders.get(get_lit_shader_key(true)) == nullptr || !setup_shaders())
+		exit(EXIT_FAILURE);
+}
+
+// apply the controls to the simulation, speeds stay constant within a step
+static void apply_simulation_input()
+{
+	SimulationInput input;
+	{
+		std::lock_guard<std::mutex> lock(gSimulationInputMutex);
+		input = gSimulationInput;
+	}
+
+	gSceneOrbits.setOrbitSpeed(0, input.orbitSpeed[0]);
+	gSceneOrbits.setRotationSpeed(0, input.rotationSpeed);
+	gSceneOrbits.setOrbitSpeed(1, input.orbitSpeed[1]);
+	gSceneOrbits.setRotationSpeed(1, input.orbitSpeed[1]);
+
+	// rebuild the fleet if its size was changed in the UI
+	if (input.fleetSize != gFleetOrbits.getBodyCount() || !gFleetLayout)
+		generate_fleet(input.fleetSize);
+}
+
+// advance the simulation by one fixed step
+static void update_scene(float time)
+{
+	TRACE_SCOPE("update scene");
+	gSceneOrbits.advance(time);
+
+	gJobSystem.parallelFor(gFleetOrbits.getBodyCount(), FLEET_GRAIN_SIZE, [time](int begin, int end) {
+		gFleetOrbits.advance(time, begin, end - begin);
+	});
+}
+
+// copy the simulation state for the render thread
+static void write_simulation_state(SimulationState& state, double displayTime, double simulatedTime)
+{
+	TRACE_SCOPE("write simulation state");
+	state.sceneOrbits = gSceneOrbits;
+	state.fleetOrbits = gFleetOrbits;
+	state.fleetLayout = gFleetLayout;
+	state.displayTime = displayTime;
+	state.simulatedTime = simulatedTime;
 }
 
-// function used to update the scene
-static void update_scene(GLFWwindow* window)
+// copy the controls the simulation reads, called on the render thread
+static void update_simulation_input()
 {
+	std::lock_guard<std::mutex> lock(gSimulationInputMutex);
 
-	// variables to keep track of orbits/rotations
-	static float orbitAngle[2] = { 0.0f, 0.0f };
-	static float rotationAngle[2] = { 0.0f, 0.0f };
+	gSimulationInput.orbitSpeed[0] = gOrbitSpeed[0];
+	gSimulationInput.orbitSpeed[1] = gOrbitSpeed[1];
+	gSimulationInput.rotationSpeed = gRotationSpeed[0];
+	gSimulationInput.fleetSize = gFleetSize;
+}
+
+// simulation thread, runs as many fixed steps as the clock has moved on and publishes the state
+// before the last one, simulated time never depends on how long frames or steps take
+static void simulation_loop()
+{
+	TRACE_THREAD_NAME("simulation");
+
+	double clockStart = get_clock_time();	// clock time of simulated time zero, moves on when steps are dropped
+	double simulatedTime = 0.0;
+	double lastRateUpdate = clockStart;
+	int stepCount = 0;
+
+	while (gSimulationRunning.load())
+	{
+		double now = get_clock_time();
+		int steps = static_cast<int>((now - clockStart - simulatedTime) / SIMULATION_STEP);
+
+		// too far behind to catch up, drop the extra time instead of spiralling
+		if (steps > MAX_CATCH_UP_STEPS)
+		{
+			clockStart += (steps - MAX_CATCH_UP_STEPS) * SIMULATION_STEP;
+			gDroppedStepsValue += steps - MAX_CATCH_UP_STEPS;
+			steps = MAX_CATCH_UP_STEPS;
+		}
+
+		if (steps > 0)
+		{
+			apply_simulation_input();
+
+			for (int i = 0; i < steps; i++)
+			{
+				// the state before the last step is shown one step after its simulated time
+				if (i == steps - 1)
+					write_simulation_state(gSnapshots.getWriteBuffer(), clockStart + simulatedTime + SIMULATION_STEP, simulatedTime);
+
+				update_scene(static_cast<float>(SIMULATION_STEP));
+				simulatedTime += SIMULATION_STEP;
+			}
+
+			gSnapshots.publish();
+			stepCount += steps;
+		}
+
+		// steps per second for the UI
+		if (now - lastRateUpdate > 1.0)
+		{
+			gSimulationRateValue = static_cast<float>(stepCount / (now - lastRateUpdate));
+			lastRateUpdate = now;
+			stepCount = 0;
+		}
+
+		// sleep until the next step is due
+		double nextStep = clockStart + simulatedTime + SIMULATION_STEP;
+		std::this_thread::sleep_for(std::chrono::duration<double>(std::max(nextStep - get_clock_time(), 0.0)));
+	}
+}
+
+// publish a first state so there is always one to draw, then hand the simulation to its thread
+static void start_simulation()
+{
+	update_simulation_input();
+	apply_simulation_input();
+	write_simulation_state(gSnapshots.getWriteBuffer(), get_clock_time(), 0.0);
+	gSnapshots.publish();
+	gSnapshots.acquire();
+
+	gSimulationRunning = true;
+	gSimulationThread = std::thread(simulation_loop);
+}
+
+static void stop_simulation()
+{
+	gSimulationRunning = false;
+	gSimulationThread.join();
+}
 
-	// calculates orbit/rotation angle based on orbit/rotation speed 
-	orbitAngle[0] += gOrbitSpeed[0] * gFrameTime;
-	orbitAngle[1] += gOrbitSpeed[1] * gFrameTime;
-	rotationAngle[0] += gRotationSpeed[0] * gFrameTime;
-	rotationAngle[1] += gRotationSpeed[1] * gFrameTime;
+// move the decode of packed positions into an instance's model matrix, so instances of models with
+// different decode transforms can be drawn by one multi draw call
+static void fold_position_decode(InstanceData& instance, const SimpleModel& model)
+{
+	glm::mat4& matrix = instance.modelMatrix;
+	const glm::vec3& offset = model.getPositionOffset();
+	const glm::vec3& scale = model.getPositionScale();
+
+	// matrix * translate(offset) * scale(scale)
+	matrix[3] = matrix * glm::vec4(offset, 1.0f);
+	matrix[0] *= scale.x;
+	matrix[1] *= scale.y;
+	matrix[2] *= scale.z;
+}
 
-	// transformations for object 1
-	gModelMatrix["OrbitObj1"] = gModelMatrix["Sphere"]
-		* glm::rotate(orbitAngle[0], glm::vec3(0.0f, 1.0f, 0.0f))
-		* glm::translate(glm::vec3(gOrbitDistance[0], 0.0f, 0.0f))
-		* glm::rotate(rotationAngle[0] - orbitAngle[0], glm::vec3(0.0f, 1.0f, 0.0f))
-		* glm::scale(glm::vec3(0.7f, 0.7f, 0.7f));
+// fill the render queue of this frame and sort it, the scene objects are culled and their levels of
+// detail picked on the workers, each submitting its own items
+static void build_render_queue()
+{
+	TRACE_SCOPE("build render queue");
+
+	const LodView view = get_lod_view();
+	const Frustum frustum = extract_frustum(gProjectionMatrix * gViewMatrix);
+	gRenderQueue.reset(MAX_RENDER_ITEMS);
 
-	
-	// transformations for object 2
-	gModelMatrix["OrbitObj2"] = gModelMatrix["OrbitObj1"] * glm::rotate(orbitAngle[1], glm::vec3(0.0f, 1.0f, 0.0f))
-		* glm::translate(glm::vec3(gOrbitDistance[1], 0.0f, 0.0f))
-		* glm::scale(glm::vec3(0.4f, 0.4f, 0.4f));
+	// lit shader variants are numbered here, the first frame with new light settings builds theirs
+	gObjectShaderKey = get_lit_shader_key(false);
+	gFleetShaderKey = get_lit_shader_key(true);
+	const std::uint32_t objectShader = get_lit_shader_sort_id(gObjectShaderKey);
+	const std::uint32_t fleetShader = get_lit_shader_sort_id(gFleetShaderKey);
 
+	// models are resolved here, the placeholder is created on the GL thread
+	SimpleModel* models[NUM_OBJECTS];
+	for (int slot = 0; slot < NUM_OBJECTS; slot++)
+		models[slot] = &get_model(get_scene_object(slot).model);
 
-	// moves the orbit path based on where the first orbit object is
-	gModelMatrix["OrbitPath2"] = gModelMatrix["OrbitObj1"];
+	gJobSystem.parallelFor(NUM_OBJECTS, 1, [&](int begin, int end) {
+		for (int slot = begin; slot < end; slot++)
+		{
+			const SceneObject object = get_scene_object(slot);
+			const glm::mat4& modelMatrix = gSceneGraph.getWorldTransform(object.node);
 
+			gObjectVisible[slot] = !models[slot]->isEmpty() && is_mesh_visible(frustum, models[slot]->getBounds(), modelMatrix);
+			if (!gObjectVisible[slot])
+				continue;
+
+			gObjectLods[slot] = select_lod(*models[slot], modelMatrix, view, gObjectLods[slot]);
+
+			std::uint64_t key = make_sort_key(RenderPass::SOLID, objectShader,
+				gMaterialHandles[static_cast<int>(object.material)].index,
+				get_mesh_sort_id(object.model, gObjectLods[slot]), get_depth_sort_id(modelMatrix));
+			gRenderQueue.submit(key, make_draw_value(DrawKind::OBJECT, slot));
+		}
+	});
+
+	// the fleet is one item, its bodies are batched by model and level and mix materials, it
+	// surrounds the sphere so it is placed at the sphere's depth
+	if (gFleetVisibleCount > 0)
+	{
+		std::uint64_t key = make_sort_key(RenderPass::SOLID, fleetShader, 0, 0,
+			get_depth_sort_id(gSceneGraph.getWorldTransform(gNodes.sphere)));
+		gRenderQueue.submit(key, make_draw_value(DrawKind::FLEET, 0));
+	}
 
+	// orbit paths are drawn after the solid objects
+	const int pathNodes[NUM_ORBIT_PATHS] = { gNodes.orbitPath1, gNodes.orbitPath2 };
+	for (int path = 0; path < NUM_ORBIT_PATHS; path++)
+	{
+		std::uint64_t key = make_sort_key(RenderPass::LINES, gSimpleShader.index, 0, 0,
+			get_depth_sort_id(gSceneGraph.getWorldTransform(pathNodes[path])));
+		gRenderQueue.submit(key, make_draw_value(DrawKind::ORBIT_PATH, path));
+	}
+
+	gRenderQueue.sort();
+}
+
+// place the scene time seconds after a simulation state, on the render thread
+static void prepare_scene(const SimulationState& state, float time)
+{
+	TRACE_SCOPE("prepare scene");
+
+	// transformations for object 1 relative to the sphere and object 2 relative to object 1
+	gSceneGraph.setLocalTransform(gNodes.orbitObj1, state.sceneOrbits.getLocalTransform(0, time));
+	gSceneGraph.setLocalTransform(gNodes.orbitObj2, state.sceneOrbits.getLocalTransform(1, time));
+
+	// propagate changes down the hierarchy, the orbit paths follow their parents
+	gSceneGraph.updateTransforms(gJobSystem);
+
+	// fleet chunks are independent, each job writes the instance data of its bodies, culls them against
+	// the view frustum, picks the levels of detail of the visible ones and counts the bodies of every batch
+	const OrbitSystem& fleet = state.fleetOrbits;
+	const FleetLayout& layout = *state.fleetLayout;
+	const int bodyCount = fleet.getBodyCount();
+	const int chunkCount = (bodyCount + FLEET_GRAIN_SIZE - 1) / FLEET_GRAIN_SIZE;
+
+	// a rebuilt fleet starts from the levels of the old one, the selection catches up in one frame
+	gFleetPlaced.resize(bodyCount);
+	gFleetInstances.resize(bodyCount);
+	gFleetLods.resize(bodyCount, 0);
+	gFleetVisible.resize(bodyCount);
+	gFleetChunkCounts.assign(chunkCount * NUM_FLEET_BATCHES, 0);
+
+	// models are resolved here, the placeholder is created on the GL thread
+	SimpleModel** models = gFleetModels;
+	for (int type = 0; type < NUM_MODEL_TYPES; type++)
+		models[type] = &get_model(static_cast<ModelType>(type));
+
+	const LodView view = get_lod_view();
+	const Frustum frustum = extract_frustum(gProjectionMatrix * gViewMatrix);
+	InstanceData* placed = gFleetPlaced.data();
+	unsigned char* lods = gFleetLods.data();
+	unsigned char* visible = gFleetVisible.data();
+	int* chunkCounts = gFleetChunkCounts.data();
+	const glm::mat4& fleetParent = gSceneGraph.getWorldTransform(gNodes.sphere);
+
+	gJobSystem.parallelFor(bodyCount, FLEET_GRAIN_SIZE, [&](int begin, int end) {
+		TRACE_SCOPE("place fleet");
+		fleet.computeTransforms(fleetParent, placed, begin, end - begin, time);
+
+		int* counts = chunkCounts + begin / FLEET_GRAIN_SIZE * NUM_FLEET_BATCHES;
+
+		for (int type = 0; type < NUM_MODEL_TYPES; type++)
+		{
+			int typeBegin = std::max(begin, layout.first[type]);
+			int typeEnd = std::min(end, layout.first[type] + layout.count[type]);
+			if (typeBegin >= typeEnd)
+				continue;
+
+			// bodies of a model without faces are never drawn
+			if (models[type]->isEmpty())
+			{
+				std::fill(visible + typeBegin, visible + typeEnd, 0);
+				continue;
+			}
+
+			cull_spheres(frustum, models[type]->getBounds(), &placed[typeBegin].modelMatrix, sizeof(InstanceData),
+				typeEnd - typeBegin, visible + typeBegin);
+
+			for (int i = typeBegin; i < typeEnd; i++)
+			{
+				// culled bodies keep their level for when they come back into view
+				if (!visible[i])
+					continue;
+
+				placed[i].materialIndex = layout.materials[i];
+				lods[i] = static_cast<unsigned char>(select_lod(*models[type], placed[i].modelMatrix, view, lods[i]));
+				counts[type * MAX_MESH_LODS + lods[i]]++;
+			}
+		}
+	});
+
+	// batches follow each other by model and level, within a batch the chunks keep their order,
+	// the counts become the position each chunk writes its next body of the batch to
+	int first = 0;
+	for (int batch = 0; batch < NUM_FLEET_BATCHES; batch++)
+	{
+		FleetBatch& fleetBatch = gFleetBatches[batch / MAX_MESH_LODS][batch % MAX_MESH_LODS];
+		fleetBatch.first = first;
+
+		for (int chunk = 0; chunk < chunkCount; chunk++)
+		{
+			int& count = chunkCounts[chunk * NUM_FLEET_BATCHES + batch];
+			int chunkFirst = first;
+			first += count;
+			count = chunkFirst;
+		}
+
+		fleetBatch.count = first - fleetBatch.first;
+	}
+
+	gFleetVisibleCount = first;
+
+	InstanceData* instances = gFleetInstances.data();
+	gJobSystem.parallelFor(bodyCount, FLEET_GRAIN_SIZE, [&](int begin, int end) {
+		TRACE_SCOPE("batch fleet");
+		int* next = chunkCounts + begin / FLEET_GRAIN_SIZE * NUM_FLEET_BATCHES;
+
+		for (int type = 0; type < NUM_MODEL_TYPES; type++)
+		{
+			int typeBegin = std::max(begin, layout.first[type]);
+			int typeEnd = std::min(end, layout.first[type] + layout.count[type]);
+
+			for (int i = typeBegin; i < typeEnd; i++)
+			{
+				if (!visible[i])
+					continue;
+
+				InstanceData& instance = instances[next[type * MAX_MESH_LODS + lods[i]]++];
+				instance = placed[i];
+				fold_position_decode(instance, *models[type]);
+			}
+		}
+	});
 }
 
 // frame buffer size callback function
@@ -206,7 +1126,7 @@ static void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 
 	// adjusts the projection matrix with new width/height
 	gProjectionMatrix = glm::perspective(glm::radians(60.0f),
-		static_cast<float>(gWindowWidth) / gWindowHeight, 0.1f, 100.0f);
+		static_cast<float>(gWindowWidth) / gWindowHeight, NEAR_PLANE, FAR_PLANE);
 
 	// adjusts the viewport with the new width/height
 	glViewport(gWindowWidth / 6.0f, 0.0f, gWindowWidth, gWindowHeight);
@@ -216,181 +1136,353 @@ static void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 
 }
 
-// function to render the scene
-static void render_scene()
+// bind an object's uniform buffer slot and draw it at the level of detail build_render_queue picked
+static void draw_object(int slot, const VertexDecodeUniforms& decode)
 {
-	// variable to store selected model string
-	std::string selectedModel;
-	
-	// variable to store selected material
-	std::string selectedMaterial;
+	SimpleModel& model = get_model(get_scene_object(slot).model);
 
-	// clear colour buffer and depth buffer
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	
+	gObjectUniforms.bindRange(OBJECT_BLOCK_BINDING, slot * gObjectStride, sizeof(ObjectBlock));
+	decode.set(model);
+	model.drawModel(gObjectLods[slot]);
+	gDrawCalls++;
 
-	ShaderProgram* gShader = &gShaders["Animation"]; // points to the shader we want to use
+	gTrianglesDrawn += model.getTriangleCount(gObjectLods[slot]);
+	gTrianglesFullDetail += model.getTriangleCount(0);
+}
 
-	gShader->use();
+// draw the fleet batches, each arena's batches with one multi draw call when indirect draws are available
+// and one instanced call per model and level of detail otherwise
+static void draw_fleet()
+{
+	gFleetDrawCalls = 0;
 
-	// *********** MAIN Sphere render *********** 
-	// set light properties
-	gShader->setUniform("uLight.dir", gLight.dir);
-	gShader->setUniform("uLight.La", gLight.La);
-	gShader->setUniform("uLight.Ld", gLight.Ld);
-	gShader->setUniform("uLight.Ls", gLight.Ls);
+	const VertexDecodeUniforms* decode = use_lit_shader(gFleetShaderKey);
+	if (decode == nullptr)
+		return;
+
+	for (int type = 0; type < NUM_MODEL_TYPES; type++)
+	{
+		for (int lod = 0; lod < MAX_MESH_LODS; lod++)
+		{
+			const FleetBatch& batch = gFleetBatches[type][lod];
+			gTrianglesDrawn += static_cast<double>(batch.count) * gFleetModels[type]->getTriangleCount(lod);
+			gTrianglesFullDetail += static_cast<double>(batch.count) * gFleetModels[type]->getTriangleCount(0);
+		}
+	}
 
-	// set material properties
-	gShader->setUniform("uMaterial.Ka", gMaterials["Brass"].Ka);
-	gShader->setUniform("uMaterial.Kd", gMaterials["Brass"].Kd);
-	gShader->setUniform("uMaterial.Ks", gMaterials["Brass"].Ks);
-	gShader->setUniform("uMaterial.shininess", gMaterials["Brass"].shininess);
+	if (!gMultiDrawIndirect)
+	{
+		for (int type = 0; type < NUM_MODEL_TYPES; type++)
+		{
+			SimpleModel& model = *gFleetModels[type];
+			decode->setDecodedByInstances(model);
+
+			for (int lod = 0; lod < MAX_MESH_LODS; lod++)
+			{
+				const FleetBatch& batch = gFleetBatches[type][lod];
+				if (batch.count == 0)
+					continue;
+
+				model.drawInstanced(gInstanceVBO, batch.first, batch.count, lod);
+				gFleetDrawCalls++;
+			}
+		}
 
-	// set viewing position
-	gShader->setUniform("uViewpoint", glm::vec3(0.0f, 2.0f, 4.0f));
+		return;
+	}
 
-	// calculate matrices
-	glm::mat4 MVP = gProjectionMatrix * gViewMatrix * gModelMatrix["Sphere"];
-	glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(gModelMatrix["Sphere"])));
+	// commands of the models in each arena follow each other
+	struct ArenaDraw
+	{
+		MeshArena* arena;
+		const SimpleModel* model;	// any of the arena's models, for the normal decode
+		int firstCommand;
+		int commandCount;
+	};
 
-	// set uniform variables
-	gShader->setUniform("uModelViewProjectionMatrix", MVP);
-	gShader->setUniform("uModelMatrix", gModelMatrix["Sphere"]);
-	gShader->setUniform("uNormalMatrix", normalMatrix);
+	ArenaDraw draws[NUM_MODEL_TYPES];
+	int drawCount = 0;
+	gFleetCommands.clear();
 
-	gModels["Sphere"].drawModel();
+	for (int first = 0; first < NUM_MODEL_TYPES; first++)
+	{
+		MeshArena* arena = gFleetModels[first]->getArena();
 
+		// models in an arena already seen were added with it
+		bool seen = arena == nullptr;
+		for (int i = 0; i < drawCount && !seen; i++)
+			seen = draws[i].arena == arena;
+		if (seen)
+			continue;
 
-	// *********** Object 1 render *********** 
+		ArenaDraw& draw = draws[drawCount++];
+		draw.arena = arena;
+		draw.model = gFleetModels[first];
+		draw.firstCommand = static_cast<int>(gFleetCommands.size());
 
-	// set light properties
-	gShader->setUniform("uLight.dir", gLight.dir);
-	gShader->setUniform("uLight.La", gLight.La);
-	gShader->setUniform("uLight.Ld", gLight.Ld);
-	gShader->setUniform("uLight.Ls", gLight.Ls);
+		for (int type = first; type < NUM_MODEL_TYPES; type++)
+		{
+			if (gFleetModels[type]->getArena() != arena)
+				continue;
+
+			for (int lod = 0; lod < MAX_MESH_LODS; lod++)
+			{
+				const FleetBatch& batch = gFleetBatches[type][lod];
+				if (batch.count > 0)
+					gFleetCommands.push_back(gFleetModels[type]->getDrawCommand(lod, batch.count, batch.first));
+			}
+		}
 
-	// if statement to determine selected material
-	if (gSelectedMaterials["Obj1"] == MaterialType::BRASS) {
-		selectedMaterial = "Brass";
-	}
-	else if (gSelectedMaterials["Obj1"] == MaterialType::JADE) {
-		selectedMaterial = "Jade";
-	}
-	else if (gSelectedMaterials["Obj1"] == MaterialType::PEARL) {
-		selectedMaterial = "Pearl";
+		draw.commandCount = static_cast<int>(gFleetCommands.size()) - draw.firstCommand;
 	}
 
-	// set material properties
-	gShader->setUniform("uMaterial.Ka", gMaterials[selectedMaterial].Ka);
-	gShader->setUniform("uMaterial.Kd", gMaterials[selectedMaterial].Kd);
-	gShader->setUniform("uMaterial.Ks", gMaterials[selectedMaterial].Ks);
-	gShader->setUniform("uMaterial.shininess", gMaterials["Brass"].shininess);
+	if (gFleetCommands.empty())
+		return;
 
-	// set viewing position
-	gShader->setUniform("uViewpoint", glm::vec3(0.0f, 2.0f, 4.0f));
+	GLsizeiptr commandSize = sizeof(DrawElementsIndirectCommand) * gFleetCommands.size();
+	GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, gIndirectBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, commandSize, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commandSize, gFleetCommands.data());
 
-	// calculate matrices
-	MVP = gProjectionMatrix * gViewMatrix * gModelMatrix["OrbitObj1"];
-	normalMatrix = glm::mat3(glm::transpose(glm::inverse(gModelMatrix["OrbitObj1"])));
+	for (int i = 0; i < drawCount; i++)
+	{
+		const ArenaDraw& draw = draws[i];
+		if (draw.commandCount == 0)
+			continue;
 
-	// set uniform variables
-	gShader->setUniform("uModelViewProjectionMatrix", MVP);
-	gShader->setUniform("uModelMatrix", gModelMatrix["OrbitObj1"]);
-	gShader->setUniform("uNormalMatrix", normalMatrix);
+		// base instances offset the instance attributes, so they point at the first instance
+		draw.arena->getInstancedVertexArray(gInstanceVBO, 0);
+		decode->setDecodedByInstances(*draw.model);
 
-	// if statements to check the object to render
-	if (gSelectedModels["Obj1"] == ModelType::SUZANNE) {
-		selectedModel = "Suzanne";
-	}
-	else if (gSelectedModels["Obj1"] == ModelType::CUBE) {
-		selectedModel = "Cube";
-	}
-	else if (gSelectedModels["Obj1"] == ModelType::SPHERE) {
-		selectedModel = "Sphere";
-	}
-	else if (gSelectedModels["Obj1"] == ModelType::TORUS) {
-		selectedModel = "Torus";
+		glMultiDrawElementsIndirect(GL_TRIANGLES, draw.arena->getIndexType(),
+			reinterpret_cast<const void*>(draw.firstCommand * sizeof(DrawElementsIndirectCommand)), draw.commandCount, 0);
+		gFleetDrawCalls++;
 	}
+}
 
-	gModels[selectedModel].drawModel();
+// draw an orbit path with the simple shader and the orbit vertex array bound
+static void draw_orbit_path(int path)
+{
+	const int pathNodes[NUM_ORBIT_PATHS] = { gNodes.orbitPath1, gNodes.orbitPath2 };
 
-	// *********** Object 2 render *********** 
+	glm::mat4 MVP = gProjectionMatrix * gViewMatrix * gSceneGraph.getWorldTransform(pathNodes[path]);
+	gSimpleUniforms.modelViewProjectionMatrix.set(MVP);
+	glDrawArrays(GL_LINE_LOOP, path * (MAXSLICES + 1), MAXSLICES);
+	gDrawCalls++;
+}
 
-	// set light properties
-	gShader->setUniform("uLight.dir", gLight.dir);
-	gShader->setUniform("uLight.La", gLight.La);
-	gShader->setUniform("uLight.Ld", gLight.Ld);
-	gShader->setUniform("uLight.Ls", gLight.Ls);
+// profiler scope of a render pass
+static int get_pass_scope(RenderPass pass)
+{
+	return pass == RenderPass::LINES ? gPasses.lines : gPasses.opaque;
+}
 
-	// if statement to determine selected material
-	if (gSelectedMaterials["Obj2"] == MaterialType::BRASS) {
-		selectedMaterial = "Brass";
-	}
-	else if (gSelectedMaterials["Obj2"] == MaterialType::JADE) {
-		selectedMaterial = "Jade";
-	}
-	else if (gSelectedMaterials["Obj2"] == MaterialType::PEARL) {
-		selectedMaterial = "Pearl";
-	}
+// move the clustered lights to a simulated time, bin them into the clusters of this frame's view and upload their lists
+static void update_light_clusters(float time)
+{
+	TRACE_SCOPE("light clusters");
 
-	// set material properties
-	gShader->setUniform("uMaterial.Ka", gMaterials[selectedMaterial].Ka);
-	gShader->setUniform("uMaterial.Kd", gMaterials[selectedMaterial].Kd);
-	gShader->setUniform("uMaterial.Ks", gMaterials[selectedMaterial].Ks);
-	gShader->setUniform("uMaterial.shininess", gMaterials[selectedMaterial].shininess);
+	if (gClusterLightCount != static_cast<int>(gClusterLights.size()))
+		generate_cluster_lights(gClusterLightCount);
 
-	// set viewing position
-	gShader->setUniform("uViewpoint", glm::vec3(0.0f, 2.0f, 4.0f));
+	gClusterLightRefs = 0;
+	gMaxClusterLights = 0;
+	if (gClusterLights.empty())
+		return;
 
-	// calculate matrices
-	MVP = gProjectionMatrix * gViewMatrix * gModelMatrix["OrbitObj2"];
-	normalMatrix = glm::mat3(glm::transpose(glm::inverse(gModelMatrix["OrbitObj2"])));
+	place_cluster_lights(time);
+	gLightClusters.build(gClusterLights, gViewMatrix, gProjectionMatrix, NEAR_PLANE, FAR_PLANE, gJobSystem);
 
-	// set uniform variables
-	gShader->setUniform("uModelViewProjectionMatrix", MVP);
-	gShader->setUniform("uModelMatrix", gModelMatrix["OrbitObj2"]);
-	gShader->setUniform("uNormalMatrix", normalMatrix);
+	// the viewport set by init and framebuffer_size_callback
+	gLightClusters.upload(glm::vec4(std::floor(gWindowWidth / 6.0f), 0.0f, gWindowWidth, gWindowHeight));
+	gLightClusters.bind();
 
-	// if statements to check the object to render
-	if (gSelectedModels["Obj2"] == ModelType::SUZANNE) {
-		selectedModel = "Suzanne";
-	}
-	else if (gSelectedModels["Obj2"] == ModelType::CUBE) {
-		selectedModel = "Cube";
-	}
-	else if (gSelectedModels["Obj2"] == ModelType::SPHERE) {
-		selectedModel = "Sphere";
+	gClusterLightRefs = gLightClusters.getIndexCount();
+	gMaxClusterLights = gLightClusters.getMaxClusterLights();
+}
+
+// function to render the scene placed by prepare_scene
+static void render_scene()
+{
+	TRACE_SCOPE("render scene");
+
+	// the opaque pass is timed from the clear, later passes from their first item
+	RenderPass currentPass = RenderPass::SOLID;
+	gProfiler.begin(get_pass_scope(currentPass));
+
+	// clear colour buffer and depth buffer
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	gTrianglesDrawn = 0.0;
+	gTrianglesFullDetail = 0.0;
+	gVisibleObjects = gFleetVisibleCount;
+	gCulledObjects = static_cast<int>(gFleetPlaced.size()) - gFleetVisibleCount;
+
+	for (int slot = 0; slot < NUM_OBJECTS; slot++)
+	{
+		if (gObjectVisible[slot])
+			gVisibleObjects++;
+		else
+			gCulledObjects++;
 	}
-	else if (gSelectedModels["Obj2"] == ModelType::TORUS) {
-		selectedModel = "Torus";
+
+	// per-frame camera and light data
+	TRACE_BEGIN("uniform setup");
+	FrameBlock frame = {};
+	frame.viewProjectionMatrix = gProjectionMatrix * gViewMatrix;
+	frame.viewpoint = glm::vec3(0.0f, 2.0f, 4.0f);
+	for (int i = 0; i < MAX_LIGHTS; i++)
+		frame.lights[i] = gLights[i].getBlock();
+	gFrameUniforms.update(0, sizeof(frame), &frame);
+
+	// per-object data for all objects, uploaded together
+	for (int slot = 0; slot < NUM_OBJECTS; slot++)
+	{
+		const SceneObject object = get_scene_object(slot);
+		set_object_block(slot, gSceneGraph.getWorldTransform(object.node), object.material);
 	}
+	gObjectUniforms.update(0, gObjectData.size(), gObjectData.data());
+	TRACE_END();
+
+	// draw the queue in key order, a shader and the state that goes with it is set up when the
+	// shader field of the key changes
+	const RenderItem* items = gRenderQueue.getItems();
+	const int itemCount = gRenderQueue.getCount();
+	std::uint32_t currentShader = ~0u;
+	const VertexDecodeUniforms* objectDecode = nullptr;	// of the object shader in use, nullptr if it failed to build
+	gShaderChanges = 0;
+	gDrawCalls = 0;
+	TRACE_BEGIN("draw queue");
+
+	for (int i = 0; i < itemCount; i++)
+	{
+		const std::uint32_t shader = get_sort_shader(items[i].key);
+		const bool shaderChanged = shader != currentShader;
+		const int index = get_draw_index(items[i].value);
 
-	gModels[selectedModel].drawModel();
+		const RenderPass pass = get_sort_pass(items[i].key);
+		if (pass != currentPass)
+		{
+			gProfiler.end(get_pass_scope(currentPass));
+			gProfiler.begin(get_pass_scope(pass));
+			currentPass = pass;
+		}
+
+		if (shaderChanged)
+		{
+			currentShader = shader;
+			gShaderChanges++;
+		}
+
+		switch (get_draw_kind(items[i].value))
+		{
+		case DrawKind::OBJECT:
+			if (shaderChanged)
+				objectDecode = use_lit_shader(gObjectShaderKey);
 
+			if (objectDecode != nullptr)
+				draw_object(index, *objectDecode);
+			break;
 
-	// *********** drawing orbit circles *********** 
+		case DrawKind::FLEET:
+		{
+			GLsizeiptr instanceSize = sizeof(InstanceData) * gFleetVisibleCount;
 
-	gShader = &gShaders["Simple"]; // points to simple shader
-	gShader->use(); // uses the new shader
-	gShader->setUniform("uColor", orbitColour); // sets the uniform colour
+			// upload this frame's instance data, orphaning the storage used by the last frame
+			GLState::bindBuffer(GL_ARRAY_BUFFER, gInstanceVBO);
+			glBufferData(GL_ARRAY_BUFFER, instanceSize, nullptr, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, instanceSize, gFleetInstances.data());
 
-	glBindVertexArray(gVAO); // binds the array
+			draw_fleet();
+			gDrawCalls += gFleetDrawCalls;
+			break;
+		}
 
-	// sets MVP for first orbit path and draws it
-	MVP = gProjectionMatrix * gViewMatrix * gModelMatrix["OrbitPath1"];
-	gShader->setUniform("uModelViewProjectionMatrix", MVP);
-	glDrawArrays(GL_LINE_LOOP, 0, MAXSLICES);
+		case DrawKind::ORBIT_PATH:
+			if (shaderChanged)
+			{
+				gShaders.get(gSimpleShader).use();
+				gSimpleUniforms.color.set(orbitColour);
+				GLState::bindVertexArray(gVAO);
+			}
 
-	// sets mvp for second orbit path and draws it
-	MVP = gProjectionMatrix * gViewMatrix * gModelMatrix["OrbitPath2"];
-	gShader->setUniform("uModelViewProjectionMatrix", MVP);
-	glDrawArrays(GL_LINE_LOOP, MAXSLICES+1, MAXSLICES);
+			draw_orbit_path(index);
+			break;
+		}
+	}
 
+	TRACE_END();
+	gProfiler.end(get_pass_scope(currentPass));
 
 	// flush the graphics pipeline
 	glFlush();
 }
 
+// add a history's newest samples to the graph vertices as a line strip, newest on the right
+static void add_graph_line(const TimeHistory& history)
+{
+	const int count = history.getCount();
+	const float step = 1.0f / std::max(history.getCapacity() - 1, 1);
+	const float firstX = 1.0f - (count - 1) * step;
+
+	for (int i = 0; i < count; i++)
+	{
+		float height = std::min(static_cast<float>(history.get(i)) / GRAPH_RANGE_MS, 1.0f);
+		gGraphVertices.push_back(glm::vec3(firstX + i * step, height, 0.0f));
+	}
+}
+
+// draw the frame graph in the bottom left corner of the window
+static void draw_frame_graph()
+{
+	const TimeHistory& frameTimes = gProfiler.getFrameTimes();
+	const TimeHistory& opaqueTimes = gProfiler.getGpuTimes(gPasses.opaque);
+	const float targetHeight = 1000.0f / 60.0f / GRAPH_RANGE_MS;
+
+	gGraphVertices.clear();
+	gGraphVertices.push_back(glm::vec3(0.0f, targetHeight, 0.0f));
+	gGraphVertices.push_back(glm::vec3(1.0f, targetHeight, 0.0f));
+	add_graph_line(frameTimes);
+	add_graph_line(opaqueTimes);
+
+	GLState::bindBuffer(GL_ARRAY_BUFFER, gGraphVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * gGraphVertices.size(), gGraphVertices.data(), GL_STREAM_DRAW);
+
+	// the graph spans [0, 1] on both axes of its own viewport and is drawn over the scene
+	glViewport(0, 0, GRAPH_WIDTH, GRAPH_HEIGHT);
+	glDisable(GL_DEPTH_TEST);
+
+	gShaders.get(gSimpleShader).use();
+	GLState::bindVertexArray(gGraphVAO);
+	gSimpleUniforms.modelViewProjectionMatrix.set(glm::ortho(0.0f, 1.0f, 0.0f, 1.0f));
+
+	gSimpleUniforms.color.set(glm::vec3(0.5f));
+	glDrawArrays(GL_LINES, 0, 2);
+	gSimpleUniforms.color.set(glm::vec3(0.2f, 1.0f, 0.2f));
+	glDrawArrays(GL_LINE_STRIP, 2, frameTimes.getCount());
+	gSimpleUniforms.color.set(glm::vec3(1.0f, 0.6f, 0.1f));
+	glDrawArrays(GL_LINE_STRIP, 2 + frameTimes.getCount(), opaqueTimes.getCount());
+
+	glEnable(GL_DEPTH_TEST);
+	glViewport(gWindowWidth / 6.0f, 0.0f, gWindowWidth, gWindowHeight);
+}
+
+// copy the rolling frame and pass percentiles to the UI
+static void update_timing_stats()
+{
+	TimeStats frame = gProfiler.getFrameTimes().getStats();
+	gFramePercentiles[0] = static_cast<float>(frame.p50);
+	gFramePercentiles[1] = static_cast<float>(frame.p95);
+	gFramePercentiles[2] = static_cast<float>(frame.p99);
+	gFramePercentiles[3] = static_cast<float>(frame.max);
+
+	for (int pass = 0; pass < gProfiler.getScopeCount() && pass < NUM_PROFILE_PASSES; pass++)
+	{
+		gPassCpuP95[pass] = static_cast<float>(gProfiler.getCpuTimes(pass).getStats().p95);
+		gPassGpuP95[pass] = static_cast<float>(gProfiler.getGpuTimes(pass).getStats().p95);
+	}
+}
+
 // key press or release callback function
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
@@ -421,6 +1513,37 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 			glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 		return;
 	}
+
+	// start a timeline trace, or stop it and write it out
+	if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+		if (trace_is_enabled())
+		{
+			trace_stop();
+			trace_dump(gTracePath);
+		}
+		else
+		{
+			trace_start();
+			std::cout << "Tracing, press T again to write " << gTracePath << std::endl;
+		}
+		return;
+	}
+
+	// compare per-frame resource lookups against the old map based path
+	if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+		benchmark_resource_lookups();
+		benchmark_orbit_system();
+		benchmark_job_scaling();
+		benchmark_frustum_culling();
+		benchmark_render_queue();
+		benchmark_mesh_loading();
+		report_mesh_optimization();
+		report_vertex_packing();
+		report_lod_chains();
+		if (ShaderProgram* shader = gLitShaders.get(get_lit_shader_key(false)))
+			run_micro_benchmarks(*shader);
+		return;
+	}
 }
 
 // mouse movement callback function
@@ -464,6 +1587,14 @@ TwBar* create_UI(const std::string name) {
 	};
 	TwType modelOptions = TwDefineEnum("modelType", modelValue, 4);
 
+	// TwEnum to store the light types, each is a lit shader variant
+	TwEnumVal lightValue[] = {
+	{POINT_LIGHT, "Point"},
+	{DIRECTIONAL_LIGHT, "Directional"},
+	{SPOT_LIGHT, "Spot"}
+	};
+	TwType lightOptions = TwDefineEnum("lightType", lightValue, 3);
+
 	// give tweak bar the size of graphics window
 	TwWindowSize(gWindowWidth, gWindowHeight);
 	TwDefine(" TW_HELP visible=false ");	// disable help menu
@@ -474,35 +1605,174 @@ TwBar* create_UI(const std::string name) {
 	// create frame stat entries
 	TwAddVarRO(twBar, "Frame Rate", TW_TYPE_FLOAT, &gFrameRate, " group='Frame Stats' precision=2 ");
 	TwAddVarRO(twBar, "Frame Time", TW_TYPE_FLOAT, &gFrameTime, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Simulation Rate", TW_TYPE_FLOAT, &gSimulationRate, " group='Frame Stats' precision=2 ");
+	TwAddVarRO(twBar, "Dropped Steps", TW_TYPE_INT32, &gDroppedSteps, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Models loaded", TW_TYPE_INT32, &gAssetsLoaded, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Load time (ms)", TW_TYPE_FLOAT, &gAssetLoadTime, " group='Frame Stats' precision=1 ");
+	TwAddVarRO(twBar, "GL calls issued", TW_TYPE_INT32, &GLState::getFrameStats().issued, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "GL calls elided", TW_TYPE_INT32, &GLState::getFrameStats().elided, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Triangles", TW_TYPE_DOUBLE, &gTrianglesDrawn, " group='Frame Stats' precision=0 ");
+	TwAddVarRO(twBar, "Full detail triangles", TW_TYPE_DOUBLE, &gTrianglesFullDetail, " group='Frame Stats' precision=0 ");
+	TwAddVarRO(twBar, "Visible objects", TW_TYPE_INT32, &gVisibleObjects, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Culled objects", TW_TYPE_INT32, &gCulledObjects, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Draw calls", TW_TYPE_INT32, &gDrawCalls, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Fleet draw calls", TW_TYPE_INT32, &gFleetDrawCalls, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Shader changes", TW_TYPE_INT32, &gShaderChanges, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Cluster light refs", TW_TYPE_INT32, &gClusterLightRefs, " group='Frame Stats' ");
+	TwAddVarRO(twBar, "Max cluster lights", TW_TYPE_INT32, &gMaxClusterLights, " group='Frame Stats' ");
+
+	// rolling percentiles in milliseconds over the last frames
+	TwAddVarRO(twBar, "Frame p50", TW_TYPE_FLOAT, &gFramePercentiles[0], " group='Timings' precision=2 ");
+	TwAddVarRO(twBar, "Frame p95", TW_TYPE_FLOAT, &gFramePercentiles[1], " group='Timings' precision=2 ");
+	TwAddVarRO(twBar, "Frame p99", TW_TYPE_FLOAT, &gFramePercentiles[2], " group='Timings' precision=2 ");
+	TwAddVarRO(twBar, "Frame max", TW_TYPE_FLOAT, &gFramePercentiles[3], " group='Timings' precision=2 ");
+
+	for (int pass = 0; pass < gProfiler.getScopeCount() && pass < NUM_PROFILE_PASSES; pass++)
+	{
+		std::string name = gProfiler.getName(pass);
+		TwAddVarRO(twBar, (name + " CPU p95").c_str(), TW_TYPE_FLOAT, &gPassCpuP95[pass], " group='Timings' precision=3 ");
+		if (gProfiler.hasGpuTimes(pass))
+			TwAddVarRO(twBar, (name + " GPU p95").c_str(), TW_TYPE_FLOAT, &gPassGpuP95[pass], " group='Timings' precision=3 ");
+	}
+	TwDefine(" Main/Timings opened=false ");
 
 	// scene controls
 	TwAddVarRW(twBar, "Wireframe", TW_TYPE_BOOLCPP, &gWireframe, " group='Controls' ");
+	TwAddVarRW(twBar, "Frame graph", TW_TYPE_BOOLCPP, &gShowFrameGraph, " group='Controls' ");
+	TwAddVarRW(twBar, "VSync", TW_TYPE_BOOLCPP, &gVSync, " group='Controls' ");
+	TwAddVarRW(twBar, "Hot reload shaders", TW_TYPE_BOOLCPP, &gHotReloadShaders, " group='Controls' ");
+	TwAddVarRW(twBar, "Light type", lightOptions, &gLightType, " group='Controls' ");
+	std::string lightCountOptions = " group='Controls' min=1 max=" + std::to_string(MAX_LIGHTS) + " ";
+	TwAddVarRW(twBar, "Lights", TW_TYPE_INT32, &gLightCount, lightCountOptions.c_str());
+	std::string clusterLightOptions = " group='Controls' min=0 max=" + std::to_string(MAX_CLUSTER_LIGHTS) + " step=16 ";
+	TwAddVarRW(twBar, "Clustered lights", TW_TYPE_INT32, &gClusterLightCount, clusterLightOptions.c_str());
+	TwAddVarRW(twBar, "LOD error (px)", TW_TYPE_FLOAT, &gLodPixelError, " group='Controls' precision=2 step='0.1' min=0.0 max=20.0 ");
 
 	// model 1 controls
-	TwAddVarRW(twBar, "Model 1", modelOptions, &gSelectedModels["Obj1"], " group='Orbit Object 1' ");
-	TwAddVarRW(twBar, "Material 1", materialOptions, &gSelectedMaterials["Obj1"], " group='Orbit Object 1' ");
+	TwAddVarRW(twBar, "Model 1", modelOptions, &gSelectedModels[0], " group='Orbit Object 1' ");
+	TwAddVarRW(twBar, "Material 1", materialOptions, &gSelectedMaterials[0], " group='Orbit Object 1' ");
 	TwAddVarRW(twBar, "Orbit speed 1", TW_TYPE_FLOAT, &gOrbitSpeed[0], " group='Orbit Object 1' precision=2 step='0.01' max=10.0 min=-10.0 ");
 	TwAddVarRW(twBar, "Rotation speed 1", TW_TYPE_FLOAT, &gRotationSpeed[0], " group='Orbit Object 1' precision=2 step='0.01' max=10.0 min=-10.0 ");
 
 	// model 2 controls
-	TwAddVarRW(twBar, "Model 2", modelOptions, &gSelectedModels["Obj2"], " group='Orbit Object 2' ");
-	TwAddVarRW(twBar, "Material 2", materialOptions, &gSelectedMaterials["Obj2"], " group='Orbit Object 2' ");
+	TwAddVarRW(twBar, "Model 2", modelOptions, &gSelectedModels[1], " group='Orbit Object 2' ");
+	TwAddVarRW(twBar, "Material 2", materialOptions, &gSelectedMaterials[1], " group='Orbit Object 2' ");
 	TwAddVarRW(twBar, "Orbit speed 2", TW_TYPE_FLOAT, &gOrbitSpeed[1], " group='Orbit Object 2' precision=2 step='0.01' max=10.0 min=-10.0 ");
 
+	// instanced fleet controls
+	std::string fleetOptions = " group='Fleet' min=0 step=1000 max=" + std::to_string(MAX_FLEET_SIZE) + " ";
+	TwAddVarRW(twBar, "Fleet size", TW_TYPE_INT32, &gFleetSize, fleetOptions.c_str());
+
 
 	return twBar;
 }
 
-int main(void)
+// settings of the named scenarios of headless runs
+struct Scenario
 {
-	GLFWwindow* window = nullptr;	// GLFW window handle
+	const char* name;
+	int fleetSize;
+	float lodPixelError;
+	int clusterLights;
+};
+
+const Scenario SCENARIOS[] = {
+	{ "default", 0, 1.0f, 0 },					// the sphere, the two orbit objects and their paths
+	{ "fleet", 100000, 1.0f, 0 },
+	{ "fleet-max", MAX_FLEET_SIZE, 1.0f, 0 },
+	{ "fleet-full-detail", 100000, 0.0f, 0 },	// every body at full detail
+	{ "lights", 0, 1.0f, 256 },
+	{ "lights-max", 0, 1.0f, MAX_CLUSTER_LIGHTS },
+};
+
+// set the controls to a scenario, returns false and lists the scenarios if there is none of that name
+static bool apply_scenario(const std::string& name)
+{
+	for (const Scenario& scenario : SCENARIOS)
+	{
+		if (name != scenario.name)
+			continue;
+
+		gFleetSize = scenario.fleetSize;
+		gLodPixelError = scenario.lodPixelError;
+		gClusterLightCount = scenario.clusterLights;
+		gWireframe = false;
+		return true;
+	}
 
+	std::cerr << "Unknown scenario " << name << ", scenarios are:";
+	for (const Scenario& scenario : SCENARIOS)
+		std::cerr << " " << scenario.name;
+	std::cerr << std::endl;
+
+	return false;
+}
+
+// frame stats of a headless run summed over the measured frames
+struct HeadlessCounters
+{
+	double drawCalls = 0.0;
+	double fleetDrawCalls = 0.0;
+	double shaderChanges = 0.0;
+	double glCallsIssued = 0.0;
+	double glCallsElided = 0.0;
+	double triangles = 0.0;
+	double visibleObjects = 0.0;
+	double culledObjects = 0.0;
+	double clusterLightRefs = 0.0;
+	double maxClusterLights = 0.0;
+
+	// add the stats of the frame just drawn
+	void add()
+	{
+		drawCalls += gDrawCalls;
+		fleetDrawCalls += gFleetDrawCalls;
+		shaderChanges += gShaderChanges;
+		glCallsIssued += GLState::getFrameStats().issued;
+		glCallsElided += GLState::getFrameStats().elided;
+		triangles += gTrianglesDrawn;
+		visibleObjects += gVisibleObjects;
+		culledObjects += gCulledObjects;
+		clusterLightRefs += gClusterLightRefs;
+		maxClusterLights += gMaxClusterLights;
+	}
+
+	// per frame averages for the report
+	void write(HeadlessReport& report, int frames) const
+	{
+		report.counters = {
+			{ "draw_calls", drawCalls / frames },
+			{ "fleet_draw_calls", fleetDrawCalls / frames },
+			{ "shader_changes", shaderChanges / frames },
+			{ "gl_calls_issued", glCallsIssued / frames },
+			{ "gl_calls_elided", glCallsElided / frames },
+			{ "triangles", triangles / frames },
+			{ "visible_objects", visibleObjects / frames },
+			{ "culled_objects", culledObjects / frames },
+			{ "cluster_light_refs", clusterLightRefs / frames },
+			{ "max_cluster_lights", maxClusterLights / frames },
+		};
+	}
+};
+
+// create the window and make its OpenGL context current, exits if either fails
+// hidden windows are never shown and get an OSMesa context, llvmpipe on a machine without a GPU
+static GLFWwindow* create_window(bool hidden)
+{
 	glfwSetErrorCallback(error_callback);	// set GLFW error callback function
 
+	// hidden windows need no display from GLFW 3.4 on, before that GLFW needs one to initialise
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 4)
+	if (hidden)
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+
 	// initialise GLFW
 	if (!glfwInit())
 	{
 		// if failed to initialise GLFW
+		if (hidden)
+			std::cerr << "Headless runs need a display, GLFW 3.4 or a build with HEADLESS_EGL" << std::endl;
 		exit(EXIT_FAILURE);
 	}
 
@@ -512,8 +1782,14 @@ int main(void)
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+	if (hidden)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	}
+
 	// create a window and its OpenGL context
-	window = glfwCreateWindow(gWindowWidth, gWindowHeight, "Assignment 2 - 3D Animation", nullptr, nullptr);
+	GLFWwindow* window = glfwCreateWindow(gWindowWidth, gWindowHeight, "Assignment 2 - 3D Animation", nullptr, nullptr);
 
 	// check if window created successfully
 	if (window == nullptr)
@@ -523,78 +1799,338 @@ int main(void)
 	}
 
 	glfwMakeContextCurrent(window);	// set window context as the current context
-	glfwSwapInterval(1);			// swap buffer interval
+	glfwSwapInterval(hidden ? 0 : 1);	// swap buffer interval, headless runs never wait
+	return window;
+}
+
+int main(int argc, char** argv)
+{
+	const double startTime = get_clock_time();
 
-	// initialise GLEW
-	if (glewInit() != GLEW_OK)
+	// --headless draws a fixed number of frames of a scenario offscreen and writes a report
+	HeadlessOptions headless;
+	if (!parse_headless_options(argc, argv, headless))
+		exit(EXIT_FAILURE);
+	if (headless.enabled && !apply_scenario(headless.scenario))
+		exit(EXIT_FAILURE);
+
+	// benchmark runs need a context for the shader but draw nothing, so they get the headless one
+	const bool hidden = headless.enabled || !headless.benchmarksPath.empty();
+
+	// --trace records everything from here on
+	TRACE_THREAD_NAME("main");
+	if (!headless.tracePath.empty())
+	{
+		gTracePath = headless.tracePath;
+		trace_start();
+	}
+
+	// headless runs on Linux get an EGL context that needs neither a display nor a window system, elsewhere they
+	// get a hidden window
+#ifdef HEADLESS_EGL
+	HeadlessContext headlessContext;
+	if (hidden && !headlessContext.create())
+		exit(EXIT_FAILURE);
+
+	GLFWwindow* window = hidden ? nullptr : create_window(false);
+#else
+	GLFWwindow* window = create_window(hidden);
+#endif
+
+	// initialise GLEW, Mesa's core profile contexts need the experimental flag for GLEW to load everything
+	if (hidden)
+		glewExperimental = GL_TRUE;
+
+	GLenum glewStatus = glewInit();
+
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// without a display GLEW fails to set up GLX, the GL entry points are loaded before that
+	if (hidden && glewStatus == GLEW_ERROR_NO_GLX_DISPLAY)
+		glewStatus = GLEW_OK;
+#endif
+
+	if (glewStatus != GLEW_OK)
 	{
 		// if failed to initialise GLEW
 		std::cerr << "GLEW initialisation failed" << std::endl;
 		exit(EXIT_FAILURE);
 	}
 
-	// set GLFW callback functions
-	glfwSetKeyCallback(window, key_callback);
-	glfwSetCursorPosCallback(window, cursor_position_callback);
-	glfwSetMouseButtonCallback(window, mouse_button_callback);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	// set GLFW callback functions, headless runs take no input
+	if (!hidden)
+	{
+		glfwSetKeyCallback(window, key_callback);
+		glfwSetCursorPosCallback(window, cursor_position_callback);
+		glfwSetMouseButtonCallback(window, mouse_button_callback);
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	}
 
 	// initialise scene and render settings
 	init(window);
 
+	bool running = true;	// false ends the rendering loop, as does closing the window
+
+	// --benchmarks times the CPU hot paths, writes the results and leaves without drawing a frame
+	bool benchmarksPassed = true;
+	if (!headless.benchmarksPath.empty())
+	{
+		std::vector<MicroBenchmarkResult> results = run_micro_benchmarks(*gLitShaders.get(get_lit_shader_key(false)));
+		benchmarksPassed = write_micro_benchmarks(headless.benchmarksPath, results);
+		if (benchmarksPassed && !headless.baselinePath.empty())
+			benchmarksPassed = compare_micro_benchmarks(headless.baselinePath, results);
+
+		running = false;
+	}
+
+	// headless frames are drawn into a framebuffer of the window's size
+	OffscreenTarget offscreen;
+	if (headless.enabled && !offscreen.create(gWindowWidth, gWindowHeight))
+		exit(EXIT_FAILURE);
+
+	start_simulation();
+
 	// initialise AntTweakBar
-	TwInit(TW_OPENGL_CORE, nullptr);
-	TwBar* tweakBar = create_UI("Main");		// create and populate tweak bar elements
+	TwBar* tweakBar = nullptr;
+	if (!hidden)
+	{
+		TwInit(TW_OPENGL_CORE, nullptr);
+		tweakBar = create_UI("Main");		// create and populate tweak bar elements
+	}
 
 	// timing data
-	double lastUpdateTime = glfwGetTime();	// last update time
-	double elapsedTime = lastUpdateTime;	// time since last update
+	double lastUpdateTime = get_clock_time();	// last update time
+	double elapsedTime = 0.0;				// time since last update
 	int frameCount = 0;						// number of frames since last update
+	bool vSyncApplied = !headless.enabled;	// swap interval set above
 
+	// headless runs draw until the scenario has loaded, then the warm up frames, then the measured frames
+	// the profiler keeps every measured frame so the report covers the whole run
+	HeadlessReport report;
+	HeadlessCounters counters;
+	int warmupLeft = headless.warmupFrames;
+	bool measuring = false;
+
+	if (headless.enabled)
+	{
+		gVSync = false;
+		gProfiler.setHistorySize(headless.frames);
+	}
 
 	// the rendering loop
-	while (!glfwWindowShouldClose(window))
+	while (running && (window == nullptr || !glfwWindowShouldClose(window)))
 	{
-		update_scene(window); // update the scene
+		gProfiler.beginFrame();
+		TRACE_BEGIN("frame");
+
+		// apply the vsync control, the simulation runs the same either way
+		if (gVSync != vSyncApplied)
+		{
+			glfwSwapInterval(gVSync ? 1 : 0);
+			vSyncApplied = gVSync;
+		}
+
+		gProfiler.begin(gPasses.update);
 
+		// pass the controls to the simulation and take its newest state without waiting
+		TRACE_BEGIN("update simulation input");
+		update_simulation_input();
+		gSnapshots.acquire();
+		TRACE_END();
+		gSimulationRate = gSimulationRateValue.load();
+		gDroppedSteps = gDroppedStepsValue.load();
+
+		// move the next slice of finished models to the GPU
+		gAssetLoader.update(UPLOAD_BUDGET);
+		gAssetsLoaded = gAssetLoader.getCompletedCount();
+		gAssetLoadTime = static_cast<float>(gAssetLoader.getLoadTime());
+
+		// rebuilt shaders are swapped in between frames
+		update_shaders();
+
+		// place the scene between the last two steps, past the newest step if the simulation stalls
+		const SimulationState& state = gSnapshots.getReadBuffer();
+		double stepTime = std::min(std::max(get_clock_time() - state.displayTime, 0.0), SIMULATION_STEP);
+		prepare_scene(state, static_cast<float>(stepTime));
+		const double sceneTime = state.simulatedTime + stepTime;
+		gProfiler.end(gPasses.update);
+
+		{
+			ProfileScope scope(gProfiler, gPasses.culling);
+			build_render_queue();
+		}
+
+		{
+			ProfileScope scope(gProfiler, gPasses.lights);
+			update_light_clusters(static_cast<float>(sceneTime));
+		}
 
 		// if wireframe set polygon render mode to wireframe
-		if (gWireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		if (gWireframe) GLState::polygonMode(GL_LINE);
 
 		render_scene();		// render the scene
 
 		// set polygon render mode to fill
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		GLState::polygonMode(GL_FILL);
+
+		if (tweakBar != nullptr)
+		{
+			ProfileScope scope(gProfiler, gPasses.ui);
+
+			if (gShowFrameGraph)
+			{
+				TRACE_SCOPE("frame graph");
+				draw_frame_graph();
+			}
+
+			TRACE_SCOPE("TwDraw");
+			TwDraw();				// draw tweak bar
+			GLState::invalidate();	// tweak bar changes GL state behind our back
+		}
+		GLState::endFrame();	// publish redundant call counters
+
+		// headless frames are not shown, finishing them puts the GPU's work into the frame time
+		if (headless.enabled)
+		{
+			TRACE_SCOPE("glFinish");
+			glFinish();
+		}
+		else
+		{
+			TRACE_SCOPE("glfwSwapBuffers");
+			glfwSwapBuffers(window);	// swap buffers
+		}
+
+		if (window != nullptr)
+		{
+			TRACE_SCOPE("glfwPollEvents");
+			glfwPollEvents();		// poll for events
+		}
 
-		TwDraw();				// draw tweak bar
+		TRACE_END();
+		gProfiler.endFrame();
 
-		glfwSwapBuffers(window);	// swap buffers
-		glfwPollEvents();			// poll for events
+		double frameEnd = get_clock_time();
+		if (report.startupTime == 0.0)
+			report.startupTime = (frameEnd - startTime) * 1000.0;
+
+		if (headless.enabled)
+		{
+			bool loaded = gAssetLoader.isDone() && state.fleetOrbits.getBodyCount() == gFleetSize;
+
+			if (loaded && report.loadTime == 0.0)
+				report.loadTime = (frameEnd - startTime) * 1000.0;
+
+			if (!measuring)
+			{
+				report.warmupFrames++;
+
+				// the next frame is the first one measured
+				if (loaded && --warmupLeft <= 0)
+				{
+					measuring = true;
+					gProfiler.reset();
+				}
+			}
+			else
+			{
+				counters.add();
+
+				if (gProfiler.getFrameTimes().getCount() == headless.frames)
+					running = false;
+			}
+		}
 
 		frameCount++;
-		elapsedTime = glfwGetTime() - lastUpdateTime;	// time since last update
+		elapsedTime = get_clock_time() - lastUpdateTime;	// time since last update
 
 		// if elapsed time since last update > 1 second
 		if (elapsedTime > 1.0)
 		{
 			gFrameTime = elapsedTime / frameCount;	// average time per frame
 			gFrameRate = 1 / gFrameTime;			// frames per second
-			lastUpdateTime = glfwGetTime();			// set last update time to current time
+			lastUpdateTime = get_clock_time();		// set last update time to current time
 			frameCount = 0;							// reset frame counter
+			update_timing_stats();
 		}
 	}
 
+	bool headlessPassed = true;
+	if (headless.enabled)
+	{
+		report.scenario = headless.scenario;
+		report.renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+		report.version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+		report.width = gWindowWidth;
+		report.height = gWindowHeight;
+		report.frames = gProfiler.getFrameTimes().getCount();
+		report.frameTimes = gProfiler.getFrameTimes().getStats();
+		counters.write(report, std::max(report.frames, 1));
+
+		for (int pass = 0; pass < gProfiler.getScopeCount(); pass++)
+		{
+			PassTimes times;
+			times.name = gProfiler.getName(pass);
+			times.cpuTimes = gProfiler.getCpuTimes(pass).getStats();
+			times.hasGpuTimes = gProfiler.hasGpuTimes(pass);
+			times.gpuTimes = gProfiler.getGpuTimes(pass).getStats();
+			report.passes.push_back(times);
+		}
+
+		headlessPassed = write_headless_report(headless.reportPath, report);
+		if (headlessPassed)
+			std::cout << "Headless " << report.scenario << ": " << report.frames << " frames, p50 "
+				<< report.frameTimes.p50 << " ms, p99 " << report.frameTimes.p99 << " ms, report in "
+				<< headless.reportPath << std::endl;
+
+		// a frame time budget makes the run fail, so scripts can catch regressions
+		if (headless.maxFrameP99 > 0.0 && report.frameTimes.p99 > headless.maxFrameP99)
+		{
+			std::cerr << "Frame time p99 " << report.frameTimes.p99 << " ms is over the limit of "
+				<< headless.maxFrameP99 << " ms" << std::endl;
+			headlessPassed = false;
+		}
+	}
+
+	// write the trace of a run that was still recording
+	if (trace_is_enabled())
+	{
+		trace_stop();
+		trace_dump(gTracePath);
+	}
+
 	// uninitialise tweak bar
-	TwDeleteBar(tweakBar);
-	TwTerminate();
+	if (tweakBar != nullptr)
+	{
+		TwDeleteBar(tweakBar);
+		TwTerminate();
+	}
 
 	// clean up
+	offscreen.release();
+	gProfiler.release();
+	gLitShaders.release();
+	gLightClusters.release();
+	glDeleteBuffers(1, &gGraphVBO);
+	glDeleteVertexArrays(1, &gGraphVAO);
 	glDeleteBuffers(1, &gVBO);
 	glDeleteVertexArrays(1, &gVAO);
+	glDeleteBuffers(1, &gInstanceVBO);
+	glDeleteBuffers(1, &gIndirectBuffer);
+	MeshArena::releaseAll();
+
+	// stop the simulation before the workers it uses
+	stop_simulation();
+	gJobSystem.stop();
 
-	// close the window and terminate GLFW
-	glfwDestroyWindow(window);
-	glfwTerminate();
+	// close the window and terminate GLFW, or release the headless context
+	if (window != nullptr)
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+#ifdef HEADLESS_EGL
+	headlessContext.release();
+#endif
 
-	exit(EXIT_SUCCESS);
+	exit(headlessPassed && benchmarksPassed ? EXIT_SUCCESS : EXIT_FAILURE);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 // include C++ headers
 #include <cstdio>
+#include <cmath>
 #include <iostream>
 #include <vector>
 #include <map>
@@ -14,38 +15,12 @@
 #include <AntTweakBar.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
+#include <glm/gtc/constants.hpp>
 //using namespace glm;	// to avoid having to use glm::
 
+#include "RenderTypes.h"
 #include "ShaderProgram.h"
 
-// vertex attribute format
-struct VertexColor
-{
-	GLfloat position[3];
-	GLfloat color[3];
-};
-
-struct VertexNormal
-{
-	GLfloat position[3];
-	GLfloat normal[3];
-};
-
-struct VertexNormTex
-{
-	GLfloat position[3];
-	GLfloat normal[3];
-	GLfloat texCoord[2];
-};
-
-struct VertexNormTex2
-{
-	GLfloat position[3];
-	GLfloat normal[3];
-	GLfloat texCoord1[2];
-	GLfloat texCoord2[2];
-};
-
 // light properties
 struct Light
 {
@@ -59,62 +34,19 @@ struct Light
 	float outerAngle;	// spotlight: outer angle
 	int type;			// light source: 0=off; 1=point; 2=directional; 3=spotlight
 
-	// set shader uniform variables based on type of light source
-	void setLightUniforms(ShaderProgram& shader, std::string prefix, bool on = true)
+	// light data in the layout of the uniform block
+	LightBlock getBlock() const
 	{
-		std::string uniformName = prefix + "type";
-
-		if (!on)
-		{
-			shader.setUniform(uniformName.c_str(), 0);
-		}
-		else
-		{
-			shader.setUniform(uniformName.c_str(), type);
-
-			uniformName = prefix + "La";
-			shader.setUniform(uniformName.c_str(), La);
-
-			uniformName = prefix + "Ld";
-			shader.setUniform(uniformName.c_str(), Ld);
-
-			uniformName = prefix + "Ls";
-			shader.setUniform(uniformName.c_str(), Ls);
-
-			// point light
-			if (type == 1)
-			{
-				uniformName = prefix + "pos";
-				shader.setUniform(uniformName.c_str(), pos);
-
-				uniformName = prefix + "att";
-				shader.setUniform(uniformName.c_str(), att);
-			}
-			// directional light
-			else if (type == 2)
-			{
-				uniformName = prefix + "dir";
-				shader.setUniform(uniformName.c_str(), dir);
-			}
-			// spotlight
-			else if (type == 3)
-			{
-				uniformName = prefix + "pos";
-				shader.setUniform(uniformName.c_str(), pos);
-
-				uniformName = prefix + "dir";
-				shader.setUniform(uniformName.c_str(), dir);
-
-				uniformName = prefix + "att";
-				shader.setUniform(uniformName.c_str(), att);
-
-				uniformName = prefix + "innerAngle";
-				shader.setUniform(uniformName.c_str(), glm::radians(innerAngle));
-
-				uniformName = prefix + "outerAngle";
-				shader.setUniform(uniformName.c_str(), glm::radians(outerAngle));
-			}
-		}
+		LightBlock block = {};
+		block.pos = pos;
+		block.innerCos = std::cos(glm::radians(innerAngle));
+		block.dir = dir;
+		block.outerCos = std::cos(glm::radians(outerAngle));
+		block.La = La;
+		block.Ld = Ld;
+		block.Ls = Ls;
+		block.att = att;
+		return block;
 	}
 };
 
@@ -126,7 +58,17 @@ struct Material
 	glm::vec3 Ks;		// specular reflection coefficient
 	glm::vec3 emission;	// light source emission component (point light/spotlight)
 	float shininess;	// specular reflection shininess exponent
-};
 
+	// material data in the layout of the uniform block
+	MaterialBlock getBlock() const
+	{
+		MaterialBlock block = {};
+		block.Ka = Ka;
+		block.Kd = Kd;
+		block.Ks = Ks;
+		block.shininess = shininess;
+		return block;
+	}
+};
 
 #endif
\ No newline at end of file
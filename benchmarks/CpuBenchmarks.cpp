@@ -0,0 +1,355 @@
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "RenderTypes.h"
+#include "OrbitSystem.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "Culling.h"
+#include "RenderQueue.h"
+
+/*****************************************************************
+ * micro-benchmarks of the CPU hot paths of a frame, built without
+ * GL, a window or Assimp, the uniform timings need a context and
+ * stay in the app, see run_micro_benchmarks
+ *****************************************************************/
+
+// bodies, objects and items per call of the array kernels, about a large scene's worth
+static const int ARRAY_SIZE = 10000;
+
+// float sphere of rings * (segments + 1) vertices with 32 bit indices, as import_mesh leaves models before packing
+static void make_sphere_mesh(MeshData& data, int rings, int segments)
+{
+	data = MeshData();
+	data.vertexCount = rings * (segments + 1);
+	data.vertexStorage.resize(data.vertexCount * sizeof(VertexNormal));
+	VertexNormal* vertices = reinterpret_cast<VertexNormal*>(data.vertexStorage.data());
+
+	for (int ring = 0; ring < rings; ring++)
+	{
+		float theta = glm::pi<float>() * ring / (rings - 1);
+
+		for (int segment = 0; segment <= segments; segment++)
+		{
+			float phi = glm::two_pi<float>() * segment / segments;
+			glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+
+			VertexNormal& vertex = vertices[ring * (segments + 1) + segment];
+			for (int k = 0; k < 3; k++)
+			{
+				vertex.position[k] = normal[k];
+				vertex.normal[k] = normal[k];
+			}
+		}
+	}
+
+	// two triangles per quad between neighbouring rings
+	data.indexCount = (rings - 1) * segments * 6;
+	data.indexStorage.resize(data.indexCount * sizeof(GLuint));
+	GLuint* indices = reinterpret_cast<GLuint*>(data.indexStorage.data());
+
+	for (int ring = 0; ring < rings - 1; ring++)
+	{
+		for (int segment = 0; segment < segments; segment++)
+		{
+			const GLuint corner = ring * (segments + 1) + segment;
+			const GLuint below = corner + segments + 1;
+			const GLuint quad[6] = { corner, below, corner + 1, corner + 1, below, below + 1 };
+
+			for (int k = 0; k < 6; k++)
+				*indices++ = quad[k];
+		}
+	}
+
+	data.vertices = data.vertexStorage.data();
+	data.indices = data.indexStorage.data();
+}
+
+// model matrices of a frame, differing per call so nothing is hoisted out of the loop
+static std::vector<glm::mat4> make_model_matrices(int count)
+{
+	std::vector<glm::mat4> models(count);
+	for (int i = 0; i < count; i++)
+		models[i] = glm::translate(glm::vec3(i, 0.5f * i, -i)) * glm::rotate(0.1f * i, glm::vec3(0.0f, 1.0f, 0.0f))
+			* glm::scale(glm::vec3(1.0f + 0.01f * i));
+	return models;
+}
+
+// orbit bodies at random speeds, distances and angles
+static void add_random_bodies(OrbitSystem& system, int bodies)
+{
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> speed(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> angle(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> distance(0.0f, 20.0f);
+	std::uniform_real_distribution<float> scale(0.01f, 2.0f);
+
+	for (int i = 0; i < bodies; i++)
+		system.addBody(speed(random), speed(random), distance(random), scale(random), angle(random), angle(random));
+}
+
+// the instruction set of an array benchmark, skipped if the CPU does not have it
+static bool get_simd_level(benchmark::State& state, SimdLevel& level)
+{
+	level = static_cast<SimdLevel>(state.range(0));
+	state.SetLabel(OrbitSystem::getSimdLevelName(level));
+
+	if (level > OrbitSystem::getBestSimdLevel())
+	{
+		state.SkipWithError("instruction set not supported");
+		return false;
+	}
+
+	return true;
+}
+
+// orbit path vertices, rebuilt into the same vector so only the first call allocates
+static void circle_generation(benchmark::State& state)
+{
+	std::vector<GLfloat> circle;
+
+	for (auto _ : state)
+	{
+		circle.clear();
+		generate_circle(2.0f, 64, 1.0f, circle);
+		benchmark::DoNotOptimize(circle.data());
+	}
+}
+BENCHMARK(circle_generation);
+
+// the two scene objects placed with a chain of glm matrices, as update_scene used to
+static void glm_matrix_chain(benchmark::State& state)
+{
+	float time = 0.0f;
+
+	for (auto _ : state)
+	{
+		time += 0.001f;
+		glm::mat4 parent = glm::rotate(time, glm::vec3(0.0f, 1.0f, 0.0f))
+			* glm::translate(glm::vec3(5.0f, 0.0f, 0.0f))
+			* glm::rotate(2.0f * time, glm::vec3(0.0f, 1.0f, 0.0f))
+			* glm::scale(glm::vec3(0.7f));
+		glm::mat4 child = parent
+			* glm::rotate(3.0f * time, glm::vec3(0.0f, 1.0f, 0.0f))
+			* glm::translate(glm::vec3(3.0f, 0.0f, 0.0f))
+			* glm::rotate(time, glm::vec3(0.0f, 1.0f, 0.0f))
+			* glm::scale(glm::vec3(0.5f));
+		benchmark::DoNotOptimize(parent);
+		benchmark::DoNotOptimize(child);
+	}
+}
+BENCHMARK(glm_matrix_chain);
+
+// the same two objects placed by the orbit system
+static void orbit_local_transforms(benchmark::State& state)
+{
+	OrbitSystem orbits;
+	orbits.addBody(1.0f, 2.0f, 5.0f, 0.7f);
+	orbits.addBody(3.0f, 1.0f, 3.0f, 0.5f);
+	float time = 0.0f;
+
+	for (auto _ : state)
+	{
+		time += 0.001f;
+		glm::mat4 parent = orbits.getLocalTransform(0, time);
+		glm::mat4 child = parent * orbits.getLocalTransform(1, time);
+		benchmark::DoNotOptimize(parent);
+		benchmark::DoNotOptimize(child);
+	}
+}
+BENCHMARK(orbit_local_transforms);
+
+static void mvp_matrix(benchmark::State& state)
+{
+	const std::vector<glm::mat4> models = make_model_matrices(64);
+	const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.5f, 0.1f, 100.0f);
+	const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 3.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	std::size_t i = 0;
+
+	for (auto _ : state)
+	{
+		glm::mat4 modelViewProjection = projection * view * models[i++ & 63];
+		benchmark::DoNotOptimize(modelViewProjection);
+	}
+}
+BENCHMARK(mvp_matrix);
+
+static void normal_matrix(benchmark::State& state)
+{
+	const std::vector<glm::mat4> models = make_model_matrices(64);
+	std::size_t i = 0;
+
+	for (auto _ : state)
+	{
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(models[i++ & 63])));
+		benchmark::DoNotOptimize(normalMatrix);
+	}
+}
+BENCHMARK(normal_matrix);
+
+// the per vertex work of import_mesh, float arrays stand in for assimp's aiVector3D arrays
+static void import_vertex_conversion(benchmark::State& state)
+{
+	MeshData sphere;
+	make_sphere_mesh(sphere, 32, 64);
+	const VertexNormal* sphereVertices = static_cast<const VertexNormal*>(sphere.vertices);
+
+	std::vector<float> positions(sphere.vertexCount * 3);
+	std::vector<float> normals(sphere.vertexCount * 3);
+	for (int i = 0; i < sphere.vertexCount; i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			positions[i * 3 + k] = sphereVertices[i].position[k];
+			normals[i * 3 + k] = sphereVertices[i].normal[k];
+		}
+	}
+
+	const std::vector<glm::mat4> models = make_model_matrices(64);
+	std::vector<VertexNormal> converted(sphere.vertexCount);
+	std::size_t i = 0;
+
+	for (auto _ : state)
+	{
+		transform_vertices(models[i++ & 63], positions.data(), normals.data(), sphere.vertexCount,
+			reinterpret_cast<unsigned char*>(converted.data()), sizeof(VertexNormal));
+		benchmark::DoNotOptimize(converted.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * sphere.vertexCount);
+}
+BENCHMARK(import_vertex_conversion);
+
+// packing replaces the storage, so every call starts from a copy of the float vertices
+static void vertex_packing(benchmark::State& state)
+{
+	MeshData sphere;
+	make_sphere_mesh(sphere, 32, 64);
+	MeshData packed;
+
+	for (auto _ : state)
+	{
+		packed.vertexStorage = sphere.vertexStorage;
+		packed.vertexCount = sphere.vertexCount;
+		packed.vertexFormat = VertexFormat::NORMAL;
+		packed.vertices = packed.vertexStorage.data();
+		pack_vertices(packed);
+		benchmark::DoNotOptimize(packed.positionScale);
+	}
+
+	state.SetItemsProcessed(state.iterations() * sphere.vertexCount);
+}
+BENCHMARK(vertex_packing);
+
+// the reordering starts from the sphere's row by row triangles on every call
+static void vertex_cache_optimization(benchmark::State& state)
+{
+	MeshData sphere;
+	make_sphere_mesh(sphere, 32, 64);
+	const GLuint* source = static_cast<const GLuint*>(sphere.indices);
+	std::vector<GLuint> indices(sphere.indexCount);
+
+	for (auto _ : state)
+	{
+		indices.assign(source, source + sphere.indexCount);
+		optimize_vertex_cache(indices.data(), sphere.indexCount, sphere.vertexCount);
+		benchmark::DoNotOptimize(indices.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * sphere.indexCount / 3);
+}
+BENCHMARK(vertex_cache_optimization);
+
+// model and normal matrices of a fleet, one benchmark per instruction set
+static void orbit_kernels(benchmark::State& state)
+{
+	SimdLevel level;
+	if (!get_simd_level(state, level))
+		return;
+
+	OrbitSystem system;
+	add_random_bodies(system, ARRAY_SIZE);
+	std::vector<InstanceData> instances(ARRAY_SIZE);
+	const glm::mat4 parent = glm::rotate(0.3f, glm::vec3(0.0f, 1.0f, 0.0f));
+
+	for (auto _ : state)
+	{
+		system.advance(1.0f / 60.0f, level);
+		system.computeTransforms(parent, instances.data(), 0.0f, level);
+		benchmark::DoNotOptimize(instances.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * ARRAY_SIZE);
+}
+BENCHMARK(orbit_kernels)->DenseRange(static_cast<int>(SimdLevel::SCALAR), static_cast<int>(SimdLevel::AVX2));
+
+// bounding spheres of a fleet against the default camera, about half of them are in view
+static void sphere_culling(benchmark::State& state)
+{
+	SimdLevel level;
+	if (!get_simd_level(state, level))
+		return;
+
+	OrbitSystem system;
+	add_random_bodies(system, ARRAY_SIZE);
+	std::vector<InstanceData> instances(ARRAY_SIZE);
+	system.computeTransforms(glm::mat4(1.0f), instances.data());
+
+	const Frustum frustum = extract_frustum(glm::perspective(glm::radians(60.0f), 1.25f, 0.1f, 100.0f)
+		* glm::lookAt(glm::vec3(1.0f, 5.0f, 15.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+
+	MeshBounds bounds;
+	bounds.boxMin = glm::vec3(-0.5f, -0.25f, -0.5f);
+	bounds.boxMax = glm::vec3(0.5f, 0.75f, 0.5f);
+	bounds.sphereCenter = glm::vec3(0.0f, 0.25f, 0.0f);
+	bounds.sphereRadius = glm::length(glm::vec3(0.5f));
+
+	std::vector<unsigned char> visible(ARRAY_SIZE);
+
+	for (auto _ : state)
+	{
+		int count = cull_spheres(frustum, bounds, &instances[0].modelMatrix, sizeof(InstanceData), ARRAY_SIZE,
+			visible.data(), level);
+		benchmark::DoNotOptimize(count);
+	}
+
+	state.SetItemsProcessed(state.iterations() * ARRAY_SIZE);
+}
+BENCHMARK(sphere_culling)->DenseRange(static_cast<int>(SimdLevel::SCALAR), static_cast<int>(SimdLevel::AVX2));
+
+// a few shaders and passes, many materials and meshes and random depths, like a large scene
+static void render_queue_sort(benchmark::State& state)
+{
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> depth(0.1f, 100.0f);
+	std::vector<std::uint64_t> keys(ARRAY_SIZE);
+	for (std::uint64_t& key : keys)
+		key = make_sort_key(static_cast<RenderPass>(random() % 2), random() % 4, random() % 256, random() % 4096,
+			quantize_depth(depth(random), 0.1f, 100.0f));
+
+	RenderQueue queue;
+
+	for (auto _ : state)
+	{
+		queue.reset(ARRAY_SIZE);
+		RenderItem* item = queue.reserve(ARRAY_SIZE);
+		for (int i = 0; i < ARRAY_SIZE; i++)
+			item[i] = { keys[i], static_cast<std::uint32_t>(i) };
+
+		queue.sort();
+		benchmark::DoNotOptimize(queue.getItems());
+	}
+
+	state.SetItemsProcessed(state.iterations() * ARRAY_SIZE);
+}
+BENCHMARK(render_queue_sort);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,12 @@
+#include <cstdlib>
+
+#include "KernelChecks.h"
+
+// the SSE and AVX2 culling kernels must agree with the scalar one on every object, over ranges with partial
+// blocks at both ends and on a single partial block
+int main()
+{
+	bool match = check_cull_kernels();
+	match = check_cull_kernels(5, 10) && match;
+	return match ? EXIT_SUCCESS : EXIT_FAILURE;
+}
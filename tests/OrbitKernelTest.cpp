@@ -0,0 +1,12 @@
+#include <cstdlib>
+
+#include "KernelChecks.h"
+
+// the SSE and AVX2 orbit kernels must match the scalar one bit for bit, on a body count with a partial block
+// at the end and on a single partial block
+int main()
+{
+	bool match = check_orbit_kernels();
+	match = check_orbit_kernels(3, 10) && match;
+	return match ? EXIT_SUCCESS : EXIT_FAILURE;
+}